@@ -0,0 +1,138 @@
+#include "CloudWatchTelemetrySink.h"
+
+#include <aws/monitoring/model/PutMetricDataRequest.h>
+#include <aws/logs/model/CreateLogGroupRequest.h>
+#include <aws/logs/model/CreateLogStreamRequest.h>
+#include <aws/logs/model/DescribeLogStreamsRequest.h>
+
+#include <com/amazonaws/kinesis/video/utils/Include.h>
+
+namespace Canary {
+
+using namespace Aws::CloudWatchLogs;
+using namespace Aws::CloudWatchLogs::Model;
+
+CloudWatchTelemetrySink::CloudWatchTelemetrySink(const Aws::Client::ClientConfiguration& clientConfig, const std::string& metricNamespace,
+                                                 const std::string& logGroupName, const std::string& logStreamName)
+    : metricsClient(clientConfig), logsClient(clientConfig), metricNamespace(metricNamespace), logGroupName(logGroupName), logStreamName(logStreamName)
+{
+}
+
+STATUS CloudWatchTelemetrySink::openLogs()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    CreateLogGroupRequest createLogGroupRequest;
+    CreateLogStreamOutcome createLogStreamOutcome;
+    CreateLogStreamRequest createLogStreamRequest;
+
+    createLogGroupRequest.SetLogGroupName(this->logGroupName.c_str());
+    // ignore error since if this operation fails, CreateLogStream should fail as well.
+    // There might be some errors that can lead to successfull CreateLogStream, e.g. log group already exists.
+    this->logsClient.CreateLogGroup(createLogGroupRequest);
+
+    createLogStreamRequest.SetLogGroupName(this->logGroupName.c_str());
+    createLogStreamRequest.SetLogStreamName(this->logStreamName.c_str());
+    createLogStreamOutcome = this->logsClient.CreateLogStream(createLogStreamRequest);
+
+    if (!createLogStreamOutcome.IsSuccess()) {
+        // The stream is reused when the canary is restarted with the same stream name, or when a retry finds out that
+        // an earlier attempt went through after all. PutLogEvents needs its current sequence token then.
+        CHK_ERR(createLogStreamOutcome.GetError().GetErrorType() == CloudWatchLogsErrors::RESOURCE_ALREADY_EXISTS, STATUS_INVALID_OPERATION,
+                "Failed to create \"%s\" log stream: %s", this->logStreamName.c_str(), createLogStreamOutcome.GetError().GetMessage().c_str());
+        CHK_STATUS(this->resyncLogs());
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS CloudWatchTelemetrySink::resyncLogs()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    DescribeLogStreamsRequest request;
+    DescribeLogStreamsOutcome outcome;
+
+    request.SetLogGroupName(this->logGroupName.c_str());
+    request.SetLogStreamNamePrefix(this->logStreamName.c_str());
+    outcome = this->logsClient.DescribeLogStreams(request);
+    CHK_ERR(outcome.IsSuccess(), STATUS_INVALID_OPERATION, "Failed to describe \"%s\" log stream: %s", this->logStreamName.c_str(),
+            outcome.GetError().GetMessage().c_str());
+
+    for (auto& logStream : outcome.GetResult().GetLogStreams()) {
+        if (logStream.GetLogStreamName() == this->logStreamName.c_str()) {
+            std::lock_guard<std::mutex> lock(this->tokenMutex);
+            this->token = logStream.GetUploadSequenceToken();
+        }
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID CloudWatchTelemetrySink::putMetrics(Aws::Vector<Aws::CloudWatch::Model::MetricDatum>&& datums, const SendCallback& callback)
+{
+    Aws::CloudWatch::Model::PutMetricDataRequest request;
+
+    request.SetNamespace(this->metricNamespace.c_str());
+    request.SetMetricData(std::move(datums));
+
+    auto asyncHandler = [callback](const Aws::CloudWatch::CloudWatchClient* cwClient, const Aws::CloudWatch::Model::PutMetricDataRequest& request,
+                                   const Aws::CloudWatch::Model::PutMetricDataOutcome& outcome,
+                                   const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context) {
+        UNUSED_PARAM(cwClient);
+        UNUSED_PARAM(context);
+
+        if (!outcome.IsSuccess()) {
+            DLOGE("Failed to put %u metrics: %s", (UINT32) request.GetMetricData().size(), outcome.GetError().GetMessage().c_str());
+            callback(TELEMETRY_SEND_RESULT_FAILED);
+        } else {
+            DLOGS("Successfully put %u metrics", (UINT32) request.GetMetricData().size());
+            callback(TELEMETRY_SEND_RESULT_SUCCESS);
+        }
+    };
+    this->metricsClient.PutMetricDataAsync(request, asyncHandler);
+}
+
+VOID CloudWatchTelemetrySink::putLogs(Aws::Vector<InputLogEvent>&& events, const LogsCallback& callback)
+{
+    PutLogEventsRequest request;
+
+    request.SetLogGroupName(this->logGroupName.c_str());
+    request.SetLogStreamName(this->logStreamName.c_str());
+    request.SetLogEvents(std::move(events));
+
+    auto asyncHandler = [this, callback](const CloudWatchLogsClient* cwClientLog, const PutLogEventsRequest& request, const PutLogEventsOutcome& outcome,
+                                         const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context) {
+        UNUSED_PARAM(cwClientLog);
+        UNUSED_PARAM(context);
+
+        if (outcome.IsSuccess()) {
+            {
+                std::lock_guard<std::mutex> lock(this->tokenMutex);
+                this->token = outcome.GetResult().GetNextSequenceToken();
+            }
+            callback(TELEMETRY_SEND_RESULT_SUCCESS, Aws::Vector<InputLogEvent>());
+        } else if (outcome.GetError().GetErrorType() == CloudWatchLogsErrors::DATA_ALREADY_ACCEPTED) {
+            callback(TELEMETRY_SEND_RESULT_ALREADY_ACCEPTED, Aws::Vector<InputLogEvent>());
+        } else if (outcome.GetError().GetErrorType() == CloudWatchLogsErrors::INVALID_SEQUENCE_TOKEN) {
+            // The SDK only lends the request to the handler, so a failed batch is the one that gets copied back
+            callback(TELEMETRY_SEND_RESULT_INVALID_TOKEN, Aws::Vector<InputLogEvent>(request.GetLogEvents()));
+        } else {
+            // Need to use printf so that we don't get into an infinite loop where we keep flushing
+            printf("Failed to push logs: %s\n", outcome.GetError().GetMessage().c_str());
+            callback(TELEMETRY_SEND_RESULT_FAILED, Aws::Vector<InputLogEvent>(request.GetLogEvents()));
+        }
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(this->tokenMutex);
+        if (this->token != "") {
+            request.SetSequenceToken(this->token);
+        }
+    }
+    this->logsClient.PutLogEventsAsync(request, asyncHandler);
+}
+
+} // namespace Canary
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <mutex>
+
+#include "TelemetrySink.h"
+
+#include <aws/monitoring/CloudWatchClient.h>
+#include <aws/logs/CloudWatchLogsClient.h>
+
+namespace Canary {
+
+// Publishes with PutMetricDataAsync and PutLogEventsAsync. The sink keeps the sequence token of the log stream, the
+// caller must not have more than one putLogs in flight since every request needs the token the previous one returned.
+class CloudWatchTelemetrySink : public TelemetrySink {
+  public:
+    CloudWatchTelemetrySink(const Aws::Client::ClientConfiguration& clientConfig, const std::string& metricNamespace, const std::string& logGroupName,
+                            const std::string& logStreamName);
+    STATUS openLogs() override;
+    STATUS resyncLogs() override;
+    VOID putMetrics(Aws::Vector<Aws::CloudWatch::Model::MetricDatum>&& datums, const SendCallback& callback) override;
+    VOID putLogs(Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&& events, const LogsCallback& callback) override;
+
+  private:
+    Aws::CloudWatch::CloudWatchClient metricsClient;
+    Aws::CloudWatchLogs::CloudWatchLogsClient logsClient;
+    std::string metricNamespace;
+    std::string logGroupName;
+    std::string logStreamName;
+    std::mutex tokenMutex;
+    Aws::String token;
+};
+
+} // namespace Canary
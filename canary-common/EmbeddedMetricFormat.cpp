@@ -0,0 +1,257 @@
+#include "EmbeddedMetricFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include <com/amazonaws/kinesis/video/utils/Include.h>
+
+namespace Canary {
+
+using Aws::CloudWatch::Model::MetricDatum;
+using Aws::CloudWatch::Model::StandardUnit;
+
+struct EmfMetric {
+    const MetricDatum* pDatum;
+    std::vector<DOUBLE> samples;
+};
+
+VOID appendJsonString(std::string& out, const std::string& value)
+{
+    CHAR escaped[8];
+
+    out += '"';
+    for (auto c : value) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if ((UINT8) c < 0x20) {
+                    SNPRINTF(escaped, SIZEOF(escaped), "\\u%04x", (UINT32) (UINT8) c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+VOID appendJsonNumber(std::string& out, DOUBLE value)
+{
+    CHAR number[32];
+
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+
+    SNPRINTF(number, SIZEOF(number), "%.15g", value);
+    out += number;
+}
+
+// Keeps the minimum, the maximum and the sum, the count too unless it's above MAX_EMF_SAMPLES_PER_DATUM
+static VOID expandStatistics(DOUBLE sampleCount, DOUBLE sum, DOUBLE minimum, DOUBLE maximum, std::vector<DOUBLE>& samples)
+{
+    UINT64 count = (UINT64) MIN(MAX(std::round(sampleCount), 0), MAX_EMF_SAMPLES_PER_DATUM), i;
+    DOUBLE mean = sampleCount > 0 ? sum / sampleCount : 0, filler;
+
+    if (count == 0) {
+        return;
+    } else if (count == 1) {
+        samples.push_back(mean);
+        return;
+    }
+
+    samples.push_back(minimum);
+    samples.push_back(maximum);
+    filler = count > 2 ? (mean * count - minimum - maximum) / (count - 2) : 0;
+    for (i = 2; i < count; i++) {
+        samples.push_back(filler);
+    }
+}
+
+static VOID getSamples(const MetricDatum& datum, std::vector<DOUBLE>& samples)
+{
+    DOUBLE total = 0, sum = 0, minimum = 0, maximum = 0, count;
+    UINT32 i;
+
+    if (datum.StatisticValuesHasBeenSet()) {
+        expandStatistics(datum.GetStatisticValues().GetSampleCount(), datum.GetStatisticValues().GetSum(),
+                         datum.GetStatisticValues().GetMinimum(), datum.GetStatisticValues().GetMaximum(), samples);
+    } else if (!datum.GetValues().empty()) {
+        for (i = 0; i < datum.GetValues().size(); i++) {
+            count = i < datum.GetCounts().size() ? datum.GetCounts()[i] : 1;
+            minimum = i == 0 ? datum.GetValues()[i] : MIN(minimum, datum.GetValues()[i]);
+            maximum = i == 0 ? datum.GetValues()[i] : MAX(maximum, datum.GetValues()[i]);
+            sum += datum.GetValues()[i] * count;
+            total += count;
+        }
+
+        if (total > MAX_EMF_SAMPLES_PER_DATUM) {
+            expandStatistics(total, sum, minimum, maximum, samples);
+            return;
+        }
+
+        for (i = 0; i < datum.GetValues().size(); i++) {
+            count = i < datum.GetCounts().size() ? std::round(datum.GetCounts()[i]) : 1;
+            for (; count > 0; count--) {
+                samples.push_back(datum.GetValues()[i]);
+            }
+        }
+    } else {
+        samples.push_back(datum.GetValue());
+    }
+}
+
+static std::string getDimensionsKey(const MetricDatum& datum)
+{
+    std::string key;
+
+    for (auto& dimension : datum.GetDimensions()) {
+        key += dimension.GetName().c_str();
+        key += '\0';
+        key += dimension.GetValue().c_str();
+        key += '\0';
+    }
+
+    return key;
+}
+
+// Record number chunk of a group of metrics that share their dimensions, i.e. their values chunk * 100 to chunk * 100 + 99
+static std::string serializeRecord(const std::string& metricNamespace, UINT64 timestamp, const std::vector<EmfMetric*>& metrics, UINT64 chunk)
+{
+    std::string record, unit;
+    UINT64 begin = chunk * MAX_EMF_VALUES_PER_METRIC, end, i;
+    const MetricDatum& first = *metrics.front()->pDatum;
+    BOOL firstItem = TRUE;
+
+    record += "{\"_aws\":{\"Timestamp\":";
+    record += std::to_string(timestamp);
+    record += ",\"CloudWatchMetrics\":[{\"Namespace\":";
+    appendJsonString(record, metricNamespace);
+
+    record += ",\"Dimensions\":[[";
+    for (auto& dimension : first.GetDimensions()) {
+        record += firstItem ? "" : ",";
+        appendJsonString(record, dimension.GetName().c_str());
+        firstItem = FALSE;
+    }
+
+    record += "]],\"Metrics\":[";
+    firstItem = TRUE;
+    for (auto pMetric : metrics) {
+        if (pMetric->samples.size() <= begin) {
+            continue;
+        }
+        record += firstItem ? "{\"Name\":" : ",{\"Name\":";
+        appendJsonString(record, pMetric->pDatum->GetMetricName().c_str());
+        if (pMetric->pDatum->GetUnit() != StandardUnit::NOT_SET) {
+            unit = Aws::CloudWatch::Model::StandardUnitMapper::GetNameForStandardUnit(pMetric->pDatum->GetUnit()).c_str();
+            record += ",\"Unit\":";
+            appendJsonString(record, unit);
+        }
+        record += "}";
+        firstItem = FALSE;
+    }
+    record += "]}]}";
+
+    for (auto& dimension : first.GetDimensions()) {
+        record += ",";
+        appendJsonString(record, dimension.GetName().c_str());
+        record += ":";
+        appendJsonString(record, dimension.GetValue().c_str());
+    }
+
+    for (auto pMetric : metrics) {
+        if (pMetric->samples.size() <= begin) {
+            continue;
+        }
+        end = MIN(begin + MAX_EMF_VALUES_PER_METRIC, pMetric->samples.size());
+
+        record += ",";
+        appendJsonString(record, pMetric->pDatum->GetMetricName().c_str());
+        record += ":";
+        if (end - begin == 1) {
+            appendJsonNumber(record, pMetric->samples[begin]);
+        } else {
+            record += "[";
+            for (i = begin; i < end; i++) {
+                if (i != begin) {
+                    record += ",";
+                }
+                appendJsonNumber(record, pMetric->samples[i]);
+            }
+            record += "]";
+        }
+    }
+    record += "}";
+
+    return record;
+}
+
+static VOID serializeGroup(const std::string& metricNamespace, UINT64 timestamp, const std::vector<EmfMetric*>& metrics,
+                           std::vector<std::string>& records)
+{
+    UINT64 chunks = 0, chunk;
+
+    for (auto pMetric : metrics) {
+        chunks = MAX(chunks, (pMetric->samples.size() + MAX_EMF_VALUES_PER_METRIC - 1) / MAX_EMF_VALUES_PER_METRIC);
+    }
+
+    for (chunk = 0; chunk < chunks; chunk++) {
+        records.push_back(serializeRecord(metricNamespace, timestamp, metrics, chunk));
+    }
+}
+
+VOID serializeEmfRecords(const std::string& metricNamespace, UINT64 timestamp, const Aws::Vector<MetricDatum>& datums,
+                         std::vector<std::string>& records)
+{
+    std::vector<EmfMetric> metrics(datums.size());
+    std::map<std::string, std::vector<EmfMetric*>> groups;
+    std::vector<EmfMetric*> recordMetrics;
+    std::map<std::string, BOOL> recordNames;
+    UINT32 i;
+
+    for (i = 0; i < datums.size(); i++) {
+        metrics[i].pDatum = &datums[i];
+        getSamples(datums[i], metrics[i].samples);
+        // JSON has no NaN or infinity
+        metrics[i].samples.erase(std::remove_if(metrics[i].samples.begin(), metrics[i].samples.end(), [](DOUBLE value) { return !std::isfinite(value); }),
+                                 metrics[i].samples.end());
+        if (!metrics[i].samples.empty()) {
+            groups[getDimensionsKey(datums[i])].push_back(&metrics[i]);
+        }
+    }
+
+    for (auto& group : groups) {
+        recordMetrics.clear();
+        recordNames.clear();
+        for (auto pMetric : group.second) {
+            // Metric names are keys of the record, so the same name with another unit needs a record of its own
+            if (recordMetrics.size() == MAX_EMF_METRICS_PER_RECORD || recordNames.count(pMetric->pDatum->GetMetricName().c_str()) != 0) {
+                serializeGroup(metricNamespace, timestamp, recordMetrics, records);
+                recordMetrics.clear();
+                recordNames.clear();
+            }
+            recordMetrics.push_back(pMetric);
+            recordNames[pMetric->pDatum->GetMetricName().c_str()] = TRUE;
+        }
+        serializeGroup(metricNamespace, timestamp, recordMetrics, records);
+    }
+}
+
+} // namespace Canary
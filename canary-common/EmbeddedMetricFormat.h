@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <aws/monitoring/model/MetricDatum.h>
+
+#include <com/amazonaws/kinesis/video/common/CommonDefs.h>
+
+namespace Canary {
+
+// Embedded Metric Format limits per record
+#define MAX_EMF_METRICS_PER_RECORD 100
+#define MAX_EMF_VALUES_PER_METRIC  100
+// Samples a single datum is expanded to at most, see serializeEmfRecords
+#define MAX_EMF_SAMPLES_PER_DATUM 1000
+
+// Serializes PutMetricData datums into CloudWatch Embedded Metric Format (EMF) records, i.e. JSON log events that
+// CloudWatch Logs turns into metrics of the given namespace. Each record is a single line without a trailing newline.
+//
+// A record can only carry one value per dimension, so datums are grouped by their dimensions, and it carries at most
+// MAX_EMF_METRICS_PER_RECORD metrics of MAX_EMF_VALUES_PER_METRIC values each, more than that is split across records.
+//
+// EMF has no counts and no statistic sets. Values with counts are repeated count times. A statistic set is expanded to
+// its minimum, its maximum and sampleCount - 2 copies of the value that keeps the sum. Either way a datum expands to at
+// most MAX_EMF_SAMPLES_PER_DATUM samples, beyond that the minimum, maximum and average are kept but not the count.
+//
+// timestamp is in milliseconds since the epoch.
+VOID serializeEmfRecords(const std::string& metricNamespace, UINT64 timestamp, const Aws::Vector<Aws::CloudWatch::Model::MetricDatum>& datums,
+                         std::vector<std::string>& records);
+
+// JSON helpers shared with the other serializers, non finite numbers aren't valid JSON and are written as null
+VOID appendJsonString(std::string& out, const std::string& value);
+VOID appendJsonNumber(std::string& out, DOUBLE value);
+
+} // namespace Canary
@@ -0,0 +1,151 @@
+#include "FileTelemetrySink.h"
+#include "EmbeddedMetricFormat.h"
+
+#include <com/amazonaws/kinesis/video/utils/Include.h>
+
+namespace Canary {
+
+using Aws::CloudWatch::Model::MetricDatum;
+using Aws::CloudWatch::Model::StandardUnit;
+using Aws::CloudWatchLogs::Model::InputLogEvent;
+
+static VOID appendJsonArray(std::string& out, const Aws::Vector<DOUBLE>& values)
+{
+    UINT32 i;
+
+    out += "[";
+    for (i = 0; i < values.size(); i++) {
+        if (i != 0) {
+            out += ",";
+        }
+        appendJsonNumber(out, values[i]);
+    }
+    out += "]";
+}
+
+static VOID appendMetricLine(std::string& out, const std::string& metricNamespace, UINT64 timestamp, const MetricDatum& datum)
+{
+    BOOL firstItem = TRUE;
+
+    out += "{\"type\":\"metric\",\"timestamp\":";
+    out += std::to_string(timestamp);
+    out += ",\"namespace\":";
+    appendJsonString(out, metricNamespace);
+    out += ",\"name\":";
+    appendJsonString(out, datum.GetMetricName().c_str());
+    if (datum.GetUnit() != StandardUnit::NOT_SET) {
+        out += ",\"unit\":";
+        appendJsonString(out, Aws::CloudWatch::Model::StandardUnitMapper::GetNameForStandardUnit(datum.GetUnit()).c_str());
+    }
+
+    out += ",\"dimensions\":{";
+    for (auto& dimension : datum.GetDimensions()) {
+        out += firstItem ? "" : ",";
+        appendJsonString(out, dimension.GetName().c_str());
+        out += ":";
+        appendJsonString(out, dimension.GetValue().c_str());
+        firstItem = FALSE;
+    }
+    out += "}";
+
+    if (datum.StatisticValuesHasBeenSet()) {
+        out += ",\"statistics\":{\"sampleCount\":";
+        appendJsonNumber(out, datum.GetStatisticValues().GetSampleCount());
+        out += ",\"sum\":";
+        appendJsonNumber(out, datum.GetStatisticValues().GetSum());
+        out += ",\"minimum\":";
+        appendJsonNumber(out, datum.GetStatisticValues().GetMinimum());
+        out += ",\"maximum\":";
+        appendJsonNumber(out, datum.GetStatisticValues().GetMaximum());
+        out += "}";
+    } else if (!datum.GetValues().empty()) {
+        out += ",\"values\":";
+        appendJsonArray(out, datum.GetValues());
+        if (!datum.GetCounts().empty()) {
+            out += ",\"counts\":";
+            appendJsonArray(out, datum.GetCounts());
+        }
+    } else {
+        out += ",\"value\":";
+        appendJsonNumber(out, datum.GetValue());
+    }
+    out += "}\n";
+}
+
+FileTelemetrySink::FileTelemetrySink(const std::string& metricNamespace) : metricNamespace(metricNamespace), pFile(NULL)
+{
+}
+
+FileTelemetrySink::~FileTelemetrySink()
+{
+    if (this->pFile != NULL) {
+        FCLOSE(this->pFile);
+    }
+}
+
+STATUS FileTelemetrySink::open(const std::string& path)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(this->pFile == NULL, STATUS_INVALID_OPERATION);
+    this->pFile = FOPEN(path.c_str(), "a");
+    CHK_ERR(this->pFile != NULL, STATUS_OPEN_FILE_FAILED, "Failed to open %s for the telemetry", path.c_str());
+    this->path = path;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS FileTelemetrySink::openLogs()
+{
+    return STATUS_SUCCESS;
+}
+
+STATUS FileTelemetrySink::resyncLogs()
+{
+    return STATUS_SUCCESS;
+}
+
+TELEMETRY_SEND_RESULT FileTelemetrySink::write(const std::string& lines)
+{
+    std::lock_guard<std::mutex> lock(this->fileMutex);
+
+    if (fwrite(lines.data(), 1, lines.size(), this->pFile) != lines.size() || fflush(this->pFile) != 0) {
+        // Need to use printf, the logs might be on their way here
+        printf("Failed to write to %s\n", this->path.c_str());
+        return TELEMETRY_SEND_RESULT_FAILED;
+    }
+
+    return TELEMETRY_SEND_RESULT_SUCCESS;
+}
+
+VOID FileTelemetrySink::putMetrics(Aws::Vector<MetricDatum>&& datums, const SendCallback& callback)
+{
+    std::string lines;
+    UINT64 timestamp = GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+
+    for (auto& datum : datums) {
+        appendMetricLine(lines, this->metricNamespace, timestamp, datum);
+    }
+
+    callback(this->write(lines));
+}
+
+VOID FileTelemetrySink::putLogs(Aws::Vector<InputLogEvent>&& events, const LogsCallback& callback)
+{
+    std::string lines;
+
+    for (auto& event : events) {
+        lines += "{\"type\":\"log\",\"timestamp\":";
+        lines += std::to_string((UINT64) event.GetTimestamp());
+        lines += ",\"message\":";
+        appendJsonString(lines, event.GetMessage().c_str());
+        lines += "}\n";
+    }
+
+    auto result = this->write(lines);
+    callback(result, result == TELEMETRY_SEND_RESULT_SUCCESS ? Aws::Vector<InputLogEvent>() : std::move(events));
+}
+
+} // namespace Canary
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <mutex>
+
+#include "TelemetrySink.h"
+
+namespace Canary {
+
+// Appends newline delimited JSON to a local file, flushed after every batch:
+//
+//   {"type":"metric","timestamp":1600000000000,"namespace":"...","name":"...","unit":"Count","dimensions":{...},"value":1}
+//   {"type":"log","timestamp":1600000000000,"message":"..."}
+//
+// A metric has "value", "values" and "counts", or "statistics" with "sampleCount", "sum", "minimum" and "maximum",
+// depending on how its datum was set. Timestamps are in milliseconds since the epoch. Nothing is ever rejected, so
+// resyncLogs has nothing to do.
+class FileTelemetrySink : public TelemetrySink {
+  public:
+    FileTelemetrySink(const std::string& metricNamespace);
+    ~FileTelemetrySink();
+    STATUS open(const std::string& path);
+    STATUS openLogs() override;
+    STATUS resyncLogs() override;
+    VOID putMetrics(Aws::Vector<Aws::CloudWatch::Model::MetricDatum>&& datums, const SendCallback& callback) override;
+    VOID putLogs(Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&& events, const LogsCallback& callback) override;
+
+  private:
+    std::string metricNamespace;
+    std::string path;
+    std::mutex fileMutex;
+    FILE* pFile;
+
+    TELEMETRY_SEND_RESULT write(const std::string& lines);
+};
+
+} // namespace Canary
@@ -0,0 +1,175 @@
+#include "LatencyHistogram.h"
+
+namespace Canary {
+
+const LatencyPercentile EXPORTED_LATENCY_PERCENTILES[EXPORTED_LATENCY_PERCENTILE_COUNT] = {
+    {50, (PCHAR) "p50"},
+    {90, (PCHAR) "p90"},
+    {99, (PCHAR) "p99"},
+    {99.9, (PCHAR) "p99.9"},
+};
+
+LatencyHistogram::Snapshot::Snapshot() : count(0), sum(0), min(MAX_UINT64), max(0)
+{
+}
+
+UINT64 LatencyHistogram::Snapshot::getCount() const
+{
+    return this->count;
+}
+
+UINT64 LatencyHistogram::Snapshot::getMin() const
+{
+    return this->count == 0 ? 0 : this->min;
+}
+
+UINT64 LatencyHistogram::Snapshot::getMax() const
+{
+    return this->max;
+}
+
+DOUBLE LatencyHistogram::Snapshot::getMean() const
+{
+    return this->count == 0 ? 0 : (DOUBLE) this->sum / this->count;
+}
+
+UINT64 LatencyHistogram::Snapshot::getPercentile(DOUBLE percentile) const
+{
+    UINT64 target, seen = 0;
+    UINT32 i;
+
+    if (this->count == 0) {
+        return 0;
+    }
+
+    percentile = MIN(MAX(percentile, 0.0), 100.0);
+    target = MAX((UINT64) (percentile / 100 * this->count + 0.5), 1);
+
+    for (i = 0; i < this->counts.size(); i++) {
+        seen += this->counts[i];
+        if (seen >= target) {
+            // The bucket bound can overshoot the largest value that was actually recorded
+            return MIN(MAX(getBucketHighestValue(i), this->getMin()), this->max);
+        }
+    }
+
+    return this->max;
+}
+
+VOID LatencyHistogram::Snapshot::merge(const Snapshot& other)
+{
+    UINT32 i;
+
+    if (this->counts.size() < other.counts.size()) {
+        this->counts.resize(other.counts.size(), 0);
+    }
+    for (i = 0; i < other.counts.size(); i++) {
+        this->counts[i] += other.counts[i];
+    }
+
+    this->count += other.count;
+    this->sum += other.sum;
+    this->min = MIN(this->min, other.min);
+    this->max = MAX(this->max, other.max);
+}
+
+std::string LatencyHistogram::Snapshot::toString() const
+{
+    CHAR buffer[64];
+    std::string summary;
+    UINT32 i;
+
+    SNPRINTF(buffer, SIZEOF(buffer), "count %" PRIu64 ", mean %.2f", this->count, this->getMean());
+    summary = buffer;
+    for (i = 0; i < EXPORTED_LATENCY_PERCENTILE_COUNT; i++) {
+        SNPRINTF(buffer, SIZEOF(buffer), ", %s %" PRIu64, EXPORTED_LATENCY_PERCENTILES[i].label,
+                 this->getPercentile(EXPORTED_LATENCY_PERCENTILES[i].percentile));
+        summary += buffer;
+    }
+    SNPRINTF(buffer, SIZEOF(buffer), ", max %" PRIu64, this->max);
+    summary += buffer;
+
+    return summary;
+}
+
+LatencyHistogram::LatencyHistogram(UINT64 maxValue)
+    : maxValue(maxValue), bucketCount(getBucketIndex(maxValue) + 1), counts(new std::atomic<UINT64>[getBucketIndex(maxValue) + 1]), count(0),
+      sum(0), min(MAX_UINT64), max(0)
+{
+    UINT32 i;
+
+    for (i = 0; i < this->bucketCount; i++) {
+        this->counts[i] = 0;
+    }
+}
+
+VOID LatencyHistogram::record(UINT64 value)
+{
+    UINT64 current;
+
+    value = MIN(value, this->maxValue);
+
+    this->counts[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    this->count.fetch_add(1, std::memory_order_relaxed);
+    this->sum.fetch_add(value, std::memory_order_relaxed);
+
+    current = this->min.load(std::memory_order_relaxed);
+    while (value < current && !this->min.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+    current = this->max.load(std::memory_order_relaxed);
+    while (value > current && !this->max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::takeSnapshot()
+{
+    Snapshot snapshot;
+    UINT32 i;
+
+    // Every counter is moved out on its own, so a sample recorded concurrently either lands in this snapshot or in
+    // the next one but is never lost. Only the totals and the buckets may briefly disagree by those few samples.
+    snapshot.counts.resize(this->bucketCount);
+    for (i = 0; i < this->bucketCount; i++) {
+        snapshot.counts[i] = this->counts[i].exchange(0, std::memory_order_relaxed);
+    }
+    snapshot.count = this->count.exchange(0, std::memory_order_relaxed);
+    snapshot.sum = this->sum.exchange(0, std::memory_order_relaxed);
+    snapshot.min = this->min.exchange(MAX_UINT64, std::memory_order_relaxed);
+    snapshot.max = this->max.exchange(0, std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+UINT32 LatencyHistogram::getBucketIndex(UINT64 value)
+{
+    UINT32 msb = 0, shift;
+
+    // Values below two sub-bucket ranges map one to one, everything above keeps LATENCY_HISTOGRAM_SUB_BUCKET_BITS
+    // significant bits per power of two
+    if (value < 2 * LATENCY_HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (UINT32) value;
+    }
+
+    for (shift = 32; shift > 0; shift >>= 1) {
+        if ((value >> (msb + shift)) != 0) {
+            msb += shift;
+        }
+    }
+
+    shift = msb - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_HISTOGRAM_SUB_BUCKET_COUNT + (UINT32) ((value >> shift) - LATENCY_HISTOGRAM_SUB_BUCKET_COUNT);
+}
+
+UINT64 LatencyHistogram::getBucketHighestValue(UINT32 index)
+{
+    UINT32 shift;
+
+    if (index < 2 * LATENCY_HISTOGRAM_SUB_BUCKET_COUNT) {
+        return index;
+    }
+
+    shift = index / LATENCY_HISTOGRAM_SUB_BUCKET_COUNT - 1;
+    return (((UINT64) LATENCY_HISTOGRAM_SUB_BUCKET_COUNT + index % LATENCY_HISTOGRAM_SUB_BUCKET_COUNT + 1) << shift) - 1;
+}
+
+} // namespace Canary
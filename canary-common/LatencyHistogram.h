@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <com/amazonaws/kinesis/video/common/CommonDefs.h>
+
+namespace Canary {
+
+// Number of linear sub-buckets per power of two, 2^7 keeps the relative error of any recorded value below 1%
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS  7
+#define LATENCY_HISTOGRAM_SUB_BUCKET_COUNT (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+#define EXPORTED_LATENCY_PERCENTILE_COUNT 4
+
+// Percentiles the canaries publish for every latency histogram, the label is used as the metric dimension value
+struct LatencyPercentile {
+    DOUBLE percentile;
+    PCHAR label;
+};
+
+extern const LatencyPercentile EXPORTED_LATENCY_PERCENTILES[EXPORTED_LATENCY_PERCENTILE_COUNT];
+
+// LatencyHistogram is a log-linear (HDR style) histogram of unsigned values, e.g. latencies in milliseconds.
+// Recording is lock free and only touches a couple of relaxed atomics, so it can be called from any callback thread.
+// Values above the trackable maximum are clamped to it.
+//
+// Periodic exports call takeSnapshot, which moves everything recorded so far into a plain Snapshot. Snapshots of the
+// same layout can be merged cheaply, e.g. to build a summary of the whole run or to combine several threads.
+class LatencyHistogram {
+  public:
+    class Snapshot {
+      public:
+        Snapshot();
+        UINT64 getCount() const;
+        UINT64 getMin() const;
+        UINT64 getMax() const;
+        DOUBLE getMean() const;
+        // percentile in [0, 100], the result is the highest value that is equivalent to the matching bucket
+        UINT64 getPercentile(DOUBLE) const;
+        VOID merge(const Snapshot&);
+        // one line summary with the count, mean, exported percentiles and maximum, meant for logs
+        std::string toString() const;
+
+      private:
+        friend class LatencyHistogram;
+
+        std::vector<UINT64> counts;
+        UINT64 count;
+        UINT64 sum;
+        UINT64 min;
+        UINT64 max;
+    };
+
+    explicit LatencyHistogram(UINT64 maxValue);
+    VOID record(UINT64);
+    Snapshot takeSnapshot();
+
+  private:
+    const UINT64 maxValue;
+    const UINT32 bucketCount;
+    std::unique_ptr<std::atomic<UINT64>[]> counts;
+    std::atomic<UINT64> count;
+    std::atomic<UINT64> sum;
+    std::atomic<UINT64> min;
+    std::atomic<UINT64> max;
+
+    static UINT32 getBucketIndex(UINT64);
+    static UINT64 getBucketHighestValue(UINT32);
+};
+
+} // namespace Canary
@@ -0,0 +1,93 @@
+#include "LogRateLimiter.h"
+
+#include <com/amazonaws/kinesis/video/utils/Include.h>
+
+namespace Canary {
+
+// A token is accounted for in thousandths so that refilling at n messages per second adds n units per millisecond
+#define LOG_RATE_LIMITER_TOKEN 1000
+
+LogRateLimiter::LogRateLimiter(UINT32 messagesPerSecond, UINT32 burst, UINT32 maxLimitedLevel)
+    : messagesPerSecond(messagesPerSecond), burst(MAX(burst, 1)), maxLimitedLevel(maxLimitedLevel), startTime(GETTIME()),
+      sites(new Site[LOG_RATE_LIMITER_SITE_COUNT])
+{
+    UINT32 i;
+
+    for (i = 0; i < LOG_RATE_LIMITER_SITE_COUNT; i++) {
+        this->sites[i].key = 0;
+        // Every call site starts with a full bucket
+        this->sites[i].bucket = (UINT64) this->burst * LOG_RATE_LIMITER_TOKEN;
+        this->sites[i].suppressed = 0;
+    }
+}
+
+LogRateLimiter::Site* LogRateLimiter::getSite(PCHAR format)
+{
+    UINT_PTR key = (UINT_PTR) format, expected;
+    // Fibonacci hashing, the low bits of a pointer are mostly alignment
+    UINT32 index = (UINT32) (((UINT64) key * 11400714819323198485ULL) >> 54), i;
+    Site* pSite;
+
+    for (i = 0; i < LOG_RATE_LIMITER_MAX_PROBES; i++) {
+        pSite = &this->sites[(index + i) & (LOG_RATE_LIMITER_SITE_COUNT - 1)];
+        expected = pSite->key.load(std::memory_order_acquire);
+        if (expected == key) {
+            return pSite;
+        }
+        if (expected == 0) {
+            if (pSite->key.compare_exchange_strong(expected, key, std::memory_order_acq_rel) || expected == key) {
+                return pSite;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+BOOL LogRateLimiter::allow(UINT32 level, PCHAR format)
+{
+    UINT64 now, bucket, refilled, tokens;
+    UINT32 elapsed;
+    BOOL allowed;
+    Site* pSite;
+
+    if (level > this->maxLimitedLevel || format == NULL || (pSite = this->getSite(format)) == NULL) {
+        return TRUE;
+    }
+
+    now = (GETTIME() - this->startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    bucket = pSite->bucket.load(std::memory_order_relaxed);
+    do {
+        // The millisecond clock wraps after 49 days, the unsigned difference stays right across the wrap
+        elapsed = (UINT32) now - (UINT32) (bucket >> 32);
+        tokens = bucket & MAX_UINT32;
+        refilled = MIN(tokens + (UINT64) elapsed * this->messagesPerSecond, (UINT64) this->burst * LOG_RATE_LIMITER_TOKEN);
+        allowed = refilled >= LOG_RATE_LIMITER_TOKEN;
+        if (allowed) {
+            refilled -= LOG_RATE_LIMITER_TOKEN;
+        }
+    } while (!pSite->bucket.compare_exchange_weak(bucket, ((now & MAX_UINT32) << 32) | refilled, std::memory_order_relaxed));
+
+    if (!allowed) {
+        pSite->suppressed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return allowed;
+}
+
+VOID LogRateLimiter::takeSuppressed(const std::function<VOID(PCHAR, UINT64)>& reporter)
+{
+    UINT32 i;
+    UINT64 suppressed;
+    UINT_PTR key;
+
+    for (i = 0; i < LOG_RATE_LIMITER_SITE_COUNT; i++) {
+        key = this->sites[i].key.load(std::memory_order_acquire);
+        if (key != 0 && this->sites[i].suppressed.load(std::memory_order_relaxed) != 0) {
+            suppressed = this->sites[i].suppressed.exchange(0, std::memory_order_relaxed);
+            reporter((PCHAR) key, suppressed);
+        }
+    }
+}
+
+} // namespace Canary
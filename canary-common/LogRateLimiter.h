@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include <com/amazonaws/kinesis/video/common/CommonDefs.h>
+
+namespace Canary {
+
+// Number of call sites tracked, must be a power of two. Call sites past that aren't limited.
+#define LOG_RATE_LIMITER_SITE_COUNT 1024
+// How many slots a lookup probes before it gives up on a call site
+#define LOG_RATE_LIMITER_MAX_PROBES 16
+
+// LogRateLimiter throttles every log call site with its own token bucket, so that a chatty verbose log in a per packet
+// or per frame path can't swamp stdout and the CloudWatch batches while the rest of the logs still get through.
+//
+// A call site is identified by its format string pointer, which is unique per DLOG statement since the format is a
+// literal. Each site gets `burst` tokens that refill at `messagesPerSecond`, calls without a token are suppressed and
+// counted. takeSuppressed reports the counts so that the caller can log a summary instead of the messages.
+//
+// allow is lock free and doesn't allocate. Levels above maxLimitedLevel, e.g. warnings and errors, are never limited.
+class LogRateLimiter {
+  public:
+    LogRateLimiter(UINT32 messagesPerSecond, UINT32 burst, UINT32 maxLimitedLevel);
+    BOOL allow(UINT32 level, PCHAR format);
+    // Calls the reporter with the format string and suppressed count of every call site that has suppressed messages
+    // since the last call
+    VOID takeSuppressed(const std::function<VOID(PCHAR, UINT64)>& reporter);
+
+  private:
+    struct Site {
+        // format string pointer, 0 while the slot is free
+        std::atomic<UINT_PTR> key;
+        // milliseconds since startTime of the last refill in the upper half, thousandths of a token in the lower half
+        std::atomic<UINT64> bucket;
+        std::atomic<UINT64> suppressed;
+    };
+
+    UINT32 messagesPerSecond;
+    UINT32 burst;
+    UINT32 maxLimitedLevel;
+    UINT64 startTime;
+    std::unique_ptr<Site[]> sites;
+
+    Site* getSite(PCHAR format);
+};
+
+} // namespace Canary
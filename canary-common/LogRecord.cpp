@@ -0,0 +1,469 @@
+#include "LogRecord.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <com/amazonaws/kinesis/video/utils/Include.h>
+
+namespace Canary {
+
+typedef enum {
+    LENGTH_MODIFIER_NONE,
+    LENGTH_MODIFIER_HH,
+    LENGTH_MODIFIER_H,
+    LENGTH_MODIFIER_L,
+    LENGTH_MODIFIER_LL,
+    LENGTH_MODIFIER_Z,
+    LENGTH_MODIFIER_J,
+    LENGTH_MODIFIER_T,
+    LENGTH_MODIFIER_LONG_DOUBLE,
+} LENGTH_MODIFIER;
+
+// A single printf conversion specification, the pointers refer to the format string
+typedef struct {
+    const CHAR* flags;
+    UINT32 flagsLength;
+    // digits or "*"
+    const CHAR* width;
+    UINT32 widthLength;
+    BOOL hasPrecision;
+    // digits or "*", without the dot
+    const CHAR* precision;
+    UINT32 precisionLength;
+    LENGTH_MODIFIER length;
+    CHAR conversion;
+} FormatSpec, *PFormatSpec;
+
+// Parses the specification that follows a '%' and returns the position right after it
+static const CHAR* parseFormatSpec(const CHAR* p, PFormatSpec pSpec)
+{
+    pSpec->flags = p;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+        p++;
+    }
+    pSpec->flagsLength = (UINT32) (p - pSpec->flags);
+
+    pSpec->width = p;
+    if (*p == '*') {
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    pSpec->widthLength = (UINT32) (p - pSpec->width);
+
+    pSpec->hasPrecision = *p == '.';
+    if (pSpec->hasPrecision) {
+        p++;
+    }
+    pSpec->precision = p;
+    if (*p == '*') {
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    pSpec->precisionLength = (UINT32) (p - pSpec->precision);
+
+    pSpec->length = LENGTH_MODIFIER_NONE;
+    switch (*p) {
+        case 'h':
+            p++;
+            pSpec->length = LENGTH_MODIFIER_H;
+            if (*p == 'h') {
+                p++;
+                pSpec->length = LENGTH_MODIFIER_HH;
+            }
+            break;
+        case 'l':
+            p++;
+            pSpec->length = LENGTH_MODIFIER_L;
+            if (*p == 'l') {
+                p++;
+                pSpec->length = LENGTH_MODIFIER_LL;
+            }
+            break;
+        case 'q':
+            p++;
+            pSpec->length = LENGTH_MODIFIER_LL;
+            break;
+        case 'z':
+            p++;
+            pSpec->length = LENGTH_MODIFIER_Z;
+            break;
+        case 'j':
+            p++;
+            pSpec->length = LENGTH_MODIFIER_J;
+            break;
+        case 't':
+            p++;
+            pSpec->length = LENGTH_MODIFIER_T;
+            break;
+        case 'L':
+            p++;
+            pSpec->length = LENGTH_MODIFIER_LONG_DOUBLE;
+            break;
+        default:
+            break;
+    }
+
+    pSpec->conversion = *p;
+    if (*p != '\0') {
+        p++;
+    }
+
+    return p;
+}
+
+static BOOL isWidthArgument(PFormatSpec pSpec)
+{
+    return pSpec->widthLength == 1 && *pSpec->width == '*';
+}
+
+static BOOL isPrecisionArgument(PFormatSpec pSpec)
+{
+    return pSpec->hasPrecision && pSpec->precisionLength == 1 && *pSpec->precision == '*';
+}
+
+// Value of literal width or precision digits, "." on its own is a precision of 0
+static UINT32 parseSpecDigits(const CHAR* p, UINT32 length)
+{
+    UINT64 value = 0;
+
+    for (; length != 0; p++, length--) {
+        value = MIN(value * 10 + (UINT64) (*p - '0'), MAX_UINT32);
+    }
+
+    return (UINT32) value;
+}
+
+UINT32 encodeLogRecord(PBYTE pBuffer, UINT32 bufferSize, UINT32 level, PCHAR format, va_list args)
+{
+    LogRecordHeader header;
+    FormatSpec spec;
+    PBYTE pCurrent = pBuffer + SIZEOF(LogRecordHeader), pEnd = pBuffer + bufferSize;
+    const CHAR *p = format, *pString;
+    INT64 signedValue;
+    UINT64 unsignedValue;
+    DOUBLE doubleValue;
+    UINT32 length, available, maxStringLength;
+    auto append = [&](const VOID* pValue, UINT32 size) -> BOOL {
+        if ((UINT32) (pEnd - pCurrent) < size) {
+            header.truncated = TRUE;
+            return FALSE;
+        }
+        MEMCPY(pCurrent, pValue, size);
+        pCurrent += size;
+        header.valueCount++;
+        return TRUE;
+    };
+
+    if (bufferSize < SIZEOF(LogRecordHeader)) {
+        return 0;
+    }
+
+    header.timestamp = GETTIME();
+    header.format = format;
+    header.level = level;
+    header.valueCount = 0;
+    header.truncated = FALSE;
+
+    while (!header.truncated && (p = STRCHR(p, '%')) != NULL) {
+        p = parseFormatSpec(p + 1, &spec);
+
+        if (isWidthArgument(&spec)) {
+            signedValue = va_arg(args, INT32);
+            if (!append(&signedValue, SIZEOF(signedValue))) {
+                break;
+            }
+        }
+        // %.*s may refer to a buffer without a terminator, so a string is never read beyond its precision
+        maxStringLength = MAX_UINT32;
+        if (isPrecisionArgument(&spec)) {
+            signedValue = va_arg(args, INT32);
+            if (!append(&signedValue, SIZEOF(signedValue))) {
+                break;
+            }
+            // A negative precision counts as if it was omitted
+            maxStringLength = signedValue < 0 ? MAX_UINT32 : (UINT32) signedValue;
+        } else if (spec.hasPrecision) {
+            maxStringLength = parseSpecDigits(spec.precision, spec.precisionLength);
+        }
+
+        switch (spec.conversion) {
+            case '%':
+                break;
+            case 'd':
+            case 'i':
+                switch (spec.length) {
+                    case LENGTH_MODIFIER_HH:
+                        signedValue = (signed char) va_arg(args, INT32);
+                        break;
+                    case LENGTH_MODIFIER_H:
+                        signedValue = (INT16) va_arg(args, INT32);
+                        break;
+                    case LENGTH_MODIFIER_L:
+                        signedValue = va_arg(args, long);
+                        break;
+                    case LENGTH_MODIFIER_LL:
+                        signedValue = va_arg(args, long long);
+                        break;
+                    case LENGTH_MODIFIER_Z:
+                    case LENGTH_MODIFIER_T:
+                        signedValue = va_arg(args, ptrdiff_t);
+                        break;
+                    case LENGTH_MODIFIER_J:
+                        signedValue = va_arg(args, intmax_t);
+                        break;
+                    default:
+                        signedValue = va_arg(args, INT32);
+                        break;
+                }
+                append(&signedValue, SIZEOF(signedValue));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            case 'c':
+                switch (spec.length) {
+                    case LENGTH_MODIFIER_HH:
+                        unsignedValue = (unsigned char) va_arg(args, UINT32);
+                        break;
+                    case LENGTH_MODIFIER_H:
+                        unsignedValue = (UINT16) va_arg(args, UINT32);
+                        break;
+                    case LENGTH_MODIFIER_L:
+                        unsignedValue = va_arg(args, unsigned long);
+                        break;
+                    case LENGTH_MODIFIER_LL:
+                        unsignedValue = va_arg(args, unsigned long long);
+                        break;
+                    case LENGTH_MODIFIER_Z:
+                    case LENGTH_MODIFIER_T:
+                        unsignedValue = va_arg(args, size_t);
+                        break;
+                    case LENGTH_MODIFIER_J:
+                        unsignedValue = va_arg(args, uintmax_t);
+                        break;
+                    default:
+                        unsignedValue = va_arg(args, UINT32);
+                        break;
+                }
+                append(&unsignedValue, SIZEOF(unsignedValue));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                doubleValue = spec.length == LENGTH_MODIFIER_LONG_DOUBLE ? (DOUBLE) va_arg(args, long double) : va_arg(args, DOUBLE);
+                append(&doubleValue, SIZEOF(doubleValue));
+                break;
+            case 'p':
+                unsignedValue = (UINT64) (UINT_PTR) va_arg(args, PVOID);
+                append(&unsignedValue, SIZEOF(unsignedValue));
+                break;
+            case 's':
+                // Strings are copied as length, bytes and terminator, a string that doesn't fit is cut off
+                pString = va_arg(args, const CHAR*);
+                pString = pString == NULL ? "(null)" : pString;
+                if ((UINT32) (pEnd - pCurrent) <= SIZEOF(UINT32) + 1) {
+                    header.truncated = TRUE;
+                    break;
+                }
+                available = (UINT32) (pEnd - pCurrent) - SIZEOF(UINT32) - 1;
+                length = (UINT32) STRNLEN(pString, MIN(available, maxStringLength));
+                // Cutting the string off at its precision is up to the format, only the buffer truncates it. pString[length]
+                // is still within the precision when the buffer was the limit.
+                header.truncated = length == available && length < maxStringLength && pString[length] != '\0';
+                MEMCPY(pCurrent, &length, SIZEOF(UINT32));
+                MEMCPY(pCurrent + SIZEOF(UINT32), pString, length);
+                pCurrent[SIZEOF(UINT32) + length] = '\0';
+                pCurrent += SIZEOF(UINT32) + length + 1;
+                header.valueCount++;
+                break;
+            case 'n':
+                // Nothing to capture, and nothing is ever written back
+                va_arg(args, PVOID);
+                break;
+            default:
+                // Unknown conversion, the rest of the arguments can't be located
+                header.truncated = TRUE;
+                break;
+        }
+    }
+
+    MEMCPY(pBuffer, &header, SIZEOF(LogRecordHeader));
+
+    return (UINT32) (pCurrent - pBuffer);
+}
+
+BOOL isLogRecordTruncated(const BYTE* pRecord)
+{
+    LogRecordHeader header;
+
+    MEMCPY(&header, pRecord, SIZEOF(LogRecordHeader));
+
+    return header.truncated;
+}
+
+UINT32 renderLogRecord(const BYTE* pRecord, UINT32 recordSize, PCHAR pBuffer, UINT32 bufferSize, PUINT64 pTimestamp)
+{
+    LogRecordHeader header;
+    FormatSpec spec;
+    const BYTE* pCurrent = pRecord + SIZEOF(LogRecordHeader);
+    const CHAR *p, *pLiteral;
+    // space for "yyyy-mm-dd HH:MM:SS" + space + null
+    CHAR timeString[MAX_TIMESTAMP_FORMAT_STR_LEN + 1 + 1];
+    CHAR specString[64];
+    UINT32 offset = 0, valuesLeft, valuesNeeded, timeStringLength, specLength, length;
+    INT64 signedValue;
+    UINT64 unsignedValue;
+    DOUBLE doubleValue;
+    INT32 written;
+    BOOL stopped = FALSE;
+    // Keeps offset within the buffer no matter how much snprintf wanted to write
+    auto advance = [&](INT32 count) {
+        if (count > 0) {
+            offset = MIN(offset + (UINT32) count, bufferSize - 1);
+        }
+    };
+    auto appendSpecNumber = [&](const CHAR* pDigits, UINT32 digitsLength) {
+        if (digitsLength == 1 && *pDigits == '*') {
+            MEMCPY(&signedValue, pCurrent, SIZEOF(signedValue));
+            pCurrent += SIZEOF(signedValue);
+            // A negative precision counts as if it was omitted, a negative width already means left aligned
+            if (signedValue < 0 && specString[specLength - 1] == '.') {
+                specLength--;
+            } else {
+                specLength += SNPRINTF(specString + specLength, SIZEOF(specString) - specLength, "%" PRId64, signedValue);
+            }
+        } else {
+            digitsLength = MIN(digitsLength, 10);
+            MEMCPY(specString + specLength, pDigits, digitsLength);
+            specLength += digitsLength;
+        }
+    };
+
+    if (bufferSize == 0) {
+        return 0;
+    }
+    pBuffer[0] = '\0';
+    if (recordSize < SIZEOF(LogRecordHeader)) {
+        return 0;
+    }
+
+    MEMCPY(&header, pRecord, SIZEOF(LogRecordHeader));
+    if (pTimestamp != NULL) {
+        *pTimestamp = header.timestamp;
+    }
+
+    // if something fails in getting time, still print the log, just without timestamp
+    if (STATUS_FAILED(generateTimestampStr(header.timestamp, (PCHAR) "%Y-%m-%d %H:%M:%S ", timeString, (UINT32) ARRAY_SIZE(timeString),
+                                           &timeStringLength))) {
+        timeString[0] = '\0';
+    }
+    advance(SNPRINTF(pBuffer, bufferSize, "%s%-*s ", timeString, LOG_RECORD_LEVEL_WIDTH, getLogLevelStr(header.level)));
+
+    p = header.format;
+    valuesLeft = header.valueCount;
+    while (*p != '\0' && !stopped) {
+        if (*p != '%') {
+            pLiteral = p;
+            while (*p != '\0' && *p != '%') {
+                p++;
+            }
+            length = MIN((UINT32) (p - pLiteral), bufferSize - 1 - offset);
+            MEMCPY(pBuffer + offset, pLiteral, length);
+            offset += length;
+            continue;
+        }
+
+        p = parseFormatSpec(p + 1, &spec);
+        if (spec.conversion == '%') {
+            advance(SNPRINTF(pBuffer + offset, bufferSize - offset, "%%"));
+            continue;
+        }
+
+        valuesNeeded = (isWidthArgument(&spec) ? 1 : 0) + (isPrecisionArgument(&spec) ? 1 : 0) + (spec.conversion == 'n' ? 0 : 1);
+        if (valuesNeeded > valuesLeft) {
+            stopped = TRUE;
+            break;
+        }
+        valuesLeft -= valuesNeeded;
+
+        // Rebuild the specification for the captured type, e.g. "%08" PRIx64 becomes "%08llx"
+        specString[0] = '%';
+        specLength = 1;
+        length = MIN(spec.flagsLength, 8);
+        MEMCPY(specString + specLength, spec.flags, length);
+        specLength += length;
+        appendSpecNumber(spec.width, spec.widthLength);
+        if (spec.hasPrecision) {
+            specString[specLength++] = '.';
+            appendSpecNumber(spec.precision, spec.precisionLength);
+        }
+
+        switch (spec.conversion) {
+            case 'd':
+            case 'i':
+                MEMCPY(&signedValue, pCurrent, SIZEOF(signedValue));
+                pCurrent += SIZEOF(signedValue);
+                SNPRINTF(specString + specLength, SIZEOF(specString) - specLength, "ll%c", spec.conversion);
+                written = SNPRINTF(pBuffer + offset, bufferSize - offset, specString, (long long) signedValue);
+                break;
+            case 'c':
+                MEMCPY(&unsignedValue, pCurrent, SIZEOF(unsignedValue));
+                pCurrent += SIZEOF(unsignedValue);
+                SNPRINTF(specString + specLength, SIZEOF(specString) - specLength, "c");
+                written = SNPRINTF(pBuffer + offset, bufferSize - offset, specString, (INT32) unsignedValue);
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                MEMCPY(&unsignedValue, pCurrent, SIZEOF(unsignedValue));
+                pCurrent += SIZEOF(unsignedValue);
+                SNPRINTF(specString + specLength, SIZEOF(specString) - specLength, "ll%c", spec.conversion);
+                written = SNPRINTF(pBuffer + offset, bufferSize - offset, specString, (unsigned long long) unsignedValue);
+                break;
+            case 'p':
+                MEMCPY(&unsignedValue, pCurrent, SIZEOF(unsignedValue));
+                pCurrent += SIZEOF(unsignedValue);
+                SNPRINTF(specString + specLength, SIZEOF(specString) - specLength, "p");
+                written = SNPRINTF(pBuffer + offset, bufferSize - offset, specString, (PVOID) (UINT_PTR) unsignedValue);
+                break;
+            case 's':
+                MEMCPY(&length, pCurrent, SIZEOF(UINT32));
+                SNPRINTF(specString + specLength, SIZEOF(specString) - specLength, "s");
+                written = SNPRINTF(pBuffer + offset, bufferSize - offset, specString, (const CHAR*) pCurrent + SIZEOF(UINT32));
+                pCurrent += SIZEOF(UINT32) + length + 1;
+                break;
+            case 'n':
+                written = 0;
+                break;
+            default:
+                MEMCPY(&doubleValue, pCurrent, SIZEOF(doubleValue));
+                pCurrent += SIZEOF(doubleValue);
+                SNPRINTF(specString + specLength, SIZEOF(specString) - specLength, "%c", spec.conversion);
+                written = SNPRINTF(pBuffer + offset, bufferSize - offset, specString, doubleValue);
+                break;
+        }
+        advance(written);
+    }
+
+    if (header.truncated) {
+        advance(SNPRINTF(pBuffer + offset, bufferSize - offset, " [truncated]"));
+    }
+    advance(SNPRINTF(pBuffer + offset, bufferSize - offset, "\n"));
+
+    return offset;
+}
+
+} // namespace Canary
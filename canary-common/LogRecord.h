@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdarg>
+
+#include <com/amazonaws/kinesis/video/common/CommonDefs.h>
+
+namespace Canary {
+
+// Width of the level column, matches the longest level name
+#define LOG_RECORD_LEVEL_WIDTH 7
+
+// A log record is the binary form of a single log call: the format string pointer, the log level, the time of the call
+// and the captured arguments. Capturing only copies the argument values (and the bytes of string arguments), the
+// expensive text formatting happens later in renderLogRecord, typically on the thread that ships the logs.
+//
+// The format string isn't copied, so it has to outlive the record. That holds for the string literals of the DLOG
+// macros.
+//
+// When the arguments don't fit into the buffer, the record keeps the ones that do and the text is cut off after them.
+struct LogRecordHeader {
+    UINT64 timestamp;
+    PCHAR format;
+    UINT32 level;
+    // number of captured values, including '*' widths and precisions
+    UINT32 valueCount;
+    BOOL truncated;
+};
+
+// Returns the size of the record, 0 when the buffer can't even hold the header
+UINT32 encodeLogRecord(PBYTE pBuffer, UINT32 bufferSize, UINT32 level, PCHAR format, va_list args);
+
+// Renders the record as "<date> <time> <level> <message>\n", the same layout addLogMetadata produces. The result is
+// always null terminated, the return value is its length. pTimestamp is optional.
+UINT32 renderLogRecord(const BYTE* pRecord, UINT32 recordSize, PCHAR pBuffer, UINT32 bufferSize, PUINT64 pTimestamp);
+
+// Whether the arguments didn't fit into the record
+BOOL isLogRecordTruncated(const BYTE* pRecord);
+
+} // namespace Canary
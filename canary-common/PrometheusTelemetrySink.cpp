@@ -0,0 +1,328 @@
+#include "PrometheusTelemetrySink.h"
+#include "EmbeddedMetricFormat.h"
+
+#include <cmath>
+
+#include <com/amazonaws/kinesis/video/utils/Include.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace Canary {
+
+using Aws::CloudWatch::Model::MetricDatum;
+using Aws::CloudWatch::Model::StandardUnit;
+using Aws::CloudWatchLogs::Model::InputLogEvent;
+
+// How often the server thread checks whether it should exit
+#define PROMETHEUS_POLL_PERIOD_MS     200
+#define PROMETHEUS_RECEIVE_TIMEOUT_MS 1000
+#define PROMETHEUS_MAX_REQUEST_SIZE   4096
+
+// FrameRate -> frame_rate, anything that isn't valid in a Prometheus name becomes an underscore
+static std::string toSnakeCase(const std::string& value)
+{
+    std::string result;
+    UINT32 i;
+    CHAR c;
+
+    for (i = 0; i < value.size(); i++) {
+        c = value[i];
+        if (c >= 'A' && c <= 'Z') {
+            if (i != 0 && ((value[i - 1] >= 'a' && value[i - 1] <= 'z') || (value[i - 1] >= '0' && value[i - 1] <= '9'))) {
+                result += '_';
+            }
+            result += (CHAR) (c - 'A' + 'a');
+        } else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9' && i != 0)) {
+            result += c;
+        } else {
+            result += '_';
+        }
+    }
+
+    return result;
+}
+
+static std::string getSeriesName(const MetricDatum& datum)
+{
+    std::string name = PROMETHEUS_METRIC_PREFIX + toSnakeCase(datum.GetMetricName().c_str());
+
+    if (datum.GetUnit() != StandardUnit::NOT_SET && datum.GetUnit() != StandardUnit::Count && datum.GetUnit() != StandardUnit::None) {
+        name += "_" + toSnakeCase(Aws::CloudWatch::Model::StandardUnitMapper::GetNameForStandardUnit(datum.GetUnit()).c_str());
+    }
+
+    return name;
+}
+
+static std::string getSeriesLabels(const MetricDatum& datum)
+{
+    std::string labels;
+
+    for (auto& dimension : datum.GetDimensions()) {
+        labels += labels.empty() ? "{" : ",";
+        labels += toSnakeCase(dimension.GetName().c_str());
+        labels += "=\"";
+        for (auto c : std::string(dimension.GetValue().c_str())) {
+            if (c == '\\' || c == '"') {
+                labels += '\\';
+                labels += c;
+            } else if (c == '\n') {
+                labels += "\\n";
+            } else {
+                labels += c;
+            }
+        }
+        labels += "\"";
+    }
+    if (!labels.empty()) {
+        labels += "}";
+    }
+
+    return labels;
+}
+
+// Sum and count of the samples a datum stands for
+static VOID getSampleTotals(const MetricDatum& datum, DOUBLE* pSum, DOUBLE* pCount)
+{
+    UINT32 i;
+    DOUBLE count;
+
+    *pSum = 0;
+    *pCount = 0;
+    if (datum.StatisticValuesHasBeenSet()) {
+        *pSum = datum.GetStatisticValues().GetSum();
+        *pCount = datum.GetStatisticValues().GetSampleCount();
+    } else if (!datum.GetValues().empty()) {
+        for (i = 0; i < datum.GetValues().size(); i++) {
+            count = i < datum.GetCounts().size() ? datum.GetCounts()[i] : 1;
+            *pSum += datum.GetValues()[i] * count;
+            *pCount += count;
+        }
+    } else {
+        *pSum = datum.GetValue();
+        *pCount = 1;
+    }
+}
+
+static VOID appendSample(std::string& out, const std::string& name, const std::string& labels, DOUBLE value)
+{
+    out += name;
+    out += labels;
+    out += " ";
+    if (std::isnan(value)) {
+        out += "NaN";
+    } else if (std::isinf(value)) {
+        out += value > 0 ? "+Inf" : "-Inf";
+    } else {
+        appendJsonNumber(out, value);
+    }
+    out += "\n";
+}
+
+PrometheusTelemetrySink::PrometheusTelemetrySink() : logEvents(0), logBytes(0), droppedSeries(0), listenFd(-1), terminated(FALSE)
+{
+}
+
+PrometheusTelemetrySink::~PrometheusTelemetrySink()
+{
+    this->terminated = TRUE;
+    if (this->serverThread.joinable()) {
+        this->serverThread.join();
+    }
+#ifndef _WIN32
+    if (this->listenFd >= 0) {
+        close(this->listenFd);
+    }
+#endif
+}
+
+STATUS PrometheusTelemetrySink::start(UINT16 port)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+#ifndef _WIN32
+    struct sockaddr_in address;
+    socklen_t addressLength = SIZEOF(address);
+    INT32 reuse = 1;
+
+    CHK(this->listenFd < 0, STATUS_INVALID_OPERATION);
+
+    CHK_ERR((this->listenFd = socket(AF_INET, SOCK_STREAM, 0)) >= 0, STATUS_INVALID_OPERATION, "Failed to create the Prometheus socket");
+    setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, SIZEOF(reuse));
+
+    MEMSET(&address, 0, SIZEOF(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    CHK_ERR(bind(this->listenFd, (struct sockaddr*) &address, SIZEOF(address)) == 0 && listen(this->listenFd, SOMAXCONN) == 0,
+            STATUS_INVALID_OPERATION, "Failed to listen on port %u for Prometheus", (UINT32) port);
+    getsockname(this->listenFd, (struct sockaddr*) &address, &addressLength);
+    DLOGI("Serving Prometheus metrics on http://127.0.0.1:%u/metrics", (UINT32) ntohs(address.sin_port));
+
+    this->serverThread = std::thread(&PrometheusTelemetrySink::runServer, this);
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus) && this->listenFd >= 0) {
+        close(this->listenFd);
+        this->listenFd = -1;
+    }
+#else
+    UNUSED_PARAM(port);
+    retStatus = STATUS_NOT_IMPLEMENTED;
+#endif
+
+    return retStatus;
+}
+
+STATUS PrometheusTelemetrySink::openLogs()
+{
+    return STATUS_SUCCESS;
+}
+
+STATUS PrometheusTelemetrySink::resyncLogs()
+{
+    return STATUS_SUCCESS;
+}
+
+VOID PrometheusTelemetrySink::putMetrics(Aws::Vector<MetricDatum>&& datums, const SendCallback& callback)
+{
+    std::string name, labels, key;
+    DOUBLE sum, count;
+
+    {
+        std::lock_guard<std::mutex> lock(this->seriesMutex);
+        for (auto& datum : datums) {
+            name = getSeriesName(datum);
+            labels = getSeriesLabels(datum);
+            getSampleTotals(datum, &sum, &count);
+            // A separator below any name character keeps e.g. frame_rate_x from sorting between the series of frame_rate
+            key = name + '\1' + labels;
+
+            auto it = this->series.find(key);
+            if (it == this->series.end()) {
+                if (this->series.size() >= MAX_PROMETHEUS_SERIES) {
+                    this->droppedSeries++;
+                    continue;
+                }
+                it = this->series.emplace(key, Series{name, labels, 0, 0, 0}).first;
+            }
+            it->second.last = count > 0 ? sum / count : 0;
+            it->second.sum += sum;
+            it->second.count += count;
+        }
+    }
+
+    callback(TELEMETRY_SEND_RESULT_SUCCESS);
+}
+
+VOID PrometheusTelemetrySink::putLogs(Aws::Vector<InputLogEvent>&& events, const LogsCallback& callback)
+{
+    for (auto& event : events) {
+        this->logBytes += event.GetMessage().size();
+    }
+    this->logEvents += events.size();
+
+    callback(TELEMETRY_SEND_RESULT_SUCCESS, Aws::Vector<InputLogEvent>());
+}
+
+std::string PrometheusTelemetrySink::render()
+{
+    std::string body;
+
+    std::lock_guard<std::mutex> lock(this->seriesMutex);
+    // Series of the same metric are adjacent since the key starts with the name. The samples of a family have to be
+    // contiguous, so the gauges of all of them come before their summaries.
+    for (auto first = this->series.begin(), next = first; first != this->series.end(); first = next) {
+        auto& name = first->second.name;
+        for (next = first; next != this->series.end() && next->second.name == name; next++) {
+        }
+
+        body += "# TYPE " + name + "_last gauge\n";
+        for (auto it = first; it != next; it++) {
+            appendSample(body, name + "_last", it->second.labels, it->second.last);
+        }
+        body += "# TYPE " + name + " summary\n";
+        for (auto it = first; it != next; it++) {
+            appendSample(body, name + "_sum", it->second.labels, it->second.sum);
+            appendSample(body, name + "_count", it->second.labels, it->second.count);
+        }
+    }
+
+    body += "# TYPE " PROMETHEUS_METRIC_PREFIX "log_events_total counter\n";
+    appendSample(body, PROMETHEUS_METRIC_PREFIX "log_events_total", "", (DOUBLE) this->logEvents.load());
+    body += "# TYPE " PROMETHEUS_METRIC_PREFIX "log_bytes_total counter\n";
+    appendSample(body, PROMETHEUS_METRIC_PREFIX "log_bytes_total", "", (DOUBLE) this->logBytes.load());
+    body += "# TYPE " PROMETHEUS_METRIC_PREFIX "dropped_series_total counter\n";
+    appendSample(body, PROMETHEUS_METRIC_PREFIX "dropped_series_total", "", (DOUBLE) this->droppedSeries.load());
+
+    return body;
+}
+
+VOID PrometheusTelemetrySink::runServer()
+{
+#ifndef _WIN32
+    struct pollfd pollFd;
+    INT32 fd;
+
+    pollFd.fd = this->listenFd;
+    pollFd.events = POLLIN;
+
+    while (!this->terminated) {
+        if (poll(&pollFd, 1, PROMETHEUS_POLL_PERIOD_MS) <= 0 || (fd = accept(this->listenFd, NULL, NULL)) < 0) {
+            continue;
+        }
+        this->serve(fd);
+        close(fd);
+    }
+#endif
+}
+
+VOID PrometheusTelemetrySink::serve(INT32 fd)
+{
+#ifndef _WIN32
+    CHAR request[PROMETHEUS_MAX_REQUEST_SIZE + 1];
+    std::string response, body;
+    struct timeval timeout;
+    ssize_t received, sent;
+    UINT64 size = 0, offset;
+
+    timeout.tv_sec = PROMETHEUS_RECEIVE_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (PROMETHEUS_RECEIVE_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, SIZEOF(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, SIZEOF(timeout));
+
+    // Only the request line matters, the headers are read so that the client doesn't get a reset
+    while (size < PROMETHEUS_MAX_REQUEST_SIZE && (received = recv(fd, request + size, PROMETHEUS_MAX_REQUEST_SIZE - size, 0)) > 0) {
+        size += received;
+        request[size] = '\0';
+        if (STRSTR(request, "\r\n\r\n") != NULL) {
+            break;
+        }
+    }
+    request[size] = '\0';
+
+    if (STRNCMP(request, "GET / ", 6) == 0 || STRNCMP(request, "GET /metrics", 12) == 0) {
+        body = this->render();
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n";
+    } else {
+        body = "Not found\n";
+        response = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n";
+    }
+    response += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+    for (offset = 0; offset < response.size(); offset += sent) {
+        if ((sent = send(fd, response.data() + offset, response.size() - offset, MSG_NOSIGNAL)) <= 0) {
+            break;
+        }
+    }
+#else
+    UNUSED_PARAM(fd);
+#endif
+}
+
+} // namespace Canary
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "TelemetrySink.h"
+
+namespace Canary {
+
+// Series kept at once, datums of new series are dropped past that
+#define MAX_PROMETHEUS_SERIES    10000
+#define PROMETHEUS_METRIC_PREFIX "kvs_canary_"
+
+// Serves the metrics in the Prometheus text exposition format on http://127.0.0.1:<port>/metrics. Every metric name,
+// unit and dimension combination is a series, e.g. FrameRate in Count with Channel=x becomes
+//
+//   kvs_canary_frame_rate_last{channel="x"}    value of the latest datum, or the average of its values
+//   kvs_canary_frame_rate_sum{channel="x"}     sum of all samples since the start
+//   kvs_canary_frame_rate_count{channel="x"}   number of samples since the start
+//
+// with the unit as a suffix of the name unless it's Count or None. Logs aren't kept, only counted in
+// kvs_canary_log_events_total and kvs_canary_log_bytes_total, the canaries print them to stdout anyway.
+//
+// The endpoint runs on its own thread and only listens on the loopback interface, port 0 picks a free port.
+class PrometheusTelemetrySink : public TelemetrySink {
+  public:
+    PrometheusTelemetrySink();
+    ~PrometheusTelemetrySink();
+    STATUS start(UINT16 port);
+    STATUS openLogs() override;
+    STATUS resyncLogs() override;
+    VOID putMetrics(Aws::Vector<Aws::CloudWatch::Model::MetricDatum>&& datums, const SendCallback& callback) override;
+    VOID putLogs(Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&& events, const LogsCallback& callback) override;
+    // Body of a scrape, exposed for tools that want it without going through the socket
+    std::string render();
+
+  private:
+    struct Series {
+        std::string name;
+        // {label="value",...} or empty
+        std::string labels;
+        DOUBLE last;
+        DOUBLE sum;
+        DOUBLE count;
+    };
+
+    std::mutex seriesMutex;
+    // keyed by name and labels, so that the output groups the series of a metric
+    std::map<std::string, Series> series;
+    std::atomic<UINT64> logEvents;
+    std::atomic<UINT64> logBytes;
+    std::atomic<UINT64> droppedSeries;
+
+    INT32 listenFd;
+    std::thread serverThread;
+    std::atomic<BOOL> terminated;
+
+    VOID runServer();
+    VOID serve(INT32 fd);
+};
+
+} // namespace Canary
@@ -0,0 +1,100 @@
+#include "TelemetrySink.h"
+#include "CloudWatchTelemetrySink.h"
+#include "FileTelemetrySink.h"
+#include "PrometheusTelemetrySink.h"
+
+#include <future>
+
+#include <com/amazonaws/kinesis/video/utils/Include.h>
+
+namespace Canary {
+
+static TELEMETRY_SEND_RESULT waitForSend(const std::function<VOID(const TelemetrySink::SendCallback&)>& send)
+{
+    std::promise<TELEMETRY_SEND_RESULT> result;
+    auto future = result.get_future();
+
+    send([&result](TELEMETRY_SEND_RESULT sendResult) { result.set_value(sendResult); });
+
+    return future.get();
+}
+
+TELEMETRY_SEND_RESULT TelemetrySink::putMetricsSync(Aws::Vector<Aws::CloudWatch::Model::MetricDatum>&& datums)
+{
+    return waitForSend([this, &datums](const SendCallback& callback) { this->putMetrics(std::move(datums), callback); });
+}
+
+TELEMETRY_SEND_RESULT TelemetrySink::putLogsSync(Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&& events)
+{
+    return waitForSend([this, &events](const SendCallback& callback) {
+        this->putLogs(std::move(events), [callback](TELEMETRY_SEND_RESULT result, Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&&) {
+            callback(result);
+        });
+    });
+}
+
+STATUS parseTelemetrySinkType(const CHAR* pValue, TELEMETRY_SINK_TYPE* pType)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pValue != NULL && pType != NULL, STATUS_NULL_ARG);
+
+    if (STRCMPI(pValue, "cloudwatch") == 0) {
+        *pType = TELEMETRY_SINK_CLOUDWATCH;
+    } else if (STRCMPI(pValue, "file") == 0) {
+        *pType = TELEMETRY_SINK_FILE;
+    } else if (STRCMPI(pValue, "prometheus") == 0) {
+        *pType = TELEMETRY_SINK_PROMETHEUS;
+    } else {
+        CHK(FALSE, STATUS_INVALID_ARG);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+const CHAR* getTelemetrySinkTypeName(TELEMETRY_SINK_TYPE type)
+{
+    switch (type) {
+        case TELEMETRY_SINK_CLOUDWATCH:
+            return "cloudwatch";
+        case TELEMETRY_SINK_FILE:
+            return "file";
+        case TELEMETRY_SINK_PROMETHEUS:
+            return "prometheus";
+    }
+
+    return "unknown";
+}
+
+STATUS createTelemetrySink(const TelemetrySinkConfig& config, std::unique_ptr<TelemetrySink>& sink)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::unique_ptr<FileTelemetrySink> fileSink;
+    std::unique_ptr<PrometheusTelemetrySink> prometheusSink;
+
+    switch (config.type) {
+        case TELEMETRY_SINK_CLOUDWATCH:
+            sink.reset(new CloudWatchTelemetrySink(config.clientConfig, config.metricNamespace, config.logGroupName, config.logStreamName));
+            break;
+        case TELEMETRY_SINK_FILE:
+            fileSink.reset(new FileTelemetrySink(config.metricNamespace));
+            CHK_STATUS(fileSink->open(config.filePath));
+            sink = std::move(fileSink);
+            break;
+        case TELEMETRY_SINK_PROMETHEUS:
+            prometheusSink.reset(new PrometheusTelemetrySink());
+            CHK_STATUS(prometheusSink->start(config.prometheusPort));
+            sink = std::move(prometheusSink);
+            break;
+        default:
+            CHK(FALSE, STATUS_INVALID_ARG);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+} // namespace Canary
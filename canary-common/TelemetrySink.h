@@ -0,0 +1,79 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <aws/core/Aws.h>
+#include <aws/logs/model/PutLogEventsRequest.h>
+#include <aws/monitoring/model/MetricDatum.h>
+
+#include <com/amazonaws/kinesis/video/common/CommonDefs.h>
+
+namespace Canary {
+
+#define DEFAULT_TELEMETRY_FILE_PATH "./canary-telemetry.ndjson"
+#define DEFAULT_PROMETHEUS_PORT     9464
+
+typedef enum {
+    // PutMetricData and PutLogEvents, what the canaries have always done
+    TELEMETRY_SINK_CLOUDWATCH,
+    // Newline delimited JSON, one line per metric datum or log event, appended to a local file
+    TELEMETRY_SINK_FILE,
+    // Metrics served in the Prometheus text format on a local port, logs are only counted
+    TELEMETRY_SINK_PROMETHEUS,
+} TELEMETRY_SINK_TYPE;
+
+typedef enum {
+    TELEMETRY_SEND_RESULT_SUCCESS,
+    // The destination already has the batch, its sequence token is stale though, see resyncLogs
+    TELEMETRY_SEND_RESULT_ALREADY_ACCEPTED,
+    TELEMETRY_SEND_RESULT_INVALID_TOKEN,
+    TELEMETRY_SEND_RESULT_FAILED,
+} TELEMETRY_SEND_RESULT;
+
+typedef struct {
+    TELEMETRY_SINK_TYPE type;
+    std::string metricNamespace;
+    // TELEMETRY_SINK_CLOUDWATCH
+    Aws::Client::ClientConfiguration clientConfig;
+    std::string logGroupName;
+    std::string logStreamName;
+    // TELEMETRY_SINK_FILE
+    std::string filePath;
+    // TELEMETRY_SINK_PROMETHEUS, the endpoint only listens on the loopback interface
+    UINT16 prometheusPort;
+} TelemetrySinkConfig;
+
+// TelemetrySink is where the canaries' metrics and logs end up. Aggregation, batching and retries stay with the
+// callers, a sink only delivers a batch and reports how that went, so that the same canary can publish to CloudWatch
+// or, e.g. on an offline CI host, to a file or a local Prometheus scrape endpoint.
+//
+// putMetrics and putLogs call back exactly once with the outcome, either before they return or later from another
+// thread, and they may be called from any thread. The *Sync variants wait for the callback. putLogs hands the events
+// back with the outcome unless they were delivered, so that a caller can keep a failed batch without copying every
+// batch up front.
+class TelemetrySink {
+  public:
+    typedef std::function<VOID(TELEMETRY_SEND_RESULT)> SendCallback;
+    typedef std::function<VOID(TELEMETRY_SEND_RESULT, Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&&)> LogsCallback;
+
+    virtual ~TelemetrySink() = default;
+    // Prepares the log destination, e.g. creates the CloudWatch log stream, and can be called again after it failed
+    virtual STATUS openLogs() = 0;
+    // Catches up with the destination after TELEMETRY_SEND_RESULT_ALREADY_ACCEPTED or TELEMETRY_SEND_RESULT_INVALID_TOKEN
+    virtual STATUS resyncLogs() = 0;
+    virtual VOID putMetrics(Aws::Vector<Aws::CloudWatch::Model::MetricDatum>&& datums, const SendCallback& callback) = 0;
+    // The events have to be in chronological order
+    virtual VOID putLogs(Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&& events, const LogsCallback& callback) = 0;
+
+    TELEMETRY_SEND_RESULT putMetricsSync(Aws::Vector<Aws::CloudWatch::Model::MetricDatum>&& datums);
+    TELEMETRY_SEND_RESULT putLogsSync(Aws::Vector<Aws::CloudWatchLogs::Model::InputLogEvent>&& events);
+};
+
+// "cloudwatch", "file" or "prometheus", anything else is STATUS_INVALID_ARG
+STATUS parseTelemetrySinkType(const CHAR* pValue, TELEMETRY_SINK_TYPE* pType);
+const CHAR* getTelemetrySinkTypeName(TELEMETRY_SINK_TYPE type);
+STATUS createTelemetrySink(const TelemetrySinkConfig& config, std::unique_ptr<TelemetrySink>& sink);
+
+} // namespace Canary
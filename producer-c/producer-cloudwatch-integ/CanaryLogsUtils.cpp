@@ -5,15 +5,42 @@
 #include "CanaryStreamUtils.h"
 
 PCloudwatchLogsObject gCloudwatchLogsObject = NULL;
+Canary::LogRateLimiter gLogRateLimiter(CANARY_LOG_RATE_LIMIT, CANARY_LOG_RATE_LIMIT_BURST, LOG_LEVEL_INFO);
+
+STATUS canaryCreateTelemetrySink(const Aws::Client::ClientConfiguration& clientConfiguration, PCHAR logGroupName, PCHAR logStreamName,
+                                 std::unique_ptr<Canary::TelemetrySink>& telemetrySink) {
+    STATUS retStatus = STATUS_SUCCESS;
+    Canary::TelemetrySinkConfig sinkConfig;
+    PCHAR pSinkType, pPrometheusPort;
+    UINT32 prometheusPort;
+
+    sinkConfig.type = Canary::TELEMETRY_SINK_CLOUDWATCH;
+    if ((pSinkType = getenv(CANARY_TELEMETRY_SINK_ENV_VAR)) != NULL) {
+        CHK_ERR(STATUS_SUCCEEDED(Canary::parseTelemetrySinkType(pSinkType, &sinkConfig.type)), STATUS_INVALID_ARG,
+                "%s must be cloudwatch, file or prometheus", CANARY_TELEMETRY_SINK_ENV_VAR);
+    }
+    if (NULL == (pPrometheusPort = getenv(CANARY_PROMETHEUS_PORT_ENV_VAR)) || STATUS_SUCCESS != STRTOUI32(pPrometheusPort, NULL, 10, &prometheusPort) ||
+        prometheusPort > MAX_UINT16) {
+        prometheusPort = DEFAULT_PROMETHEUS_PORT;
+    }
+
+    sinkConfig.metricNamespace = CANARY_METRIC_NAMESPACE;
+    sinkConfig.clientConfig = clientConfiguration;
+    sinkConfig.logGroupName = logGroupName;
+    sinkConfig.logStreamName = logStreamName;
+    sinkConfig.filePath = getenv(CANARY_TELEMETRY_SINK_PATH_ENV_VAR) != NULL ? getenv(CANARY_TELEMETRY_SINK_PATH_ENV_VAR) : DEFAULT_TELEMETRY_FILE_PATH;
+    sinkConfig.prometheusPort = (UINT16) prometheusPort;
+    CHK_STATUS(Canary::createTelemetrySink(sinkConfig, telemetrySink));
+    DLOGI("Publishing metrics and logs to %s", Canary::getTelemetrySinkTypeName(sinkConfig.type));
+
+CleanUp:
+    return retStatus;
+}
 
 STATUS initializeCloudwatchLogger(PCloudwatchLogsObject pCloudwatchLogsObject) {
     STATUS retStatus = STATUS_SUCCESS;
-    CHK(pCloudwatchLogsObject != NULL, STATUS_NULL_ARG);
-    pCloudwatchLogsObject->canaryLogGroupRequest.SetLogGroupName(pCloudwatchLogsObject->logGroupName);
-    pCloudwatchLogsObject->pCwl->CreateLogGroup(pCloudwatchLogsObject->canaryLogGroupRequest);
-    pCloudwatchLogsObject->canaryLogStreamRequest.SetLogStreamName(pCloudwatchLogsObject->logStreamName);
-    pCloudwatchLogsObject->canaryLogStreamRequest.SetLogGroupName(pCloudwatchLogsObject->logGroupName);
-    pCloudwatchLogsObject->pCwl->CreateLogStream(pCloudwatchLogsObject->canaryLogStreamRequest);
+    CHK(pCloudwatchLogsObject != NULL && pCloudwatchLogsObject->pTelemetrySink != NULL, STATUS_NULL_ARG);
+    CHK_STATUS(pCloudwatchLogsObject->pTelemetrySink->openLogs());
     gCloudwatchLogsObject = pCloudwatchLogsObject;
 CleanUp:
     return retStatus;
@@ -24,51 +51,51 @@ VOID setUpLogEventVector(PCHAR logString) {
     auto logEvent = Aws::CloudWatchLogs::Model::InputLogEvent()
                    .WithMessage(awsCwString)
                    .WithTimestamp(GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    std::lock_guard<std::mutex> lock(gCloudwatchLogsObject->canaryInputLogEventLock);
     gCloudwatchLogsObject->canaryInputLogEventVec.push_back(logEvent);
 }
 
-VOID onPutLogEventResponseReceivedHandler(const Aws::CloudWatchLogs::CloudWatchLogsClient* cwClientLog,
-                                          const Aws::CloudWatchLogs::Model::PutLogEventsRequest& request,
-                                          const Aws::CloudWatchLogs::Model::PutLogEventsOutcome& outcome,
-                                          const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context) {
-    if (!outcome.IsSuccess()) {
-        DLOGE("Failed to push logs: %s", outcome.GetError().GetMessage().c_str());
-    }
-    else {
-        DLOGS("Successfully pushed logs to cloudwatch");
-        gCloudwatchLogsObject->token = outcome.GetResult().GetNextSequenceToken();
+BOOL canaryStreamAddLogEvent(PCHAR logString) {
+    if (gCloudwatchLogsObject == NULL) {
+        return FALSE;
     }
+    setUpLogEventVector(logString);
+    return TRUE;
+}
+
+static VOID addSuppressedLogSummaries() {
+    CHAR summary[MAX_LOG_FORMAT_LENGTH + 1];
+
+    gLogRateLimiter.takeSuppressed([&summary](PCHAR format, UINT64 count) {
+        SNPRINTF(summary, SIZEOF(summary), "%" PRIu64 " messages suppressed by the log rate limit: \"%.*s\"\n", count,
+                 CANARY_LOG_SUPPRESSION_FORMAT_LENGTH, format);
+        fputs(summary, stdout);
+        setUpLogEventVector(summary);
+    });
 }
 
 VOID canaryStreamSendLogs(PCloudwatchLogsObject pCloudwatchLogsObject) {
-    Aws::CloudWatchLogs::Model::PutLogEventsOutcome outcome;
-    auto request = Aws::CloudWatchLogs::Model::PutLogEventsRequest()
-                   .WithLogGroupName(pCloudwatchLogsObject->logGroupName)
-                   .WithLogStreamName(pCloudwatchLogsObject->logStreamName)
-                   .WithLogEvents(pCloudwatchLogsObject->canaryInputLogEventVec);
-    if (pCloudwatchLogsObject->token != "") {
-        request.SetSequenceToken(pCloudwatchLogsObject->token);
-    }
-    pCloudwatchLogsObject->pCwl->PutLogEventsAsync(request, onPutLogEventResponseReceivedHandler);
-    pCloudwatchLogsObject->canaryInputLogEventVec.clear();
+    Aws::Vector<InputLogEvent> events;
+    addSuppressedLogSummaries();
+    std::unique_lock<std::mutex> lock(pCloudwatchLogsObject->canaryInputLogEventLock);
+    events.swap(pCloudwatchLogsObject->canaryInputLogEventVec);
+    lock.unlock();
+    pCloudwatchLogsObject->pTelemetrySink->putLogs(std::move(events), [](Canary::TELEMETRY_SEND_RESULT result, Aws::Vector<InputLogEvent>&&) {
+        if (result == Canary::TELEMETRY_SEND_RESULT_SUCCESS) {
+            DLOGS("Successfully pushed logs");
+        }
+    });
 }
 
 VOID canaryStreamSendLogSync(PCloudwatchLogsObject pCloudwatchLogsObject) {
-    auto request = Aws::CloudWatchLogs::Model::PutLogEventsRequest()
-                   .WithLogGroupName(pCloudwatchLogsObject->logGroupName)
-                   .WithLogStreamName(pCloudwatchLogsObject->logStreamName)
-                   .WithLogEvents(pCloudwatchLogsObject->canaryInputLogEventVec);
-    if (pCloudwatchLogsObject->token != "") {
-       request.SetSequenceToken(pCloudwatchLogsObject->token);
+    Aws::Vector<InputLogEvent> events;
+    addSuppressedLogSummaries();
+    std::unique_lock<std::mutex> lock(pCloudwatchLogsObject->canaryInputLogEventLock);
+    events.swap(pCloudwatchLogsObject->canaryInputLogEventVec);
+    lock.unlock();
+    if (pCloudwatchLogsObject->pTelemetrySink->putLogsSync(std::move(events)) == Canary::TELEMETRY_SEND_RESULT_SUCCESS) {
+        DLOGS("Successfully pushed logs");
     }
-    auto outcome = pCloudwatchLogsObject->pCwl->PutLogEvents(request);
-    if (!outcome.IsSuccess()) {
-            DLOGE("Failed to push logs: %s", outcome.GetError().GetMessage().c_str());
-        }
-        else {
-            DLOGS("Successfully pushed logs to cloudwatch");
-        }
-    pCloudwatchLogsObject->canaryInputLogEventVec.clear();
 }
 
 
@@ -79,17 +106,15 @@ VOID cloudWatchLogger(UINT32 level, PCHAR tag, PCHAR fmt, ...)
     UINT32 logLevel = GET_LOGGER_LOG_LEVEL();
     UNUSED_PARAM(tag);
 
-    if (level >= logLevel) {
+    if (level >= logLevel && gLogRateLimiter.allow(level, fmt)) {
         addLogMetadata(logFmtString, (UINT32) ARRAY_SIZE(logFmtString), fmt, level);
 
-        // Creating a copy to store the logFmtString for cloudwatch logging purpose
-        va_list valist, valist_cw;
-        va_start(valist_cw, fmt);
-        vsnprintf(cwLogFmtString, (SIZE_T) SIZEOF(cwLogFmtString), logFmtString, valist_cw);
-        va_end(valist_cw);
+        // Formatted once, the same text goes to stdout and to cloudwatch
+        va_list valist;
         va_start(valist, fmt);
-        vprintf(logFmtString, valist);
+        vsnprintf(cwLogFmtString, (SIZE_T) SIZEOF(cwLogFmtString), logFmtString, valist);
         va_end(valist);
+        fputs(cwLogFmtString, stdout);
         setUpLogEventVector(cwLogFmtString);
     }
 }
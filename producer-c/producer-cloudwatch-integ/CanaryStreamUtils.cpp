@@ -4,7 +4,7 @@
 #define LOG_CLASS "CanaryStreamCallbacks"
 #include "CanaryStreamUtils.h"
 
-STATUS createCanaryStreamCallbacks(Aws::CloudWatch::CloudWatchClient* cwClient,
+STATUS createCanaryStreamCallbacks(Canary::TelemetrySink* pTelemetrySink,
                                    PCHAR pStreamName,
                                    PCanaryStreamCallbacks* ppCanaryStreamCallbacks)
 {
@@ -23,8 +23,12 @@ STATUS createCanaryStreamCallbacks(Aws::CloudWatch::CloudWatchClient* cwClient,
     pCanaryStreamCallbacks->streamCallbacks.version = STREAM_CALLBACKS_CURRENT_VERSION;
     pCanaryStreamCallbacks->streamCallbacks.customData = (UINT64) pCanaryStreamCallbacks;
     pCanaryStreamCallbacks->timeOfNextKeyFrame = new std::map<UINT64, UINT64>();
+    pCanaryStreamCallbacks->pBufferingAckLatency = new Canary::LatencyHistogram(CANARY_MAX_ACK_LATENCY);
+    pCanaryStreamCallbacks->pReceivedAckLatency = new Canary::LatencyHistogram(CANARY_MAX_ACK_LATENCY);
+    pCanaryStreamCallbacks->pPersistedAckLatency = new Canary::LatencyHistogram(CANARY_MAX_ACK_LATENCY);
+    pCanaryStreamCallbacks->ackLatencyTotals = new std::map<std::string, Canary::LatencyHistogram::Snapshot>();
 
-    pCanaryStreamCallbacks->pCwClient = cwClient;
+    pCanaryStreamCallbacks->pTelemetrySink = pTelemetrySink;
 
     dimension.SetName(pStreamName);
     dimension.SetValue("ProducerSDK");
@@ -41,6 +45,9 @@ STATUS createCanaryStreamCallbacks(Aws::CloudWatch::CloudWatchClient* cwClient,
     pCanaryStreamCallbacks->receivedAckDatum.AddDimensions(dimension);
     pCanaryStreamCallbacks->persistedAckDatum.AddDimensions(dimension);
     pCanaryStreamCallbacks->bufferingAckDatum.AddDimensions(dimension);
+    pCanaryStreamCallbacks->receivedAckDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
+    pCanaryStreamCallbacks->persistedAckDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
+    pCanaryStreamCallbacks->bufferingAckDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
     pCanaryStreamCallbacks->streamErrorDatum.AddDimensions(dimension);
     pCanaryStreamCallbacks->currentFrameRateDatum.AddDimensions(dimension);
     pCanaryStreamCallbacks->contentStoreAvailableSizeDatum.AddDimensions(dimension);
@@ -81,6 +88,13 @@ STATUS freeCanaryStreamCallbacks(PStreamCallbacks* ppStreamCallbacks)
     CHK(pCanaryStreamCallbacks != NULL, retStatus);
 
     delete(pCanaryStreamCallbacks->timeOfNextKeyFrame);
+    delete(pCanaryStreamCallbacks->pBufferingAckLatency);
+    delete(pCanaryStreamCallbacks->pReceivedAckLatency);
+    delete(pCanaryStreamCallbacks->pPersistedAckLatency);
+    delete(pCanaryStreamCallbacks->ackLatencyTotals);
+    if (pCanaryStreamCallbacks->pEmfFile != NULL) {
+        FCLOSE(pCanaryStreamCallbacks->pEmfFile);
+    }
     // Release the object
     MEMFREE(pCanaryStreamCallbacks);
 
@@ -133,19 +147,13 @@ STATUS canaryStreamFragmentAckHandler(UINT64 customData,
 
     switch (pFragmentAck->ackType) {
         case FRAGMENT_ACK_TYPE_BUFFERING:
-            pCanaryStreamCallbacks->bufferingAckDatum.SetValue((GETTIME() - timeOfFragmentEndSent) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
-            pCanaryStreamCallbacks->bufferingAckDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-            canaryStreamSendMetrics(pCanaryStreamCallbacks, pCanaryStreamCallbacks->bufferingAckDatum);
+            pCanaryStreamCallbacks->pBufferingAckLatency->record((GETTIME() - timeOfFragmentEndSent) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
             break;
         case FRAGMENT_ACK_TYPE_RECEIVED:
-            pCanaryStreamCallbacks->receivedAckDatum.SetValue((GETTIME() - timeOfFragmentEndSent) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
-            pCanaryStreamCallbacks->receivedAckDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-            canaryStreamSendMetrics(pCanaryStreamCallbacks, pCanaryStreamCallbacks->receivedAckDatum);
+            pCanaryStreamCallbacks->pReceivedAckLatency->record((GETTIME() - timeOfFragmentEndSent) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
             break;
         case FRAGMENT_ACK_TYPE_PERSISTED:
-            pCanaryStreamCallbacks->persistedAckDatum.SetValue((GETTIME() - timeOfFragmentEndSent) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
-            pCanaryStreamCallbacks->persistedAckDatum.SetUnit(Aws::CloudWatch::Model::StandardUnit::Milliseconds);
-            canaryStreamSendMetrics(pCanaryStreamCallbacks, pCanaryStreamCallbacks->persistedAckDatum);
+            pCanaryStreamCallbacks->pPersistedAckLatency->record((GETTIME() - timeOfFragmentEndSent) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
             pCanaryStreamCallbacks->timeOfNextKeyFrame->erase(pFragmentAck->timestamp);
             break;
         case FRAGMENT_ACK_TYPE_ERROR:
@@ -157,24 +165,141 @@ STATUS canaryStreamFragmentAckHandler(UINT64 customData,
     return STATUS_SUCCESS;
 }
 
-VOID onPutMetricDataResponseReceivedHandler(const Aws::CloudWatch::CloudWatchClient* cwClient,
-                                            const Aws::CloudWatch::Model::PutMetricDataRequest& request,
-                                            const Aws::CloudWatch::Model::PutMetricDataOutcome& outcome,
-                                            const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context) {
-    if (!outcome.IsSuccess()) {
-        DLOGE("Failed to put sample metric data: %s", outcome.GetError().GetMessage().c_str());
+STATUS canaryStreamInitMetricSink(PCanaryStreamCallbacks pCanaryStreamCallbacks, BOOL logStreamAvailable)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PCHAR pMetricSink, pPath;
+
+    CHK(pCanaryStreamCallbacks != NULL, STATUS_NULL_ARG);
+
+    pMetricSink = getenv(CANARY_METRIC_SINK_ENV_VAR);
+    if (pMetricSink != NULL && STRCMPI(pMetricSink, "emf") == 0) {
+        if (logStreamAvailable) {
+            pCanaryStreamCallbacks->metricSink = CANARY_METRIC_SINK_EMF;
+        } else {
+            DLOGW("EMF metrics need the cloudwatch log stream, fallback to PutMetricData");
+        }
+    } else if (pMetricSink != NULL && STRCMPI(pMetricSink, "emf-file") == 0) {
+        if ((pPath = getenv(CANARY_METRIC_SINK_PATH_ENV_VAR)) == NULL) {
+            pPath = CANARY_DEFAULT_EMF_FILE_PATH;
+        }
+        pCanaryStreamCallbacks->pEmfFile = FOPEN(pPath, "a");
+        CHK_ERR(pCanaryStreamCallbacks->pEmfFile != NULL, STATUS_OPEN_FILE_FAILED, "Failed to open %s for the metrics", pPath);
+        pCanaryStreamCallbacks->metricSink = CANARY_METRIC_SINK_EMF_FILE;
     }
-    else {
-        DLOGS("Successfully put sample metric data");
+
+CleanUp:
+
+    return retStatus;
+}
+
+// Every metric goes out through here, either to the telemetry sink or as EMF records
+static VOID canaryStreamPutMetricData(PCanaryStreamCallbacks pCanaryStreamCallbacks, Aws::CloudWatch::Model::PutMetricDataRequest& cwRequest,
+                                      BOOL synchronous)
+{
+    std::vector<std::string> records;
+
+    if (pCanaryStreamCallbacks->metricSink == CANARY_METRIC_SINK_CLOUDWATCH) {
+        // The sink reports failures itself
+        auto datums = cwRequest.GetMetricData();
+        if (synchronous) {
+            pCanaryStreamCallbacks->pTelemetrySink->putMetricsSync(std::move(datums));
+        } else {
+            pCanaryStreamCallbacks->pTelemetrySink->putMetrics(std::move(datums), [](Canary::TELEMETRY_SEND_RESULT result) { UNUSED_PARAM(result); });
+        }
+        return;
+    }
+
+    // Appending is synchronous either way, the records go out with the logs
+    Canary::serializeEmfRecords(CANARY_METRIC_NAMESPACE, GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, cwRequest.GetMetricData(), records);
+    for (auto& record : records) {
+        if (pCanaryStreamCallbacks->metricSink == CANARY_METRIC_SINK_EMF) {
+            canaryStreamAddLogEvent((PCHAR) record.c_str());
+        } else {
+            fputs(record.c_str(), pCanaryStreamCallbacks->pEmfFile);
+            fputc('\n', pCanaryStreamCallbacks->pEmfFile);
+        }
+    }
+    if (pCanaryStreamCallbacks->pEmfFile != NULL) {
+        fflush(pCanaryStreamCallbacks->pEmfFile);
     }
 }
 
 VOID canaryStreamSendMetrics(PCanaryStreamCallbacks pCanaryStreamCallbacks, Aws::CloudWatch::Model::MetricDatum& metricDatum)
 {
     Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
-    cwRequest.SetNamespace("KinesisVideoSDKCanary");
     cwRequest.AddMetricData(metricDatum);
-    pCanaryStreamCallbacks->pCwClient->PutMetricDataAsync(cwRequest, onPutMetricDataResponseReceivedHandler);
+    canaryStreamPutMetricData(pCanaryStreamCallbacks, cwRequest, FALSE);
+}
+
+static VOID addLatencyPercentiles(Aws::CloudWatch::Model::PutMetricDataRequest& cwRequest, const Aws::CloudWatch::Model::MetricDatum& identityDatum,
+                                  const Aws::CloudWatch::Model::Dimension* pExtraDimension, const Canary::LatencyHistogram::Snapshot& snapshot)
+{
+    Aws::CloudWatch::Model::MetricDatum metricDatum;
+    Aws::CloudWatch::Model::Dimension percentileDimension;
+    UINT32 i;
+
+    if (snapshot.getCount() == 0) {
+        return;
+    }
+
+    percentileDimension.SetName("Percentile");
+    for (i = 0; i < EXPORTED_LATENCY_PERCENTILE_COUNT; i++) {
+        percentileDimension.SetValue(Canary::EXPORTED_LATENCY_PERCENTILES[i].label);
+        metricDatum = identityDatum;
+        metricDatum.SetValue(snapshot.getPercentile(Canary::EXPORTED_LATENCY_PERCENTILES[i].percentile));
+        metricDatum.AddDimensions(percentileDimension);
+        if (pExtraDimension != NULL) {
+            metricDatum.AddDimensions(*pExtraDimension);
+        }
+        cwRequest.AddMetricData(metricDatum);
+    }
+}
+
+VOID canaryStreamSendAckLatencyPercentiles(PCanaryStreamCallbacks pCanaryStreamCallbacks)
+{
+    Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
+    auto& totals = *pCanaryStreamCallbacks->ackLatencyTotals;
+    auto addAckLatency = [&](Aws::CloudWatch::Model::MetricDatum& metricDatum, Canary::LatencyHistogram* pLatency) {
+        auto snapshot = pLatency->takeSnapshot();
+        addLatencyPercentiles(cwRequest, metricDatum, NULL, snapshot);
+        totals[metricDatum.GetMetricName()].merge(snapshot);
+    };
+
+    addAckLatency(pCanaryStreamCallbacks->bufferingAckDatum, pCanaryStreamCallbacks->pBufferingAckLatency);
+    addAckLatency(pCanaryStreamCallbacks->receivedAckDatum, pCanaryStreamCallbacks->pReceivedAckLatency);
+    addAckLatency(pCanaryStreamCallbacks->persistedAckDatum, pCanaryStreamCallbacks->pPersistedAckLatency);
+
+    // A single request carries the percentiles of every ack type
+    if (!cwRequest.GetMetricData().empty()) {
+        canaryStreamPutMetricData(pCanaryStreamCallbacks, cwRequest, FALSE);
+    }
+}
+
+VOID canaryStreamSendAckLatencySummary(PCanaryStreamCallbacks pCanaryStreamCallbacks)
+{
+    Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
+    Aws::CloudWatch::Model::Dimension scopeDimension;
+    auto& totals = *pCanaryStreamCallbacks->ackLatencyTotals;
+    auto addAckLatencySummary = [&](Aws::CloudWatch::Model::MetricDatum& metricDatum) {
+        auto& total = totals[metricDatum.GetMetricName()];
+        DLOGI("%s over the whole run (ms): %s", metricDatum.GetMetricName().c_str(), total.toString().c_str());
+        addLatencyPercentiles(cwRequest, metricDatum, &scopeDimension, total);
+    };
+
+    // Whatever was recorded since the last period is part of the summary as well
+    canaryStreamSendAckLatencyPercentiles(pCanaryStreamCallbacks);
+
+    scopeDimension.SetName("Scope");
+    scopeDimension.SetValue("Run");
+    addAckLatencySummary(pCanaryStreamCallbacks->bufferingAckDatum);
+    addAckLatencySummary(pCanaryStreamCallbacks->receivedAckDatum);
+    addAckLatencySummary(pCanaryStreamCallbacks->persistedAckDatum);
+
+    // The SDK is shut down right after the summary, so it's sent synchronously
+    if (!cwRequest.GetMetricData().empty()) {
+        canaryStreamPutMetricData(pCanaryStreamCallbacks, cwRequest, TRUE);
+    }
 }
 
 STATUS computeStreamMetricsFromCanary(STREAM_HANDLE streamHandle, PCanaryStreamCallbacks pCanaryStreamCallbacks) {
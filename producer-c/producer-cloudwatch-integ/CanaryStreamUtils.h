@@ -4,6 +4,8 @@
 #pragma once
 
 #include <com/amazonaws/kinesis/video/cproducer/Include.h>
+#include <mutex>
+
 #include <aws/core/Aws.h>
 #include <aws/monitoring/CloudWatchClient.h>
 #include <aws/monitoring/model/PutMetricDataRequest.h>
@@ -14,6 +16,11 @@
 #include <aws/logs/model/DeleteLogStreamRequest.h>
 #include <aws/logs/model/DescribeLogStreamsRequest.h>
 
+#include "LatencyHistogram.h"
+#include "LogRateLimiter.h"
+#include "EmbeddedMetricFormat.h"
+#include "TelemetrySink.h"
+
 #ifdef  __cplusplus
 extern "C" {
 #endif
@@ -31,6 +38,29 @@ extern "C" {
 #define CANARY_FILE_LOGGING_BUFFER_SIZE     (200 * 1024)
 #define CANARY_MAX_NUMBER_OF_LOG_FILES      10
 #define CANARY_APP_FILE_LOGGER              (PCHAR) "ENABLE_FILE_LOGGER"
+
+// Ack latencies are in milliseconds, anything slower is recorded as this value
+#define CANARY_MAX_ACK_LATENCY              (10 * 60 * 1000)
+#define CANARY_LATENCY_EXPORT_PERIOD        (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+
+// Every log call site up to info level may log CANARY_LOG_RATE_LIMIT messages per second after a burst of
+// CANARY_LOG_RATE_LIMIT_BURST, the suppressed ones are summarized whenever the logs are sent
+#define CANARY_LOG_RATE_LIMIT               10
+#define CANARY_LOG_RATE_LIMIT_BURST         50
+#define CANARY_LOG_SUPPRESSION_FORMAT_LENGTH 80
+
+// "cloudwatch" (default) sends PutMetricData requests, "emf" appends Embedded Metric Format records to the canary log
+// stream and "emf-file" appends them to CANARY_METRIC_SINK_PATH
+#define CANARY_METRIC_SINK_ENV_VAR          (PCHAR) "CANARY_METRIC_SINK"
+#define CANARY_METRIC_SINK_PATH_ENV_VAR     (PCHAR) "CANARY_METRIC_SINK_PATH"
+#define CANARY_DEFAULT_EMF_FILE_PATH        (PCHAR) "./canary-metrics.emf"
+#define CANARY_METRIC_NAMESPACE             "KinesisVideoSDKCanary"
+
+// "cloudwatch" (default), "file" appends newline delimited JSON to CANARY_TELEMETRY_SINK_PATH and "prometheus" serves
+// the metrics on CANARY_PROMETHEUS_PORT, see canary-common/TelemetrySink.h
+#define CANARY_TELEMETRY_SINK_ENV_VAR       (PCHAR) "CANARY_TELEMETRY_SINK"
+#define CANARY_TELEMETRY_SINK_PATH_ENV_VAR  (PCHAR) "CANARY_TELEMETRY_SINK_PATH"
+#define CANARY_PROMETHEUS_PORT_ENV_VAR      (PCHAR) "CANARY_PROMETHEUS_PORT"
 struct __CallbackStateMachine;
 struct __CallbacksProvider;
 
@@ -45,15 +75,18 @@ using namespace std;
 // Struct definition
 ////////////////////////////////////////////////////////////////////////
 
+typedef enum {
+    CANARY_METRIC_SINK_CLOUDWATCH,
+    CANARY_METRIC_SINK_EMF,
+    CANARY_METRIC_SINK_EMF_FILE,
+} CANARY_METRIC_SINK;
+
 typedef struct __CloudwatchLogsObject CloudwatchLogsObject;
 struct __CloudwatchLogsObject {
-    CloudWatchLogsClient* pCwl;
-    CreateLogGroupRequest canaryLogGroupRequest;
-    CreateLogStreamRequest canaryLogStreamRequest;
-    PutLogEventsRequest canaryPutLogEventRequest;
-    PutLogEventsResult canaryPutLogEventresult;
+    Canary::TelemetrySink* pTelemetrySink;
     Aws::Vector<InputLogEvent> canaryInputLogEventVec;
-    Aws::String token;
+    // The logger and the metric callbacks append to canaryInputLogEventVec from different threads
+    std::mutex canaryInputLogEventLock;
     CHAR logGroupName[MAX_STREAM_NAME_LEN + 1];
     CHAR logStreamName[MAX_STREAM_NAME_LEN + 1];
 };
@@ -64,7 +97,7 @@ struct __CanaryStreamCallbacks {
     // First member should be the stream callbacks
     StreamCallbacks streamCallbacks;
     PCHAR pStreamName;
-    CloudWatchClient* pCwClient;
+    Canary::TelemetrySink* pTelemetrySink;
     PutMetricDataRequest* cwRequest;
     MetricDatum receivedAckDatum;
     MetricDatum persistedAckDatum;
@@ -75,19 +108,31 @@ struct __CanaryStreamCallbacks {
     MetricDatum contentStoreAvailableSizeDatum;
     MetricDatum memoryAllocationSizeDatum;
     map<UINT64, UINT64>* timeOfNextKeyFrame;
+    // Ack latencies are recorded from the ack callback and published as percentiles periodically
+    Canary::LatencyHistogram* pBufferingAckLatency;
+    Canary::LatencyHistogram* pReceivedAckLatency;
+    Canary::LatencyHistogram* pPersistedAckLatency;
+    // Published ack latencies of the whole run keyed by the metric name
+    map<string, Canary::LatencyHistogram::Snapshot>* ackLatencyTotals;
+    CANARY_METRIC_SINK metricSink;
+    // Open while metricSink is CANARY_METRIC_SINK_EMF_FILE
+    FILE* pEmfFile;
 };
 typedef struct __CanaryStreamCallbacks* PCanaryStreamCallbacks;
 
 ////////////////////////////////////////////////////////////////////////
 // Callback function implementations
 ////////////////////////////////////////////////////////////////////////
-STATUS createCanaryStreamCallbacks(Aws::CloudWatch::CloudWatchClient*, PCHAR, PCanaryStreamCallbacks*);
+STATUS createCanaryStreamCallbacks(Canary::TelemetrySink*, PCHAR, PCanaryStreamCallbacks*);
 STATUS freeCanaryStreamCallbacks(PStreamCallbacks*);
 STATUS canaryStreamFragmentAckHandler(UINT64, STREAM_HANDLE, UPLOAD_HANDLE, PFragmentAck);
 STATUS canaryStreamErrorReportHandler(UINT64, STREAM_HANDLE, UPLOAD_HANDLE, UINT64, STATUS);
 STATUS canaryStreamFreeHandler(PUINT64);
+STATUS canaryStreamInitMetricSink(PCanaryStreamCallbacks, BOOL);
 VOID canaryStreamSendMetrics(PCanaryStreamCallbacks, Aws::CloudWatch::Model::MetricDatum&);
 VOID canaryStreamRecordFragmentEndSendTime(PCanaryStreamCallbacks, UINT64, UINT64);
+VOID canaryStreamSendAckLatencyPercentiles(PCanaryStreamCallbacks);
+VOID canaryStreamSendAckLatencySummary(PCanaryStreamCallbacks);
 STATUS computeStreamMetricsFromCanary(STREAM_HANDLE, PCanaryStreamCallbacks);
 STATUS computeClientMetricsFromCanary(CLIENT_HANDLE, PCanaryStreamCallbacks);
 VOID currentMemoryAllocation(PCanaryStreamCallbacks);
@@ -97,8 +142,10 @@ VOID currentMemoryAllocation(PCanaryStreamCallbacks);
 ////////////////////////////////////////////////////////////////////////
 VOID cloudWatchLogger(UINT32, PCHAR, PCHAR, ...);
 STATUS initializeCloudwatchLogger(PCloudwatchLogsObject);
+STATUS canaryCreateTelemetrySink(const Aws::Client::ClientConfiguration&, PCHAR, PCHAR, std::unique_ptr<Canary::TelemetrySink>&);
 VOID canaryStreamSendLogs(PCloudwatchLogsObject);
 VOID canaryStreamSendLogSync(PCloudwatchLogsObject);
+BOOL canaryStreamAddLogEvent(PCHAR);
 
 #ifdef  __cplusplus
 }
@@ -75,7 +75,7 @@ INT32 main(INT32 argc, CHAR *argv[])
     UINT64 lastKeyFrameTimestamp = 0;
     CloudwatchLogsObject cloudwatchLogsObject;
     PCanaryStreamCallbacks pCanaryStreamCallbacks = NULL;
-    UINT64 currentTime;
+    UINT64 currentTime, latencyExportTime;
     BOOL cleanUpDone = FALSE;
     BOOL fileLoggingEnabled = FALSE;
 
@@ -116,13 +116,14 @@ INT32 main(INT32 argc, CHAR *argv[])
 
         ClientConfiguration clientConfiguration;
         clientConfiguration.region = region;
-        CloudWatchClient cw(clientConfiguration);
-
-        CloudWatchLogsClient cwl(clientConfiguration);
 
         STRCPY(cloudwatchLogsObject.logGroupName, "ProducerSDK");
         SNPRINTF(cloudwatchLogsObject.logStreamName, MAX_STREAM_NAME_LEN + 5, "%s-log", streamName);
-        cloudwatchLogsObject.pCwl = &cwl;
+
+        // Has to go before the SDK shuts down, like the clients it may hold
+        std::unique_ptr<Canary::TelemetrySink> telemetrySink;
+        CHK_STATUS(canaryCreateTelemetrySink(clientConfiguration, cloudwatchLogsObject.logGroupName, cloudwatchLogsObject.logStreamName, telemetrySink));
+        cloudwatchLogsObject.pTelemetrySink = telemetrySink.get();
         if((retStatus = initializeCloudwatchLogger(&cloudwatchLogsObject)) != STATUS_SUCCESS) {
             DLOGW("Cloudwatch logger failed to be initialized with 0x%08x error code. Fallback to file logging", retStatus);
             fileLoggingEnabled = TRUE;
@@ -162,7 +163,8 @@ INT32 main(INT32 argc, CHAR *argv[])
             }
         }
 
-        CHK_STATUS(createCanaryStreamCallbacks(&cw, streamName, &pCanaryStreamCallbacks));
+        CHK_STATUS(createCanaryStreamCallbacks(telemetrySink.get(), streamName, &pCanaryStreamCallbacks));
+        CHK_STATUS(canaryStreamInitMetricSink(pCanaryStreamCallbacks, !fileLoggingEnabled));
         CHK_STATUS(addStreamCallbacks(pClientCallbacks, &pCanaryStreamCallbacks->streamCallbacks));
 
         if(!fileLoggingEnabled) {
@@ -181,6 +183,7 @@ INT32 main(INT32 argc, CHAR *argv[])
         frame.decodingTs = GETTIME(); // current time
         frame.presentationTs = frame.decodingTs;
         currentTime = GETTIME();
+        latencyExportTime = currentTime;
         while (ATOMIC_LOAD_BOOL(&sigCaptureInterrupt) != TRUE) {
             if (frameIndex < 0) {
                 frameIndex = 0;
@@ -195,6 +198,10 @@ INT32 main(INT32 argc, CHAR *argv[])
                     CHK_STATUS(computeStreamMetricsFromCanary(streamHandle, pCanaryStreamCallbacks));
                     CHK_STATUS(computeClientMetricsFromCanary(clientHandle, pCanaryStreamCallbacks));
                     currentMemoryAllocation(pCanaryStreamCallbacks);
+                    if (GETTIME() > latencyExportTime + CANARY_LATENCY_EXPORT_PERIOD) {
+                        canaryStreamSendAckLatencyPercentiles(pCanaryStreamCallbacks);
+                        latencyExportTime = GETTIME();
+                    }
                     if((!fileLoggingEnabled) && (GETTIME() > currentTime + (60 * HUNDREDS_OF_NANOS_IN_A_SECOND))) {
                         canaryStreamSendLogs(&cloudwatchLogsObject);
                         currentTime = GETTIME();
@@ -217,6 +224,8 @@ INT32 main(INT32 argc, CHAR *argv[])
         freeStreamInfoProvider(&pStreamInfo);
         freeKinesisVideoStream(&streamHandle);
         freeKinesisVideoClient(&clientHandle);
+        // The stream is gone, so no more acks can come in
+        canaryStreamSendAckLatencySummary(pCanaryStreamCallbacks);
         freeCallbacksProvider(&pClientCallbacks); // This will also take care of freeing canaryStreamCallbacks
         RESET_INSTRUMENTED_ALLOCATORS();
         DLOGI("CleanUp Done");
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * On-disk layout of the packed canary media samples. All fields are stored in the host byte order since the pack
+ * is generated at build time by kvsWebrtcCanaryAssetPacker on the same machine that runs the canary.
+ *
+ * +-----------------+
+ * | AssetPackHeader |
+ * +-----------------+
+ * | AssetPackTrack  | x trackCount
+ * +-----------------+
+ * | AssetPackFrame  | x frameCount, grouped by track and ordered by presentation time
+ * +-----------------+
+ * | payloads        | each payload starts at a multiple of ASSET_PACK_PAYLOAD_ALIGNMENT
+ * +-----------------+
+ */
+
+#define ASSET_PACK_MAGIC             "KVSA"
+#define ASSET_PACK_CURRENT_VERSION   1
+#define ASSET_PACK_PAYLOAD_ALIGNMENT 64
+
+#define ASSET_PACK_TRACK_KIND_VIDEO 1
+#define ASSET_PACK_TRACK_KIND_AUDIO 2
+
+#define ASSET_PACK_CODEC_H264 1
+#define ASSET_PACK_CODEC_OPUS 2
+
+#define ASSET_PACK_FRAME_FLAG_KEY_FRAME (1 << 0)
+
+typedef struct {
+    CHAR magic[4];
+    UINT32 version;
+    UINT32 trackCount;
+    UINT32 frameCount;
+    // Offset of the first payload byte from the beginning of the file
+    UINT64 payloadOffset;
+} AssetPackHeader, *PAssetPackHeader;
+
+typedef struct {
+    UINT32 kind;
+    UINT32 codec;
+    // Nominal bitrate of the encoded samples in kbps, 0 when unknown
+    UINT32 bitrate;
+    // Index of the first frame of this track in the frame index
+    UINT32 firstFrame;
+    UINT32 frameCount;
+    UINT32 reserved;
+} AssetPackTrack, *PAssetPackTrack;
+
+typedef struct {
+    // Payload offset from the beginning of the file
+    UINT64 offset;
+    // Frame duration in 100ns
+    UINT64 duration;
+    UINT32 size;
+    UINT32 track;
+    UINT32 flags;
+    UINT32 reserved;
+} AssetPackFrame, *PAssetPackFrame;
+
+static_assert(SIZEOF(AssetPackHeader) == 24, "AssetPackHeader layout changed");
+static_assert(SIZEOF(AssetPackTrack) == 24, "AssetPackTrack layout changed");
+static_assert(SIZEOF(AssetPackFrame) == 32, "AssetPackFrame layout changed");
@@ -2,8 +2,7 @@
 
 namespace Canary {
 
-Cloudwatch::Cloudwatch(Canary::PConfig pConfig, ClientConfiguration* pClientConfig)
-    : logs(pConfig, pClientConfig), monitoring(pConfig, pClientConfig), terminated(FALSE), useFileLogger(FALSE)
+Cloudwatch::Cloudwatch(Canary::PConfig pConfig) : logs(pConfig), monitoring(pConfig), terminated(FALSE), useFileLogger(FALSE)
 {
 }
 
@@ -11,24 +10,36 @@ STATUS Cloudwatch::init(Canary::PConfig pConfig)
 {
     ENTERS();
     STATUS retStatus = STATUS_SUCCESS;
-    ClientConfiguration clientConfig;
-    CreateLogGroupRequest createLogGroupRequest;
-    Aws::CloudWatchLogs::Model::CreateLogStreamOutcome createLogStreamOutcome;
-    CreateLogStreamRequest createLogStreamRequest;
-
-    clientConfig.region = pConfig->pRegion;
-    auto& instance = getInstanceImpl(pConfig, &clientConfig);
-
-    if (STATUS_FAILED(instance.logs.init())) {
+    TelemetrySinkConfig sinkConfig;
+
+    auto& instance = getInstanceImpl(pConfig);
+
+    sinkConfig.type = pConfig->telemetrySink;
+    sinkConfig.metricNamespace = DEFAULT_CLOUDWATCH_NAMESPACE;
+    sinkConfig.clientConfig.region = pConfig->pRegion;
+    // Every request has to complete before Aws::ShutdownAPI, the timeouts bound how long the exit waits for them
+    sinkConfig.clientConfig.connectTimeoutMs = TELEMETRY_CONNECT_TIMEOUT_MS;
+    sinkConfig.clientConfig.requestTimeoutMs = TELEMETRY_REQUEST_TIMEOUT_MS;
+    sinkConfig.logGroupName = pConfig->pLogGroupName;
+    sinkConfig.logStreamName = pConfig->pLogStreamName;
+    sinkConfig.filePath = pConfig->pTelemetrySinkPath;
+    sinkConfig.prometheusPort = pConfig->prometheusPort;
+    CHK_STATUS(createTelemetrySink(sinkConfig, instance.sink));
+
+    if (STATUS_FAILED(instance.logs.init(instance.sink.get()))) {
         DLOGW("Failed to create Cloudwatch logger, fallback to file logger");
         CHK_STATUS(createFileLogger(DEFAULT_FILE_LOGGING_BUFFER_SIZE, MAX_FILE_LOGGER_LOG_FILE_COUNT, (PCHAR) FILE_LOGGER_LOG_FILE_DIRECTORY_PATH,
                                     TRUE, TRUE, NULL));
         instance.useFileLogger = TRUE;
+        if (pConfig->metricSink == METRIC_SINK_EMF) {
+            DLOGW("EMF metrics need the CloudWatch log stream, fallback to PutMetricData");
+            pConfig->metricSink = METRIC_SINK_CLOUDWATCH;
+        }
     } else {
         globalCustomLogPrintFn = logger;
     }
 
-    CHK_STATUS(instance.monitoring.init());
+    CHK_STATUS(instance.monitoring.init(instance.sink.get()));
 
 CleanUp:
 
@@ -41,47 +52,55 @@ Cloudwatch& Cloudwatch::getInstance()
     return getInstanceImpl();
 }
 
-Cloudwatch& Cloudwatch::getInstanceImpl(Canary::PConfig pConfig, ClientConfiguration* pClientConfig)
+Cloudwatch& Cloudwatch::getInstanceImpl(Canary::PConfig pConfig)
 {
-    static Cloudwatch instance{pConfig, pClientConfig};
+    static Cloudwatch instance{pConfig};
     return instance;
 }
 
 VOID Cloudwatch::deinit()
 {
     auto& instance = getInstance();
+
+    // Metrics go first, with the EMF sink their last records still have to make it into the log stream
+    if (!instance.useFileLogger) {
+        instance.logs.reportStats();
+    }
+    instance.monitoring.deinit();
+
     if (instance.useFileLogger) {
         freeFileLogger();
     } else {
+        // Anything logged from here on is printed right away, the flush thread is about to exit
+        instance.terminated = TRUE;
         instance.logs.deinit();
     }
-    instance.monitoring.deinit();
     instance.terminated = TRUE;
 }
 
 VOID Cloudwatch::logger(UINT32 level, PCHAR tag, PCHAR fmt, ...)
 {
     CHAR logFmtString[MAX_LOG_FORMAT_LENGTH + 1];
-    CHAR cwLogFmtString[MAX_LOG_FORMAT_LENGTH + 1];
     UINT32 logLevel = GET_LOGGER_LOG_LEVEL();
+    va_list valist;
     UNUSED_PARAM(tag);
 
     if (level >= logLevel) {
-        addLogMetadata(logFmtString, (UINT32) ARRAY_SIZE(logFmtString), fmt, level);
+        auto& instance = getInstance();
 
-        // Creating a copy to store the logFmtString for cloudwatch logging purpose
-        va_list valist, valist_cw;
-        va_start(valist_cw, fmt);
-        vsnprintf(cwLogFmtString, (SIZE_T) SIZEOF(cwLogFmtString), logFmtString, valist_cw);
-        va_end(valist_cw);
-        va_start(valist, fmt);
-        vprintf(logFmtString, valist);
-        va_end(valist);
+        if (!instance.logs.rateLimiter.allow(level, fmt)) {
+            return;
+        }
 
-        auto& instance = getInstance();
+        va_start(valist, fmt);
         if (!instance.terminated) {
-            instance.logs.push(cwLogFmtString);
+            // Formatting is deferred to the log flush thread, which prints the same text that goes to CloudWatch
+            instance.logs.push(level, fmt, valist);
+        } else {
+            addLogMetadata(logFmtString, (UINT32) ARRAY_SIZE(logFmtString), fmt, level);
+            vprintf(logFmtString, valist);
         }
+        va_end(valist);
     }
 }
 
@@ -8,6 +8,8 @@ class Cloudwatch {
     Cloudwatch(Cloudwatch const&) = delete;
     void operator=(Cloudwatch const&) = delete;
 
+    // Outlives logs and monitoring, both of them publish through it
+    std::unique_ptr<TelemetrySink> sink;
     CloudwatchLogs logs;
     CloudwatchMonitoring monitoring;
 
@@ -17,9 +19,9 @@ class Cloudwatch {
     static VOID logger(UINT32, PCHAR, PCHAR, ...);
 
   private:
-    static Cloudwatch& getInstanceImpl(Canary::PConfig = nullptr, ClientConfiguration* = nullptr);
+    static Cloudwatch& getInstanceImpl(Canary::PConfig = nullptr);
 
-    Cloudwatch(Canary::PConfig, ClientConfiguration*);
+    Cloudwatch(Canary::PConfig);
     BOOL terminated;
     BOOL useFileLogger;
 };
@@ -2,28 +2,71 @@
 
 namespace Canary {
 
-CloudwatchLogs::CloudwatchLogs(PConfig pConfig, ClientConfiguration* pClientConfig) : pConfig(pConfig), client(*pClientConfig)
+CloudwatchLogs::LogBatch::LogBatch() : size(0), startTime(0)
 {
 }
 
-STATUS CloudwatchLogs::init()
+CloudwatchLogs::CloudwatchLogs(PConfig pConfig)
+    : rateLimiter(LOG_RATE_LIMIT, LOG_RATE_LIMIT_BURST, LOG_LEVEL_INFO), pConfig(pConfig), pSink(NULL), ring(new LogSlot[LOG_RING_CAPACITY]), enqueuePosition(0), dequeuePosition(0), droppedLogs(0),
+      truncatedLogs(0), lastTimestamp(0), lastSuppressionReport(GETTIME()), terminated(FALSE), sendPending(FALSE), sendStartTime(0), sendCompleted(FALSE),
+      sendResult(TELEMETRY_SEND_RESULT_SUCCESS), streamReady(FALSE), retryTime(0), inFlightFromSpool(FALSE), inFlightSpoolEnd({0, 0}), batchEvents(MAX_CLOUDWATCH_LOG_COUNT),
+      batchSize(MAX_CLOUDWATCH_LOG_BATCH_SIZE), flushLatency(MAX_TRACKED_LATENCY)
+{
+    UINT32 i;
+
+    for (i = 0; i < LOG_RING_CAPACITY; i++) {
+        this->ring[i].sequence = i;
+    }
+}
+
+std::string CloudwatchLogs::getSpoolPath(PConfig pConfig)
+{
+    std::string path = DEFAULT_LOG_SPOOL_PATH "-";
+    std::string name = std::string(pConfig->pLogGroupName) + "-" + pConfig->pLogStreamName;
+
+    // Log group names may contain slashes
+    for (auto c : name) {
+        path += isalnum((UINT8) c) || c == '-' || c == '_' || c == '.' ? c : '_';
+    }
+
+    return path;
+}
+
+STATUS CloudwatchLogs::init(TelemetrySink* pSink)
 {
     STATUS retStatus = STATUS_SUCCESS;
-    CreateLogGroupRequest createLogGroupRequest;
-    Aws::CloudWatchLogs::Model::CreateLogStreamOutcome createLogStreamOutcome;
-    CreateLogStreamRequest createLogStreamRequest;
 
-    createLogGroupRequest.SetLogGroupName(pConfig->pLogGroupName);
-    // ignore error since if this operation fails, CreateLogStream should fail as well.
-    // There might be some errors that can lead to successfull CreateLogStream, e.g. log group already exists.
-    this->client.CreateLogGroup(createLogGroupRequest);
+    CHK(pSink != NULL, STATUS_NULL_ARG);
+    this->pSink = pSink;
+
+    this->spoolPath = getSpoolPath(this->pConfig);
+    if (STATUS_FAILED(this->spool.open(this->spoolPath))) {
+        DLOGW("Failed to open the log spool in %s, logs that can't be delivered are lost", this->spoolPath.c_str());
+    } else if (!this->spool.isEmpty()) {
+        DLOGI("Replaying %" PRIu64 " log events that a previous run couldn't deliver", this->spool.getEventCount());
+    }
 
-    createLogStreamRequest.SetLogGroupName(pConfig->pLogGroupName);
-    createLogStreamRequest.SetLogStreamName(pConfig->pLogStreamName);
-    createLogStreamOutcome = this->client.CreateLogStream(createLogStreamRequest);
+    if (STATUS_FAILED(retStatus = this->connect())) {
+        // Without a spool there's nowhere to keep the logs until CloudWatch is back
+        CHK(this->spool.isOpen(), retStatus);
+        DLOGW("Spooling logs to %s until the log stream can be created", this->spoolPath.c_str());
+        this->retryTime = GETTIME() + LOG_SPOOL_RETRY_PERIOD;
+        retStatus = STATUS_SUCCESS;
+    }
 
-    CHK_ERR(createLogStreamOutcome.IsSuccess(), STATUS_INVALID_OPERATION, "Failed to create \"%s\" log stream: %s", pConfig->pLogStreamName,
-            createLogStreamOutcome.GetError().GetMessage().c_str());
+    this->flushThread = std::thread(&CloudwatchLogs::runFlushThread, this);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS CloudwatchLogs::connect()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK_STATUS(this->pSink->openLogs());
+    this->streamReady = TRUE;
 
 CleanUp:
 
@@ -32,78 +75,339 @@ CleanUp:
 
 VOID CloudwatchLogs::deinit()
 {
-    this->flush(TRUE);
+    {
+        std::lock_guard<std::mutex> lock(this->flushMutex);
+        this->terminated = TRUE;
+    }
+    this->flushCvar.notify_all();
+
+    // The flush thread ships whatever is left before it exits
+    if (this->flushThread.joinable()) {
+        this->flushThread.join();
+    }
 }
 
-VOID CloudwatchLogs::push(string log)
+VOID CloudwatchLogs::push(UINT32 level, PCHAR format, va_list args)
 {
-    std::lock_guard<std::recursive_mutex> lock(this->sync.mutex);
-    Aws::String awsCwString(log.c_str(), log.size());
-    auto logEvent =
-        Aws::CloudWatchLogs::Model::InputLogEvent().WithMessage(awsCwString).WithTimestamp(GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
-    this->logs.push_back(logEvent);
+    UINT64 position = this->enqueuePosition.load(std::memory_order_relaxed), sequence;
+    LogSlot* pSlot;
+
+    // Bounded multi producer ring: a slot is free for the producer whose position matches its sequence, the flush
+    // thread hands it back one lap later
+    while (TRUE) {
+        pSlot = &this->ring[position & (LOG_RING_CAPACITY - 1)];
+        sequence = pSlot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (this->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            // The flush thread is a whole lap behind, i.e. the ring is full
+            this->droppedLogs++;
+            return;
+        } else {
+            position = this->enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
 
-    if (this->logs.size() >= MAX_CLOUDWATCH_LOG_COUNT) {
-        this->flush();
+    // Only the arguments are captured here, the text is rendered by the flush thread
+    pSlot->size = encodeLogRecord(pSlot->record, SIZEOF(pSlot->record), level, format, args);
+    if (isLogRecordTruncated(pSlot->record)) {
+        this->truncatedLogs++;
+    }
+    pSlot->sequence.store(position + 1, std::memory_order_release);
+
+    // Only the logger that reaches the threshold wakes up the flush thread, the others are picked up by the timer
+    if (position + 1 - this->dequeuePosition.load(std::memory_order_relaxed) == LOG_RING_DRAIN_THRESHOLD) {
+        this->flushCvar.notify_one();
     }
 }
 
-VOID CloudwatchLogs::flush(BOOL sync)
+VOID CloudwatchLogs::pushEvent(const std::string& event)
 {
-    std::unique_lock<std::recursive_mutex> lock(this->sync.mutex);
-    if (this->logs.size() == 0) {
+    std::lock_guard<std::mutex> lock(this->pendingEventsMutex);
+    if (this->pendingEvents.size() >= MAX_PENDING_LOG_EVENTS) {
+        this->droppedLogs++;
         return;
     }
+    this->pendingEvents.push_back(event);
+}
+
+VOID CloudwatchLogs::runFlushThread()
+{
+    BOOL terminated;
+
+    while (TRUE) {
+        {
+            std::unique_lock<std::mutex> lock(this->flushMutex);
+            this->flushCvar.wait_for(lock, std::chrono::milliseconds(LOG_DRAIN_PERIOD / HUNDREDS_OF_NANOS_IN_A_MILLISECOND), [this]() {
+                return this->terminated || this->sendCompleted ||
+                    this->enqueuePosition.load() - this->dequeuePosition.load() >= LOG_RING_DRAIN_THRESHOLD;
+            });
+            terminated = this->terminated;
+        }
 
-    auto pendingLogs = this->logs;
-    this->logs.clear();
+        this->drain();
+        this->completeSend();
 
-    // wait until previous logs have been flushed entirely
-    auto waitUntilFlushed = [this] { return !this->sync.pending.load(); };
-    this->sync.await.wait(lock, waitUntilFlushed);
+        // An aged batch keeps filling up while the previous one is in flight, it goes out once that one completed
+        if (!this->batch.events.empty() && (terminated || (GETTIME() - this->batch.startTime >= LOG_BATCH_MAX_AGE && !this->isSendPending()))) {
+            this->send();
+        }
 
-    auto request = Aws::CloudWatchLogs::Model::PutLogEventsRequest()
-                       .WithLogGroupName(this->pConfig->pLogGroupName)
-                       .WithLogStreamName(this->pConfig->pLogStreamName)
-                       .WithLogEvents(pendingLogs);
+        if (terminated) {
+            this->replayBeforeExit();
+            break;
+        }
 
-    if (this->token != "") {
-        request.SetSequenceToken(this->token);
+        this->replay();
     }
+}
+
+VOID CloudwatchLogs::drain()
+{
+    UINT64 position = this->dequeuePosition.load(std::memory_order_relaxed), dropped, truncated, timestamp;
+    LogSlot* pSlot;
+    CHAR message[MAX_LOG_FORMAT_LENGTH + 1];
+    UINT32 size;
+    std::vector<std::string> pendingEvents;
+    auto addEvent = [this](const Aws::String& text, UINT64 timestamp) {
+        UINT64 size = text.size() + CLOUDWATCH_LOG_EVENT_OVERHEAD;
 
-    if (!sync) {
-        auto asyncHandler = [this](const Aws::CloudWatchLogs::CloudWatchLogsClient* cwClientLog,
-                                   const Aws::CloudWatchLogs::Model::PutLogEventsRequest& request,
-                                   const Aws::CloudWatchLogs::Model::PutLogEventsOutcome& outcome,
-                                   const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context) {
-            UNUSED_PARAM(cwClientLog);
-            UNUSED_PARAM(request);
-            UNUSED_PARAM(context);
+        if (this->batch.events.size() == MAX_CLOUDWATCH_LOG_COUNT || this->batch.size + size > MAX_CLOUDWATCH_LOG_BATCH_SIZE) {
+            this->send();
+        }
+        if (this->batch.events.empty()) {
+            this->batch.startTime = GETTIME();
+        }
 
-            if (!outcome.IsSuccess()) {
-                // Need to use printf so that we don't get into an infinite loop where we keep flushing
-                printf("Failed to push logs: %s\n", outcome.GetError().GetMessage().c_str());
-            } else {
-                DLOGS("Successfully pushed logs to cloudwatch");
-                this->token = outcome.GetResult().GetNextSequenceToken();
+        this->lastTimestamp = MAX(this->lastTimestamp, timestamp);
+        this->batch.events.push_back(
+            Aws::CloudWatchLogs::Model::InputLogEvent().WithMessage(text).WithTimestamp(this->lastTimestamp / HUNDREDS_OF_NANOS_IN_A_MILLISECOND));
+        this->batch.size += size;
+    };
+
+    while (TRUE) {
+        pSlot = &this->ring[position & (LOG_RING_CAPACITY - 1)];
+        if (pSlot->sequence.load(std::memory_order_acquire) != position + 1) {
+            break;
+        }
+
+        // Rendered once for both stdout and CloudWatch
+        size = renderLogRecord(pSlot->record, pSlot->size, message, SIZEOF(message), &timestamp);
+        pSlot->sequence.store(position + LOG_RING_CAPACITY, std::memory_order_release);
+        this->dequeuePosition.store(++position, std::memory_order_relaxed);
+
+        fputs(message, stdout);
+        addEvent(Aws::String(message, size), timestamp);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->pendingEventsMutex);
+        pendingEvents.swap(this->pendingEvents);
+    }
+    for (auto& event : pendingEvents) {
+        addEvent(Aws::String(event.c_str(), event.size()), GETTIME());
+    }
+
+    dropped = this->droppedLogs.exchange(0);
+    truncated = this->truncatedLogs.exchange(0);
+    if (dropped != 0 || truncated != 0) {
+        SNPRINTF(message, SIZEOF(message), "%" PRIu64 " log events were dropped and %" PRIu64 " truncated to %u bytes of arguments\n", dropped,
+                 truncated, LOG_RING_SLOT_SIZE);
+        // Not logged so that we don't feed the ring that just overflowed
+        fputs(message, stdout);
+        addEvent(message, GETTIME());
+    }
+
+    if (GETTIME() - this->lastSuppressionReport >= LOG_SUPPRESSION_REPORT_PERIOD) {
+        this->lastSuppressionReport = GETTIME();
+        this->rateLimiter.takeSuppressed([&message, &addEvent](PCHAR format, UINT64 count) {
+            SNPRINTF(message, SIZEOF(message), "%" PRIu64 " messages suppressed by the log rate limit: \"%.*s\"\n", count,
+                     LOG_SUPPRESSION_FORMAT_LENGTH, format);
+            fputs(message, stdout);
+            addEvent(message, GETTIME());
+        });
+    }
+}
+
+VOID CloudwatchLogs::send()
+{
+    // The next request needs the sequence token returned for the one in flight, only a full batch ends up waiting here
+    this->waitForPendingSend();
+    this->completeSend();
+
+    // Nothing goes straight to CloudWatch while older events wait in the spool, e.g. the batch that just failed
+    if (this->spool.isOpen() && (!this->spool.isEmpty() || !this->streamReady || GETTIME() < this->retryTime)) {
+        this->spoolEvents(this->batch.events);
+        this->batch = LogBatch();
+        return;
+    }
+
+    this->putLogEvents(std::move(this->batch.events), FALSE, LogSpool::Position{0, 0});
+    this->batch = LogBatch();
+}
+
+VOID CloudwatchLogs::replay()
+{
+    Aws::Vector<InputLogEvent> events;
+    LogSpool::Position end;
+    UINT64 size = 0, firstTimestamp = 0;
+
+    if (!this->spool.isOpen() || this->spool.isEmpty() || this->isSendPending() || GETTIME() < this->retryTime) {
+        return;
+    }
+
+    if (!this->streamReady && STATUS_FAILED(this->connect())) {
+        this->retryTime = GETTIME() + LOG_SPOOL_RETRY_PERIOD;
+        return;
+    }
+
+    end = this->spool.read([&](UINT64 timestamp, const CHAR* pMessage, UINT32 messageSize) {
+        if (events.empty()) {
+            firstTimestamp = timestamp;
+        }
+        if (events.size() == MAX_CLOUDWATCH_LOG_COUNT || size + messageSize + CLOUDWATCH_LOG_EVENT_OVERHEAD > MAX_CLOUDWATCH_LOG_BATCH_SIZE ||
+            ABS((INT64) (timestamp - firstTimestamp)) >= (INT64) (MAX_CLOUDWATCH_LOG_BATCH_SPAN / HUNDREDS_OF_NANOS_IN_A_MILLISECOND)) {
+            return FALSE;
+        }
+
+        events.push_back(Aws::CloudWatchLogs::Model::InputLogEvent().WithMessage(Aws::String(pMessage, messageSize)).WithTimestamp(timestamp));
+        size += messageSize + CLOUDWATCH_LOG_EVENT_OVERHEAD;
+        return TRUE;
+    });
+
+    // A batch that failed while newer ones were spooled behind it lands after them, PutLogEvents wants every request
+    // in chronological order
+    std::stable_sort(events.begin(), events.end(),
+                     [](const InputLogEvent& a, const InputLogEvent& b) { return a.GetTimestamp() < b.GetTimestamp(); });
+
+    this->putLogEvents(std::move(events), TRUE, end);
+}
+
+VOID CloudwatchLogs::replayBeforeExit()
+{
+    UINT64 deadline = GETTIME() + LOG_SPOOL_EXIT_REPLAY_TIMEOUT;
+
+    this->waitForPendingSend();
+    this->completeSend();
+
+    // Whatever is left is replayed by the next run
+    while (this->spool.isOpen() && !this->spool.isEmpty() && GETTIME() < deadline && GETTIME() >= this->retryTime) {
+        this->replay();
+        this->waitForPendingSend();
+        this->completeSend();
+    }
+
+    if (this->spool.isOpen() && !this->spool.isEmpty()) {
+        printf("%" PRIu64 " log events are left in %s for the next run\n", this->spool.getEventCount(), this->spoolPath.c_str());
+    }
+}
+
+VOID CloudwatchLogs::putLogEvents(Aws::Vector<InputLogEvent>&& events, BOOL fromSpool, const LogSpool::Position& spoolEnd)
+{
+    UINT64 size = 0;
+
+    for (auto& event : events) {
+        size += event.GetMessage().size() + CLOUDWATCH_LOG_EVENT_OVERHEAD;
+    }
+    this->batchEvents.record(events.size());
+    this->batchSize.record(size);
+
+    this->inFlightFromSpool = fromSpool;
+    this->inFlightSpoolEnd = spoolEnd;
+
+    {
+        std::lock_guard<std::mutex> lock(this->flushMutex);
+        this->sendPending = TRUE;
+        this->sendCompleted = FALSE;
+        this->sendStartTime = GETTIME();
+    }
+
+    // Local sinks call back before putLogs returns, so the flush mutex must not be held here
+    this->pSink->putLogs(std::move(events), [this](TELEMETRY_SEND_RESULT result, Aws::Vector<InputLogEvent>&& failedEvents) {
+        {
+            std::lock_guard<std::mutex> lock(this->flushMutex);
+            this->sendResult = result;
+            // Spooled batches are still in the spool anyway
+            if (!this->inFlightFromSpool) {
+                this->failedEvents = std::move(failedEvents);
             }
+            this->flushLatency.record((GETTIME() - this->sendStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+            this->sendPending = FALSE;
+            this->sendCompleted = TRUE;
+        }
+        this->flushCvar.notify_all();
+    });
+}
 
-            this->sync.pending = FALSE;
-            this->sync.await.notify_one();
-        };
-
-        this->sync.pending = TRUE;
-        this->client.PutLogEventsAsync(request, asyncHandler);
-    } else {
-        auto outcome = this->client.PutLogEvents(request);
-        if (!outcome.IsSuccess()) {
-            // Need to use printf so that we don't get into an infinite loop where we keep flushing
-            printf("Failed to push logs: %s\n", outcome.GetError().GetMessage().c_str());
-        } else {
-            DLOGS("Successfully pushed logs to cloudwatch");
-            this->token = outcome.GetResult().GetNextSequenceToken();
+VOID CloudwatchLogs::completeSend()
+{
+    TELEMETRY_SEND_RESULT result;
+    Aws::Vector<InputLogEvent> failedEvents;
+
+    {
+        std::lock_guard<std::mutex> lock(this->flushMutex);
+        if (!this->sendCompleted) {
+            return;
+        }
+        this->sendCompleted = FALSE;
+        result = this->sendResult;
+        failedEvents.swap(this->failedEvents);
+    }
+
+    switch (result) {
+        case TELEMETRY_SEND_RESULT_SUCCESS:
+        case TELEMETRY_SEND_RESULT_ALREADY_ACCEPTED:
+            if (this->inFlightFromSpool) {
+                this->spool.consume(this->inFlightSpoolEnd);
+            }
+            break;
+        case TELEMETRY_SEND_RESULT_INVALID_TOKEN:
+        case TELEMETRY_SEND_RESULT_FAILED:
+            if (!this->inFlightFromSpool && this->spool.isOpen()) {
+                this->spoolEvents(failedEvents);
+            }
+            // A stale token is fixed right away, anything else waits for CloudWatch to recover
+            if (result == TELEMETRY_SEND_RESULT_FAILED) {
+                this->retryTime = GETTIME() + LOG_SPOOL_RETRY_PERIOD;
+            }
+            break;
+    }
+
+    if (result == TELEMETRY_SEND_RESULT_ALREADY_ACCEPTED || result == TELEMETRY_SEND_RESULT_INVALID_TOKEN) {
+        if (STATUS_FAILED(this->pSink->resyncLogs())) {
+            this->retryTime = GETTIME() + LOG_SPOOL_RETRY_PERIOD;
+        }
+    }
+}
+
+VOID CloudwatchLogs::spoolEvents(const Aws::Vector<InputLogEvent>& events)
+{
+    for (auto& event : events) {
+        if (!this->spool.append((UINT64) event.GetTimestamp(), event.GetMessage().c_str(), (UINT32) event.GetMessage().size())) {
+            // Reported along with the events the ring dropped
+            this->droppedLogs++;
         }
     }
 }
 
+BOOL CloudwatchLogs::isSendPending()
+{
+    std::lock_guard<std::mutex> lock(this->flushMutex);
+    return this->sendPending;
+}
+
+VOID CloudwatchLogs::waitForPendingSend()
+{
+    std::unique_lock<std::mutex> lock(this->flushMutex);
+    this->flushCvar.wait(lock, [this]() { return !this->sendPending; });
+}
+
+VOID CloudwatchLogs::reportStats()
+{
+    Canary::Cloudwatch::getInstance().monitoring.pushLogBatchStats(this->batchEvents.takeSnapshot(), this->batchSize.takeSnapshot(),
+                                                                    this->flushLatency.takeSnapshot());
+}
+
 } // namespace Canary
@@ -2,27 +2,110 @@
 
 namespace Canary {
 
+// CloudwatchLogs never does any work on the logging thread besides capturing the log arguments into a preallocated slot
+// of a bounded ring, see LogRecord.h. A dedicated thread drains the ring, renders every record once for stdout as well
+// as CloudWatch, and ships them in batches through the TelemetrySink, PutLogEvents unless Config::telemetrySink says
+// otherwise.
+//
+// When the ring is full, e.g. because CloudWatch is slow, new events are dropped and counted instead of blocking the
+// caller. The number of dropped and truncated events is reported in the log stream itself.
+//
+// Batches are double buffered: the flush thread keeps filling the next batch while the previous one is in flight. A
+// batch is sent once the next event would exceed the PutLogEvents count or size limits, or once its oldest event is
+// LOG_BATCH_MAX_AGE old and the previous one is out of the way. Only a full batch waits for the one in flight.
+//
+// Batches that CloudWatch doesn't take, because PutLogEvents failed or because the log stream couldn't be created, are
+// appended to a LogSpool on disk. A batch in flight is moved into the request, the sink hands it back if it fails. As
+// long as the spool isn't empty every new batch goes there as well, to keep the order, and the flush thread replays it
+// batch by batch. The backlog is bounded by the spool size. What can't be delivered before exit is replayed by the next
+// run.
+//
+// rateLimiter throttles chatty call sites before they reach the ring, the flush thread logs how many messages each of
+// them suppressed.
 class CloudwatchLogs {
   public:
-    CloudwatchLogs(Canary::PConfig, ClientConfiguration*);
-    STATUS init();
+    CloudwatchLogs(Canary::PConfig);
+    STATUS init(TelemetrySink*);
     VOID deinit();
-    VOID push(string log);
-    VOID flush(BOOL sync = FALSE);
+    VOID push(UINT32, PCHAR, va_list);
+    // Adds an event as is, without log metadata and without printing it
+    VOID pushEvent(const std::string&);
+    VOID reportStats();
+
+    LogRateLimiter rateLimiter;
 
   private:
-    class Synchronization {
-      public:
-        std::atomic<bool> pending;
-        std::recursive_mutex mutex;
-        std::condition_variable_any await;
+    struct LogSlot {
+        // Slot turn in the ring, see push and drain
+        std::atomic<UINT64> sequence;
+        UINT32 size;
+        BYTE record[LOG_RING_SLOT_SIZE];
+    };
+
+    struct LogBatch {
+        Aws::Vector<InputLogEvent> events;
+        // payload size as PutLogEvents accounts for it
+        UINT64 size;
+        // when the oldest event was added
+        UINT64 startTime;
+
+        LogBatch();
     };
 
     PConfig pConfig;
-    CloudWatchLogsClient client;
-    Synchronization sync;
-    Aws::Vector<InputLogEvent> logs;
-    Aws::String token;
+    TelemetrySink* pSink;
+
+    std::unique_ptr<LogSlot[]> ring;
+    std::atomic<UINT64> enqueuePosition;
+    // only advanced by the flush thread, the loggers read it to tell when the backlog should be drained
+    std::atomic<UINT64> dequeuePosition;
+    std::atomic<UINT64> droppedLogs;
+    std::atomic<UINT64> truncatedLogs;
+    std::mutex pendingEventsMutex;
+    std::vector<std::string> pendingEvents;
+
+    LogBatch batch;
+    // PutLogEvents requires the events of a batch in chronological order
+    UINT64 lastTimestamp;
+    UINT64 lastSuppressionReport;
+    std::thread flushThread;
+    // guards the members below, which are shared with the PutLogEvents handler
+    std::mutex flushMutex;
+    std::condition_variable flushCvar;
+    BOOL terminated;
+    BOOL sendPending;
+    UINT64 sendStartTime;
+    BOOL sendCompleted;
+    TELEMETRY_SEND_RESULT sendResult;
+
+    // One per log stream, so that canaries running side by side don't share theirs
+    std::string spoolPath;
+    LogSpool spool;
+    // Only used by the flush thread once it runs
+    BOOL streamReady;
+    // When to try again after CloudWatch failed
+    UINT64 retryTime;
+    // A live batch that failed, as the sink handed it back, guarded by flushMutex until completeSend spools it
+    Aws::Vector<InputLogEvent> failedEvents;
+    BOOL inFlightFromSpool;
+    LogSpool::Position inFlightSpoolEnd;
+
+    LatencyHistogram batchEvents;
+    LatencyHistogram batchSize;
+    LatencyHistogram flushLatency;
+
+    static std::string getSpoolPath(PConfig);
+    VOID runFlushThread();
+    VOID drain();
+    VOID send();
+    VOID replay();
+    VOID replayBeforeExit();
+    VOID putLogEvents(Aws::Vector<InputLogEvent>&&, BOOL, const LogSpool::Position&);
+    VOID completeSend();
+    VOID spoolEvents(const Aws::Vector<InputLogEvent>&);
+    STATUS connect();
+    BOOL isSendPending();
+    VOID waitForPendingSend();
 };
 
 } // namespace Canary
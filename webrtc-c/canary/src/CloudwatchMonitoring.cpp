@@ -2,52 +2,350 @@
 
 namespace Canary {
 
-CloudwatchMonitoring::CloudwatchMonitoring(PConfig pConfig, ClientConfiguration* pClientConfig) : pConfig(pConfig), client(*pClientConfig)
+CloudwatchMonitoring::MetricBucket::MetricBucket(const MetricDatum& datum)
+    : identity(), sampleCount(0), sum(0), minimum(0), maximum(0), valuesOverflowed(FALSE)
 {
+    this->identity.SetMetricName(datum.GetMetricName());
+    this->identity.SetUnit(datum.GetUnit());
+    this->identity.SetDimensions(datum.GetDimensions());
 }
 
-STATUS CloudwatchMonitoring::init()
+VOID CloudwatchMonitoring::MetricBucket::add(const MetricDatum& datum)
+{
+    DOUBLE sampleCount, sum, minimum, maximum;
+
+    if (datum.StatisticValuesHasBeenSet()) {
+        sampleCount = datum.GetStatisticValues().GetSampleCount();
+        sum = datum.GetStatisticValues().GetSum();
+        minimum = datum.GetStatisticValues().GetMinimum();
+        maximum = datum.GetStatisticValues().GetMaximum();
+        // A statistic set can't be turned back into values
+        this->valuesOverflowed = TRUE;
+    } else {
+        sampleCount = 1;
+        sum = minimum = maximum = datum.GetValue();
+        if (!this->valuesOverflowed) {
+            this->values[datum.GetValue()] += 1;
+            this->valuesOverflowed = this->values.size() > MAX_METRIC_DATUM_VALUES;
+        }
+    }
+
+    this->minimum = this->sampleCount == 0 ? minimum : MIN(this->minimum, minimum);
+    this->maximum = this->sampleCount == 0 ? maximum : MAX(this->maximum, maximum);
+    this->sampleCount += sampleCount;
+    this->sum += sum;
+}
+
+MetricDatum CloudwatchMonitoring::MetricBucket::toDatum() const
+{
+    MetricDatum datum = this->identity;
+    StatisticSet statistics;
+
+    if (!this->valuesOverflowed) {
+        for (auto& it : this->values) {
+            datum.AddValues(it.first);
+            datum.AddCounts(it.second);
+        }
+    } else {
+        statistics.SetSampleCount(this->sampleCount);
+        statistics.SetSum(this->sum);
+        statistics.SetMinimum(this->minimum);
+        statistics.SetMaximum(this->maximum);
+        datum.SetStatisticValues(statistics);
+    }
+
+    return datum;
+}
+
+CloudwatchMonitoring::CloudwatchMonitoring(PConfig pConfig)
+    : pConfig(pConfig), pSink(NULL), queue(METRIC_QUEUE_CAPACITY, MAX_METRIC_SENDS_IN_FLIGHT), pEmfFile(NULL), terminated(FALSE), coalescedMetrics(0), droppedMetrics(0),
+      signalingInitDelay(MAX_TRACKED_LATENCY), iceHolePunchingDelay(MAX_TRACKED_LATENCY),
+      sessionSetupDelay(MAX_TRACKED_LATENCY), offerLatency(MAX_TRACKED_SIGNALING_LATENCY), answerLatency(MAX_TRACKED_SIGNALING_LATENCY),
+      iceCandidateLatency(MAX_TRACKED_SIGNALING_LATENCY), signalingQueueWait(MAX_TRACKED_SIGNALING_LATENCY),
+      signalingSendLatency(MAX_TRACKED_SIGNALING_LATENCY), cachedIceServerWait(MAX_TRACKED_LATENCY), fetchedIceServerWait(MAX_TRACKED_LATENCY)
+{
+}
+
+STATUS CloudwatchMonitoring::init(TelemetrySink* pSink)
 {
     STATUS retStatus = STATUS_SUCCESS;
 
+    CHK(pSink != NULL, STATUS_NULL_ARG);
+    this->pSink = pSink;
+
     this->channelDimension.SetName("Channel");
     this->channelDimension.SetValue(pConfig->pChannelName);
 
+    if (pConfig->metricSink == METRIC_SINK_EMF_FILE) {
+        this->pEmfFile = FOPEN(pConfig->pMetricSinkPath, "a");
+        CHK_ERR(this->pEmfFile != NULL, STATUS_OPEN_FILE_FAILED, "Failed to open %s for the metrics", pConfig->pMetricSinkPath);
+    } else if (pConfig->metricSink == METRIC_SINK_CLOUDWATCH) {
+        CHK_STATUS(this->queue.start(pSink));
+    }
+
+    this->flushThread = std::thread(&CloudwatchMonitoring::runFlushThread, this);
+
+CleanUp:
+
     return retStatus;
 }
 
 VOID CloudwatchMonitoring::deinit()
 {
-    // need to wait all metrics to be flushed out, otherwise we'll get a segfault.
+    {
+        std::lock_guard<std::mutex> lock(this->bucketsMutex);
+        this->terminated = TRUE;
+    }
+    this->flushCvar.notify_all();
+    if (this->flushThread.joinable()) {
+        this->flushThread.join();
+    }
+
+    // Whatever was aggregated since the last window, e.g. the exit status, still has to go out
+    this->exportLatencyHistograms();
+    this->pushLatencySummaries();
+    this->flush();
+
+    // Requests still in flight at Aws::ShutdownAPI crash the process, the drain only returns once there are none left.
     // https://docs.aws.amazon.com/sdk-for-cpp/v1/developer-guide/basic-use.html
-    // TODO: maybe add a timeout? But, this might cause a segfault if it hits a timeout.
-    while (this->pendingMetrics.load() > 0) {
-        THREAD_SLEEP(HUNDREDS_OF_NANOS_IN_A_MILLISECOND * 500);
+    this->queue.drain(GETTIME() + METRIC_DRAIN_TIMEOUT);
+
+    if (this->pEmfFile != NULL) {
+        FCLOSE(this->pEmfFile);
+        this->pEmfFile = NULL;
+    }
+}
+
+std::string CloudwatchMonitoring::getMetricKey(const MetricDatum& datum)
+{
+    std::string key = datum.GetMetricName() + "|" + std::to_string((UINT32) datum.GetUnit());
+
+    for (auto& dimension : datum.GetDimensions()) {
+        key += "|" + dimension.GetName() + "=" + dimension.GetValue();
     }
+
+    return key;
 }
 
 VOID CloudwatchMonitoring::push(const MetricDatum& datum)
 {
-    Aws::CloudWatch::Model::PutMetricDataRequest cwRequest;
-    cwRequest.SetNamespace(DEFAULT_CLOUDWATCH_NAMESPACE);
-    cwRequest.AddMetricData(datum);
+    std::string key = getMetricKey(datum);
 
-    auto asyncHandler = [this](const Aws::CloudWatch::CloudWatchClient* cwClient, const Aws::CloudWatch::Model::PutMetricDataRequest& request,
-                               const Aws::CloudWatch::Model::PutMetricDataOutcome& outcome,
-                               const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context) {
-        UNUSED_PARAM(cwClient);
-        UNUSED_PARAM(request);
-        UNUSED_PARAM(context);
+    std::lock_guard<std::mutex> lock(this->bucketsMutex);
+    auto it = this->buckets.find(key);
+    if (it == this->buckets.end()) {
+        if (this->buckets.size() >= MAX_PENDING_METRIC_BUCKETS) {
+            this->droppedMetrics++;
+            return;
+        }
+        it = this->buckets.emplace(key, MetricBucket(datum)).first;
+    } else {
+        this->coalescedMetrics++;
+    }
+    it->second.add(datum);
+}
+
+VOID CloudwatchMonitoring::flush()
+{
+    std::map<std::string, MetricBucket> pendingBuckets;
+    Aws::Vector<MetricDatum> batch;
+    MetricDatum datum;
+    UINT64 coalesced = this->coalescedMetrics.exchange(0), dropped = this->droppedMetrics.exchange(0) + this->queue.takeDroppedMetrics();
+    // EMF records aren't limited by the PutMetricData request size, the larger the batch the fewer records
+    UINT32 maxBatchSize = this->pConfig->metricSink == METRIC_SINK_CLOUDWATCH ? MAX_METRIC_DATUMS_PER_REQUEST : MAX_UINT32;
+
+    {
+        std::lock_guard<std::mutex> lock(this->bucketsMutex);
+        pendingBuckets.swap(this->buckets);
+    }
+
+    DLOGD("Flushing %u aggregated metrics, %" PRIu64 " samples coalesced, %" PRIu64 " dropped", (UINT32) pendingBuckets.size(), coalesced,
+          dropped);
+
+    // The counters describe the aggregation itself, so they're sent along with the batch instead of being aggregated
+    if (coalesced != 0 || dropped != 0) {
+        datum.SetMetricName("CoalescedMetrics");
+        datum.SetValue(coalesced);
+        datum.SetUnit(StandardUnit::Count);
+        datum.AddDimensions(this->channelDimension);
+        batch.push_back(datum);
+
+        datum.SetMetricName("DroppedMetrics");
+        datum.SetValue(dropped);
+        batch.push_back(datum);
+    }
+
+    for (auto& it : pendingBuckets) {
+        batch.push_back(it.second.toDatum());
+        if (batch.size() == maxBatchSize) {
+            this->send(std::move(batch));
+            batch.clear();
+        }
+    }
+
+    if (!batch.empty()) {
+        this->send(std::move(batch));
+    }
+}
+
+VOID CloudwatchMonitoring::runFlushThread()
+{
+    std::unique_lock<std::mutex> lock(this->bucketsMutex);
+
+    while (!this->terminated) {
+        this->flushCvar.wait_for(lock, std::chrono::milliseconds(this->pConfig->metricsWindow / HUNDREDS_OF_NANOS_IN_A_MILLISECOND),
+                                 [this]() { return this->terminated; });
+        if (this->terminated) {
+            break;
+        }
+
+        // The sends are behind, another window of aggregation costs nothing while a new batch would evict an old one
+        if (this->queue.isFull()) {
+            DLOGW("Metric queue is full, postponing the flush");
+            continue;
+        }
+
+        lock.unlock();
+        this->exportLatencyHistograms();
+        this->flush();
+        lock.lock();
+    }
+}
+
+VOID CloudwatchMonitoring::send(Aws::Vector<MetricDatum>&& datums)
+{
+    if (this->pConfig->metricSink != METRIC_SINK_CLOUDWATCH) {
+        this->sendEmf(datums);
+        return;
+    }
+
+    // Dropped datums are counted by the queue and picked up by the next flush
+    this->queue.push(std::move(datums));
+}
 
-        if (!outcome.IsSuccess()) {
-            DLOGE("Failed to put sample metric data: %s", outcome.GetError().GetMessage().c_str());
+VOID CloudwatchMonitoring::sendEmf(const Aws::Vector<MetricDatum>& datums)
+{
+    std::vector<std::string> records;
+
+    serializeEmfRecords(DEFAULT_CLOUDWATCH_NAMESPACE, GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, datums, records);
+
+    for (auto& record : records) {
+        if (this->pConfig->metricSink == METRIC_SINK_EMF) {
+            Canary::Cloudwatch::getInstance().logs.pushEvent(record);
         } else {
-            DLOGS("Successfully put sample metric data");
+            fputs(record.c_str(), this->pEmfFile);
+            fputc('\n', this->pEmfFile);
+        }
+    }
+    if (this->pEmfFile != NULL) {
+        fflush(this->pEmfFile);
+    }
+
+    DLOGS("Wrote %u metrics as %u EMF records", (UINT32) datums.size(), (UINT32) records.size());
+}
+
+VOID CloudwatchMonitoring::exportLatencyHistograms()
+{
+    MetricDatum identity, messageIdentity, sourceIdentity;
+    Dimension messageTypeDimension, sourceDimension;
+    std::pair<const CHAR*, LatencyHistogram*> messageLatencies[] = {
+        {"Offer", &this->offerLatency}, {"Answer", &this->answerLatency}, {"IceCandidate", &this->iceCandidateLatency}};
+    std::pair<const CHAR*, LatencyHistogram*> iceServerWaits[] = {{"Cache", &this->cachedIceServerWait}, {"Signaling", &this->fetchedIceServerWait}};
+
+    identity.SetUnit(StandardUnit::Milliseconds);
+    identity.AddDimensions(this->channelDimension);
+
+    identity.SetMetricName("SignalingInitDelay");
+    this->pushLatencySnapshot(identity, this->signalingInitDelay.takeSnapshot());
+
+    identity.SetMetricName("ICEHolePunchingDelay");
+    this->pushLatencySnapshot(identity, this->iceHolePunchingDelay.takeSnapshot());
+
+    identity.SetMetricName("SessionSetupDelay");
+    this->pushLatencySnapshot(identity, this->sessionSetupDelay.takeSnapshot());
+
+    identity.SetMetricName("IceServerWait");
+    sourceDimension.SetName("Source");
+    for (auto& it : iceServerWaits) {
+        sourceIdentity = identity;
+        sourceDimension.SetValue(it.first);
+        sourceIdentity.AddDimensions(sourceDimension);
+        this->pushLatencySnapshot(sourceIdentity, it.second->takeSnapshot());
+    }
+
+    identity.SetUnit(StandardUnit::Microseconds);
+    identity.SetMetricName("SignalingQueueWait");
+    this->pushLatencySnapshot(identity, this->signalingQueueWait.takeSnapshot());
+
+    identity.SetMetricName("SignalingSendLatency");
+    this->pushLatencySnapshot(identity, this->signalingSendLatency.takeSnapshot());
+
+    identity.SetMetricName("SignalingMessageLatency");
+    messageTypeDimension.SetName("MessageType");
+    for (auto& it : messageLatencies) {
+        messageIdentity = identity;
+        messageTypeDimension.SetValue(it.first);
+        messageIdentity.AddDimensions(messageTypeDimension);
+        this->pushLatencySnapshot(messageIdentity, it.second->takeSnapshot());
+    }
+}
+
+VOID CloudwatchMonitoring::pushLatencySnapshot(const MetricDatum& identity, const LatencyHistogram::Snapshot& snapshot)
+{
+    if (snapshot.getCount() == 0) {
+        return;
+    }
+
+    this->pushLatencyPercentiles(identity, snapshot);
+
+    std::lock_guard<std::mutex> lock(this->latencySummariesMutex);
+    auto& summary = this->latencySummaries[getMetricKey(identity)];
+    summary.identity = identity;
+    summary.total.merge(snapshot);
+}
+
+VOID CloudwatchMonitoring::pushLatencyPercentiles(const MetricDatum& identity, const LatencyHistogram::Snapshot& snapshot)
+{
+    MetricDatum datum;
+    Dimension percentileDimension;
+    UINT32 i;
+
+    percentileDimension.SetName("Percentile");
+
+    for (i = 0; i < EXPORTED_LATENCY_PERCENTILE_COUNT; i++) {
+        percentileDimension.SetValue(EXPORTED_LATENCY_PERCENTILES[i].label);
+
+        datum = identity;
+        datum.SetValue(snapshot.getPercentile(EXPORTED_LATENCY_PERCENTILES[i].percentile));
+        datum.AddDimensions(percentileDimension);
+
+        this->push(datum);
+    }
+}
+
+VOID CloudwatchMonitoring::pushLatencySummaries()
+{
+    MetricDatum datum;
+    Dimension scopeDimension;
+    std::string label;
+
+    scopeDimension.SetName("Scope");
+    scopeDimension.SetValue("Run");
+
+    std::lock_guard<std::mutex> lock(this->latencySummariesMutex);
+    for (auto& it : this->latencySummaries) {
+        label = it.second.identity.GetMetricName();
+        for (auto& dimension : it.second.identity.GetDimensions()) {
+            if (dimension.GetName() != this->channelDimension.GetName()) {
+                label += " " + dimension.GetName() + "=" + dimension.GetValue();
+            }
         }
-        this->pendingMetrics--;
-    };
-    this->pendingMetrics++;
-    this->client.PutMetricDataAsync(cwRequest, asyncHandler);
+        DLOGI("%s over the whole run: %s", label.c_str(), it.second.total.toString().c_str());
+
+        datum = it.second.identity;
+        datum.AddDimensions(scopeDimension);
+        this->pushLatencyPercentiles(datum, it.second.total);
+    }
 }
 
 VOID CloudwatchMonitoring::pushExitStatus(STATUS retStatus)
@@ -70,12 +368,111 @@ VOID CloudwatchMonitoring::pushExitStatus(STATUS retStatus)
     this->push(datum);
 }
 
-VOID CloudwatchMonitoring::pushSignalingInitDelay(UINT64 delay, StandardUnit unit)
+VOID CloudwatchMonitoring::recordSignalingInitDelay(UINT64 delay)
+{
+    this->signalingInitDelay.record(delay);
+}
+
+VOID CloudwatchMonitoring::recordICEHolePunchingDelay(UINT64 delay)
+{
+    this->iceHolePunchingDelay.record(delay);
+}
+
+VOID CloudwatchMonitoring::recordSessionSetupDelay(UINT64 delay)
+{
+    this->sessionSetupDelay.record(delay);
+}
+
+VOID CloudwatchMonitoring::recordSignalingMessageLatency(SIGNALING_MESSAGE_TYPE type, UINT64 latency)
+{
+    switch (type) {
+        case SIGNALING_MESSAGE_TYPE_OFFER:
+            this->offerLatency.record(latency);
+            break;
+        case SIGNALING_MESSAGE_TYPE_ANSWER:
+            this->answerLatency.record(latency);
+            break;
+        case SIGNALING_MESSAGE_TYPE_ICE_CANDIDATE:
+            this->iceCandidateLatency.record(latency);
+            break;
+        default:
+            break;
+    }
+}
+
+VOID CloudwatchMonitoring::recordSignalingQueueWait(UINT64 wait)
+{
+    this->signalingQueueWait.record(wait);
+}
+
+VOID CloudwatchMonitoring::recordSignalingSendLatency(UINT64 latency)
+{
+    this->signalingSendLatency.record(latency);
+}
+
+VOID CloudwatchMonitoring::recordIceServerWait(UINT64 wait, BOOL cached)
+{
+    (cached ? this->cachedIceServerWait : this->fetchedIceServerWait).record(wait);
+}
+
+VOID CloudwatchMonitoring::pushConcurrentConnections(UINT64 count)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("ConcurrentConnections");
+    datum.SetValue(count);
+    datum.SetUnit(StandardUnit::Count);
+
+    datum.AddDimensions(this->channelDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushFanoutQueueDepth(UINT64 depth)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("FanoutQueueDepth");
+    datum.SetValue(depth);
+    datum.SetUnit(StandardUnit::Count);
+
+    datum.AddDimensions(this->channelDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushFanoutWriteLatency(UINT64 latency, StandardUnit unit)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("FanoutWriteLatency");
+    datum.SetValue(latency);
+    datum.SetUnit(unit);
+
+    datum.AddDimensions(this->channelDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushFanoutDroppedFrames(UINT64 count)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("FanoutDroppedFrames");
+    datum.SetValue(count);
+    datum.SetUnit(StandardUnit::Count);
+
+    datum.AddDimensions(this->channelDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushPacerSendJitter(UINT64 jitter, StandardUnit unit)
 {
     MetricDatum datum;
 
-    datum.SetMetricName("SignalingInitDelay");
-    datum.SetValue(delay);
+    datum.SetMetricName("PacerSendJitter");
+    datum.SetValue(jitter);
     datum.SetUnit(unit);
 
     datum.AddDimensions(this->channelDimension);
@@ -83,17 +480,189 @@ VOID CloudwatchMonitoring::pushSignalingInitDelay(UINT64 delay, StandardUnit uni
     this->push(datum);
 }
 
-VOID CloudwatchMonitoring::pushICEHolePunchingDelay(UINT64 delay, StandardUnit unit)
+VOID CloudwatchMonitoring::pushPacerDroppedFrames(UINT64 count)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("PacerDroppedFrames");
+    datum.SetValue(count);
+    datum.SetUnit(StandardUnit::Count);
+
+    datum.AddDimensions(this->channelDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushRenditionSwitches(UINT64 count)
+{
+    MetricDatum datum;
+
+    datum.SetMetricName("RenditionSwitches");
+    datum.SetValue(count);
+    datum.SetUnit(StandardUnit::Count);
+
+    datum.AddDimensions(this->channelDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushRenditionTime(UINT32 bitrate, UINT64 time, StandardUnit unit)
 {
     MetricDatum datum;
+    Dimension renditionDimension;
+
+    renditionDimension.SetName("Rendition");
+    renditionDimension.SetValue(std::to_string(bitrate) + "kbps");
 
-    datum.SetMetricName("ICEHolePunchingDelay");
-    datum.SetValue(delay);
+    datum.SetMetricName("RenditionTime");
+    datum.SetValue(time);
     datum.SetUnit(unit);
 
     datum.AddDimensions(this->channelDimension);
+    datum.AddDimensions(renditionDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushStartupPhase(const CHAR* phase, BOOL cold, UINT64 duration)
+{
+    MetricDatum datum;
+    Dimension phaseDimension, startDimension;
+
+    phaseDimension.SetName("Phase");
+    phaseDimension.SetValue(phase);
+    startDimension.SetName("Start");
+    startDimension.SetValue(cold ? "Cold" : "Warm");
+
+    datum.SetMetricName("StartupPhaseDuration");
+    datum.SetValue(duration);
+    datum.SetUnit(StandardUnit::Milliseconds);
+
+    datum.AddDimensions(this->channelDimension);
+    datum.AddDimensions(phaseDimension);
+    datum.AddDimensions(startDimension);
+
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushReceiveStats(MEDIA_STREAM_TRACK_KIND kind, const ReceiveMetrics::Stats& stats, UINT64 period)
+{
+    MetricDatum datum, latencyIdentity;
+    Dimension trackDimension;
+
+    trackDimension.SetName("Track");
+    trackDimension.SetValue(kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "Video" : "Audio");
+
+    datum.AddDimensions(this->channelDimension);
+    datum.AddDimensions(trackDimension);
+
+    datum.SetMetricName("ReceivedFrames");
+    datum.SetValue(stats.received);
+    datum.SetUnit(StandardUnit::Count);
+    this->push(datum);
+
+    datum.SetMetricName("LostFrames");
+    datum.SetValue(stats.lost);
+    this->push(datum);
+
+    datum.SetMetricName("OutOfOrderFrames");
+    datum.SetValue(stats.outOfOrder);
+    this->push(datum);
+
+    datum.SetMetricName("CorruptedFrames");
+    datum.SetValue(stats.corrupted);
+    this->push(datum);
+
+    datum.SetMetricName("ReceiveGoodput");
+    datum.SetValue(period == 0 ? 0 : (DOUBLE) stats.bytes * 8 / 1000 * HUNDREDS_OF_NANOS_IN_A_SECOND / period);
+    datum.SetUnit(StandardUnit::Kilobits_Second);
+    this->push(datum);
+
+    datum.SetMetricName("FrameJitter");
+    datum.SetValue(stats.jitter);
+    datum.SetUnit(StandardUnit::Milliseconds);
+    this->push(datum);
+
+    latencyIdentity.SetMetricName("EndToEndFrameLatency");
+    latencyIdentity.SetUnit(StandardUnit::Milliseconds);
+    latencyIdentity.AddDimensions(this->channelDimension);
+    latencyIdentity.AddDimensions(trackDimension);
+    this->pushLatencySnapshot(latencyIdentity, stats.latency);
+}
+
+VOID CloudwatchMonitoring::pushSessionStats(UINT64 active, UINT64 failed, DOUBLE sendRate)
+{
+    MetricDatum datum;
+
+    datum.AddDimensions(this->channelDimension);
+
+    datum.SetMetricName("ActiveSessions");
+    datum.SetValue(active);
+    datum.SetUnit(StandardUnit::Count);
+    this->push(datum);
+
+    datum.SetMetricName("FailedSessions");
+    datum.SetValue(failed);
+    this->push(datum);
+
+    datum.SetMetricName("SessionSendRate");
+    datum.SetValue(sendRate);
+    datum.SetUnit(StandardUnit::Kilobits_Second);
+    this->push(datum);
+}
+
+VOID CloudwatchMonitoring::pushProcessUsage(UINT64 threads, UINT64 residentBytes, DOUBLE cpuUsage, UINT64 sessions)
+{
+    MetricDatum datum;
+
+    datum.AddDimensions(this->channelDimension);
+
+    datum.SetMetricName("ProcessThreads");
+    datum.SetValue(threads);
+    datum.SetUnit(StandardUnit::Count);
+    this->push(datum);
 
+    datum.SetMetricName("ProcessMemory");
+    datum.SetValue(residentBytes);
+    datum.SetUnit(StandardUnit::Bytes);
     this->push(datum);
+
+    datum.SetMetricName("ProcessCpuUsage");
+    datum.SetValue(cpuUsage);
+    datum.SetUnit(StandardUnit::Percent);
+    this->push(datum);
+
+    // What a session costs at this level of concurrency
+    if (sessions != 0) {
+        datum.SetMetricName("CpuUsagePerSession");
+        datum.SetValue(cpuUsage / sessions);
+        this->push(datum);
+
+        datum.SetMetricName("MemoryPerSession");
+        datum.SetValue((DOUBLE) residentBytes / sessions);
+        datum.SetUnit(StandardUnit::Bytes);
+        this->push(datum);
+    }
+}
+
+VOID CloudwatchMonitoring::pushLogBatchStats(const LatencyHistogram::Snapshot& events, const LatencyHistogram::Snapshot& size,
+                                             const LatencyHistogram::Snapshot& latency)
+{
+    MetricDatum identity;
+
+    identity.AddDimensions(this->channelDimension);
+
+    identity.SetMetricName("LogBatchEvents");
+    identity.SetUnit(StandardUnit::Count);
+    this->pushLatencySnapshot(identity, events);
+
+    identity.SetMetricName("LogBatchSize");
+    identity.SetUnit(StandardUnit::Bytes);
+    this->pushLatencySnapshot(identity, size);
+
+    identity.SetMetricName("LogFlushLatency");
+    identity.SetUnit(StandardUnit::Milliseconds);
+    this->pushLatencySnapshot(identity, latency);
 }
 
 } // namespace Canary
@@ -2,21 +2,115 @@
 
 namespace Canary {
 
+// CloudwatchMonitoring doesn't send a request per sample. Samples with the same metric name, unit and dimensions are
+// aggregated locally for Config::metricsWindow and a background thread flushes all of them in batches.
+//
+// Depending on Config::metricSink the batches go out through the TelemetrySink, or as Embedded Metric Format records
+// through the canary log stream or into a local file.
+//
+// CloudWatch batches are queued in a MetricQueue, which bounds the sends in flight and retries failed ones. While the
+// queue is full the flush is postponed and the samples keep being aggregated, at exit it's drained with a deadline.
+//
+// Latencies are recorded into histograms instead and published as percentiles every window, their totals are logged
+// and published once more at exit as a summary of the whole run.
 class CloudwatchMonitoring {
   public:
-    CloudwatchMonitoring(Canary::PConfig, ClientConfiguration*);
-    STATUS init();
+    CloudwatchMonitoring(Canary::PConfig);
+    STATUS init(TelemetrySink*);
     VOID deinit();
     VOID push(const MetricDatum&);
+    VOID flush();
     VOID pushExitStatus(STATUS);
-    VOID pushSignalingInitDelay(UINT64, StandardUnit);
-    VOID pushICEHolePunchingDelay(UINT64, StandardUnit);
+    // in milliseconds
+    VOID recordSignalingInitDelay(UINT64);
+    VOID recordICEHolePunchingDelay(UINT64);
+    VOID recordSessionSetupDelay(UINT64);
+    // in microseconds, from the message coming in until it's handled, for an offer until its answer went out
+    VOID recordSignalingMessageLatency(SIGNALING_MESSAGE_TYPE, UINT64);
+    // in microseconds, how long outgoing messages waited in the SignalingQueue and how long sending them took
+    VOID recordSignalingQueueWait(UINT64);
+    VOID recordSignalingSendLatency(UINT64);
+    // How long the first connection of a peer waited for its TURN servers, by where they came from
+    VOID recordIceServerWait(UINT64, BOOL cached);
+    VOID pushConcurrentConnections(UINT64);
+    VOID pushFanoutQueueDepth(UINT64);
+    VOID pushFanoutWriteLatency(UINT64, StandardUnit);
+    VOID pushFanoutDroppedFrames(UINT64);
+    VOID pushPacerSendJitter(UINT64, StandardUnit);
+    VOID pushPacerDroppedFrames(UINT64);
+    VOID pushRenditionSwitches(UINT64);
+    VOID pushRenditionTime(UINT32, UINT64, StandardUnit);
+    VOID pushReceiveStats(MEDIA_STREAM_TRACK_KIND, const ReceiveMetrics::Stats&, UINT64);
+    // sessions of a load run and their total send rate in kilobits per second
+    VOID pushSessionStats(UINT64 active, UINT64 failed, DOUBLE sendRate);
+    // One phase of a startup benchmark run in milliseconds, see StartupBenchmark
+    VOID pushStartupPhase(const CHAR* phase, BOOL cold, UINT64 duration);
+    // process wide, CPU usage in percent of a core
+    VOID pushProcessUsage(UINT64 threads, UINT64 residentBytes, DOUBLE cpuUsage, UINT64 sessions);
+    // events and bytes per PutLogEvents batch and flush latency in milliseconds
+    VOID pushLogBatchStats(const LatencyHistogram::Snapshot&, const LatencyHistogram::Snapshot&, const LatencyHistogram::Snapshot&);
 
   private:
+    class MetricBucket {
+      public:
+        MetricBucket(const MetricDatum&);
+        VOID add(const MetricDatum&);
+        MetricDatum toDatum() const;
+
+      private:
+        // name, unit and dimensions of the aggregated samples
+        MetricDatum identity;
+        DOUBLE sampleCount;
+        DOUBLE sum;
+        DOUBLE minimum;
+        DOUBLE maximum;
+        // distinct values are sent as is until there are too many of them, a statistic set is used after that
+        std::map<DOUBLE, DOUBLE> values;
+        BOOL valuesOverflowed;
+    };
+
+    struct LatencySummary {
+        // name, unit and dimensions of the published percentiles
+        MetricDatum identity;
+        LatencyHistogram::Snapshot total;
+    };
+
     Dimension channelDimension;
     PConfig pConfig;
-    CloudWatchClient client;
-    std::atomic<UINT64> pendingMetrics;
+    TelemetrySink* pSink;
+    MetricQueue queue;
+    FILE* pEmfFile;
+
+    std::mutex bucketsMutex;
+    std::map<std::string, MetricBucket> buckets;
+    std::thread flushThread;
+    std::condition_variable flushCvar;
+    BOOL terminated;
+    // samples merged into an existing bucket and samples that never made it out since the last flush
+    std::atomic<UINT64> coalescedMetrics;
+    std::atomic<UINT64> droppedMetrics;
+
+    LatencyHistogram signalingInitDelay;
+    LatencyHistogram iceHolePunchingDelay;
+    LatencyHistogram sessionSetupDelay;
+    LatencyHistogram offerLatency;
+    LatencyHistogram answerLatency;
+    LatencyHistogram iceCandidateLatency;
+    LatencyHistogram signalingQueueWait;
+    LatencyHistogram signalingSendLatency;
+    LatencyHistogram cachedIceServerWait;
+    LatencyHistogram fetchedIceServerWait;
+    std::mutex latencySummariesMutex;
+    std::map<std::string, LatencySummary> latencySummaries;
+
+    static std::string getMetricKey(const MetricDatum&);
+    VOID runFlushThread();
+    VOID send(Aws::Vector<MetricDatum>&&);
+    VOID sendEmf(const Aws::Vector<MetricDatum>&);
+    VOID exportLatencyHistograms();
+    VOID pushLatencySnapshot(const MetricDatum&, const LatencyHistogram::Snapshot&);
+    VOID pushLatencyPercentiles(const MetricDatum&, const LatencyHistogram::Snapshot&);
+    VOID pushLatencySummaries();
 };
 
 } // namespace Canary
@@ -2,6 +2,51 @@
 
 namespace Canary {
 
+// Every value a setting has across the sources, more than one make it an axis of the scenario matrix
+typedef std::map<std::string, std::vector<std::string>> Settings;
+
+typedef struct {
+    const CHAR* pName;
+    // where the setting used to come from before there was a config file, NULL if it never did
+    const CHAR* pEnvVar;
+    BOOL required;
+    // the same for every scenario, e.g. where the telemetry goes, so it can't be an axis of the matrix
+    BOOL processWide;
+} SettingInfo;
+
+static const SettingInfo SETTINGS[] = {
+    {"channelName", CANARY_CHANNEL_NAME_ENV_VAR, TRUE, FALSE},
+    {"clientId", CANARY_CLIENT_ID_ENV_VAR, TRUE, FALSE},
+    // master, viewer or pair, CANARY_IS_MASTER is a boolean though
+    {"role", CANARY_IS_MASTER_ENV_VAR, TRUE, FALSE},
+    {"trickleIce", CANARY_TRICKLE_ICE_ENV_VAR, TRUE, FALSE},
+    {"useTurn", CANARY_USE_TURN_ENV_VAR, TRUE, FALSE},
+    {"signaling", CANARY_SIGNALING_ENV_VAR, FALSE, FALSE},
+    {"maxViewers", CANARY_MAX_VIEWERS_ENV_VAR, FALSE, FALSE},
+    {"pacerOverrunPolicy", CANARY_PACER_OVERRUN_POLICY_ENV_VAR, FALSE, FALSE},
+    {"sessions", CANARY_SESSIONS_ENV_VAR, FALSE, FALSE},
+    {"sessionsPerSecond", CANARY_SESSIONS_PER_SECOND_ENV_VAR, FALSE, FALSE},
+    {"startupRuns", CANARY_STARTUP_RUNS_ENV_VAR, FALSE, FALSE},
+    {"startupCaches", CANARY_STARTUP_CACHES_ENV_VAR, FALSE, FALSE},
+    {"codec", CANARY_CODEC_ENV_VAR, FALSE, FALSE},
+    {"maxBitrateKbps", CANARY_MAX_BITRATE_KBPS_ENV_VAR, FALSE, FALSE},
+    {"stampAudio", NULL, FALSE, FALSE},
+    {"region", DEFAULT_REGION_ENV_VAR, FALSE, TRUE},
+    {"logLevel", DEBUG_LOG_LEVEL_ENV_VAR, FALSE, TRUE},
+    {"logGroupName", CANARY_LOG_GROUP_NAME_ENV_VAR, TRUE, TRUE},
+    {"logStreamName", CANARY_LOG_STREAM_NAME_ENV_VAR, FALSE, TRUE},
+    {"durationSeconds", CANARY_DURATION_IN_SECONDS_ENV_VAR, TRUE, FALSE},
+    {"metricsWindowSeconds", CANARY_METRICS_WINDOW_SECONDS_ENV_VAR, FALSE, FALSE},
+    {"metricSink", CANARY_METRIC_SINK_ENV_VAR, FALSE, TRUE},
+    {"metricSinkPath", CANARY_METRIC_SINK_PATH_ENV_VAR, FALSE, TRUE},
+    {"telemetrySink", CANARY_TELEMETRY_SINK_ENV_VAR, FALSE, TRUE},
+    {"telemetrySinkPath", CANARY_TELEMETRY_SINK_PATH_ENV_VAR, FALSE, TRUE},
+    {"prometheusPort", CANARY_PROMETHEUS_PORT_ENV_VAR, FALSE, TRUE},
+    {"traceFile", CANARY_TRACE_FILE_ENV_VAR, FALSE, TRUE},
+    // not a scenario setting, whether the scenarios run at the same time or back to back
+    {"concurrent", NULL, FALSE, FALSE},
+};
+
 STATUS mustenv(CHAR const* pKey, const CHAR** ppValue)
 {
     STATUS retStatus = STATUS_SUCCESS;
@@ -15,16 +60,28 @@ CleanUp:
     return retStatus;
 }
 
-STATUS mustenvBool(CHAR const* pKey, PBOOL pResult)
+static const SettingInfo* findSetting(const std::string& name)
+{
+    for (auto& setting : SETTINGS) {
+        if (name == setting.pName) {
+            return &setting;
+        }
+    }
+
+    return NULL;
+}
+
+static STATUS parseBool(const std::string& name, const std::string& value, PBOOL pResult)
 {
     STATUS retStatus = STATUS_SUCCESS;
-    const CHAR* pValue;
 
-    CHK_STATUS(mustenv(pKey, &pValue));
-    if (STRCMPI(pValue, "on") == 0 || STRCMPI(pValue, "true") == 0) {
+    // on and off are what the environment variables have always used
+    if (STRCMPI(value.c_str(), "on") == 0 || STRCMPI(value.c_str(), "true") == 0) {
         *pResult = TRUE;
-    } else {
+    } else if (STRCMPI(value.c_str(), "off") == 0 || STRCMPI(value.c_str(), "false") == 0) {
         *pResult = FALSE;
+    } else {
+        CHK_ERR(FALSE, STATUS_INVALID_ARG, "%s must be on, off, true or false, not %s", name.c_str(), value.c_str());
     }
 
 CleanUp:
@@ -32,13 +89,261 @@ CleanUp:
     return retStatus;
 }
 
-STATUS mustenvUint64(CHAR const* pKey, PUINT64 pResult)
+static STATUS parseUint64(const std::string& name, const std::string& value, UINT64 maximum, PUINT64 pResult)
 {
     STATUS retStatus = STATUS_SUCCESS;
+
+    CHK_ERR(!value.empty() && STATUS_SUCCEEDED(STRTOUI64((PCHAR) value.c_str(), NULL, 10, pResult)) && *pResult <= maximum, STATUS_INVALID_ARG,
+            "%s must be a number up to %" PRIu64 ", not %s", name.c_str(), maximum, value.c_str());
+
+CleanUp:
+
+    return retStatus;
+}
+
+static VOID loadEnvSettings(Settings& settings)
+{
     const CHAR* pValue;
 
-    CHK_STATUS(mustenv(pKey, &pValue));
-    STRTOUI64((PCHAR) pValue, NULL, 10, pResult);
+    for (auto& setting : SETTINGS) {
+        if (setting.pEnvVar == NULL || (pValue = getenv(setting.pEnvVar)) == NULL) {
+            continue;
+        }
+
+        if (STRCMP(setting.pName, "role") == 0) {
+            // Same as before, anything that isn't on or true is a viewer
+            settings[setting.pName] = {STRCMPI(pValue, "on") == 0 || STRCMPI(pValue, "true") == 0 ? "master" : "viewer"};
+        } else {
+            settings[setting.pName] = {pValue};
+        }
+    }
+}
+
+static STATUS parseJsonSetting(const std::string& name, Aws::Utils::Json::JsonView value, std::string& result)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    if (value.IsString()) {
+        result = value.AsString().c_str();
+    } else if (value.IsBool()) {
+        result = value.AsBool() ? "true" : "false";
+    } else if (value.IsIntegerType()) {
+        result = std::to_string(value.AsInt64());
+    } else {
+        CHK_ERR(FALSE, STATUS_INVALID_ARG, "%s must be a string, a boolean or an integer", name.c_str());
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+static STATUS loadFileSettings(const std::string& path, Settings& settings)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string content, name;
+    UINT64 size = 0;
+    size_t i;
+
+    CHK_ERR(STATUS_SUCCEEDED(readFile((PCHAR) path.c_str(), FALSE, NULL, &size)), STATUS_OPEN_FILE_FAILED, "Failed to read %s", path.c_str());
+    content.resize(size);
+    CHK_ERR(size == 0 || STATUS_SUCCEEDED(readFile((PCHAR) path.c_str(), FALSE, (PBYTE) &content[0], &size)), STATUS_OPEN_FILE_FAILED,
+            "Failed to read %s", path.c_str());
+    content.resize(size);
+
+    {
+        Aws::Utils::Json::JsonValue json(content.c_str());
+        CHK_ERR(json.WasParseSuccessful(), STATUS_INVALID_ARG, "Failed to parse %s: %s", path.c_str(), json.GetErrorMessage().c_str());
+        CHK_ERR(json.View().IsObject(), STATUS_INVALID_ARG, "%s must contain a JSON object", path.c_str());
+
+        for (auto& it : json.View().GetAllObjects()) {
+            name = it.first.c_str();
+            if (name == "matrix") {
+                CHK_ERR(it.second.IsObject(), STATUS_INVALID_ARG, "matrix in %s must be an object", path.c_str());
+                for (auto& axis : it.second.GetAllObjects()) {
+                    name = axis.first.c_str();
+                    CHK_ERR(findSetting(name) != NULL && name != "concurrent", STATUS_INVALID_ARG, "Unknown matrix axis %s in %s", name.c_str(),
+                            path.c_str());
+                    auto& values = settings[name];
+                    values.clear();
+                    if (axis.second.IsListType()) {
+                        auto array = axis.second.AsArray();
+                        CHK_ERR(array.GetLength() != 0, STATUS_INVALID_ARG, "Matrix axis %s in %s has no values", name.c_str(), path.c_str());
+                        for (i = 0; i < array.GetLength(); i++) {
+                            values.emplace_back();
+                            CHK_STATUS(parseJsonSetting(name, array[i], values.back()));
+                        }
+                    } else {
+                        values.emplace_back();
+                        CHK_STATUS(parseJsonSetting(name, axis.second, values.back()));
+                    }
+                }
+            } else {
+                CHK_ERR(findSetting(name) != NULL, STATUS_INVALID_ARG, "Unknown setting %s in %s", name.c_str(), path.c_str());
+                // The matrix wins over a plain value of the same setting, whatever order they're in
+                if (json.View().ValueExists("matrix") && json.View().GetObject("matrix").ValueExists(name.c_str())) {
+                    continue;
+                }
+                settings[name] = {""};
+                CHK_STATUS(parseJsonSetting(name, it.second, settings[name].back()));
+            }
+        }
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+// --name value or --name=value, a comma separated value is a matrix axis. --concurrent doesn't need a value.
+static STATUS loadCommandLineSettings(INT32 argc, PCHAR argv[], Settings& settings, std::string& configPath)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string name, value;
+    size_t separator, start;
+    INT32 i;
+
+    for (i = 1; i < argc; i++) {
+        name = argv[i];
+        CHK_ERR(name.compare(0, 2, "--") == 0, STATUS_INVALID_ARG, "Unexpected argument %s, settings are passed as --name value", argv[i]);
+        name.erase(0, 2);
+
+        if ((separator = name.find('=')) != std::string::npos) {
+            value = name.substr(separator + 1);
+            name.erase(separator);
+        } else if (name == "concurrent") {
+            value = "true";
+        } else {
+            CHK_ERR(i + 1 < argc, STATUS_INVALID_ARG, "--%s is missing its value", name.c_str());
+            value = argv[++i];
+        }
+
+        if (name == "config") {
+            configPath = value;
+            continue;
+        }
+        CHK_ERR(findSetting(name) != NULL, STATUS_INVALID_ARG, "Unknown setting --%s", name.c_str());
+
+        auto& values = settings[name];
+        values.clear();
+        for (start = 0; start <= value.size(); start = separator + 1) {
+            separator = value.find(',', start);
+            separator = separator == std::string::npos ? value.size() : separator;
+            values.push_back(value.substr(start, separator - start));
+        }
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+const CHAR* Config::keep(const std::string& value)
+{
+    this->pStrings->push_back(value);
+    return this->pStrings->back().c_str();
+}
+
+STATUS Config::apply(const std::string& name, const std::string& value)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 number;
+
+    if (name == "channelName") {
+        this->pChannelName = this->keep(value);
+    } else if (name == "clientId") {
+        this->pClientId = this->keep(value);
+    } else if (name == "role") {
+        CHK_ERR(value == "master" || value == "viewer" || value == "pair", STATUS_INVALID_ARG, "role must be master, viewer or pair, not %s",
+                value.c_str());
+        this->isPair = value == "pair";
+        this->isMaster = value != "viewer";
+    } else if (name == "trickleIce") {
+        /* This is ignored for master. Master can extract the info from offer. Viewer has to know if peer can trickle or
+         * not ahead of time. */
+        CHK_STATUS(parseBool(name, value, &this->trickleIce));
+    } else if (name == "useTurn") {
+        CHK_STATUS(parseBool(name, value, &this->useTurn));
+    } else if (name == "maxViewers") {
+        CHK_STATUS(parseUint64(name, value, MAX_UINT32, &number));
+        this->maxViewers = MIN(MAX((UINT32) number, 1), MAX_CONCURRENT_CONNECTIONS);
+    } else if (name == "pacerOverrunPolicy") {
+        CHK_ERR(value == "catchup" || value == "drop", STATUS_INVALID_ARG, "pacerOverrunPolicy must be catchup or drop, not %s", value.c_str());
+        this->pacerOverrunPolicy = value == "catchup" ? PACER_OVERRUN_POLICY_CATCH_UP : PACER_OVERRUN_POLICY_DROP;
+    } else if (name == "signaling") {
+        CHK_ERR(STATUS_SUCCEEDED(parseSignalingTransportType(value.c_str(), &this->signaling)), STATUS_INVALID_ARG,
+                "signaling must be kvs or local, not %s", value.c_str());
+    } else if (name == "sessions") {
+        CHK_STATUS(parseUint64(name, value, MAX_SESSIONS, &number));
+        CHK_ERR(number != 0, STATUS_INVALID_ARG, "sessions can't be 0");
+        this->sessions = (UINT32) number;
+    } else if (name == "sessionsPerSecond") {
+        CHK_STATUS(parseUint64(name, value, MAX_SESSIONS, &number));
+        CHK_ERR(number != 0, STATUS_INVALID_ARG, "sessionsPerSecond can't be 0");
+        this->sessionsPerSecond = (UINT32) number;
+    } else if (name == "startupRuns") {
+        CHK_STATUS(parseUint64(name, value, MAX_STARTUP_RUNS, &number));
+        this->startupRuns = (UINT32) number;
+    } else if (name == "startupCaches") {
+        if (value == "keep") {
+            this->startupCaches = STARTUP_CACHES_KEEP;
+        } else if (value == "wipe") {
+            this->startupCaches = STARTUP_CACHES_WIPE;
+        } else {
+            CHK_ERR(value == "alternate", STATUS_INVALID_ARG, "startupCaches must be keep, wipe or alternate, not %s", value.c_str());
+            this->startupCaches = STARTUP_CACHES_ALTERNATE;
+        }
+    } else if (name == "codec") {
+        CHK_ERR(STRCMPI(value.c_str(), "h264") == 0, STATUS_INVALID_ARG, "codec must be h264, the asset pack has no other video, not %s",
+                value.c_str());
+        this->videoCodec = RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE;
+    } else if (name == "maxBitrateKbps") {
+        CHK_STATUS(parseUint64(name, value, MAX_UINT32, &number));
+        this->maxVideoBitrate = number * 1000;
+    } else if (name == "stampAudio") {
+        CHK_STATUS(parseBool(name, value, &this->stampAudio));
+    } else if (name == "region") {
+        this->pRegion = this->keep(value);
+    } else if (name == "logLevel") {
+        CHK_STATUS(parseUint64(name, value, LOG_LEVEL_SILENT, &number));
+        this->logLevel = (UINT32) number;
+    } else if (name == "logGroupName") {
+        STRNCPY(this->pLogGroupName, value.c_str(), ARRAY_SIZE(this->pLogGroupName) - 1);
+    } else if (name == "logStreamName") {
+        STRNCPY(this->pLogStreamName, value.c_str(), ARRAY_SIZE(this->pLogStreamName) - 1);
+    } else if (name == "durationSeconds") {
+        CHK_STATUS(parseUint64(name, value, MAX_UINT64 / HUNDREDS_OF_NANOS_IN_A_SECOND, &number));
+        this->duration = number * HUNDREDS_OF_NANOS_IN_A_SECOND;
+    } else if (name == "metricsWindowSeconds") {
+        CHK_STATUS(parseUint64(name, value, MAX_UINT64 / HUNDREDS_OF_NANOS_IN_A_SECOND, &number));
+        CHK_ERR(number != 0, STATUS_INVALID_ARG, "metricsWindowSeconds can't be 0");
+        this->metricsWindow = number * HUNDREDS_OF_NANOS_IN_A_SECOND;
+    } else if (name == "metricSink") {
+        if (STRCMPI(value.c_str(), "emf") == 0) {
+            this->metricSink = METRIC_SINK_EMF;
+        } else if (STRCMPI(value.c_str(), "emf-file") == 0) {
+            this->metricSink = METRIC_SINK_EMF_FILE;
+        } else {
+            CHK_ERR(STRCMPI(value.c_str(), "cloudwatch") == 0, STATUS_INVALID_ARG, "metricSink must be cloudwatch, emf or emf-file, not %s",
+                    value.c_str());
+            this->metricSink = METRIC_SINK_CLOUDWATCH;
+        }
+    } else if (name == "metricSinkPath") {
+        this->pMetricSinkPath = this->keep(value);
+    } else if (name == "telemetrySink") {
+        // A typo must not make an offline run publish to CloudWatch, so an unknown sink is an error
+        CHK_ERR(STATUS_SUCCEEDED(parseTelemetrySinkType(value.c_str(), &this->telemetrySink)), STATUS_INVALID_ARG,
+                "telemetrySink must be cloudwatch, file or prometheus, not %s", value.c_str());
+    } else if (name == "telemetrySinkPath") {
+        this->pTelemetrySinkPath = this->keep(value);
+    } else if (name == "prometheusPort") {
+        CHK_STATUS(parseUint64(name, value, MAX_UINT16, &number));
+        this->prometheusPort = (UINT16) number;
+    } else if (name == "traceFile") {
+        this->pTraceFilePath = value.empty() ? NULL : this->keep(value);
+    } else {
+        CHK_ERR(FALSE, STATUS_INVALID_ARG, "Unknown setting %s", name.c_str());
+    }
 
 CleanUp:
 
@@ -48,72 +353,176 @@ CleanUp:
 VOID Config::print()
 {
     DLOGD("\n\n"
+          "\tScenario      : %s\n"
           "\tChannel Name  : %s\n"
           "\tRegion        : %s\n"
           "\tClient ID     : %s\n"
           "\tRole          : %s\n"
           "\tTrickle ICE   : %s\n"
           "\tUse TURN      : %s\n"
+          "\tSignaling     : %s\n"
+          "\tMax Viewers   : %u\n"
+          "\tPacer Overrun : %s\n"
+          "\tSessions      : %u, %u per second\n"
+          "\tStartup Runs  : %u, %s caches\n"
+          "\tMax Bitrate   : %" PRIu64 " kbps\n"
+          "\tStamp Audio   : %s\n"
           "\tLog Level     : %u\n"
           "\tLog Group     : %s\n"
           "\tLog Stream    : %s\n"
           "\tDuration      : %lu seconds\n"
+          "\tMetrics Window: %lu seconds\n"
+          "\tMetric Sink   : %s\n"
+          "\tTelemetry Sink: %s\n"
+          "\tTrace File    : %s\n"
           "\n",
-          this->pChannelName, this->pRegion, this->pClientId, this->isMaster ? "Master" : "Viewer", this->trickleIce ? "True" : "False",
-          this->useTurn ? "True" : "False", this->logLevel, this->pLogGroupName, this->pLogStreamName,
-          this->duration / HUNDREDS_OF_NANOS_IN_A_SECOND);
+          this->pScenarioName[0] == '\0' ? "-" : this->pScenarioName, this->pChannelName, this->pRegion, this->pClientId,
+          this->isPair ? "Pair" : this->isMaster ? "Master" : "Viewer", this->trickleIce ? "True" : "False", this->useTurn ? "True" : "False",
+          getSignalingTransportTypeName(this->signaling), this->maxViewers, this->pacerOverrunPolicy == PACER_OVERRUN_POLICY_DROP ? "Drop" : "Catch up",
+          this->sessions, this->sessionsPerSecond, this->startupRuns,
+          this->startupCaches == STARTUP_CACHES_KEEP       ? "keep"
+              : this->startupCaches == STARTUP_CACHES_WIPE ? "wipe"
+                                                           : "alternate",
+          this->maxVideoBitrate / 1000, this->stampAudio ? "True" : "False", this->logLevel,
+          this->pLogGroupName, this->pLogStreamName, this->duration / HUNDREDS_OF_NANOS_IN_A_SECOND,
+          this->metricsWindow / HUNDREDS_OF_NANOS_IN_A_SECOND,
+          this->metricSink == METRIC_SINK_EMF ? "EMF" : this->metricSink == METRIC_SINK_EMF_FILE ? this->pMetricSinkPath : "PutMetricData",
+          getTelemetrySinkTypeName(this->telemetrySink), this->pTraceFilePath == NULL ? "-" : this->pTraceFilePath);
 }
 
-STATUS Config::init(INT32 argc, PCHAR argv[], Canary::PConfig pConfig)
+STATUS Config::init(INT32 argc, PCHAR argv[], std::vector<Config>& scenarios, PBOOL pConcurrent)
 {
-    // TODO: Probably also support command line args to fill the config
-    // TODO: Probably also support JSON format to fill the config to allow more scalable option
-    UNUSED_PARAM(argc);
-    UNUSED_PARAM(argv);
-
     STATUS retStatus = STATUS_SUCCESS;
-    PCHAR pLogLevel, pLogStreamName;
-    const CHAR *pLogGroupName, *pClientId;
-    UINT64 durationInSeconds;
+    Settings settings, commandLineSettings;
+    std::string configPath, scenarioName, channelSuffix;
+    std::vector<const std::string*> axes;
+    std::shared_ptr<std::deque<std::string>> pStrings = std::make_shared<std::deque<std::string>>();
+    const CHAR *pAccessKey, *pSecretKey, *pConfigPath;
+    UINT64 scenarioCount = 1, index;
+    BOOL needsCredentials = FALSE;
+    size_t rest, choice;
 
-    CHK(pConfig != NULL, STATUS_NULL_ARG);
+    CHK(pConcurrent != NULL, STATUS_NULL_ARG);
 
-    MEMSET(pConfig, 0, SIZEOF(Config));
+    loadEnvSettings(settings);
+    CHK_STATUS(loadCommandLineSettings(argc, argv, commandLineSettings, configPath));
+    if (configPath.empty() && (pConfigPath = getenv(CANARY_CONFIG_FILE_ENV_VAR)) != NULL) {
+        configPath = pConfigPath;
+    }
+    if (!configPath.empty()) {
+        CHK_STATUS(loadFileSettings(configPath, settings));
+    }
+    for (auto& it : commandLineSettings) {
+        settings[it.first] = it.second;
+    }
 
-    CHK_STATUS(mustenv(CANARY_CHANNEL_NAME_ENV_VAR, &pConfig->pChannelName));
-    CHK_STATUS(mustenv(CANARY_CLIENT_ID_ENV_VAR, &pClientId));
-    CHK_STATUS(mustenv(CANARY_CLIENT_ID_ENV_VAR, &pConfig->pClientId));
-    CHK_STATUS(mustenvBool(CANARY_IS_MASTER_ENV_VAR, &pConfig->isMaster));
-    /* This is ignored for master. Master can extract the info from offer. Viewer has to know if peer can trickle or
-     * not ahead of time. */
-    CHK_STATUS(mustenvBool(CANARY_TRICKLE_ICE_ENV_VAR, &pConfig->trickleIce));
-    CHK_STATUS(mustenvBool(CANARY_USE_TURN_ENV_VAR, &pConfig->useTurn));
+    *pConcurrent = FALSE;
+    if (settings.count("concurrent") != 0) {
+        CHK_STATUS(parseBool("concurrent", settings["concurrent"].back(), pConcurrent));
+        settings.erase("concurrent");
+    }
 
-    CHK_STATUS(mustenv(ACCESS_KEY_ENV_VAR, &pConfig->pAccessKey));
-    CHK_STATUS(mustenv(SECRET_KEY_ENV_VAR, &pConfig->pSecretKey));
-    pConfig->pSessionToken = getenv(SESSION_TOKEN_ENV_VAR);
-    if ((pConfig->pRegion = getenv(DEFAULT_REGION_ENV_VAR)) == NULL) {
-        pConfig->pRegion = DEFAULT_AWS_REGION;
+    for (auto& setting : SETTINGS) {
+        CHK_ERR(!setting.required || settings.count(setting.pName) != 0, STATUS_INVALID_OPERATION,
+                "%s must be set, either in %s, with --%s or in the config file", setting.pName, setting.pEnvVar, setting.pName);
     }
 
-    // Set the logger log level
-    if (NULL == (pLogLevel = getenv(DEBUG_LOG_LEVEL_ENV_VAR)) || (STATUS_SUCCESS != STRTOUI32(pLogLevel, NULL, 10, &pConfig->logLevel))) {
-        pConfig->logLevel = LOG_LEVEL_WARN;
+    // Credentials only ever come from the environment, so that they don't end up in config files or the process list.
+    // Offline runs that neither signal through KVS nor publish to CloudWatch don't need any.
+    pAccessKey = getenv(ACCESS_KEY_ENV_VAR);
+    pSecretKey = getenv(SECRET_KEY_ENV_VAR);
+
+    for (auto& it : settings) {
+        if (it.second.size() > 1) {
+            CHK_ERR(!findSetting(it.first)->processWide, STATUS_INVALID_ARG,
+                    "%s applies to the whole process, it can't be an axis of the scenario matrix", it.first.c_str());
+            axes.push_back(&it.first);
+            scenarioCount *= it.second.size();
+            CHK_ERR(scenarioCount <= MAX_SCENARIOS, STATUS_INVALID_ARG, "The scenario matrix has more than %u combinations", MAX_SCENARIOS);
+        }
     }
 
-    CHK_STATUS(mustenv(CANARY_LOG_GROUP_NAME_ENV_VAR, &pLogGroupName));
-    STRNCPY(pConfig->pLogGroupName, pLogGroupName, ARRAY_SIZE(pConfig->pLogGroupName) - 1);
+    scenarios.clear();
+    for (index = 0; index < scenarioCount; index++) {
+        Config config = Config();
 
-    pLogStreamName = getenv(CANARY_LOG_STREAM_NAME_ENV_VAR);
-    if (pLogStreamName != NULL) {
-        STRNCPY(pConfig->pLogStreamName, pLogStreamName, ARRAY_SIZE(pConfig->pLogStreamName) - 1);
-    } else {
-        SNPRINTF(pConfig->pLogStreamName, ARRAY_SIZE(pConfig->pLogStreamName) - 1, "%s-%s-%llu", pConfig->pChannelName,
-                 pConfig->isMaster ? "master" : "viewer", GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+        config.pStrings = pStrings;
+        config.maxViewers = 1;
+        config.sessions = 1;
+        config.sessionsPerSecond = DEFAULT_SESSIONS_PER_SECOND;
+        config.startupRuns = 0;
+        config.startupCaches = STARTUP_CACHES_ALTERNATE;
+        // Live media would rather skip late frames than burst them, so dropping is the default
+        config.pacerOverrunPolicy = PACER_OVERRUN_POLICY_DROP;
+        config.signaling = SIGNALING_TRANSPORT_KVS;
+        config.videoCodec = RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE;
+        config.pAccessKey = pAccessKey;
+        config.pSecretKey = pSecretKey;
+        config.pSessionToken = getenv(SESSION_TOKEN_ENV_VAR);
+        config.pRegion = DEFAULT_AWS_REGION;
+        config.logLevel = LOG_LEVEL_WARN;
+        config.metricsWindow = DEFAULT_METRICS_WINDOW;
+        config.metricSink = METRIC_SINK_CLOUDWATCH;
+        config.pMetricSinkPath = DEFAULT_EMF_FILE_PATH;
+        config.telemetrySink = TELEMETRY_SINK_CLOUDWATCH;
+        config.pTelemetrySinkPath = DEFAULT_TELEMETRY_FILE_PATH;
+        config.prometheusPort = DEFAULT_PROMETHEUS_PORT;
+        config.pTraceFilePath = NULL;
+
+        scenarioName.clear();
+        channelSuffix.clear();
+        rest = (size_t) index;
+        for (auto& it : settings) {
+            if (it.second.size() == 1) {
+                CHK_STATUS(config.apply(it.first, it.second[0]));
+                continue;
+            }
+
+            choice = rest % it.second.size();
+            rest /= it.second.size();
+            CHK_STATUS(config.apply(it.first, it.second[choice]));
+
+            scenarioName += (scenarioName.empty() ? "" : ",") + it.first + "=" + it.second[choice];
+            if (it.first != "role") {
+                channelSuffix += "-" + it.first + "_" + it.second[choice];
+            }
+        }
+        STRNCPY(config.pScenarioName, scenarioName.c_str(), ARRAY_SIZE(config.pScenarioName) - 1);
+        if (settings.count("stampAudio") == 0) {
+            config.stampAudio = config.isPair;
+        }
+        if (!channelSuffix.empty()) {
+            config.pChannelName = config.keep(config.pChannelName + channelSuffix);
+        }
+
+        CHK_ERR(config.signaling != SIGNALING_TRANSPORT_LOCAL || !config.useTurn, STATUS_INVALID_ARG,
+                "useTurn needs the TURN servers of a KVS channel, it doesn't work with local signaling");
+        // The runs wipe the caches of the whole process and a master alone has nobody to send its first frame to
+        CHK_ERR(config.startupRuns == 0 || (scenarioCount == 1 && config.sessions == 1 && (!config.isMaster || config.isPair)), STATUS_INVALID_ARG,
+                "startupRuns needs a single session of a viewer or a pair and no scenario matrix");
+        needsCredentials = needsCredentials || config.signaling == SIGNALING_TRANSPORT_KVS || config.telemetrySink == TELEMETRY_SINK_CLOUDWATCH;
+
+        // Only a master can serve more than one viewer, the master of a pair only has its own
+        if (!config.isMaster || config.isPair) {
+            config.maxViewers = 1;
+        }
+
+        if (config.pLogStreamName[0] == '\0') {
+            SNPRINTF(config.pLogStreamName, ARRAY_SIZE(config.pLogStreamName) - 1, "%s-%s-%llu", config.pChannelName,
+                     config.isMaster ? "master" : "viewer", GETTIME() / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+        }
+
+        scenarios.push_back(config);
     }
 
-    CHK_STATUS(mustenvUint64(CANARY_DURATION_IN_SECONDS_ENV_VAR, &durationInSeconds));
-    pConfig->duration = durationInSeconds * HUNDREDS_OF_NANOS_IN_A_SECOND;
+    if (needsCredentials) {
+        CHK_STATUS(mustenv(ACCESS_KEY_ENV_VAR, &pAccessKey));
+        CHK_STATUS(mustenv(SECRET_KEY_ENV_VAR, &pSecretKey));
+    }
+
+    if (scenarioCount > 1) {
+        DLOGI("Running %" PRIu64 " scenarios %s", scenarioCount, *pConcurrent ? "concurrently" : "back to back");
+    }
 
 CleanUp:
 
@@ -5,15 +5,69 @@ namespace Canary {
 class Config;
 typedef Config* PConfig;
 
+typedef enum {
+    // Publish every overdue frame immediately until the track is back on schedule
+    PACER_OVERRUN_POLICY_CATCH_UP,
+    // Skip overdue frames, video resumes on the next key frame
+    PACER_OVERRUN_POLICY_DROP,
+} PACER_OVERRUN_POLICY;
+
+typedef enum {
+    // Aggregated metrics go to the telemetry sink as they are, a PutMetricData request per batch with CloudWatch
+    METRIC_SINK_CLOUDWATCH,
+    // Embedded Metric Format records appended to the canary log stream, CloudWatch extracts the metrics from there
+    METRIC_SINK_EMF,
+    // Embedded Metric Format records appended to a local file, e.g. to try out metric changes without network
+    METRIC_SINK_EMF_FILE,
+} METRIC_SINK;
+
+typedef enum {
+    // Nothing is wiped, only a run without anything cached from before starts cold
+    STARTUP_CACHES_KEEP,
+    // The signaling and TURN server caches are wiped before every run
+    STARTUP_CACHES_WIPE,
+    // The caches are wiped before every other run, so that one benchmark gets both the cold and the warm starts
+    STARTUP_CACHES_ALTERNATE,
+} STARTUP_CACHE_POLICY;
+
+// A config is put together from the environment variables, then a JSON config file and then the command line, every
+// source overriding the previous ones. Settings are named the same everywhere, e.g. --trickleIce on on the command line
+// or "trickleIce": true in the file, see SETTINGS in Config.cpp.
+//
+// Settings with a list of values, under "matrix" in the file or comma separated on the command line, are the axes of a
+// scenario matrix and every combination of their values becomes its own scenario:
+//
+//   {
+//     "channelName": "canary",
+//     "durationSeconds": 300,
+//     "concurrent": true,
+//     "matrix": {"role": ["master", "viewer"], "trickleIce": [true, false], "useTurn": [true, false]}
+//   }
+//
+// The values of every axis but role are appended to the channel name, canary-trickleIce_true-useTurn_false, so that
+// the master and the viewer of the same combination meet on their own channel when they run concurrently.
 class Config {
   public:
-    static STATUS init(INT32 argc, PCHAR argv[], PConfig);
+    static STATUS init(INT32 argc, PCHAR argv[], std::vector<Config>& scenarios, PBOOL pConcurrent);
 
     const CHAR* pChannelName;
     const CHAR* pClientId;
     BOOL isMaster;
+    // every session is a master and a viewer connected to each other, isMaster is TRUE then
+    BOOL isPair;
     BOOL trickleIce;
     BOOL useTurn;
+    // where offers, answers and candidates go, the local relay only connects peers within this process
+    SIGNALING_TRANSPORT_TYPE signaling;
+    // Number of viewers a master accepts at once, each of them gets its own peer connection
+    UINT32 maxViewers;
+    PACER_OVERRUN_POLICY pacerOverrunPolicy;
+    // Independent sessions started in this process, see LoadGenerator
+    UINT32 sessions;
+    UINT32 sessionsPerSecond;
+    // Init, connect and teardown cycles of the startup benchmark, 0 runs the scenario as usual, see StartupBenchmark
+    UINT32 startupRuns;
+    STARTUP_CACHE_POLICY startupCaches;
 
     // credentials
     const CHAR* pAccessKey;
@@ -27,8 +81,36 @@ class Config {
     CHAR pLogStreamName[MAX_LOG_STREAM_NAME + 1];
 
     UINT64 duration;
+    // How long metric samples are aggregated before they're sent to CloudWatch
+    UINT64 metricsWindow;
+    METRIC_SINK metricSink;
+    // where METRIC_SINK_EMF_FILE writes to
+    const CHAR* pMetricSinkPath;
+    // where metrics and logs end up, CloudWatch unless the canary runs offline
+    TELEMETRY_SINK_TYPE telemetrySink;
+    // where TELEMETRY_SINK_FILE writes to
+    const CHAR* pTelemetrySinkPath;
+    UINT16 prometheusPort;
+    // where the Chrome trace of the startup and session timelines is written at exit, NULL for no trace, see Tracer
+    const CHAR* pTraceFilePath;
+
+    // axis values of the scenario in the matrix, empty without a matrix
+    CHAR pScenarioName[MAX_SCENARIO_NAME_LENGTH + 1];
+    RTC_CODEC videoCodec;
+    // in bits per second, caps the bandwidth estimate that the pacer picks renditions by, 0 for no cap
+    UINT64 maxVideoBitrate;
+    // Opus has no place for the FrameMetadata trailer that other decoders skip, so audio only carries it when the
+    // remote is a canary too. On by default for a pair only, the remote of a master or a viewer could be anything.
+    BOOL stampAudio;
 
     VOID print();
+
+  private:
+    STATUS apply(const std::string& name, const std::string& value);
+    const CHAR* keep(const std::string&);
+
+    // Values that came from the config file or the command line, shared by all the scenarios pointing into them
+    std::shared_ptr<std::deque<std::string>> pStrings;
 };
 
 } // namespace Canary
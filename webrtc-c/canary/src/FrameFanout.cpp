@@ -0,0 +1,269 @@
+#include "Include.h"
+
+namespace Canary {
+
+FrameFanout::Consumer::Consumer(const std::string& name, MEDIA_STREAM_TRACK_KIND kind, WriteFunc write)
+    : name(name), kind(kind), write(write), active(TRUE), scheduled(FALSE), busy(FALSE), awaitingKeyFrame(FALSE), written(0), dropped(0), failed(0),
+      maxQueueDepth(0), totalWriteLatency(0), maxWriteLatency(0)
+{
+}
+
+VOID FrameFanout::Consumer::deactivate()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->active = FALSE;
+    this->queue.clear();
+}
+
+FrameFanout::FrameFanout(UINT32 workerCount, UINT32 queueDepth, CloudwatchMonitoring* pMonitoring)
+    : workerCount(workerCount), queueDepth(MAX(queueDepth, 1)), pMonitoring(pMonitoring), terminated(FALSE)
+{
+}
+
+FrameFanout::~FrameFanout()
+{
+    this->stop();
+}
+
+STATUS FrameFanout::start()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 i;
+
+    CHK(this->workers.empty(), STATUS_INVALID_OPERATION);
+
+    for (i = 0; i < this->workerCount; i++) {
+        this->workers.emplace_back(&FrameFanout::runWorker, this);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID FrameFanout::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->readyMutex);
+        this->terminated = TRUE;
+    }
+    this->readyCvar.notify_all();
+
+    for (auto& worker : this->workers) {
+        worker.join();
+    }
+    this->workers.clear();
+}
+
+FrameFanout::PConsumer FrameFanout::subscribe(const std::string& name, MEDIA_STREAM_TRACK_KIND kind, WriteFunc write)
+{
+    auto pConsumer = std::make_shared<Consumer>(name, kind, write);
+
+    std::lock_guard<std::mutex> lock(this->consumersMutex);
+    this->consumers.push_back(pConsumer);
+
+    return pConsumer;
+}
+
+VOID FrameFanout::unsubscribe(const PConsumer& pConsumer)
+{
+    pConsumer->deactivate();
+
+    {
+        std::lock_guard<std::mutex> lock(this->consumersMutex);
+        for (auto it = this->consumers.begin(); it != this->consumers.end(); it++) {
+            if (*it == pConsumer) {
+                this->consumers.erase(it);
+                break;
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(pConsumer->mutex);
+    pConsumer->idle.wait(lock, [&pConsumer]() { return !pConsumer->busy; });
+}
+
+UINT32 FrameFanout::getQueueDepth()
+{
+    return this->workerCount == 0 ? 0 : this->queueDepth;
+}
+
+VOID FrameFanout::publish(const PSharedFrame& pFrame)
+{
+    std::lock_guard<std::mutex> lock(this->consumersMutex);
+
+    for (auto& pConsumer : this->consumers) {
+        if (pConsumer->kind == pFrame->kind && pConsumer->active.load()) {
+            this->dispatch(pConsumer, pFrame);
+        }
+    }
+}
+
+VOID FrameFanout::dispatch(const PConsumer& pConsumer, const PSharedFrame& pFrame)
+{
+    STATUS writeStatus;
+    BOOL schedule = FALSE, keyFrame = (pFrame->frame.flags & FRAME_FLAG_KEY_FRAME) != 0;
+    Frame frame;
+    UINT64 latency;
+
+    {
+        std::lock_guard<std::mutex> lock(pConsumer->mutex);
+        if (this->workerCount != 0) {
+            // Drop frames rather than letting a slow consumer fall further and further behind
+            if (pConsumer->queue.size() >= this->queueDepth) {
+                if (pConsumer->kind == MEDIA_STREAM_TRACK_KIND_VIDEO) {
+                    // Every queued frame after a dropped one references it, the decoder would stay broken until the
+                    // next key frame anyway, so like MediaPacer the consumer skips ahead to it
+                    pConsumer->dropped += pConsumer->queue.size();
+                    pConsumer->queue.clear();
+                    pConsumer->awaitingKeyFrame = TRUE;
+                } else {
+                    pConsumer->queue.pop_front();
+                    pConsumer->dropped++;
+                }
+            }
+
+            if (pConsumer->awaitingKeyFrame && !keyFrame) {
+                pConsumer->dropped++;
+            } else {
+                pConsumer->awaitingKeyFrame = FALSE;
+                pConsumer->queue.push_back(pFrame);
+                pConsumer->maxQueueDepth = MAX(pConsumer->maxQueueDepth, (UINT64) pConsumer->queue.size());
+
+                // A consumer is only ever in the ready queue once, which keeps its frames in order
+                schedule = !pConsumer->scheduled;
+                pConsumer->scheduled = TRUE;
+            }
+        } else {
+            pConsumer->busy = TRUE;
+        }
+    }
+
+    if (schedule) {
+        {
+            std::lock_guard<std::mutex> lock(this->readyMutex);
+            this->ready.push_back(pConsumer);
+        }
+        this->readyCvar.notify_one();
+    }
+
+    if (this->workerCount == 0) {
+        frame = pFrame->frame;
+        writeStatus = pConsumer->write(&frame);
+        latency = GETTIME() - pFrame->publishTime;
+
+        {
+            std::lock_guard<std::mutex> lock(pConsumer->mutex);
+            pConsumer->busy = FALSE;
+            pConsumer->written += STATUS_SUCCEEDED(writeStatus) ? 1 : 0;
+            pConsumer->failed += STATUS_FAILED(writeStatus) ? 1 : 0;
+            pConsumer->totalWriteLatency += latency;
+            pConsumer->maxWriteLatency = MAX(pConsumer->maxWriteLatency, latency);
+        }
+        pConsumer->idle.notify_all();
+    }
+}
+
+VOID FrameFanout::runWorker()
+{
+    PConsumer pConsumer;
+    PSharedFrame pFrame;
+    STATUS writeStatus;
+    Frame frame;
+    UINT64 latency;
+    BOOL requeue;
+
+    while (TRUE) {
+        {
+            std::unique_lock<std::mutex> lock(this->readyMutex);
+            this->readyCvar.wait(lock, [this]() { return this->terminated || !this->ready.empty(); });
+            if (this->terminated) {
+                break;
+            }
+            pConsumer = this->ready.front();
+            this->ready.pop_front();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pConsumer->mutex);
+            if (pConsumer->queue.empty() || !pConsumer->active.load()) {
+                pConsumer->scheduled = FALSE;
+                pConsumer->queue.clear();
+                pFrame = nullptr;
+            } else {
+                pFrame = pConsumer->queue.front();
+                pConsumer->queue.pop_front();
+                pConsumer->busy = TRUE;
+            }
+        }
+
+        if (pFrame == nullptr) {
+            continue;
+        }
+
+        // Only the frame descriptor is copied since writeFrame doesn't take a const frame, the payload is shared
+        frame = pFrame->frame;
+        writeStatus = pConsumer->write(&frame);
+        latency = GETTIME() - pFrame->publishTime;
+        pFrame = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(pConsumer->mutex);
+            pConsumer->busy = FALSE;
+            pConsumer->written += STATUS_SUCCEEDED(writeStatus) ? 1 : 0;
+            pConsumer->failed += STATUS_FAILED(writeStatus) ? 1 : 0;
+            pConsumer->totalWriteLatency += latency;
+            pConsumer->maxWriteLatency = MAX(pConsumer->maxWriteLatency, latency);
+
+            // Go to the back of the ready queue after every frame so that one busy consumer can't starve the others
+            requeue = !pConsumer->queue.empty() && pConsumer->active.load();
+            pConsumer->scheduled = requeue;
+        }
+        pConsumer->idle.notify_all();
+
+        if (requeue) {
+            {
+                std::lock_guard<std::mutex> lock(this->readyMutex);
+                this->ready.push_back(pConsumer);
+            }
+            this->readyCvar.notify_one();
+        }
+
+        pConsumer = nullptr;
+    }
+}
+
+VOID FrameFanout::reportStats()
+{
+    UINT64 writes, maxQueueDepth = 0, maxWriteLatency = 0, dropped = 0;
+
+    std::lock_guard<std::mutex> lock(this->consumersMutex);
+    for (auto& pConsumer : this->consumers) {
+        std::lock_guard<std::mutex> consumerLock(pConsumer->mutex);
+        writes = pConsumer->written + pConsumer->failed;
+        DLOGI("Fanout consumer %s: queue depth %u (max %" PRIu64 "), written %" PRIu64 ", failed %" PRIu64 ", dropped %" PRIu64
+              ", write latency avg %" PRIu64 " us, max %" PRIu64 " us",
+              pConsumer->name.c_str(), (UINT32) pConsumer->queue.size(), pConsumer->maxQueueDepth, pConsumer->written, pConsumer->failed,
+              pConsumer->dropped, writes == 0 ? 0 : pConsumer->totalWriteLatency / writes / HUNDREDS_OF_NANOS_IN_A_MICROSECOND,
+              pConsumer->maxWriteLatency / HUNDREDS_OF_NANOS_IN_A_MICROSECOND);
+
+        maxQueueDepth = MAX(maxQueueDepth, pConsumer->maxQueueDepth);
+        maxWriteLatency = MAX(maxWriteLatency, pConsumer->maxWriteLatency);
+        dropped += pConsumer->dropped;
+
+        pConsumer->written = 0;
+        pConsumer->failed = 0;
+        pConsumer->dropped = 0;
+        pConsumer->maxQueueDepth = pConsumer->queue.size();
+        pConsumer->totalWriteLatency = 0;
+        pConsumer->maxWriteLatency = 0;
+    }
+
+    if (!this->consumers.empty()) {
+        this->pMonitoring->pushFanoutQueueDepth(maxQueueDepth);
+        this->pMonitoring->pushFanoutWriteLatency(maxWriteLatency / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, StandardUnit::Milliseconds);
+        this->pMonitoring->pushFanoutDroppedFrames(dropped);
+    }
+}
+
+} // namespace Canary
@@ -0,0 +1,89 @@
+#pragma once
+
+namespace Canary {
+
+// SharedFrame is produced once and then handed to every subscribed consumer by reference. The payload is not copied
+// per consumer, it has to stay valid for as long as the frame is referenced, e.g. by pointing into payload.
+struct SharedFrame {
+    Frame frame;
+    // optional storage for frame.frameData when the payload doesn't live in the FrameStore
+    std::vector<BYTE> payload;
+    MEDIA_STREAM_TRACK_KIND kind;
+    UINT64 publishTime;
+};
+typedef std::shared_ptr<const SharedFrame> PSharedFrame;
+
+class FrameFanout;
+typedef FrameFanout* PFrameFanout;
+class CloudwatchMonitoring;
+
+// FrameFanout dispatches published frames to all of the consumers subscribed to the frame kind. Every consumer owns
+// a bounded queue and is drained by a fixed pool of workers, so a slow consumer only drops its own frames instead of
+// delaying everybody else. An overflowing audio queue drops its oldest frame, an overflowing video queue is flushed and
+// the consumer resumes with the next key frame, since the frames after a dropped one would reference it. With no
+// workers, frames are written inline on the publishing thread.
+class FrameFanout {
+  public:
+    typedef std::function<STATUS(PFrame)> WriteFunc;
+
+    class Consumer {
+      public:
+        Consumer(const std::string&, MEDIA_STREAM_TRACK_KIND, WriteFunc);
+
+        // Stop dispatching to this consumer without waiting for an in-flight write. Safe to call from any thread.
+        VOID deactivate();
+
+      private:
+        friend class FrameFanout;
+
+        const std::string name;
+        const MEDIA_STREAM_TRACK_KIND kind;
+        const WriteFunc write;
+        std::atomic<BOOL> active;
+        std::mutex mutex;
+        std::condition_variable idle;
+        std::deque<PSharedFrame> queue;
+        BOOL scheduled;
+        BOOL busy;
+        // video frames are skipped until the next key frame after the queue was flushed
+        BOOL awaitingKeyFrame;
+
+        // stats since the last report, guarded by mutex
+        UINT64 written;
+        UINT64 dropped;
+        UINT64 failed;
+        UINT64 maxQueueDepth;
+        UINT64 totalWriteLatency;
+        UINT64 maxWriteLatency;
+    };
+    typedef std::shared_ptr<Consumer> PConsumer;
+
+    FrameFanout(UINT32 workerCount, UINT32 queueDepth, CloudwatchMonitoring*);
+    ~FrameFanout();
+    STATUS start();
+    VOID stop();
+    PConsumer subscribe(const std::string&, MEDIA_STREAM_TRACK_KIND, WriteFunc);
+    // Blocks until the consumer is no longer being written to, so the write target can be freed afterwards
+    VOID unsubscribe(const PConsumer&);
+    VOID publish(const PSharedFrame&);
+    VOID reportStats();
+    // How many frames a consumer holds on to at most besides the one being written
+    UINT32 getQueueDepth();
+
+  private:
+    const UINT32 workerCount;
+    const UINT32 queueDepth;
+    CloudwatchMonitoring* const pMonitoring;
+    std::vector<std::thread> workers;
+    std::mutex consumersMutex;
+    std::vector<PConsumer> consumers;
+    std::mutex readyMutex;
+    std::condition_variable readyCvar;
+    std::deque<PConsumer> ready;
+    BOOL terminated;
+
+    VOID dispatch(const PConsumer&, const PSharedFrame&);
+    VOID runWorker();
+};
+
+} // namespace Canary
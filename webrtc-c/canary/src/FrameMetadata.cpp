@@ -0,0 +1,202 @@
+#include "Include.h"
+
+namespace Canary {
+
+static const CHAR HEX_DIGITS[] = "0123456789abcdef";
+
+static VOID encodeHex(PBYTE pInput, UINT32 size, PBYTE pOutput)
+{
+    UINT32 i;
+
+    for (i = 0; i < size; i++) {
+        pOutput[i * 2] = HEX_DIGITS[pInput[i] >> 4];
+        pOutput[i * 2 + 1] = HEX_DIGITS[pInput[i] & 0x0f];
+    }
+}
+
+static BOOL decodeHexDigit(BYTE digit, PBYTE pValue)
+{
+    if (digit >= '0' && digit <= '9') {
+        *pValue = digit - '0';
+    } else if (digit >= 'a' && digit <= 'f') {
+        *pValue = digit - 'a' + 10;
+    } else {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BOOL decodeHex(PBYTE pInput, UINT32 size, PBYTE pOutput)
+{
+    UINT32 i;
+    BYTE high, low;
+
+    for (i = 0; i < size; i++) {
+        if (!decodeHexDigit(pInput[i * 2], &high) || !decodeHexDigit(pInput[i * 2 + 1], &low)) {
+            return FALSE;
+        }
+        pOutput[i] = (BYTE) ((high << 4) | low);
+    }
+
+    return TRUE;
+}
+
+static UINT32 updateNalCrc(UINT32 crc, PBYTE pNal, UINT32 size)
+{
+    // Trailing zeros can't be told apart from the leading zero of a 4 byte start code
+    while (size > 0 && pNal[size - 1] == 0x00) {
+        size--;
+    }
+
+    return size == 0 ? crc : updateCrc32(crc, pNal, size);
+}
+
+static BOOL isMetadataSei(PBYTE pNal, UINT32 size)
+{
+    return size >= FRAME_METADATA_VIDEO_TRAILER_SIZE - 4 && pNal[0] == FRAME_METADATA_SEI_NAL_HEADER && pNal[1] == FRAME_METADATA_SEI_USER_DATA &&
+        MEMCMP(pNal + 3, FRAME_METADATA_SEI_UUID, FRAME_METADATA_SEI_UUID_SIZE) == 0;
+}
+
+static BOOL isVclNal(BYTE header)
+{
+    // Coded slices, the picture itself
+    return (header & 0x1f) >= 1 && (header & 0x1f) <= 5;
+}
+
+// Returns the offset of the NAL unit header that follows the next start code at or after offset, or size if there's none
+static UINT32 findNextNal(PBYTE pPayload, UINT32 size, UINT32 offset)
+{
+    for (; offset + 3 < size; offset++) {
+        if (pPayload[offset] == 0x00 && pPayload[offset + 1] == 0x00 && pPayload[offset + 2] == 0x01) {
+            return offset + 3;
+        }
+    }
+
+    return size;
+}
+
+UINT32 computeFrameCrc(MEDIA_STREAM_TRACK_KIND kind, PBYTE pPayload, UINT32 size)
+{
+    UINT32 crc = 0, i = 0, nalStart = 0;
+
+    if (kind != MEDIA_STREAM_TRACK_KIND_VIDEO) {
+        return COMPUTE_CRC32(pPayload, size);
+    }
+
+    // The metadata SEI is skipped, it was inserted after the CRC was computed
+    while (i + 2 < size) {
+        if (pPayload[i] == 0x00 && pPayload[i + 1] == 0x00 && pPayload[i + 2] == 0x01) {
+            if (!isMetadataSei(pPayload + nalStart, i - nalStart)) {
+                crc = updateNalCrc(crc, pPayload + nalStart, i - nalStart);
+            }
+            i += 3;
+            nalStart = i;
+        } else {
+            i++;
+        }
+    }
+
+    return isMetadataSei(pPayload + nalStart, size - nalStart) ? crc : updateNalCrc(crc, pPayload + nalStart, size - nalStart);
+}
+
+STATUS stampFrameMetadata(MEDIA_STREAM_TRACK_KIND kind, PFrameMetadata pMetadata, PBYTE pBuffer, UINT32 size, UINT32 bufferSize,
+                          PUINT32 pStampedSize)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    BYTE metadata[FRAME_METADATA_SIZE];
+    PBYTE pCurPtr;
+    UINT32 offset;
+
+    CHK(pMetadata != NULL && pBuffer != NULL && pStampedSize != NULL, STATUS_NULL_ARG);
+    CHK(bufferSize >= size + FRAME_METADATA_MAX_TRAILER_SIZE, STATUS_BUFFER_TOO_SMALL);
+
+    pMetadata->size = size;
+    pMetadata->crc = computeFrameCrc(kind, pBuffer, size);
+
+    MEMCPY(metadata, FRAME_METADATA_MAGIC, 4);
+    putUnalignedInt64BigEndian((PINT64) (metadata + 4), pMetadata->sendTime);
+    putUnalignedInt32BigEndian((PINT32) (metadata + 12), pMetadata->sequence);
+    putUnalignedInt32BigEndian((PINT32) (metadata + 16), pMetadata->size);
+    putUnalignedInt32BigEndian((PINT32) (metadata + 20), pMetadata->crc);
+
+    pCurPtr = pBuffer + size;
+    if (kind == MEDIA_STREAM_TRACK_KIND_VIDEO) {
+        // Decoders only take SEI in front of the first slice of the picture, after the parameter sets. Without a slice
+        // the SEI goes to the end.
+        for (offset = findNextNal(pBuffer, size, 0); offset < size && !isVclNal(pBuffer[offset]); offset = findNextNal(pBuffer, size, offset)) {
+        }
+        if (offset < size) {
+            offset -= 3;
+            // The SEI brings its own 4 byte start code, the slice keeps the 3 bytes of its own
+            if (offset > 0 && pBuffer[offset - 1] == 0x00) {
+                offset--;
+            }
+            MEMMOVE(pBuffer + offset + FRAME_METADATA_VIDEO_TRAILER_SIZE, pBuffer + offset, size - offset);
+            pCurPtr = pBuffer + offset;
+        }
+
+        *pCurPtr++ = 0x00;
+        *pCurPtr++ = 0x00;
+        *pCurPtr++ = 0x00;
+        *pCurPtr++ = 0x01;
+        *pCurPtr++ = FRAME_METADATA_SEI_NAL_HEADER;
+        *pCurPtr++ = FRAME_METADATA_SEI_USER_DATA;
+        *pCurPtr++ = FRAME_METADATA_SEI_UUID_SIZE + FRAME_METADATA_ENCODED_SIZE;
+        MEMCPY(pCurPtr, FRAME_METADATA_SEI_UUID, FRAME_METADATA_SEI_UUID_SIZE);
+        pCurPtr += FRAME_METADATA_SEI_UUID_SIZE;
+        encodeHex(metadata, FRAME_METADATA_SIZE, pCurPtr);
+        pCurPtr += FRAME_METADATA_ENCODED_SIZE;
+        *pCurPtr++ = FRAME_METADATA_SEI_STOP_BITS;
+        pCurPtr = pBuffer + size + FRAME_METADATA_VIDEO_TRAILER_SIZE;
+    } else {
+        encodeHex(metadata, FRAME_METADATA_SIZE, pCurPtr);
+        pCurPtr += FRAME_METADATA_ENCODED_SIZE;
+    }
+
+    *pStampedSize = (UINT32) (pCurPtr - pBuffer);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS parseFrameMetadata(MEDIA_STREAM_TRACK_KIND kind, PBYTE pFrameData, UINT32 size, PFrameMetadata pMetadata, PUINT32 pPayloadSize)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    BYTE metadata[FRAME_METADATA_SIZE];
+    PBYTE pEncoded;
+    UINT32 offset;
+
+    CHK(pFrameData != NULL && pMetadata != NULL && pPayloadSize != NULL, STATUS_NULL_ARG);
+
+    if (kind == MEDIA_STREAM_TRACK_KIND_VIDEO) {
+        // The start codes may have been rewritten, so only the NAL units themselves are matched
+        for (offset = findNextNal(pFrameData, size, 0); offset < size && !isVclNal(pFrameData[offset]) &&
+             !isMetadataSei(pFrameData + offset, size - offset);
+             offset = findNextNal(pFrameData, size, offset)) {
+        }
+        CHK(offset < size && isMetadataSei(pFrameData + offset, size - offset), STATUS_INVALID_ARG);
+        CHK(pFrameData[offset + FRAME_METADATA_VIDEO_TRAILER_SIZE - 5] == FRAME_METADATA_SEI_STOP_BITS, STATUS_INVALID_ARG);
+        pEncoded = pFrameData + offset + 3 + FRAME_METADATA_SEI_UUID_SIZE;
+        // computeFrameCrc skips the SEI
+        *pPayloadSize = size;
+    } else {
+        CHK(size >= FRAME_METADATA_AUDIO_TRAILER_SIZE, STATUS_INVALID_ARG);
+        pEncoded = pFrameData + size - FRAME_METADATA_AUDIO_TRAILER_SIZE;
+        *pPayloadSize = size - FRAME_METADATA_AUDIO_TRAILER_SIZE;
+    }
+
+    CHK(decodeHex(pEncoded, FRAME_METADATA_SIZE, metadata) && MEMCMP(metadata, FRAME_METADATA_MAGIC, 4) == 0, STATUS_INVALID_ARG);
+
+    pMetadata->sendTime = (UINT64) getUnalignedInt64BigEndian(metadata + 4);
+    pMetadata->sequence = (UINT32) getUnalignedInt32BigEndian(metadata + 12);
+    pMetadata->size = (UINT32) getUnalignedInt32BigEndian(metadata + 16);
+    pMetadata->crc = (UINT32) getUnalignedInt32BigEndian(metadata + 20);
+
+CleanUp:
+
+    return retStatus;
+}
+
+} // namespace Canary
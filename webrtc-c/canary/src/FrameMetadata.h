@@ -0,0 +1,44 @@
+#pragma once
+
+namespace Canary {
+
+// Every published frame carries a trailer with its send time, sequence number, payload size and payload CRC so that
+// the remote canary can measure end to end latency, loss and corruption. The fields are hex encoded so that they
+// never contain an H264 start code. Video carries them in an SEI user data NAL unit that decoders skip, inserted in
+// front of the first slice where the standard puts SEI. Audio appends them right after the opus payload, which only
+// a canary can take apart, see Config::stampAudio.
+#define FRAME_METADATA_MAGIC          "KVSC"
+#define FRAME_METADATA_SIZE           24
+#define FRAME_METADATA_ENCODED_SIZE   (FRAME_METADATA_SIZE * 2)
+#define FRAME_METADATA_SEI_UUID       "KvsWebRtcCanary!"
+#define FRAME_METADATA_SEI_UUID_SIZE  16
+#define FRAME_METADATA_SEI_NAL_HEADER 0x06
+#define FRAME_METADATA_SEI_USER_DATA  0x05
+#define FRAME_METADATA_SEI_STOP_BITS  0x80
+// start code, NAL header, SEI payload type and size, uuid, encoded metadata and the rbsp stop bits
+#define FRAME_METADATA_VIDEO_TRAILER_SIZE (4 + 3 + FRAME_METADATA_SEI_UUID_SIZE + FRAME_METADATA_ENCODED_SIZE + 1)
+#define FRAME_METADATA_AUDIO_TRAILER_SIZE FRAME_METADATA_ENCODED_SIZE
+#define FRAME_METADATA_MAX_TRAILER_SIZE   FRAME_METADATA_VIDEO_TRAILER_SIZE
+
+typedef struct {
+    // GETTIME() of the sender when the frame was published
+    UINT64 sendTime;
+    UINT32 sequence;
+    // size and CRC of the payload in front of the trailer
+    UINT32 size;
+    UINT32 crc;
+} FrameMetadata, *PFrameMetadata;
+
+// Adds the metadata trailer to the size bytes of payload in pBuffer, bufferSize has to leave room for
+// FRAME_METADATA_MAX_TRAILER_SIZE more bytes. The size and crc of the metadata are filled in from the payload.
+STATUS stampFrameMetadata(MEDIA_STREAM_TRACK_KIND, PFrameMetadata, PBYTE pBuffer, UINT32 size, UINT32 bufferSize, PUINT32 pStampedSize);
+
+// Extracts the trailer from a received frame and returns how much of the frame the CRC covers, all of it for video as
+// computeFrameCrc skips the SEI
+STATUS parseFrameMetadata(MEDIA_STREAM_TRACK_KIND, PBYTE pFrameData, UINT32 size, PFrameMetadata, PUINT32 pPayloadSize);
+
+// The depacketizer rewrites H264 start codes, so video is checksummed over the NAL unit bodies only, without the
+// metadata SEI
+UINT32 computeFrameCrc(MEDIA_STREAM_TRACK_KIND, PBYTE pPayload, UINT32 size);
+
+} // namespace Canary
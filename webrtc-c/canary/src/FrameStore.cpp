@@ -0,0 +1,185 @@
+#include "Include.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace Canary {
+
+FrameStore::FrameStore() : pData(NULL), dataSize(0), mapped(FALSE), pIndex(NULL)
+{
+}
+
+FrameStore::~FrameStore()
+{
+#ifndef _WIN32
+    if (this->mapped) {
+        munmap(this->pData, this->dataSize);
+        this->pData = NULL;
+    }
+#endif
+    SAFE_MEMFREE(this->pData);
+}
+
+STATUS FrameStore::init(const std::string& path)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 startTime = GETTIME();
+
+    CHK(this->pData == NULL, STATUS_INVALID_OPERATION);
+
+#ifndef _WIN32
+    {
+        INT32 fd;
+        struct stat fileStat;
+        PVOID pMapped;
+
+        CHK_ERR((fd = open(path.c_str(), O_RDONLY)) >= 0, STATUS_OPEN_FILE_FAILED, "Failed to open %s", path.c_str());
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            close(fd);
+            CHK_ERR(FALSE, STATUS_READ_FILE_FAILED, "Failed to stat %s", path.c_str());
+        }
+
+        pMapped = mmap(NULL, (SIZE_T) fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        CHK_ERR(pMapped != MAP_FAILED, STATUS_READ_FILE_FAILED, "Failed to map %s", path.c_str());
+
+        this->pData = (PBYTE) pMapped;
+        this->dataSize = (UINT64) fileStat.st_size;
+        this->mapped = TRUE;
+
+        // The whole pack is streamed in a loop, so ask the kernel to bring it into the page cache up front
+        madvise(pMapped, (SIZE_T) this->dataSize, MADV_WILLNEED);
+    }
+#else
+    CHK_STATUS(readFile((PCHAR) path.c_str(), TRUE, NULL, &this->dataSize));
+    this->pData = (PBYTE) MEMALLOC(this->dataSize);
+    CHK_ERR(this->pData != NULL, STATUS_NOT_ENOUGH_MEMORY, "Failed to allocate %" PRIu64 " bytes for %s", this->dataSize, path.c_str());
+    CHK_STATUS(readFile((PCHAR) path.c_str(), TRUE, this->pData, &this->dataSize));
+#endif
+
+    CHK_STATUS(this->validate());
+
+    DLOGI("Loaded %u tracks (%" PRIu64 " bytes) from %s in %" PRIu64 " ms", (UINT32) this->tracks.size(), this->dataSize, path.c_str(),
+          (GETTIME() - startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS FrameStore::validate()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PAssetPackHeader pHeader = (PAssetPackHeader) this->pData;
+    PAssetPackTrack pPackTracks;
+    Track track;
+    UINT64 indexEnd;
+    UINT32 i;
+
+    CHK_ERR(this->dataSize >= SIZEOF(AssetPackHeader) && MEMCMP(pHeader->magic, ASSET_PACK_MAGIC, SIZEOF(pHeader->magic)) == 0,
+            STATUS_INVALID_ARG, "Not a canary asset pack");
+    CHK_ERR(pHeader->version == ASSET_PACK_CURRENT_VERSION, STATUS_INVALID_ARG, "Unsupported asset pack version %u", pHeader->version);
+
+    indexEnd = SIZEOF(AssetPackHeader) + (UINT64) pHeader->trackCount * SIZEOF(AssetPackTrack) +
+        (UINT64) pHeader->frameCount * SIZEOF(AssetPackFrame);
+    CHK_ERR(indexEnd <= pHeader->payloadOffset && pHeader->payloadOffset <= this->dataSize, STATUS_INVALID_ARG, "Truncated asset pack index");
+
+    pPackTracks = (PAssetPackTrack) (this->pData + SIZEOF(AssetPackHeader));
+    this->pIndex = (PAssetPackFrame) (pPackTracks + pHeader->trackCount);
+
+    for (i = 0; i < pHeader->trackCount; i++) {
+        CHK_ERR((UINT64) pPackTracks[i].firstFrame + pPackTracks[i].frameCount <= pHeader->frameCount && pPackTracks[i].frameCount > 0,
+                STATUS_INVALID_ARG, "Invalid frame range for track %u", i);
+        track.kind = pPackTracks[i].kind == ASSET_PACK_TRACK_KIND_VIDEO ? MEDIA_STREAM_TRACK_KIND_VIDEO : MEDIA_STREAM_TRACK_KIND_AUDIO;
+        track.bitrate = pPackTracks[i].bitrate;
+        track.firstFrame = pPackTracks[i].firstFrame;
+        track.frameCount = pPackTracks[i].frameCount;
+        this->tracks.push_back(track);
+    }
+
+    for (i = 0; i < pHeader->frameCount; i++) {
+        // Compared without adding, so that a huge offset can't wrap around
+        CHK_ERR(this->pIndex[i].offset >= pHeader->payloadOffset && this->pIndex[i].size <= this->dataSize &&
+                    this->pIndex[i].offset <= this->dataSize - this->pIndex[i].size,
+                STATUS_INVALID_ARG, "Frame %u is out of bounds", i);
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        this->tracks.clear();
+        this->pIndex = NULL;
+    }
+
+    return retStatus;
+}
+
+STATUS FrameStore::findTrack(MEDIA_STREAM_TRACK_KIND kind, PTrack* ppTrack) const
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(ppTrack != NULL, STATUS_NULL_ARG);
+    *ppTrack = NULL;
+
+    for (auto& track : this->tracks) {
+        if (track.kind == kind) {
+            *ppTrack = &track;
+            break;
+        }
+    }
+
+    CHK(*ppTrack != NULL, STATUS_NOT_FOUND);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS FrameStore::findTracks(MEDIA_STREAM_TRACK_KIND kind, std::vector<PTrack>& tracks) const
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    tracks.clear();
+    for (auto& track : this->tracks) {
+        if (track.kind == kind) {
+            tracks.push_back(&track);
+        }
+    }
+
+    CHK(!tracks.empty(), STATUS_NOT_FOUND);
+    std::stable_sort(tracks.begin(), tracks.end(), [](PTrack pLeft, PTrack pRight) { return pLeft->bitrate < pRight->bitrate; });
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS FrameStore::getFrame(PTrack pTrack, UINT32 index, PFrame pFrame) const
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PAssetPackFrame pPackFrame;
+
+    CHK(pTrack != NULL && pFrame != NULL, STATUS_NULL_ARG);
+    CHK(index < pTrack->frameCount, STATUS_INVALID_ARG);
+
+    pPackFrame = this->pIndex + pTrack->firstFrame + index;
+    // The payload is never written to, the cast is only needed to fit into the Frame structure
+    pFrame->frameData = (PBYTE) this->pData + pPackFrame->offset;
+    pFrame->size = pPackFrame->size;
+    pFrame->duration = pPackFrame->duration;
+    pFrame->flags = (pPackFrame->flags & ASSET_PACK_FRAME_FLAG_KEY_FRAME) != 0 ? FRAME_FLAG_KEY_FRAME : FRAME_FLAG_NONE;
+
+CleanUp:
+
+    return retStatus;
+}
+
+const std::vector<FrameStore::Track>& FrameStore::getTracks() const
+{
+    return this->tracks;
+}
+
+} // namespace Canary
@@ -0,0 +1,39 @@
+#pragma once
+
+namespace Canary {
+
+class FrameStore;
+typedef FrameStore* PFrameStore;
+
+// FrameStore maps the packed sample frames (see AssetPack.h) once at startup so that the send loop only hands
+// out pointer and size pairs without any file I/O or allocation.
+class FrameStore {
+  public:
+    struct Track {
+        MEDIA_STREAM_TRACK_KIND kind;
+        UINT32 bitrate;
+        UINT32 firstFrame;
+        UINT32 frameCount;
+    };
+    typedef const Track* PTrack;
+
+    FrameStore();
+    ~FrameStore();
+    STATUS init(const std::string& path);
+    STATUS findTrack(MEDIA_STREAM_TRACK_KIND, PTrack*) const;
+    // Returns every track of the kind ordered by ascending bitrate, e.g. the renditions of a bitrate ladder
+    STATUS findTracks(MEDIA_STREAM_TRACK_KIND, std::vector<PTrack>&) const;
+    STATUS getFrame(PTrack, UINT32 index, PFrame) const;
+    const std::vector<Track>& getTracks() const;
+
+  private:
+    PBYTE pData;
+    UINT64 dataSize;
+    BOOL mapped;
+    PAssetPackFrame pIndex;
+    std::vector<Track> tracks;
+
+    STATUS validate();
+};
+
+} // namespace Canary
@@ -0,0 +1,169 @@
+#include "Include.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Canary {
+
+std::mutex IceServerCache::fileMutex;
+
+IceServerCache::IceServerCache(const std::string& path) : path(path)
+{
+}
+
+STATUS IceServerCache::load(const std::string& key, UINT64 minRemainingTtl, std::vector<IceServer>& servers)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::map<std::string, std::vector<IceServer>> entries;
+    UINT64 now = GETTIME();
+
+    servers.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        CHK_STATUS(this->read(entries));
+    }
+
+    for (auto& server : entries[key]) {
+        // The servers of a channel came in one go, a single stale one means they all have to be fetched again
+        CHK(server.expiration >= now + minRemainingTtl, retStatus);
+    }
+    servers = entries[key];
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS IceServerCache::store(const std::string& key, const std::vector<IceServer>& servers)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::map<std::string, std::vector<IceServer>> entries;
+    Aws::Utils::Json::JsonValue json;
+    std::string content, tmpPath = this->path + ".tmp";
+    UINT64 now = GETTIME();
+    UINT32 i;
+
+    std::lock_guard<std::mutex> lock(fileMutex);
+    CHK_STATUS(this->read(entries));
+    entries[key] = servers;
+
+    for (auto& entry : entries) {
+        // load wouldn't return any of a channel's servers once one of them expired
+        if (std::any_of(entry.second.begin(), entry.second.end(), [now](const IceServer& server) { return server.expiration < now; })) {
+            continue;
+        }
+
+        Aws::Utils::Array<Aws::Utils::Json::JsonValue> array(entry.second.size());
+        for (i = 0; i < entry.second.size(); i++) {
+            array[i]
+                .WithString("uri", entry.second[i].uri.c_str())
+                .WithString("userName", entry.second[i].userName.c_str())
+                .WithString("credential", entry.second[i].credential.c_str())
+                .WithInt64("expiration", (long long) entry.second[i].expiration);
+        }
+        json.WithArray(entry.first.c_str(), array);
+    }
+
+    // Another process reads either the old or the new file, never half of one
+    content = json.View().WriteCompact().c_str();
+    CHK_STATUS(writePrivate(tmpPath, content));
+    CHK_ERR(rename(tmpPath.c_str(), this->path.c_str()) == 0, STATUS_WRITE_TO_FILE_FAILED, "Failed to replace %s with errno %d", this->path.c_str(),
+            errno);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS IceServerCache::writePrivate(const std::string& filePath, const std::string& content)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+#ifndef _WIN32
+    INT32 fd = -1;
+    size_t written = 0;
+    ssize_t result;
+
+    // The credentials are only for this user, a leftover file keeps its mode through O_TRUNC so it's set explicitly
+    CHK_ERR((fd = ::open(filePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600)) >= 0, STATUS_OPEN_FILE_FAILED, "Failed to open %s with errno %d",
+            filePath.c_str(), errno);
+    CHK_ERR(fchmod(fd, 0600) == 0, STATUS_WRITE_TO_FILE_FAILED, "Failed to restrict %s with errno %d", filePath.c_str(), errno);
+    while (written < content.size()) {
+        result = ::write(fd, content.data() + written, content.size() - written);
+        CHK_ERR(result > 0 || (result < 0 && errno == EINTR), STATUS_WRITE_TO_FILE_FAILED, "Failed to write %s with errno %d", filePath.c_str(),
+                errno);
+        written += result > 0 ? (size_t) result : 0;
+    }
+#else
+    CHK_STATUS(writeFile((PCHAR) filePath.c_str(), FALSE, FALSE, (PBYTE) content.c_str(), content.size()));
+#endif
+
+CleanUp:
+
+#ifndef _WIN32
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+
+    return retStatus;
+}
+
+STATUS IceServerCache::read(std::map<std::string, std::vector<IceServer>>& entries)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string content;
+    UINT64 size = 0;
+    IceServer server;
+#ifndef _WIN32
+    struct stat fileStat;
+#endif
+
+    entries.clear();
+
+#ifndef _WIN32
+    // Nothing has been cached yet on the first run
+    CHK(stat(this->path.c_str(), &fileStat) == 0, retStatus);
+    // Credentials that others could have read, or planted, aren't used. The next store replaces the file with a private one.
+    CHK_WARN((fileStat.st_mode & (S_IRWXG | S_IRWXO)) == 0, retStatus, "Ignoring %s, it's accessible to other users", this->path.c_str());
+#endif
+    CHK(STATUS_SUCCEEDED(readFile((PCHAR) this->path.c_str(), FALSE, NULL, &size)) && size != 0, retStatus);
+    content.resize(size);
+    CHK_ERR(STATUS_SUCCEEDED(readFile((PCHAR) this->path.c_str(), FALSE, (PBYTE) &content[0], &size)), STATUS_OPEN_FILE_FAILED, "Failed to read %s",
+            this->path.c_str());
+    content.resize(size);
+
+    {
+        Aws::Utils::Json::JsonValue json(content.c_str());
+        // A broken cache only costs a fetch, it's replaced with the next store
+        CHK_WARN(json.WasParseSuccessful() && json.View().IsObject(), retStatus, "Ignoring %s, it isn't a JSON object", this->path.c_str());
+
+        for (auto& entry : json.View().GetAllObjects()) {
+            if (!entry.second.IsListType()) {
+                continue;
+            }
+            auto array = entry.second.AsArray();
+            auto& servers = entries[entry.first.c_str()];
+            for (size_t i = 0; i < array.GetLength(); i++) {
+                server.uri = array[i].GetString("uri").c_str();
+                server.userName = array[i].GetString("userName").c_str();
+                server.credential = array[i].GetString("credential").c_str();
+                server.expiration = (UINT64) array[i].GetInt64("expiration");
+                servers.push_back(server);
+            }
+        }
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        entries.clear();
+    }
+
+    return retStatus;
+}
+
+} // namespace Canary
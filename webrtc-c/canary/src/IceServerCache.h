@@ -0,0 +1,26 @@
+#pragma once
+
+namespace Canary {
+
+// IceServerCache keeps the TURN servers of each channel in a JSON file across runs, the way the signaling client keeps
+// the channel and endpoint lookups with SIGNALING_API_CALL_CACHE_TYPE_FILE. A restarted canary can then allocate on
+// the TURN servers right away instead of waiting for the signaling client to fetch new credentials. The file holds TURN
+// credentials, so it's only readable by the user and one that others can access is ignored.
+class IceServerCache {
+  public:
+    IceServerCache(const std::string& path);
+    // Servers that are still good for at least minRemainingTtl, none if the cache doesn't have such for the key
+    STATUS load(const std::string& key, UINT64 minRemainingTtl, std::vector<IceServer>&);
+    // Replaces the servers of key and drops whatever expired in the meantime
+    STATUS store(const std::string& key, const std::vector<IceServer>&);
+
+  private:
+    // Peers of the same process share the file, processes replace it as a whole
+    static std::mutex fileMutex;
+    const std::string path;
+
+    STATUS read(std::map<std::string, std::vector<IceServer>>&);
+    static STATUS writePrivate(const std::string& filePath, const std::string& content);
+};
+
+} // namespace Canary
@@ -1,35 +1,136 @@
 #pragma once
 
 #define DEFAULT_CLOUDWATCH_NAMESPACE "KinesisVideoSDKCanary"
-#define DEFAULT_FPS_VALUE            25
 // TODO: This value shouldn't matter. But, since we don't allow NULL value, we have to set to a value
 #define DEFAULT_VIEWER_PEER_ID           "ConsumerViewer"
 #define DEFAULT_FILE_LOGGING_BUFFER_SIZE (200 * 1024)
 
 #define MAX_LOG_STREAM_NAME        512
-#define MAX_CLOUDWATCH_LOG_COUNT   128
 #define MAX_NUMBER_OF_LOG_FILES    10
 #define MAX_CONCURRENT_CONNECTIONS 10
 #define MAX_TURN_SERVERS           1
 #define MAX_STATUS_CODE_LENGTH     16
+#define MAX_SCENARIO_NAME_LENGTH   256
+// Combinations a scenario matrix may expand to
+#define MAX_SCENARIOS    64
+#define MAX_SESSIONS     1000
+#define MAX_STARTUP_RUNS 1000
 
-#define NUMBER_OF_H264_FRAME_FILES  1500
-#define NUMBER_OF_OPUS_FRAME_FILES  618
-#define SAMPLE_VIDEO_FRAME_DURATION (HUNDREDS_OF_NANOS_IN_A_SECOND / DEFAULT_FPS_VALUE)
-#define SAMPLE_AUDIO_FRAME_DURATION (20 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+// Log records waiting for the flush thread, the capacity has to be a power of two. Arguments that don't fit are cut off.
+#define LOG_RING_CAPACITY        4096
+#define LOG_RING_SLOT_SIZE       512
+#define LOG_RING_DRAIN_THRESHOLD (LOG_RING_CAPACITY / 4)
+#define LOG_DRAIN_PERIOD         (200 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+// Preformatted events, e.g. EMF metric records, waiting for the flush thread
+#define MAX_PENDING_LOG_EVENTS 10000
+// PutLogEvents limits, every event counts against the batch size with its message plus a fixed overhead
+#define MAX_CLOUDWATCH_LOG_COUNT      10000
+#define MAX_CLOUDWATCH_LOG_BATCH_SIZE (1024 * 1024)
+#define CLOUDWATCH_LOG_EVENT_OVERHEAD 26
+// How long the oldest event may wait for its batch to fill up
+#define LOG_BATCH_MAX_AGE       (1 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define LOG_STATS_REPORT_PERIOD (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+// Every log call site up to info level may log LOG_RATE_LIMIT messages per second after a burst of LOG_RATE_LIMIT_BURST,
+// the rest are counted and summarized every LOG_SUPPRESSION_REPORT_PERIOD
+#define LOG_RATE_LIMIT                10
+#define LOG_RATE_LIMIT_BURST          50
+#define LOG_SUPPRESSION_REPORT_PERIOD (10 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+// How much of the format string identifies a call site in the summary
+#define LOG_SUPPRESSION_FORMAT_LENGTH 80
+// Undelivered log batches are spooled to disk, at most LOG_SPOOL_MAX_SEGMENTS * LOG_SPOOL_SEGMENT_SIZE bytes. The
+// directory is named after the log group and the log stream.
+#define DEFAULT_LOG_SPOOL_PATH        "./log-spool"
+#define LOG_SPOOL_SEGMENT_SIZE        (4 * 1024 * 1024)
+#define LOG_SPOOL_MAX_SEGMENTS        16
+#define LOG_SPOOL_RETRY_PERIOD        (5 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define LOG_SPOOL_EXIT_REPLAY_TIMEOUT (10 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+// PutLogEvents rejects batches that span more than a day
+#define MAX_CLOUDWATCH_LOG_BATCH_SPAN (24 * HUNDREDS_OF_NANOS_IN_AN_HOUR)
+
+// PutMetricData limits: distinct values per datum and datums per request
+#define MAX_METRIC_DATUM_VALUES       150
+#define MAX_METRIC_DATUMS_PER_REQUEST 20
+// Distinct metric name, unit and dimension combinations that are aggregated at once
+#define MAX_PENDING_METRIC_BUCKETS 1000
+#define DEFAULT_METRICS_WINDOW     (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define DEFAULT_EMF_FILE_PATH      "./canary-metrics.emf"
+// Batches waiting for PutMetricData and batches being sent at once, see MetricQueue
+#define METRIC_QUEUE_CAPACITY      64
+#define MAX_METRIC_SENDS_IN_FLIGHT 4
+// Failed batches are retried after a jittered exponential backoff between the base and the max delay
+#define METRIC_SEND_MAX_RETRIES 3
+#define METRIC_RETRY_BASE_DELAY (500 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+#define METRIC_RETRY_MAX_DELAY  (30 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+// How long the exit waits for queued metrics, requests already in flight are bounded by the client timeouts
+#define METRIC_DRAIN_TIMEOUT         (10 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define TELEMETRY_CONNECT_TIMEOUT_MS 3000
+#define TELEMETRY_REQUEST_TIMEOUT_MS 5000
+// Latency histograms are in milliseconds, anything slower is recorded as this value
+#define MAX_TRACKED_LATENCY (10 * 60 * 1000)
+// Signaling message latencies are in microseconds
+#define MAX_TRACKED_SIGNALING_LATENCY (60 * 1000 * 1000)
+
+#define DEFAULT_ASSET_PACK_PATH "./assets/samples.kvsa"
+
+#define DEFAULT_FANOUT_WORKER_COUNT 2
+#define DEFAULT_FANOUT_QUEUE_DEPTH  16
+#define FANOUT_STATS_REPORT_PERIOD  (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+
+#define PACER_STATS_REPORT_PERIOD   (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define RECEIVE_STATS_REPORT_PERIOD (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+#define TERMINATION_POLL_PERIOD     (100 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+
+#define DEFAULT_SESSIONS_PER_SECOND 1
+
+// Share of the bandwidth estimate that the video rendition may use
+#define RENDITION_BITRATE_HEADROOM   0.8
+#define RENDITION_UPSWITCH_HOLD_TIME (5 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+
+// Messages a SignalingQueue holds at once, including the candidates waiting for their offer or answer
+#define MAX_QUEUED_SIGNALING_MESSAGES 1024
 
 #define ASYNC_ICE_CONFIG_INFO_WAIT_TIMEOUT (3 * HUNDREDS_OF_NANOS_IN_A_SECOND)
-#define ICE_CONFIG_INFO_POLL_PERIOD        (20 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
-
-#define CANARY_CHANNEL_NAME_ENV_VAR        "CANARY_CHANNEL_NAME"
-#define CANARY_CLIENT_ID_ENV_VAR           "CANARY_CLIENT_ID"
-#define CANARY_TRICKLE_ICE_ENV_VAR         "CANARY_TRICKLE_ICE"
-#define CANARY_IS_MASTER_ENV_VAR           "CANARY_IS_MASTER"
-#define CANARY_USE_TURN_ENV_VAR            "CANARY_USE_TURN"
-#define CANARY_LOG_GROUP_NAME_ENV_VAR      "CANARY_LOG_GROUP_NAME"
-#define CANARY_LOG_STREAM_NAME_ENV_VAR     "CANARY_LOG_STREAM_NAME"
-#define CANARY_CERT_PATH_ENV_VAR           "CANARY_CERT_PATH"
-#define CANARY_DURATION_IN_SECONDS_ENV_VAR "CANARY_DURATION_IN_SECONDS"
+
+// Next to the signaling client's own cache, cached TURN credentials have to outlive at least the first allocations
+#define ICE_SERVER_CACHE_FILE_PATH         "./.CanaryIceServerCache"
+#define ICE_SERVER_CACHE_MIN_REMAINING_TTL (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+// Where SIGNALING_API_CALL_CACHE_TYPE_FILE makes the signaling client keep the channel and endpoint lookups
+#define SIGNALING_CACHE_FILE_PATH "./.SignalingCache_v0"
+
+// A startup benchmark run that didn't get its first frame out by then counts as failed
+#define STARTUP_RUN_TIMEOUT (60 * HUNDREDS_OF_NANOS_IN_A_SECOND)
+
+// Trace events every thread keeps, see Tracer, and how much of an event's detail is kept
+#define TRACE_BUFFER_CAPACITY   16384
+#define TRACE_BUFFER_CHUNK_SIZE 256
+#define TRACE_DETAIL_LENGTH     63
+
+#define CANARY_CHANNEL_NAME_ENV_VAR           "CANARY_CHANNEL_NAME"
+#define CANARY_CLIENT_ID_ENV_VAR              "CANARY_CLIENT_ID"
+#define CANARY_TRICKLE_ICE_ENV_VAR            "CANARY_TRICKLE_ICE"
+#define CANARY_IS_MASTER_ENV_VAR              "CANARY_IS_MASTER"
+#define CANARY_USE_TURN_ENV_VAR               "CANARY_USE_TURN"
+#define CANARY_MAX_VIEWERS_ENV_VAR            "CANARY_MAX_VIEWERS"
+#define CANARY_PACER_OVERRUN_POLICY_ENV_VAR   "CANARY_PACER_OVERRUN_POLICY"
+#define CANARY_LOG_GROUP_NAME_ENV_VAR         "CANARY_LOG_GROUP_NAME"
+#define CANARY_LOG_STREAM_NAME_ENV_VAR        "CANARY_LOG_STREAM_NAME"
+#define CANARY_CERT_PATH_ENV_VAR              "CANARY_CERT_PATH"
+#define CANARY_DURATION_IN_SECONDS_ENV_VAR    "CANARY_DURATION_IN_SECONDS"
+#define CANARY_METRICS_WINDOW_SECONDS_ENV_VAR "CANARY_METRICS_WINDOW_SECONDS"
+#define CANARY_METRIC_SINK_ENV_VAR            "CANARY_METRIC_SINK"
+#define CANARY_METRIC_SINK_PATH_ENV_VAR       "CANARY_METRIC_SINK_PATH"
+#define CANARY_TELEMETRY_SINK_ENV_VAR         "CANARY_TELEMETRY_SINK"
+#define CANARY_TELEMETRY_SINK_PATH_ENV_VAR    "CANARY_TELEMETRY_SINK_PATH"
+#define CANARY_PROMETHEUS_PORT_ENV_VAR        "CANARY_PROMETHEUS_PORT"
+#define CANARY_CODEC_ENV_VAR                  "CANARY_CODEC"
+#define CANARY_MAX_BITRATE_KBPS_ENV_VAR       "CANARY_MAX_BITRATE_KBPS"
+#define CANARY_CONFIG_FILE_ENV_VAR            "CANARY_CONFIG_FILE"
+#define CANARY_SESSIONS_ENV_VAR               "CANARY_SESSIONS"
+#define CANARY_SESSIONS_PER_SECOND_ENV_VAR    "CANARY_SESSIONS_PER_SECOND"
+#define CANARY_SIGNALING_ENV_VAR              "CANARY_SIGNALING"
+#define CANARY_STARTUP_RUNS_ENV_VAR           "CANARY_STARTUP_RUNS"
+#define CANARY_STARTUP_CACHES_ENV_VAR         "CANARY_STARTUP_CACHES"
+#define CANARY_TRACE_FILE_ENV_VAR             "CANARY_TRACE_FILE"
 
 #include <aws/core/Aws.h>
 #include <aws/monitoring/CloudWatchClient.h>
@@ -40,9 +141,15 @@
 #include <aws/logs/model/PutLogEventsRequest.h>
 #include <aws/logs/model/DeleteLogStreamRequest.h>
 #include <aws/logs/model/DescribeLogStreamsRequest.h>
+#include <aws/core/utils/json/JsonSerializer.h>
 
 #include <com/amazonaws/kinesis/video/webrtcclient/Include.h>
 
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
+
 using namespace Aws::Client;
 using namespace Aws::CloudWatchLogs;
 using namespace Aws::CloudWatchLogs::Model;
@@ -50,8 +157,28 @@ using namespace Aws::CloudWatch::Model;
 using namespace Aws::CloudWatch;
 using namespace std;
 
+#include "LatencyHistogram.h"
+#include "Trace.h"
+#include "LogRecord.h"
+#include "LogRateLimiter.h"
+#include "EmbeddedMetricFormat.h"
+#include "TelemetrySink.h"
+#include "SignalingTransport.h"
+#include "IceServerCache.h"
+#include "LocalSignaling.h"
 #include "Config.h"
+#include "AssetPack.h"
+#include "FrameStore.h"
+#include "FrameMetadata.h"
+#include "FrameFanout.h"
+#include "MediaPacer.h"
+#include "ReceiveMetrics.h"
+#include "LogSpool.h"
 #include "CloudwatchLogs.h"
+#include "MetricQueue.h"
 #include "CloudwatchMonitoring.h"
 #include "Cloudwatch.h"
+#include "SignalingQueue.h"
 #include "Peer.h"
+#include "LoadGenerator.h"
+#include "StartupBenchmark.h"
@@ -0,0 +1,342 @@
+#include "Include.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace Canary {
+
+LoadGenerator::LoadGenerator(const Canary::PConfig pConfig, PFrameFanout pFanout, CloudwatchMonitoring* pMonitoring, const Peer::Callbacks& callbacks)
+    : pConfig(pConfig), pFanout(pFanout), pMonitoring(pMonitoring), callbacks(callbacks), terminated(FALSE), lastReportTime(GETTIME()),
+      lastCpuTime(0)
+{
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    // Only there in case the caller bailed out between start and stop
+    if (this->rampThread.joinable()) {
+        CHK_LOG_ERR(this->stop());
+    }
+}
+
+STATUS LoadGenerator::start()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(!this->rampThread.joinable(), STATUS_INVALID_OPERATION);
+
+    this->lastReportTime = GETTIME();
+    this->rampThread = std::thread(&LoadGenerator::runRamp, this);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS LoadGenerator::stop()
+{
+    STATUS retStatus = STATUS_SUCCESS, firstFailure = STATUS_SUCCESS;
+    UINT32 failed = 0, started;
+
+    {
+        std::lock_guard<std::mutex> lock(this->rampMutex);
+        this->terminated = TRUE;
+    }
+    this->rampCvar.notify_all();
+    if (this->rampThread.joinable()) {
+        this->rampThread.join();
+    }
+
+    // No session is added anymore, so the lock isn't needed from here on
+    for (auto& pSession : this->sessions) {
+        if (pSession->setupThread.joinable()) {
+            pSession->setupThread.join();
+        }
+    }
+
+    for (auto& pSession : this->sessions) {
+        // The viewer of a pair leaves first, as it would in a real session
+        if (pSession->viewerConnected) {
+            retStatus = pSession->pViewer->shutdown();
+            pSession->status = STATUS_FAILED(pSession->status) ? pSession->status : retStatus;
+        }
+        if (pSession->masterConnected) {
+            retStatus = pSession->pMaster->shutdown();
+            pSession->status = STATUS_FAILED(pSession->status) ? pSession->status : retStatus;
+        }
+
+        if (STATUS_FAILED(pSession->status)) {
+            firstFailure = STATUS_FAILED(firstFailure) ? firstFailure : pSession->status;
+            failed++;
+        }
+    }
+    // The run may have been stopped before the ramp started all of them
+    started = (UINT32) this->sessions.size();
+    this->sessions.clear();
+
+    if (failed != 0) {
+        DLOGW("%u of %u sessions failed, the first one with 0x%08x", failed, started, firstFailure);
+    }
+
+    // Some sessions failing is what a load test is there to find out, the run only fails when nothing worked
+    retStatus = STATUS_SUCCESS;
+    CHK(failed == 0 || failed < started, firstFailure);
+
+CleanUp:
+
+    return retStatus;
+}
+
+BOOL LoadGenerator::isDone()
+{
+    std::lock_guard<std::mutex> lock(this->sessionsMutex);
+
+    if (this->sessions.size() < this->pConfig->sessions) {
+        return FALSE;
+    }
+
+    for (auto& pSession : this->sessions) {
+        if (!this->isSessionDone(*pSession)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+VOID LoadGenerator::runRamp()
+{
+    std::unique_lock<std::mutex> lock(this->rampMutex);
+    UINT64 rampStartTime = GETTIME(), startTime, now;
+    UINT32 i;
+    PSession pSession;
+
+    for (i = 0; i < this->pConfig->sessions && !this->terminated; i++) {
+        startTime = rampStartTime + (UINT64) i * HUNDREDS_OF_NANOS_IN_A_SECOND / this->pConfig->sessionsPerSecond;
+        now = GETTIME();
+        if (this->rampCvar.wait_for(lock, std::chrono::milliseconds(startTime > now ? (startTime - now) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND : 0),
+                                    [this]() { return this->terminated.load(); })) {
+            break;
+        }
+
+        pSession = this->createSession(i);
+        {
+            std::lock_guard<std::mutex> sessionsLock(this->sessionsMutex);
+            for (auto& pRunning : this->sessions) {
+                pSession->concurrency += this->isSessionDone(*pRunning) ? 0 : 1;
+            }
+            this->sessions.push_back(pSession);
+        }
+
+        // Setting up blocks on signaling, the ramp goes on regardless of how long that takes
+        pSession->setupThread = std::thread([this, pSession]() { this->setupSession(*pSession); });
+    }
+}
+
+LoadGenerator::PSession LoadGenerator::createSession(UINT32 index)
+{
+    PSession pSession = std::make_shared<Session>();
+    Peer::Callbacks sessionCallbacks = this->callbacks;
+    // Owned by the session and so by the peers below, the callbacks can't hold a reference to it
+    Session* pRawSession = pSession.get();
+    BOOL singlePeer = this->pConfig->sessions == 1 && !this->pConfig->isPair;
+
+    pSession->index = index;
+    pSession->channelName = this->pConfig->pChannelName;
+    pSession->masterClientId = this->pConfig->pClientId;
+    if (this->pConfig->sessions > 1) {
+        pSession->channelName += "-" + std::to_string(index);
+        pSession->masterClientId += "-" + std::to_string(index);
+    }
+    pSession->viewerClientId = pSession->masterClientId + (this->pConfig->isPair ? "-viewer" : "");
+    pSession->concurrency = 0;
+    pSession->disconnected = FALSE;
+    pSession->setupDone = FALSE;
+    pSession->masterConnected = FALSE;
+    pSession->viewerConnected = FALSE;
+    pSession->status = STATUS_SUCCESS;
+    pSession->lastSentBytes = 0;
+
+    pSession->masterConfig = *this->pConfig;
+    pSession->masterConfig.pChannelName = pSession->channelName.c_str();
+    pSession->masterConfig.pClientId = pSession->masterClientId.c_str();
+    pSession->viewerConfig = pSession->masterConfig;
+    pSession->viewerConfig.pClientId = pSession->viewerClientId.c_str();
+    pSession->viewerConfig.isMaster = FALSE;
+    pSession->viewerConfig.isPair = FALSE;
+
+    sessionCallbacks.onDisconnected = [pRawSession]() { pRawSession->disconnected = TRUE; };
+    if (!singlePeer) {
+        sessionCallbacks.onBandwidthEstimation = NULL;
+    }
+
+    if (this->pConfig->isMaster) {
+        pSession->pMaster.reset(new Peer(&pSession->masterConfig, sessionCallbacks, this->pFanout, this->pMonitoring));
+    }
+    if (!this->pConfig->isMaster || this->pConfig->isPair) {
+        pSession->pViewer.reset(new Peer(&pSession->viewerConfig, sessionCallbacks, this->pFanout, this->pMonitoring));
+    }
+
+    return pSession;
+}
+
+STATUS LoadGenerator::setupSession(Session& session)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    // The master of a pair has to be on the channel before the viewer sends its offer
+    if (session.pMaster != nullptr) {
+        CHK_STATUS(session.pMaster->init());
+        CHK_STATUS(session.pMaster->connect());
+        session.masterConnected = TRUE;
+    }
+    if (session.pViewer != nullptr) {
+        CHK_STATUS(session.pViewer->init());
+        CHK_STATUS(session.pViewer->connect());
+        session.viewerConnected = TRUE;
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        DLOGW("Session %u on %s failed to set up with 0x%08x", session.index, session.channelName.c_str(), retStatus);
+    }
+
+    session.status = retStatus;
+    session.setupDone = TRUE;
+    return retStatus;
+}
+
+BOOL LoadGenerator::isSessionDone(Session& session)
+{
+    return session.setupDone && (STATUS_FAILED(session.status) || session.disconnected);
+}
+
+BOOL LoadGenerator::getSessionStats(UINT32 index, Peer::Stats& stats)
+{
+    PSession pSession;
+
+    {
+        std::lock_guard<std::mutex> lock(this->sessionsMutex);
+        if (index >= this->sessions.size()) {
+            return FALSE;
+        }
+        pSession = this->sessions[index];
+    }
+
+    stats = this->getSessionStats(*pSession);
+    return TRUE;
+}
+
+Peer::Stats LoadGenerator::getSessionStats(Session& session)
+{
+    Peer::Stats stats, peerStats;
+    std::vector<Peer*> peers;
+
+    if (session.pMaster != nullptr) {
+        peers.push_back(session.pMaster.get());
+    }
+    if (session.pViewer != nullptr) {
+        peers.push_back(session.pViewer.get());
+    }
+
+    MEMSET(&stats, 0x00, SIZEOF(stats));
+    for (auto pPeer : peers) {
+        peerStats = pPeer->getStats();
+        // The viewer of a pair is the one whose setup covers both sides
+        stats.signalingConnectTime = MAX(stats.signalingConnectTime, peerStats.signalingConnectTime);
+        stats.signalingClientCreateTime = MAX(stats.signalingClientCreateTime, peerStats.signalingClientCreateTime);
+        stats.signalingClientConnectTime = MAX(stats.signalingClientConnectTime, peerStats.signalingClientConnectTime);
+        stats.iceServerWaitTime = MAX(stats.iceServerWaitTime, peerStats.iceServerWaitTime);
+        stats.iceConnectTime = MAX(stats.iceConnectTime, peerStats.iceConnectTime);
+        stats.setupTime = MAX(stats.setupTime, peerStats.setupTime);
+        stats.firstFrameTime = MAX(stats.firstFrameTime, peerStats.firstFrameTime);
+        stats.failedConnections += peerStats.failedConnections;
+        stats.sentBytes += peerStats.sentBytes;
+    }
+
+    return stats;
+}
+
+VOID LoadGenerator::reportStats()
+{
+    std::vector<PSession> sessions;
+    UINT64 now = GETTIME(), elapsed = MAX(now - this->lastReportTime, 1), active = 0, failed = 0, totalSentBytes = 0, sentBytes;
+    Peer::Stats stats;
+
+    {
+        std::lock_guard<std::mutex> lock(this->sessionsMutex);
+        sessions = this->sessions;
+    }
+    this->lastReportTime = now;
+
+    for (auto& pSession : sessions) {
+        if (pSession->pMaster != nullptr) {
+            pSession->pMaster->reportReceiveStats();
+        }
+        if (pSession->pViewer != nullptr) {
+            pSession->pViewer->reportReceiveStats();
+        }
+
+        stats = this->getSessionStats(*pSession);
+        sentBytes = stats.sentBytes;
+        totalSentBytes += sentBytes - pSession->lastSentBytes;
+        if (pSession->setupDone && (STATUS_FAILED(pSession->status) || stats.failedConnections != 0)) {
+            failed++;
+        } else if (!this->isSessionDone(*pSession)) {
+            active++;
+        }
+
+        DLOGI("Session %u on %s: signaling %" PRIu64 " ms, TURN servers %" PRIu64 " ms, ICE %" PRIu64 " ms, setup %" PRIu64
+              " ms at %u concurrent sessions, sending %" PRIu64 " kbps, %" PRIu64 " failed connections, status 0x%08x",
+              pSession->index, pSession->channelName.c_str(), stats.signalingConnectTime, stats.iceServerWaitTime, stats.iceConnectTime,
+              stats.setupTime, pSession->concurrency, (sentBytes - pSession->lastSentBytes) * 8 * HUNDREDS_OF_NANOS_IN_A_SECOND / elapsed / 1000,
+              stats.failedConnections, pSession->status);
+        pSession->lastSentBytes = sentBytes;
+    }
+
+    this->pMonitoring->pushSessionStats(active, failed, (DOUBLE) totalSentBytes * 8 * HUNDREDS_OF_NANOS_IN_A_SECOND / elapsed / 1000);
+    this->reportProcessUsage(active, elapsed);
+}
+
+VOID LoadGenerator::reportProcessUsage(UINT64 sessions, UINT64 elapsed)
+{
+    UINT64 threads = 0, residentBytes = 0, cpuTime = 0;
+    DOUBLE cpuUsage = 0;
+
+#ifdef __linux__
+    CHAR line[256];
+    FILE* pStatus = FOPEN("/proc/self/status", "r");
+
+    if (pStatus != NULL) {
+        while (fgets(line, SIZEOF(line), pStatus) != NULL) {
+            if (STRNCMP(line, "Threads:", 8) == 0) {
+                threads = strtoull(line + 8, NULL, 10);
+            } else if (STRNCMP(line, "VmRSS:", 6) == 0) {
+                // in kB
+                residentBytes = strtoull(line + 6, NULL, 10) * 1024;
+            }
+        }
+        FCLOSE(pStatus);
+    }
+#endif
+
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        cpuTime = ((UINT64) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * HUNDREDS_OF_NANOS_IN_A_SECOND +
+            ((UINT64) usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * HUNDREDS_OF_NANOS_IN_A_MICROSECOND;
+        // Percent of a single core, the first report covers everything since the process started
+        cpuUsage = (DOUBLE) (cpuTime - this->lastCpuTime) * 100 / elapsed;
+        this->lastCpuTime = cpuTime;
+    }
+#endif
+
+    DLOGI("Process with %" PRIu64 " active sessions: %" PRIu64 " threads, %" PRIu64 " kB resident, %.1f%% CPU", sessions, threads,
+          residentBytes / 1024, cpuUsage);
+    this->pMonitoring->pushProcessUsage(threads, residentBytes, cpuUsage, sessions);
+}
+
+} // namespace Canary
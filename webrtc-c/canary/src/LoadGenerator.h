@@ -0,0 +1,81 @@
+#pragma once
+
+namespace Canary {
+
+class LoadGenerator;
+typedef LoadGenerator* PLoadGenerator;
+
+// LoadGenerator runs Config::sessions independent sessions in this process, each of them a master, a viewer or a
+// master and a viewer connected to each other, depending on the role. Sessions are started at
+// Config::sessionsPerSecond so that the signaling and ICE setup of one doesn't just measure the burst of all the others.
+//
+// With more than one session every session gets its own channel, <channel>-<index>, and its own client id. All of
+// them share the frame fanout, and so the single pacer, of the scenario. The pacer can only follow one bandwidth
+// estimate, so estimates are only forwarded when there is a single peer and otherwise the pacer stays at the cap.
+//
+// reportStats logs the setup times and the send rate of every session and pushes the aggregate session counts along
+// with the threads, memory and CPU of the process, which is what a scaling curve over the number of sessions needs.
+class LoadGenerator {
+  public:
+    LoadGenerator(const Canary::PConfig, PFrameFanout, CloudwatchMonitoring*, const Peer::Callbacks&);
+    ~LoadGenerator();
+    STATUS start();
+    // Shuts every session down, fails only when none of them could be set up
+    STATUS stop();
+    // Every session has been started and has either failed or disconnected again
+    BOOL isDone();
+    VOID reportStats();
+    // Setup times and counters of the index-th session that has been started, FALSE if it hasn't been started yet
+    BOOL getSessionStats(UINT32 index, Peer::Stats&);
+
+  private:
+    struct Session {
+        UINT32 index;
+        // storage of the channel name and the client id that the configs point to
+        std::string channelName;
+        std::string masterClientId;
+        std::string viewerClientId;
+        Config masterConfig;
+        Config viewerConfig;
+        // a pair has both, otherwise only one of them is there
+        std::unique_ptr<Peer> pMaster;
+        std::unique_ptr<Peer> pViewer;
+        std::thread setupThread;
+        // sessions that were already running when this one started
+        UINT32 concurrency;
+        std::atomic<BOOL> setupDone;
+        std::atomic<BOOL> disconnected;
+        // only read once the setup thread has been joined
+        BOOL masterConnected;
+        BOOL viewerConnected;
+        STATUS status;
+        UINT64 lastSentBytes;
+    };
+    typedef std::shared_ptr<Session> PSession;
+
+    const Canary::PConfig pConfig;
+    const PFrameFanout pFanout;
+    CloudwatchMonitoring* const pMonitoring;
+    const Peer::Callbacks callbacks;
+
+    // guards sessions, the ramp thread appends to it while the stats timer reads it
+    std::mutex sessionsMutex;
+    std::vector<PSession> sessions;
+    std::mutex rampMutex;
+    std::condition_variable rampCvar;
+    std::thread rampThread;
+    std::atomic<BOOL> terminated;
+
+    // metrics
+    UINT64 lastReportTime;
+    UINT64 lastCpuTime;
+
+    VOID runRamp();
+    PSession createSession(UINT32 index);
+    STATUS setupSession(Session&);
+    BOOL isSessionDone(Session&);
+    Peer::Stats getSessionStats(Session&);
+    VOID reportProcessUsage(UINT64 sessions, UINT64 elapsed);
+};
+
+} // namespace Canary
@@ -0,0 +1,200 @@
+#include "Include.h"
+
+namespace Canary {
+
+LocalSignalingRelay& LocalSignalingRelay::getInstance()
+{
+    static LocalSignalingRelay instance;
+    return instance;
+}
+
+STATUS LocalSignalingRelay::join(PLocalSignalingTransport pTransport)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    auto pConfig = pTransport->pConfig;
+    std::lock_guard<std::mutex> lock(this->channelsMutex);
+    auto& channel = this->channels[pConfig->pChannelName];
+
+    if (pConfig->isMaster) {
+        CHK_ERR(channel.pMaster == NULL, STATUS_INVALID_OPERATION, "Channel %s already has a master", pConfig->pChannelName);
+        channel.pMaster = pTransport;
+    } else {
+        CHK_ERR(channel.viewers.count(pConfig->pClientId) == 0, STATUS_INVALID_OPERATION, "Channel %s already has a viewer %s",
+                pConfig->pChannelName, pConfig->pClientId);
+        channel.viewers[pConfig->pClientId] = pTransport;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID LocalSignalingRelay::leave(PLocalSignalingTransport pTransport)
+{
+    auto pConfig = pTransport->pConfig;
+    std::lock_guard<std::mutex> lock(this->channelsMutex);
+    auto it = this->channels.find(pConfig->pChannelName);
+
+    if (it == this->channels.end()) {
+        return;
+    }
+
+    if (it->second.pMaster == pTransport) {
+        it->second.pMaster = NULL;
+    } else if (it->second.viewers.count(pConfig->pClientId) != 0 && it->second.viewers[pConfig->pClientId] == pTransport) {
+        it->second.viewers.erase(pConfig->pClientId);
+    }
+
+    if (it->second.pMaster == NULL && it->second.viewers.empty()) {
+        this->channels.erase(it);
+    }
+}
+
+STATUS LocalSignalingRelay::send(PLocalSignalingTransport pSender, PSignalingMessage pMsg)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    auto pConfig = pSender->pConfig;
+    PLocalSignalingTransport pReceiver = NULL;
+    std::lock_guard<std::mutex> lock(this->channelsMutex);
+    auto it = this->channels.find(pConfig->pChannelName);
+
+    CHK_ERR(it != this->channels.end(), STATUS_INVALID_OPERATION, "%s isn't connected to channel %s", pConfig->pClientId, pConfig->pChannelName);
+
+    if (!pConfig->isMaster) {
+        pReceiver = it->second.pMaster;
+    } else if (it->second.viewers.count(pMsg->peerClientId) != 0) {
+        pReceiver = it->second.viewers[pMsg->peerClientId];
+    }
+
+    // The service doesn't tell the sender either, the offer or answer just never gets a reply
+    CHK_WARN(pReceiver != NULL, retStatus, "Dropping message type %u on channel %s, %s isn't there", pMsg->messageType, pConfig->pChannelName,
+             pConfig->isMaster ? pMsg->peerClientId : "the master");
+
+    // Delivering under the lock makes sure that the receiver doesn't leave in between
+    pReceiver->deliver(*pMsg, pConfig->pClientId);
+
+CleanUp:
+
+    return retStatus;
+}
+
+LocalSignalingTransport::LocalSignalingTransport(const Canary::PConfig pConfig) : pConfig(pConfig), joined(FALSE), terminated(FALSE)
+{
+    MEMSET(&this->callbacks, 0x00, SIZEOF(this->callbacks));
+}
+
+LocalSignalingTransport::~LocalSignalingTransport()
+{
+    // Once the relay forgot about this transport nothing can be added to the inbox anymore
+    if (this->joined.exchange(FALSE)) {
+        LocalSignalingRelay::getInstance().leave(this);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->inboxMutex);
+        this->terminated = TRUE;
+    }
+    this->inboxCvar.notify_all();
+
+    if (this->deliveryThread.joinable()) {
+        this->deliveryThread.join();
+    }
+}
+
+STATUS LocalSignalingTransport::init(const SignalingClientCallbacks& callbacks)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    IceServerConfig config;
+
+    CHK(!this->deliveryThread.joinable(), STATUS_INVALID_OPERATION);
+
+    config.cached = FALSE;
+    this->resolveIceServers(STATUS_SUCCESS, config);
+    this->callbacks = callbacks;
+    this->changeState(SIGNALING_CLIENT_STATE_NEW);
+    this->deliveryThread = std::thread(&LocalSignalingTransport::runDelivery, this);
+    this->changeState(SIGNALING_CLIENT_STATE_READY);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS LocalSignalingTransport::connect()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(this->deliveryThread.joinable(), STATUS_INVALID_OPERATION);
+    CHK(!this->joined.load(), retStatus);
+
+    this->changeState(SIGNALING_CLIENT_STATE_CONNECTING);
+    CHK_STATUS(LocalSignalingRelay::getInstance().join(this));
+    this->joined = TRUE;
+    this->changeState(SIGNALING_CLIENT_STATE_CONNECTED);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS LocalSignalingTransport::send(PSignalingMessage pMsg)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pMsg != NULL, STATUS_NULL_ARG);
+    CHK_ERR(this->joined.load(), STATUS_INVALID_OPERATION, "Sending before connecting to channel %s", this->pConfig->pChannelName);
+    CHK_STATUS(LocalSignalingRelay::getInstance().send(this, pMsg));
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID LocalSignalingTransport::deliver(const SignalingMessage& message, const CHAR* pSenderClientId)
+{
+    std::unique_ptr<ReceivedSignalingMessage> pReceived(new ReceivedSignalingMessage());
+
+    MEMSET(pReceived.get(), 0x00, SIZEOF(ReceivedSignalingMessage));
+    pReceived->signalingMessage = message;
+    STRNCPY(pReceived->signalingMessage.peerClientId, pSenderClientId, MAX_SIGNALING_CLIENT_ID_LEN);
+    pReceived->statusCode = SERVICE_CALL_RESULT_OK;
+
+    {
+        std::lock_guard<std::mutex> lock(this->inboxMutex);
+        this->inbox.push_back(std::move(pReceived));
+    }
+    this->inboxCvar.notify_all();
+}
+
+VOID LocalSignalingTransport::runDelivery()
+{
+    std::unique_lock<std::mutex> lock(this->inboxMutex);
+    std::unique_ptr<ReceivedSignalingMessage> pReceived;
+
+    while (TRUE) {
+        this->inboxCvar.wait(lock, [this]() { return this->terminated || !this->inbox.empty(); });
+        if (this->terminated) {
+            break;
+        }
+
+        pReceived = std::move(this->inbox.front());
+        this->inbox.pop_front();
+
+        // The peer replies from within the callback, which goes through the relay and possibly back into this inbox
+        lock.unlock();
+        if (this->callbacks.messageReceivedFn != NULL) {
+            CHK_LOG_ERR(this->callbacks.messageReceivedFn(this->callbacks.customData, pReceived.get()));
+        }
+        pReceived.reset();
+        lock.lock();
+    }
+}
+
+VOID LocalSignalingTransport::changeState(SIGNALING_CLIENT_STATE state)
+{
+    if (this->callbacks.stateChangeFn != NULL) {
+        CHK_LOG_ERR(this->callbacks.stateChangeFn(this->callbacks.customData, state));
+    }
+}
+
+} // namespace Canary
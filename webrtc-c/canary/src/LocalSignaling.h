@@ -0,0 +1,61 @@
+#pragma once
+
+namespace Canary {
+
+class LocalSignalingTransport;
+typedef LocalSignalingTransport* PLocalSignalingTransport;
+
+// LocalSignalingRelay stands in for the KVS signaling service when masters and viewers run in the same process, e.g.
+// with the pair role or with a concurrent scenario matrix, so that they can set up their connections on a host without
+// network access or credentials. Like a single master channel of the service, a channel has at most one master and
+// any number of viewers: what a viewer sends goes to the master and what the master sends goes to the viewer with the
+// peerClientId of the message. The receiver sees the sender's client id as peerClientId, messages to a peer that
+// isn't there are dropped.
+class LocalSignalingRelay {
+  public:
+    static LocalSignalingRelay& getInstance();
+    STATUS join(PLocalSignalingTransport);
+    VOID leave(PLocalSignalingTransport);
+    STATUS send(PLocalSignalingTransport, PSignalingMessage);
+
+  private:
+    struct Channel {
+        PLocalSignalingTransport pMaster;
+        std::map<std::string, PLocalSignalingTransport> viewers;
+    };
+
+    // guards channels and what is delivered to their transports, so that nothing is delivered to a transport that left
+    std::mutex channelsMutex;
+    std::map<std::string, Channel> channels;
+};
+
+// LocalSignalingTransport connects a peer to the LocalSignalingRelay. Messages are delivered from a thread of the
+// receiving transport, as the signaling client would from its own, so that a peer waiting for ICE gathering while it
+// handles an offer doesn't hold up anybody else. There are no TURN servers, the peers only have host candidates.
+class LocalSignalingTransport : public SignalingTransport {
+  public:
+    LocalSignalingTransport(const Canary::PConfig);
+    ~LocalSignalingTransport();
+    STATUS init(const SignalingClientCallbacks&) override;
+    STATUS connect() override;
+    STATUS send(PSignalingMessage) override;
+
+  private:
+    friend class LocalSignalingRelay;
+
+    const Canary::PConfig pConfig;
+    SignalingClientCallbacks callbacks;
+    std::atomic<BOOL> joined;
+
+    std::mutex inboxMutex;
+    std::condition_variable inboxCvar;
+    std::deque<std::unique_ptr<ReceivedSignalingMessage>> inbox;
+    std::thread deliveryThread;
+    BOOL terminated;
+
+    VOID deliver(const SignalingMessage&, const CHAR* pSenderClientId);
+    VOID runDelivery();
+    VOID changeState(SIGNALING_CLIENT_STATE);
+};
+
+} // namespace Canary
@@ -0,0 +1,284 @@
+#include "Include.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace Canary {
+
+#define LOG_SPOOL_SEGMENT_PREFIX    "segment-"
+#define LOG_SPOOL_SEGMENT_EXTENSION ".kvsl"
+
+static PLogSpoolSegmentHeader getSegmentHeader(PBYTE pData)
+{
+    return (PLogSpoolSegmentHeader) pData;
+}
+
+LogSpool::LogSpool() : eventCount(0), opened(FALSE), lockFd(-1)
+{
+}
+
+LogSpool::~LogSpool()
+{
+    for (auto& segment : this->segments) {
+        this->unmapSegment(segment, FALSE);
+    }
+#ifndef _WIN32
+    // Releases the lock
+    if (this->lockFd >= 0) {
+        close(this->lockFd);
+    }
+#endif
+}
+
+std::string LogSpool::getSegmentPath(UINT32 index)
+{
+    CHAR name[64];
+
+    SNPRINTF(name, SIZEOF(name), LOG_SPOOL_SEGMENT_PREFIX "%010u" LOG_SPOOL_SEGMENT_EXTENSION, index);
+    return this->directory + "/" + name;
+}
+
+STATUS LogSpool::open(const std::string& directory)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+#ifndef _WIN32
+    DIR* pDir = NULL;
+    struct dirent* pEntry;
+    std::vector<UINT32> indexes;
+    Segment segment;
+    PLogSpoolSegmentHeader pHeader;
+    LogSpoolEventHeader event;
+    UINT64 offset;
+    UINT32 index;
+    CHAR extension[16];
+
+    CHK(!this->opened, STATUS_INVALID_OPERATION);
+    this->directory = directory;
+
+    CHK_ERR(mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST, STATUS_INVALID_OPERATION, "Failed to create log spool directory %s",
+            directory.c_str());
+    // Another canary using the same directory would truncate and consume the segments of this one
+    CHK_ERR((this->lockFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY)) >= 0, STATUS_DIRECTORY_OPEN_FAILED,
+            "Failed to open log spool directory %s", directory.c_str());
+    CHK_ERR(flock(this->lockFd, LOCK_EX | LOCK_NB) == 0, STATUS_INVALID_OPERATION, "Log spool directory %s is locked by another process",
+            directory.c_str());
+    CHK_ERR((pDir = opendir(directory.c_str())) != NULL, STATUS_DIRECTORY_OPEN_FAILED, "Failed to open log spool directory %s", directory.c_str());
+    while ((pEntry = readdir(pDir)) != NULL) {
+        if (sscanf(pEntry->d_name, LOG_SPOOL_SEGMENT_PREFIX "%u%15s", &index, extension) == 2 && STRCMP(extension, LOG_SPOOL_SEGMENT_EXTENSION) == 0) {
+            indexes.push_back(index);
+        }
+    }
+    std::sort(indexes.begin(), indexes.end());
+
+    // Recover whatever the previous run couldn't deliver, empty and corrupted segments are dropped
+    for (auto segmentIndex : indexes) {
+        if (STATUS_FAILED(this->mapSegment(segmentIndex, FALSE, &segment))) {
+            continue;
+        }
+
+        pHeader = getSegmentHeader(segment.pData);
+        if (pHeader->magic != LOG_SPOOL_SEGMENT_MAGIC || pHeader->version != LOG_SPOOL_SEGMENT_VERSION ||
+            pHeader->writeOffset > LOG_SPOOL_SEGMENT_SIZE || pHeader->readOffset < SIZEOF(LogSpoolSegmentHeader) ||
+            pHeader->readOffset >= pHeader->writeOffset || this->segments.size() == LOG_SPOOL_MAX_SEGMENTS) {
+            this->unmapSegment(segment, TRUE);
+            continue;
+        }
+
+        for (offset = pHeader->readOffset; offset < pHeader->writeOffset; offset += SIZEOF(event) + event.size) {
+            if (offset + SIZEOF(event) > pHeader->writeOffset) {
+                // Keep what is intact
+                pHeader->writeOffset = offset;
+                break;
+            }
+            MEMCPY(&event, segment.pData + offset, SIZEOF(event));
+            if (offset + SIZEOF(event) + event.size > pHeader->writeOffset) {
+                pHeader->writeOffset = offset;
+                break;
+            }
+            this->eventCount++;
+        }
+        if (pHeader->readOffset == pHeader->writeOffset) {
+            this->unmapSegment(segment, TRUE);
+            continue;
+        }
+        this->segments.push_back(segment);
+    }
+
+    this->opened = TRUE;
+
+CleanUp:
+
+    if (pDir != NULL) {
+        closedir(pDir);
+    }
+    if (!this->opened && this->lockFd >= 0) {
+        close(this->lockFd);
+        this->lockFd = -1;
+    }
+#else
+    UNUSED_PARAM(directory);
+    retStatus = STATUS_NOT_IMPLEMENTED;
+#endif
+
+    return retStatus;
+}
+
+STATUS LogSpool::mapSegment(UINT32 index, BOOL create, Segment* pSegment)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+#ifndef _WIN32
+    std::string path = this->getSegmentPath(index);
+    INT32 fd = -1;
+    struct stat fileStat;
+    PVOID pMapped;
+
+    CHK_ERR((fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644)) >= 0, STATUS_OPEN_FILE_FAILED, "Failed to open %s",
+            path.c_str());
+    if (create) {
+        CHK_ERR(ftruncate(fd, LOG_SPOOL_SEGMENT_SIZE) == 0, STATUS_WRITE_TO_FILE_FAILED, "Failed to allocate %s", path.c_str());
+    } else {
+        CHK_ERR(fstat(fd, &fileStat) == 0 && fileStat.st_size == LOG_SPOOL_SEGMENT_SIZE, STATUS_READ_FILE_FAILED, "Unexpected size of %s",
+                path.c_str());
+    }
+
+    pMapped = mmap(NULL, LOG_SPOOL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CHK_ERR(pMapped != MAP_FAILED, STATUS_READ_FILE_FAILED, "Failed to map %s", path.c_str());
+
+    pSegment->index = index;
+    pSegment->pData = (PBYTE) pMapped;
+    if (create) {
+        getSegmentHeader(pSegment->pData)->magic = LOG_SPOOL_SEGMENT_MAGIC;
+        getSegmentHeader(pSegment->pData)->version = LOG_SPOOL_SEGMENT_VERSION;
+        getSegmentHeader(pSegment->pData)->readOffset = SIZEOF(LogSpoolSegmentHeader);
+        getSegmentHeader(pSegment->pData)->writeOffset = SIZEOF(LogSpoolSegmentHeader);
+    }
+
+CleanUp:
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (STATUS_FAILED(retStatus) && !create) {
+        // Not worth keeping around, it can't be replayed anyway
+        unlink(path.c_str());
+    }
+#else
+    UNUSED_PARAM(index);
+    UNUSED_PARAM(create);
+    UNUSED_PARAM(pSegment);
+    retStatus = STATUS_NOT_IMPLEMENTED;
+#endif
+
+    return retStatus;
+}
+
+VOID LogSpool::unmapSegment(const Segment& segment, BOOL remove)
+{
+#ifndef _WIN32
+    munmap(segment.pData, LOG_SPOOL_SEGMENT_SIZE);
+    if (remove) {
+        unlink(this->getSegmentPath(segment.index).c_str());
+    }
+#else
+    UNUSED_PARAM(segment);
+    UNUSED_PARAM(remove);
+#endif
+}
+
+BOOL LogSpool::isOpen()
+{
+    return this->opened;
+}
+
+BOOL LogSpool::isEmpty()
+{
+    return this->eventCount == 0;
+}
+
+UINT64 LogSpool::getEventCount()
+{
+    return this->eventCount;
+}
+
+BOOL LogSpool::append(UINT64 timestamp, const CHAR* pMessage, UINT32 size)
+{
+    UINT64 eventSize = SIZEOF(LogSpoolEventHeader) + size;
+    PLogSpoolSegmentHeader pHeader;
+    LogSpoolEventHeader event;
+    Segment segment;
+
+    if (!this->opened || eventSize > LOG_SPOOL_SEGMENT_SIZE - SIZEOF(LogSpoolSegmentHeader)) {
+        return FALSE;
+    }
+
+    if (this->segments.empty() || getSegmentHeader(this->segments.back().pData)->writeOffset + eventSize > LOG_SPOOL_SEGMENT_SIZE) {
+        if (this->segments.size() == LOG_SPOOL_MAX_SEGMENTS ||
+            STATUS_FAILED(this->mapSegment(this->segments.empty() ? 0 : this->segments.back().index + 1, TRUE, &segment))) {
+            return FALSE;
+        }
+        this->segments.push_back(segment);
+    }
+
+    pHeader = getSegmentHeader(this->segments.back().pData);
+    event.timestamp = timestamp;
+    event.size = size;
+    MEMCPY(this->segments.back().pData + pHeader->writeOffset, &event, SIZEOF(event));
+    MEMCPY(this->segments.back().pData + pHeader->writeOffset + SIZEOF(event), pMessage, size);
+    // Published last, a crash in between leaves the event out instead of a torn one in
+    pHeader->writeOffset += eventSize;
+    this->eventCount++;
+
+    return TRUE;
+}
+
+LogSpool::Position LogSpool::read(const std::function<BOOL(UINT64, const CHAR*, UINT32)>& visitor)
+{
+    Position position = {0, 0};
+    PLogSpoolSegmentHeader pHeader;
+    LogSpoolEventHeader event;
+    UINT64 offset;
+
+    for (auto& segment : this->segments) {
+        pHeader = getSegmentHeader(segment.pData);
+        for (offset = pHeader->readOffset; offset < pHeader->writeOffset; offset += SIZEOF(event) + event.size) {
+            MEMCPY(&event, segment.pData + offset, SIZEOF(event));
+            if (!visitor(event.timestamp, (const CHAR*) segment.pData + offset + SIZEOF(event), event.size)) {
+                return position;
+            }
+            position.segment = segment.index;
+            position.offset = offset + SIZEOF(event) + event.size;
+        }
+    }
+
+    return position;
+}
+
+VOID LogSpool::consume(const Position& position)
+{
+    PLogSpoolSegmentHeader pHeader;
+    LogSpoolEventHeader event;
+    UINT64 offset, end;
+
+    while (!this->segments.empty() && this->segments.front().index <= position.segment) {
+        pHeader = getSegmentHeader(this->segments.front().pData);
+        end = this->segments.front().index == position.segment ? MIN(position.offset, pHeader->writeOffset) : pHeader->writeOffset;
+        for (offset = pHeader->readOffset; offset < end; offset += SIZEOF(event) + event.size) {
+            MEMCPY(&event, this->segments.front().pData + offset, SIZEOF(event));
+            this->eventCount--;
+        }
+        pHeader->readOffset = MAX(pHeader->readOffset, end);
+
+        if (pHeader->readOffset < pHeader->writeOffset) {
+            break;
+        }
+        this->unmapSegment(this->segments.front(), TRUE);
+        this->segments.pop_front();
+    }
+}
+
+} // namespace Canary
@@ -0,0 +1,75 @@
+#pragma once
+
+namespace Canary {
+
+#define LOG_SPOOL_SEGMENT_MAGIC   0x4c53564b // "KVSL"
+#define LOG_SPOOL_SEGMENT_VERSION 1
+
+// Every segment file starts with this header. The offsets are relative to the start of the file and are updated in
+// place, so the spool survives a restart of the canary.
+typedef struct {
+    UINT32 magic;
+    UINT32 version;
+    // first event that hasn't been delivered yet
+    UINT64 readOffset;
+    // end of the last appended event
+    UINT64 writeOffset;
+} LogSpoolSegmentHeader, *PLogSpoolSegmentHeader;
+
+// Followed by size bytes of message
+typedef struct {
+    UINT64 timestamp;
+    UINT32 size;
+} LogSpoolEventHeader, *PLogSpoolEventHeader;
+
+// LogSpool is an append-only queue of log events on disk, made of fixed size memory mapped segment files in a
+// directory. CloudwatchLogs appends batches it can't deliver and replays them in order once CloudWatch is reachable
+// again. Events are only removed from the spool by consume, after they have been delivered, so anything that wasn't
+// delivered before the canary exits is replayed by the next run.
+//
+// The spool holds at most LOG_SPOOL_MAX_SEGMENTS segments of LOG_SPOOL_SEGMENT_SIZE bytes, append fails once they are
+// full. Segments are deleted as soon as everything in them is consumed.
+//
+// The directory is locked while the spool is open, open fails if another process holds the lock.
+//
+// LogSpool is not thread safe, it is only used by the log flush thread.
+class LogSpool {
+  public:
+    // Where the next read starts, or up to where the events have been read
+    struct Position {
+        UINT32 segment;
+        UINT64 offset;
+    };
+
+    LogSpool();
+    ~LogSpool();
+    STATUS open(const std::string& directory);
+    BOOL isOpen();
+    BOOL isEmpty();
+    // Number of events appended and not consumed yet
+    UINT64 getEventCount();
+    BOOL append(UINT64 timestamp, const CHAR* pMessage, UINT32 size);
+    // Calls the visitor for the undelivered events in order until it returns FALSE, returns the position after the
+    // last event it accepted
+    Position read(const std::function<BOOL(UINT64, const CHAR*, UINT32)>& visitor);
+    VOID consume(const Position& position);
+
+  private:
+    struct Segment {
+        UINT32 index;
+        PBYTE pData;
+    };
+
+    std::string directory;
+    std::deque<Segment> segments;
+    UINT64 eventCount;
+    BOOL opened;
+    // holds the lock of the directory
+    INT32 lockFd;
+
+    std::string getSegmentPath(UINT32 index);
+    STATUS mapSegment(UINT32 index, BOOL create, Segment* pSegment);
+    VOID unmapSegment(const Segment& segment, BOOL remove);
+};
+
+} // namespace Canary
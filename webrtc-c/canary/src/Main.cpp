@@ -1,8 +1,9 @@
 #include "Include.h"
 
-STATUS onNewConnection(Canary::PPeer);
-STATUS run(Canary::PConfig);
-VOID sendLocalFrames(Canary::PPeer, MEDIA_STREAM_TRACK_KIND, const std::string&, UINT64, UINT32);
+STATUS onNewConnection(Canary::PConfig, Canary::Peer::Connection&);
+STATUS run(std::vector<Canary::Config>&, BOOL, Canary::StartupPhases&);
+STATUS runScenario(Canary::PConfig, Canary::PFrameStore, TIMER_QUEUE_HANDLE, BOOL, const Canary::StartupPhases&);
+STATUS runPeer(Canary::PConfig, Canary::PFrameStore, TIMER_QUEUE_HANDLE, Canary::CloudwatchMonitoring*, const Canary::StartupPhases&);
 
 std::atomic<bool> terminated;
 VOID handleSignal(INT32 signal)
@@ -23,16 +24,30 @@ INT32 main(INT32 argc, CHAR* argv[])
     // Make sure that all destructors have been called first before resetting the instrumented allocators
     CHK_STATUS([&]() -> STATUS {
         STATUS retStatus = STATUS_SUCCESS;
-        Canary::Config config;
+        std::vector<Canary::Config> scenarios;
+        BOOL concurrent;
+        Canary::StartupPhases processPhases;
+        UINT64 startTime = GETTIME();
 
         Aws::SDKOptions options;
         Aws::InitAPI(options);
 
-        CHK_STATUS(Canary::Config::init(argc, argv, &config));
-        CHK_STATUS(run(&config));
+        MEMSET(&processPhases, 0x00, SIZEOF(processPhases));
+        processPhases.durations[Canary::STARTUP_PHASE_AWS_INIT] = MAX((GETTIME() - startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, 1);
+        Canary::Tracer::getInstance().complete("startup", "Aws::InitAPI", startTime);
+
+        // The tracer has been recording since the start, the config only decides whether it keeps doing so
+        startTime = GETTIME();
+        CHK_STATUS(Canary::Config::init(argc, argv, scenarios, &concurrent));
+        Canary::Tracer::getInstance().complete("startup", "Config::init", startTime);
+        Canary::Tracer::getInstance().configure(scenarios[0].pTraceFilePath);
+
+        CHK_STATUS(run(scenarios, concurrent, processPhases));
 
     CleanUp:
 
+        // A failed run is when the trace is needed most
+        CHK_LOG_ERR(Canary::Tracer::getInstance().write());
         Aws::ShutdownAPI(options);
 
         return retStatus;
@@ -52,53 +67,80 @@ CleanUp:
     return STATUS_FAILED(retStatus) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-STATUS run(Canary::PConfig pConfig)
+// The AWS SDK, the telemetry pipeline, the WebRTC SDK and the frame store are set up once and shared by all of the
+// scenarios, only the peer and its media path are per scenario
+STATUS run(std::vector<Canary::Config>& scenarios, BOOL concurrent, Canary::StartupPhases& processPhases)
 {
     STATUS retStatus = STATUS_SUCCESS;
-    BOOL initialized = FALSE;
+    BOOL initialized = FALSE, scenariosStarted = FALSE;
     TIMER_QUEUE_HANDLE timerQueueHandle = 0;
-    UINT32 timeoutTimerId;
+    UINT32 logStatsTimerId, i;
+    // Declared ahead of any CHK so that it outlives the timer queue below
+    Canary::FrameStore frameStore;
+    std::vector<std::thread> threads;
+    std::vector<STATUS> statuses(scenarios.size(), STATUS_SUCCESS);
+    // The first scenario also configures the process wide logging and telemetry
+    Canary::PConfig pConfig = &scenarios[0];
+    UINT64 startTime = GETTIME();
 
     CHK_STATUS(Canary::Cloudwatch::init(pConfig));
+    processPhases.durations[Canary::STARTUP_PHASE_CLOUDWATCH_INIT] = MAX((GETTIME() - startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, 1);
+    Canary::Tracer::getInstance().complete("startup", "Cloudwatch::init", startTime);
+    startTime = GETTIME();
     CHK_STATUS(initKvsWebRtc());
+    processPhases.durations[Canary::STARTUP_PHASE_KVS_WEBRTC_INIT] = MAX((GETTIME() - startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, 1);
+    Canary::Tracer::getInstance().complete("startup", "initKvsWebRtc", startTime);
     initialized = TRUE;
 
+    // Cloudwatch::init may have fallen back to another metric sink
+    for (auto& scenario : scenarios) {
+        scenario.metricSink = pConfig->metricSink;
+    }
+
     SET_LOGGER_LOG_LEVEL(pConfig->logLevel);
-    pConfig->print();
+    for (auto& scenario : scenarios) {
+        scenario.print();
+    }
 
     CHK_STATUS(timerQueueCreate(&timerQueueHandle));
 
-    if (pConfig->duration != 0) {
-        auto terminate = [](UINT32 timerId, UINT64 currentTime, UINT64 customData) -> STATUS {
+    CHK_STATUS(timerQueueAddTimer(
+        timerQueueHandle, LOG_STATS_REPORT_PERIOD, LOG_STATS_REPORT_PERIOD,
+        [](UINT32 timerId, UINT64 currentTime, UINT64 customData) -> STATUS {
             UNUSED_PARAM(timerId);
             UNUSED_PARAM(currentTime);
             UNUSED_PARAM(customData);
-            terminated = TRUE;
-            return STATUS_TIMER_QUEUE_STOP_SCHEDULING;
-        };
-        CHK_STATUS(
-            timerQueueAddTimer(timerQueueHandle, pConfig->duration, TIMER_QUEUE_SINGLE_INVOCATION_PERIOD, terminate, (UINT64) NULL, &timeoutTimerId));
-    }
-
-    {
-        Canary::Peer::Callbacks callbacks;
-        callbacks.onNewConnection = onNewConnection;
-        callbacks.onDisconnected = []() { terminated = TRUE; };
-
-        RtcMediaStreamTrack videoTrack, audioTrack;
+            Canary::Cloudwatch::getInstance().logs.reportStats();
+            return STATUS_SUCCESS;
+        },
+        (UINT64) NULL, &logStatsTimerId));
 
-        Canary::Peer peer(pConfig, callbacks);
-        CHK_STATUS(peer.init());
-        CHK_STATUS(peer.connect());
-
-        std::thread videoThread(sendLocalFrames, &peer, MEDIA_STREAM_TRACK_KIND_VIDEO, "./assets/h264SampleFrames/frame-%04d.h264",
-                                NUMBER_OF_H264_FRAME_FILES, SAMPLE_VIDEO_FRAME_DURATION);
-        std::thread audioThread(sendLocalFrames, &peer, MEDIA_STREAM_TRACK_KIND_AUDIO, "./assets/opusSampleFrames/sample-%03d.opus",
-                                NUMBER_OF_OPUS_FRAME_FILES, SAMPLE_AUDIO_FRAME_DURATION);
+    // Map all of the sample frames before connecting so that the pacers never touch the disk
+    startTime = GETTIME();
+    CHK_STATUS(frameStore.init(DEFAULT_ASSET_PACK_PATH));
+    Canary::Tracer::getInstance().complete("startup", "FrameStore::init", startTime);
+
+    // From here on every scenario publishes its own exit status
+    scenariosStarted = TRUE;
+    if (concurrent) {
+        for (i = 0; i < scenarios.size(); i++) {
+            threads.emplace_back(
+                [&, i]() { statuses[i] = runScenario(&scenarios[i], &frameStore, timerQueueHandle, scenarios.size() == 1, processPhases); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    } else {
+        for (i = 0; i < scenarios.size() && !terminated.load(); i++) {
+            statuses[i] = runScenario(&scenarios[i], &frameStore, timerQueueHandle, scenarios.size() == 1, processPhases);
+        }
+    }
 
-        videoThread.join();
-        audioThread.join();
-        CHK_STATUS(peer.shutdown());
+    for (i = 0; i < scenarios.size(); i++) {
+        if (scenarios.size() > 1) {
+            DLOGI("Scenario %s exited with 0x%08x", scenarios[i].pScenarioName, statuses[i]);
+        }
+        retStatus = STATUS_FAILED(retStatus) ? retStatus : statuses[i];
     }
 
 CleanUp:
@@ -108,7 +150,7 @@ CleanUp:
     }
 
     DLOGI("Exiting with 0x%08x", retStatus);
-    if (initialized) {
+    if (initialized && !scenariosStarted) {
         Canary::Cloudwatch::getInstance().monitoring.pushExitStatus(retStatus);
     }
 
@@ -118,7 +160,128 @@ CleanUp:
     return retStatus;
 }
 
-STATUS onNewConnection(Canary::PPeer pPeer)
+STATUS runScenario(Canary::PConfig pConfig, Canary::PFrameStore pFrameStore, TIMER_QUEUE_HANDLE timerQueueHandle, BOOL sharedMonitoring,
+                   const Canary::StartupPhases& processPhases)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::unique_ptr<Canary::CloudwatchMonitoring> scenarioMonitoring;
+    Canary::CloudwatchMonitoring* pMonitoring = &Canary::Cloudwatch::getInstance().monitoring;
+
+    // Every scenario of a matrix publishes its own metrics, so that their Channel dimensions don't mix
+    if (!sharedMonitoring) {
+        scenarioMonitoring.reset(new Canary::CloudwatchMonitoring(pConfig));
+        CHK_STATUS(scenarioMonitoring->init(Canary::Cloudwatch::getInstance().sink.get()));
+        pMonitoring = scenarioMonitoring.get();
+    }
+
+    retStatus = runPeer(pConfig, pFrameStore, timerQueueHandle, pMonitoring, processPhases);
+    pMonitoring->pushExitStatus(retStatus);
+
+CleanUp:
+
+    if (scenarioMonitoring != nullptr) {
+        scenarioMonitoring->deinit();
+    }
+
+    return retStatus;
+}
+
+STATUS runPeer(Canary::PConfig pConfig, Canary::PFrameStore pFrameStore, TIMER_QUEUE_HANDLE timerQueueHandle,
+               Canary::CloudwatchMonitoring* pMonitoring, const Canary::StartupPhases& processPhases)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 fanoutStatsTimerId, pacerStatsTimerId, receiveStatsTimerId;
+    BOOL fanoutStatsTimerAdded = FALSE, pacerStatsTimerAdded = FALSE;
+    UINT64 deadline = pConfig->duration == 0 ? MAX_UINT64 : GETTIME() + pConfig->duration;
+    // Declared ahead of any CHK so that the timers can be cancelled before they go away
+    Canary::FrameFanout fanout(DEFAULT_FANOUT_WORKER_COUNT, DEFAULT_FANOUT_QUEUE_DEPTH, pMonitoring);
+    Canary::MediaPacer pacer(pFrameStore, &fanout, pConfig->pacerOverrunPolicy, pMonitoring);
+    Canary::Peer::Callbacks callbacks;
+
+    callbacks.onNewConnection = [pConfig](Canary::Peer::Connection& connection) { return onNewConnection(pConfig, connection); };
+    callbacks.onBandwidthEstimation = [&pacer, pConfig](UINT64 bitrate) {
+        pacer.setBandwidthEstimate(pConfig->maxVideoBitrate == 0 ? bitrate : MIN(bitrate, pConfig->maxVideoBitrate));
+    };
+    // Until the first estimate arrives the cap is the best guess there is
+    pacer.setBandwidthEstimate(pConfig->maxVideoBitrate);
+
+    CHK_STATUS(fanout.start());
+    CHK_STATUS(timerQueueAddTimer(
+        timerQueueHandle, FANOUT_STATS_REPORT_PERIOD, FANOUT_STATS_REPORT_PERIOD,
+        [](UINT32 timerId, UINT64 currentTime, UINT64 customData) -> STATUS {
+            UNUSED_PARAM(timerId);
+            UNUSED_PARAM(currentTime);
+            ((Canary::PFrameFanout) customData)->reportStats();
+            return STATUS_SUCCESS;
+        },
+        (UINT64) &fanout, &fanoutStatsTimerId));
+    fanoutStatsTimerAdded = TRUE;
+    CHK_STATUS(timerQueueAddTimer(
+        timerQueueHandle, PACER_STATS_REPORT_PERIOD, PACER_STATS_REPORT_PERIOD,
+        [](UINT32 timerId, UINT64 currentTime, UINT64 customData) -> STATUS {
+            UNUSED_PARAM(timerId);
+            UNUSED_PARAM(currentTime);
+            ((Canary::PMediaPacer) customData)->reportStats();
+            return STATUS_SUCCESS;
+        },
+        (UINT64) &pacer, &pacerStatsTimerId));
+    pacerStatsTimerAdded = TRUE;
+
+    CHK_STATUS(pacer.addTrack(MEDIA_STREAM_TRACK_KIND_VIDEO));
+    CHK_STATUS(pacer.addTrack(MEDIA_STREAM_TRACK_KIND_AUDIO, pConfig->stampAudio));
+
+    if (pConfig->startupRuns != 0) {
+        // The pacer keeps going across the runs, so that the first frame of a run only waits for the session to be set up
+        CHK_STATUS(pacer.start());
+        Canary::StartupBenchmark benchmark(pConfig, &fanout, pMonitoring, callbacks, processPhases);
+        retStatus = benchmark.run(terminated);
+        pacer.stop();
+        fanout.reportStats();
+    } else {
+        // Sessions come up in the background, every one of them stays until it disconnects or the canary exits
+        Canary::LoadGenerator generator(pConfig, &fanout, pMonitoring, callbacks);
+        CHK_STATUS(generator.start());
+
+        // The generator doesn't outlive this block, so the timer is cancelled before leaving it, whether the pacer ran or not
+        CHK_STATUS(timerQueueAddTimer(
+            timerQueueHandle, RECEIVE_STATS_REPORT_PERIOD, RECEIVE_STATS_REPORT_PERIOD,
+            [](UINT32 timerId, UINT64 currentTime, UINT64 customData) -> STATUS {
+                UNUSED_PARAM(timerId);
+                UNUSED_PARAM(currentTime);
+                ((Canary::PLoadGenerator) customData)->reportStats();
+                return STATUS_SUCCESS;
+            },
+            (UINT64) &generator, &receiveStatsTimerId));
+
+        // A single pacer thread publishes every track, no matter how many sessions and viewers the frames are fanned out to
+        if (STATUS_SUCCEEDED(retStatus = pacer.start())) {
+            while (!terminated.load() && !generator.isDone() && GETTIME() < deadline) {
+                THREAD_SLEEP(TERMINATION_POLL_PERIOD);
+            }
+            pacer.stop();
+        }
+        CHK_LOG_ERR(timerQueueCancelTimer(timerQueueHandle, receiveStatsTimerId, (UINT64) &generator));
+        CHK_STATUS(retStatus);
+
+        pacer.reportStats();
+        fanout.reportStats();
+        generator.reportStats();
+        CHK_STATUS(generator.stop());
+    }
+
+CleanUp:
+
+    if (pacerStatsTimerAdded) {
+        CHK_LOG_ERR(timerQueueCancelTimer(timerQueueHandle, pacerStatsTimerId, (UINT64) &pacer));
+    }
+    if (fanoutStatsTimerAdded) {
+        CHK_LOG_ERR(timerQueueCancelTimer(timerQueueHandle, fanoutStatsTimerId, (UINT64) &fanout));
+    }
+
+    return retStatus;
+}
+
+STATUS onNewConnection(Canary::PConfig pConfig, Canary::Peer::Connection& connection)
 {
     STATUS retStatus = STATUS_SUCCESS;
     RtcMediaStreamTrack videoTrack, audioTrack;
@@ -126,79 +289,25 @@ STATUS onNewConnection(Canary::PPeer pPeer)
     MEMSET(&videoTrack, 0x00, SIZEOF(RtcMediaStreamTrack));
     MEMSET(&audioTrack, 0x00, SIZEOF(RtcMediaStreamTrack));
 
-    // Declare that we support H264,Profile=42E01F,level-asymmetry-allowed=1,packetization-mode=1 and Opus
-    CHK_STATUS(pPeer->addSupportedCodec(RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE));
-    CHK_STATUS(pPeer->addSupportedCodec(RTC_CODEC_OPUS));
+    // Declare that we support the configured video codec, H264,Profile=42E01F,level-asymmetry-allowed=1,packetization-mode=1 by default, and Opus
+    CHK_STATUS(connection.addSupportedCodec(pConfig->videoCodec));
+    CHK_STATUS(connection.addSupportedCodec(RTC_CODEC_OPUS));
 
     // Add a SendRecv Transceiver of type video
     videoTrack.kind = MEDIA_STREAM_TRACK_KIND_VIDEO;
-    videoTrack.codec = RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE;
+    videoTrack.codec = pConfig->videoCodec;
     STRCPY(videoTrack.streamId, "myKvsVideoStream");
     STRCPY(videoTrack.trackId, "myVideoTrack");
-    CHK_STATUS(pPeer->addTransceiver(videoTrack));
+    CHK_STATUS(connection.addTransceiver(videoTrack));
 
     // Add a SendRecv Transceiver of type video
     audioTrack.kind = MEDIA_STREAM_TRACK_KIND_AUDIO;
     audioTrack.codec = RTC_CODEC_OPUS;
     STRCPY(audioTrack.streamId, "myKvsVideoStream");
     STRCPY(audioTrack.trackId, "myAudioTrack");
-    CHK_STATUS(pPeer->addTransceiver(audioTrack));
+    CHK_STATUS(connection.addTransceiver(audioTrack));
 
 CleanUp:
 
     return retStatus;
 }
-
-VOID sendLocalFrames(Canary::PPeer pPeer, MEDIA_STREAM_TRACK_KIND kind, const std::string& pattern, UINT64 frameCount, UINT32 frameDuration)
-{
-    STATUS retStatus = STATUS_SUCCESS;
-    Frame frame;
-    UINT64 fileIndex = 0, frameSize;
-    CHAR filePath[MAX_PATH_LEN + 1];
-    UINT64 startTime, lastFrameTime, elapsed;
-
-    frame.frameData = NULL;
-    frame.size = 0;
-    frame.presentationTs = 0;
-    startTime = GETTIME();
-    lastFrameTime = startTime;
-
-    while (!terminated.load()) {
-        fileIndex = fileIndex % frameCount + 1;
-        SNPRINTF(filePath, MAX_PATH_LEN, pattern.c_str(), fileIndex);
-
-        CHK_STATUS(readFile(filePath, TRUE, NULL, &frameSize));
-
-        // Re-alloc if needed
-        if (frameSize > frame.size) {
-            frame.frameData = (PBYTE) REALLOC(frame.frameData, frameSize);
-            CHK_ERR(frame.frameData != NULL, STATUS_NOT_ENOUGH_MEMORY, "Failed to realloc media buffer");
-        }
-        frame.size = (UINT32) frameSize;
-
-        CHK_STATUS(readFile(filePath, TRUE, frame.frameData, &frameSize));
-
-        frame.presentationTs += frameDuration;
-
-        pPeer->writeFrame(&frame, kind);
-
-        // Adjust sleep in the case the sleep itself and writeFrame take longer than expected. Since sleep makes sure that the thread
-        // will be paused at least until the given amount, we can assume that there's no too early frame scenario.
-        // Also, it's very unlikely to have a delay greater than SAMPLE_VIDEO_FRAME_DURATION, so the logic assumes that this is always
-        // true for simplicity.
-        elapsed = lastFrameTime - startTime;
-        THREAD_SLEEP(frameDuration - elapsed % frameDuration);
-        lastFrameTime = GETTIME();
-    }
-
-CleanUp:
-
-    SAFE_MEMFREE(frame.frameData);
-
-    auto threadKind = kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "video" : "audio";
-    if (STATUS_FAILED(retStatus)) {
-        DLOGE("%s thread exited with 0x%08x", threadKind, retStatus);
-    } else {
-        DLOGI("%s thread exited successfully", threadKind);
-    }
-}
@@ -0,0 +1,309 @@
+#include "Include.h"
+
+namespace Canary {
+
+MediaPacer::TrackState::TrackState()
+    : kind(MEDIA_STREAM_TRACK_KIND_VIDEO), stamp(TRUE), rendition(0), targetRendition(0), upswitchCandidateTime(0), frameIndex(0), presentationTs(0),
+      awaitingKeyFrame(FALSE), sequence(0), nextStampedFrame(0), maxFrameSize(0), sent(0), dropped(0), totalJitter(0), maxJitter(0), switches(0)
+{
+}
+
+MediaPacer::MediaPacer(PFrameStore pFrameStore, PFrameFanout pFanout, PACER_OVERRUN_POLICY overrunPolicy, CloudwatchMonitoring* pMonitoring)
+    : pFrameStore(pFrameStore), pFanout(pFanout), overrunPolicy(overrunPolicy), pMonitoring(pMonitoring), terminated(FALSE), startTime(0),
+      bandwidthEstimate(0)
+{
+}
+
+MediaPacer::~MediaPacer()
+{
+    this->stop();
+}
+
+STATUS MediaPacer::addTrack(MEDIA_STREAM_TRACK_KIND kind, BOOL stamp)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    TrackState track;
+    Frame frame;
+    UINT32 i;
+
+    CHK(!this->thread.joinable(), STATUS_INVALID_OPERATION);
+
+    track.kind = kind;
+    track.stamp = stamp;
+    CHK_STATUS(this->pFrameStore->findTracks(kind, track.renditions));
+    track.renditionTime.resize(track.renditions.size());
+
+    for (auto pTrack : track.renditions) {
+        for (i = 0; i < pTrack->frameCount; i++) {
+            CHK_STATUS(this->pFrameStore->getFrame(pTrack, i, &frame));
+            track.maxFrameSize = MAX(track.maxFrameSize, frame.size);
+        }
+    }
+    // Every consumer queue may hold the latest frames, plus the one being written and the one being published
+    track.stampedFrames.resize(this->pFanout->getQueueDepth() + 2);
+    for (auto& pSharedFrame : track.stampedFrames) {
+        pSharedFrame = std::make_shared<SharedFrame>();
+        pSharedFrame->payload.resize(track.maxFrameSize + FRAME_METADATA_MAX_TRAILER_SIZE);
+    }
+    this->tracks.push_back(track);
+
+    DLOGI("Pacing %s with %u rendition(s)", kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "video" : "audio", (UINT32) track.renditions.size());
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS MediaPacer::start()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(!this->thread.joinable() && !this->tracks.empty(), STATUS_INVALID_OPERATION);
+
+    this->terminated = FALSE;
+    this->thread = std::thread(&MediaPacer::run, this);
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID MediaPacer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->terminated = TRUE;
+    }
+    this->cvar.notify_all();
+
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+}
+
+VOID MediaPacer::setBandwidthEstimate(UINT64 bitrate)
+{
+    this->bandwidthEstimate = bitrate;
+}
+
+VOID MediaPacer::run()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 now, deadline, nextDeadline;
+
+    this->startTime = GETTIME();
+
+    while (TRUE) {
+        now = GETTIME();
+        nextDeadline = MAX_UINT64;
+
+        for (auto& track : this->tracks) {
+            // With the catch up policy, every overdue frame goes out back to back until the track is on time again
+            while ((deadline = this->startTime + track.presentationTs) <= now) {
+                CHK_STATUS(this->publishDueFrame(track, now));
+            }
+            nextDeadline = MIN(nextDeadline, deadline);
+        }
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        now = GETTIME();
+        if (nextDeadline > now) {
+            this->cvar.wait_for(lock, std::chrono::microseconds((nextDeadline - now) / HUNDREDS_OF_NANOS_IN_A_MICROSECOND),
+                                [this]() { return this->terminated; });
+        }
+        if (this->terminated) {
+            break;
+        }
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        DLOGE("Media pacer exited with 0x%08x", retStatus);
+    }
+}
+
+VOID MediaPacer::selectRendition(TrackState& track, UINT64 now)
+{
+    UINT64 estimate = this->bandwidthEstimate.load();
+    UINT32 desired = 0, i;
+
+    if (track.renditions.size() < 2 || estimate == 0) {
+        return;
+    }
+
+    // Highest rendition that still leaves some headroom for audio, retransmissions and estimate noise
+    for (i = 1; i < track.renditions.size(); i++) {
+        if ((DOUBLE) track.renditions[i]->bitrate * 1000 <= estimate * RENDITION_BITRATE_HEADROOM) {
+            desired = i;
+        }
+    }
+
+    if (desired > track.rendition) {
+        if (track.upswitchCandidateTime == 0) {
+            track.upswitchCandidateTime = now;
+        } else if (now - track.upswitchCandidateTime >= RENDITION_UPSWITCH_HOLD_TIME) {
+            track.targetRendition = desired;
+        }
+    } else {
+        track.targetRendition = desired;
+        track.upswitchCandidateTime = 0;
+    }
+}
+
+STATUS MediaPacer::publishDueFrame(TrackState& track, UINT64 now)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    Frame frame;
+    FrameMetadata metadata;
+    FrameStore::PTrack pTrack;
+    UINT64 jitter;
+    UINT32 previousRendition = track.rendition;
+    BOOL drop;
+
+    this->selectRendition(track, now);
+
+    MEMSET(&frame, 0x00, SIZEOF(Frame));
+    frame.version = FRAME_CURRENT_VERSION;
+
+    // Renditions can only be switched where the new one starts a fresh GOP
+    if (track.targetRendition != track.rendition) {
+        pTrack = track.renditions[track.targetRendition];
+        CHK_STATUS(this->pFrameStore->getFrame(pTrack, track.frameIndex % pTrack->frameCount, &frame));
+        if ((frame.flags & FRAME_FLAG_KEY_FRAME) != 0) {
+            track.rendition = track.targetRendition;
+            track.frameIndex %= pTrack->frameCount;
+        }
+    }
+
+    pTrack = track.renditions[track.rendition];
+    CHK_STATUS(this->pFrameStore->getFrame(pTrack, track.frameIndex, &frame));
+    CHK(frame.duration != 0, STATUS_INVALID_ARG);
+
+    track.frameIndex = (track.frameIndex + 1) % pTrack->frameCount;
+    frame.presentationTs = track.presentationTs;
+    frame.decodingTs = frame.presentationTs;
+    track.presentationTs += frame.duration;
+
+    jitter = now - (this->startTime + frame.presentationTs);
+    drop = FALSE;
+    if (this->overrunPolicy == PACER_OVERRUN_POLICY_DROP) {
+        if (jitter >= frame.duration) {
+            drop = TRUE;
+            // Skipping a video frame breaks the references of everything up to the next key frame
+            track.awaitingKeyFrame = track.kind == MEDIA_STREAM_TRACK_KIND_VIDEO;
+        } else if (track.awaitingKeyFrame) {
+            drop = (frame.flags & FRAME_FLAG_KEY_FRAME) == 0;
+            track.awaitingKeyFrame = drop;
+        }
+    }
+
+    if (!drop) {
+        auto pSharedFrame = this->takeStampedFrame(track);
+
+        // The frame store is read only, so the payload is copied once to append the metadata trailer. Every viewer
+        // still shares this copy.
+        CHK(frame.size <= track.maxFrameSize, STATUS_INVALID_ARG);
+        MEMCPY(pSharedFrame->payload.data(), frame.frameData, frame.size);
+        if (track.stamp) {
+            metadata.sendTime = now;
+            metadata.sequence = track.sequence++;
+            CHK_STATUS(stampFrameMetadata(track.kind, &metadata, pSharedFrame->payload.data(), frame.size, (UINT32) pSharedFrame->payload.size(),
+                                          &frame.size));
+        }
+        frame.frameData = pSharedFrame->payload.data();
+
+        pSharedFrame->frame = frame;
+        pSharedFrame->kind = track.kind;
+        pSharedFrame->publishTime = now;
+        this->pFanout->publish(pSharedFrame);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+        if (drop) {
+            track.dropped++;
+        } else {
+            track.sent++;
+            track.totalJitter += jitter;
+            track.maxJitter = MAX(track.maxJitter, jitter);
+        }
+        if (track.rendition != previousRendition) {
+            track.switches++;
+            DLOGI("Switched %s rendition from %u kbps to %u kbps", track.kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "video" : "audio",
+                  track.renditions[previousRendition]->bitrate, pTrack->bitrate);
+        }
+        track.renditionTime[track.rendition] += frame.duration;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+std::shared_ptr<SharedFrame> MediaPacer::takeStampedFrame(TrackState& track)
+{
+    auto& pSharedFrame = track.stampedFrames[track.nextStampedFrame];
+
+    track.nextStampedFrame = (track.nextStampedFrame + 1) % (UINT32) track.stampedFrames.size();
+
+    if (pSharedFrame.use_count() == 1) {
+        // Pairs with the release of the last consumer reference, its reads of the payload are done
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } else {
+        // A consumer is still stuck on it, it's freed with the consumer's reference instead
+        DLOGW("Stamped %s frame still in use, allocating another one", track.kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "video" : "audio");
+        pSharedFrame = std::make_shared<SharedFrame>();
+        pSharedFrame->payload.resize(track.maxFrameSize + FRAME_METADATA_MAX_TRAILER_SIZE);
+    }
+
+    return pSharedFrame;
+}
+
+VOID MediaPacer::reportStats()
+{
+    UINT64 maxJitter = 0, dropped = 0, switches = 0, totalTime;
+    UINT32 i;
+
+    std::lock_guard<std::mutex> lock(this->statsMutex);
+    auto& monitoring = *this->pMonitoring;
+
+    for (auto& track : this->tracks) {
+        auto trackKind = track.kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "video" : "audio";
+        DLOGI("Paced %s track: sent %" PRIu64 ", dropped %" PRIu64 ", send jitter avg %" PRIu64 " us, max %" PRIu64 " us, %" PRIu64
+              " rendition switches",
+              trackKind, track.sent, track.dropped, track.sent == 0 ? 0 : track.totalJitter / track.sent / HUNDREDS_OF_NANOS_IN_A_MICROSECOND,
+              track.maxJitter / HUNDREDS_OF_NANOS_IN_A_MICROSECOND, track.switches);
+
+        // With a single rendition all of the time is spent in it, which isn't worth a metric
+        if (track.renditions.size() > 1) {
+            totalTime = 0;
+            for (i = 0; i < track.renditions.size(); i++) {
+                totalTime += track.renditionTime[i];
+            }
+            for (i = 0; i < track.renditions.size(); i++) {
+                DLOGI("Paced %s track: %u kbps rendition for %" PRIu64 " ms (%" PRIu64 "%%)", trackKind, track.renditions[i]->bitrate,
+                      track.renditionTime[i] / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, totalTime == 0 ? 0 : track.renditionTime[i] * 100 / totalTime);
+                monitoring.pushRenditionTime(track.renditions[i]->bitrate, track.renditionTime[i] / HUNDREDS_OF_NANOS_IN_A_MILLISECOND,
+                                             StandardUnit::Milliseconds);
+            }
+        }
+
+        maxJitter = MAX(maxJitter, track.maxJitter);
+        dropped += track.dropped;
+        switches += track.switches;
+
+        track.sent = 0;
+        track.dropped = 0;
+        track.totalJitter = 0;
+        track.maxJitter = 0;
+        track.switches = 0;
+        std::fill(track.renditionTime.begin(), track.renditionTime.end(), 0);
+    }
+
+    monitoring.pushPacerSendJitter(maxJitter / HUNDREDS_OF_NANOS_IN_A_MICROSECOND, StandardUnit::Microseconds);
+    monitoring.pushPacerDroppedFrames(dropped);
+    monitoring.pushRenditionSwitches(switches);
+}
+
+} // namespace Canary
@@ -0,0 +1,80 @@
+#pragma once
+
+namespace Canary {
+
+class MediaPacer;
+typedef MediaPacer* PMediaPacer;
+class CloudwatchMonitoring;
+
+// MediaPacer publishes the frames of every track from a single thread. Each frame is due at the pacer start time
+// plus its media timestamp, so sleep overshoot and publish cost never accumulate into drift. A frame that is
+// published a whole frame duration or more after its deadline is an overrun, see PACER_OVERRUN_POLICY.
+//
+// When the frame store has several renditions of a kind, the track follows the bandwidth estimate set with
+// setBandwidthEstimate and switches renditions at key frames. Switching down happens on the next key frame,
+// switching up only once the estimate has allowed it for RENDITION_UPSWITCH_HOLD_TIME.
+class MediaPacer {
+  public:
+    MediaPacer(PFrameStore, PFrameFanout, PACER_OVERRUN_POLICY, CloudwatchMonitoring*);
+    ~MediaPacer();
+    // Without stamp the frames go out without the FrameMetadata trailer, for receivers that aren't canaries
+    STATUS addTrack(MEDIA_STREAM_TRACK_KIND, BOOL stamp = TRUE);
+    STATUS start();
+    VOID stop();
+    // Estimate in bits per second, 0 means that there's no estimate yet
+    VOID setBandwidthEstimate(UINT64);
+    VOID reportStats();
+
+  private:
+    struct TrackState {
+        MEDIA_STREAM_TRACK_KIND kind;
+        BOOL stamp;
+        // ordered by ascending bitrate, the frames of all of them share the same timeline
+        std::vector<FrameStore::PTrack> renditions;
+        UINT32 rendition;
+        UINT32 targetRendition;
+        UINT64 upswitchCandidateTime;
+        UINT32 frameIndex;
+        // media time of the next frame relative to the pacer start time
+        UINT64 presentationTs;
+        // a video track that dropped a frame can only resume on a key frame
+        BOOL awaitingKeyFrame;
+        // sequence number of the next published frame, dropped frames don't consume one
+        UINT32 sequence;
+        // Ring of frames to stamp, preallocated for the largest frame of the track. A frame is reused once the fanout
+        // let go of it, which is the case by the time the ring comes around unless a consumer got stuck in a write.
+        std::vector<std::shared_ptr<SharedFrame>> stampedFrames;
+        UINT32 nextStampedFrame;
+        UINT32 maxFrameSize;
+
+        // stats since the last report, guarded by statsMutex
+        UINT64 sent;
+        UINT64 dropped;
+        UINT64 totalJitter;
+        UINT64 maxJitter;
+        UINT64 switches;
+        std::vector<UINT64> renditionTime;
+
+        TrackState();
+    };
+
+    const PFrameStore pFrameStore;
+    const PFrameFanout pFanout;
+    const PACER_OVERRUN_POLICY overrunPolicy;
+    CloudwatchMonitoring* const pMonitoring;
+    std::vector<TrackState> tracks;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cvar;
+    BOOL terminated;
+    std::mutex statsMutex;
+    UINT64 startTime;
+    std::atomic<UINT64> bandwidthEstimate;
+
+    VOID run();
+    VOID selectRendition(TrackState&, UINT64);
+    std::shared_ptr<SharedFrame> takeStampedFrame(TrackState&);
+    STATUS publishDueFrame(TrackState&, UINT64);
+};
+
+} // namespace Canary
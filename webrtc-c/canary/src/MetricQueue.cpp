@@ -0,0 +1,184 @@
+#include "Include.h"
+
+namespace Canary {
+
+MetricQueue::MetricQueue(UINT32 capacity, UINT32 maxInFlight)
+    : pSink(NULL), capacity(MAX(capacity, 1)), maxInFlight(MAX(maxInFlight, 1)), droppedMetrics(0), retriedBatches(0), inFlight(0),
+      draining(FALSE), drainDeadline(0), terminated(FALSE)
+{
+}
+
+MetricQueue::~MetricQueue()
+{
+    // Only there in case init failed half way, deinit drains the queue
+    if (this->senderThread.joinable()) {
+        this->drain(GETTIME());
+    }
+}
+
+STATUS MetricQueue::start(TelemetrySink* pSink)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pSink != NULL, STATUS_NULL_ARG);
+    CHK(!this->senderThread.joinable(), STATUS_INVALID_OPERATION);
+
+    this->pSink = pSink;
+    this->senderThread = std::thread(&MetricQueue::runSender, this);
+
+CleanUp:
+
+    return retStatus;
+}
+
+UINT32 MetricQueue::push(Aws::Vector<MetricDatum>&& datums)
+{
+    UINT32 dropped = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(this->queueMutex);
+        if (this->batches.size() >= this->capacity) {
+            // The newer metrics are the more useful ones
+            dropped = (UINT32) this->batches.front().datums.size();
+            this->batches.pop_front();
+        }
+        this->batches.push_back(Batch{std::move(datums), 0, 0});
+    }
+    this->queueCvar.notify_all();
+
+    this->droppedMetrics += dropped;
+    return dropped;
+}
+
+BOOL MetricQueue::isFull()
+{
+    std::lock_guard<std::mutex> lock(this->queueMutex);
+    return this->batches.size() >= this->capacity;
+}
+
+VOID MetricQueue::drain(UINT64 deadline)
+{
+    UINT64 now = GETTIME(), dropped = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(this->queueMutex);
+        this->draining = TRUE;
+        this->drainDeadline = deadline;
+        this->queueCvar.notify_all();
+
+        this->queueCvar.wait_for(lock, std::chrono::milliseconds(deadline > now ? (deadline - now) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND : 0),
+                                 [this]() { return this->batches.empty() && this->inFlight == 0; });
+
+        for (auto& batch : this->batches) {
+            dropped += batch.datums.size();
+        }
+        this->batches.clear();
+        this->terminated = TRUE;
+        this->queueCvar.notify_all();
+
+        // In flight sends can't be cancelled, the client timeouts bound this wait
+        this->queueCvar.wait(lock, [this]() { return this->inFlight == 0; });
+    }
+
+    if (dropped != 0) {
+        DLOGW("Dropped %" PRIu64 " metrics that couldn't be sent before the drain deadline", dropped);
+        this->droppedMetrics += dropped;
+    }
+
+    if (this->senderThread.joinable()) {
+        this->senderThread.join();
+    }
+}
+
+UINT64 MetricQueue::takeDroppedMetrics()
+{
+    return this->droppedMetrics.exchange(0);
+}
+
+UINT64 MetricQueue::takeRetriedBatches()
+{
+    return this->retriedBatches.exchange(0);
+}
+
+VOID MetricQueue::runSender()
+{
+    std::unique_lock<std::mutex> lock(this->queueMutex);
+    UINT64 now, nextRetryTime;
+    Batch batch;
+
+    while (!this->terminated) {
+        now = GETTIME();
+        nextRetryTime = MAX_UINT64;
+
+        if (this->inFlight < this->maxInFlight) {
+            auto it = this->batches.begin();
+            for (; it != this->batches.end() && it->retryTime > now; it++) {
+                nextRetryTime = MIN(nextRetryTime, it->retryTime);
+            }
+
+            if (it != this->batches.end()) {
+                batch = std::move(*it);
+                this->batches.erase(it);
+                this->inFlight++;
+
+                // Local sinks complete before putMetrics returns, which takes the lock
+                lock.unlock();
+                this->submit(std::move(batch));
+                lock.lock();
+                continue;
+            }
+        }
+
+        if (nextRetryTime == MAX_UINT64) {
+            this->queueCvar.wait(lock);
+        } else {
+            this->queueCvar.wait_for(lock, std::chrono::milliseconds((nextRetryTime - now) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND + 1));
+        }
+    }
+}
+
+VOID MetricQueue::submit(Batch&& batch)
+{
+    // Kept until the outcome is known, the sink takes its own copy of the datums
+    auto pBatch = std::make_shared<Batch>(std::move(batch));
+    Aws::Vector<MetricDatum> datums = pBatch->datums;
+
+    pBatch->attempts++;
+    this->pSink->putMetrics(std::move(datums), [this, pBatch](TELEMETRY_SEND_RESULT result) { this->complete(pBatch, result); });
+}
+
+VOID MetricQueue::complete(const std::shared_ptr<Batch>& pBatch, TELEMETRY_SEND_RESULT result)
+{
+    UINT64 dropped = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(this->queueMutex);
+        this->inFlight--;
+
+        if (result != TELEMETRY_SEND_RESULT_SUCCESS) {
+            pBatch->retryTime = GETTIME() + getRetryDelay(pBatch->attempts);
+            // Retries don't evict fresh batches, and they're pointless once the drain deadline would pass first
+            if (pBatch->attempts > METRIC_SEND_MAX_RETRIES || this->terminated || this->batches.size() >= this->capacity ||
+                (this->draining && pBatch->retryTime > this->drainDeadline)) {
+                dropped = pBatch->datums.size();
+            } else {
+                this->batches.push_front(std::move(*pBatch));
+                this->retriedBatches++;
+            }
+        }
+    }
+    this->queueCvar.notify_all();
+
+    this->droppedMetrics += dropped;
+}
+
+UINT64 MetricQueue::getRetryDelay(UINT32 attempts)
+{
+    UINT64 delay = METRIC_RETRY_BASE_DELAY << MIN(attempts - 1, 16);
+
+    // Half of the delay is random, so that the canaries behind the same outage don't retry in lockstep
+    delay = MIN(delay, METRIC_RETRY_MAX_DELAY);
+    return delay / 2 + (UINT64) RAND() % (delay / 2 + 1);
+}
+
+} // namespace Canary
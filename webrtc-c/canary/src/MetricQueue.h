@@ -0,0 +1,58 @@
+#pragma once
+
+namespace Canary {
+
+// MetricQueue bounds what CloudwatchMonitoring has on its way to the telemetry sink: at most `capacity` batches wait
+// in the queue and at most `maxInFlight` of them are being sent at once. A sender thread submits the batches and
+// retries failed ones up to METRIC_SEND_MAX_RETRIES times with a jittered exponential backoff.
+//
+// push never blocks. When the queue is full the oldest batch is dropped, CloudwatchMonitoring checks isFull first and
+// keeps aggregating instead, so that only a forced flush at exit can drop anything. Dropped datums are counted.
+//
+// drain waits for the queue to empty until a deadline, drops what is left after that and then waits for the sends in
+// flight. Those can't be cancelled, the client timeouts bound how long they take, and they have to complete before
+// Aws::ShutdownAPI.
+class MetricQueue {
+  public:
+    MetricQueue(UINT32 capacity, UINT32 maxInFlight);
+    ~MetricQueue();
+    STATUS start(TelemetrySink*);
+    // Returns the number of datums dropped to make room
+    UINT32 push(Aws::Vector<MetricDatum>&&);
+    BOOL isFull();
+    VOID drain(UINT64 deadline);
+    // Datums dropped, because the queue was full or because they ran out of retries, since the last call
+    UINT64 takeDroppedMetrics();
+    UINT64 takeRetriedBatches();
+
+  private:
+    struct Batch {
+        Aws::Vector<MetricDatum> datums;
+        UINT32 attempts;
+        // when the batch may be sent again after it failed
+        UINT64 retryTime;
+    };
+
+    TelemetrySink* pSink;
+    UINT32 capacity;
+    UINT32 maxInFlight;
+    std::atomic<UINT64> droppedMetrics;
+    std::atomic<UINT64> retriedBatches;
+
+    // guards the members below, which are shared with the sink callbacks
+    std::mutex queueMutex;
+    std::condition_variable queueCvar;
+    std::deque<Batch> batches;
+    UINT32 inFlight;
+    BOOL draining;
+    UINT64 drainDeadline;
+    BOOL terminated;
+    std::thread senderThread;
+
+    VOID runSender();
+    VOID submit(Batch&&);
+    VOID complete(const std::shared_ptr<Batch>&, TELEMETRY_SEND_RESULT);
+    static UINT64 getRetryDelay(UINT32 attempts);
+};
+
+} // namespace Canary
@@ -2,25 +2,79 @@
 
 namespace Canary {
 
-Peer::Peer(const Canary::PConfig pConfig, const Callbacks& callbacks)
-    : pConfig(pConfig), callbacks(callbacks), pAwsCredentialProvider(nullptr), terminated(FALSE), iceGatheringDone(FALSE), receivedOffer(FALSE),
-      receivedAnswer(FALSE), foundPeerId(FALSE), pPeerConnection(nullptr), status(STATUS_SUCCESS)
+static const CHAR* getConnectionStateName(RTC_PEER_CONNECTION_STATE state)
+{
+    switch (state) {
+        case RTC_PEER_CONNECTION_STATE_NEW:
+            return "new";
+        case RTC_PEER_CONNECTION_STATE_CONNECTING:
+            return "connecting";
+        case RTC_PEER_CONNECTION_STATE_CONNECTED:
+            return "connected";
+        case RTC_PEER_CONNECTION_STATE_DISCONNECTED:
+            return "disconnected";
+        case RTC_PEER_CONNECTION_STATE_FAILED:
+            return "failed";
+        case RTC_PEER_CONNECTION_STATE_CLOSED:
+            return "closed";
+        default:
+            break;
+    }
+
+    return "unknown";
+}
+
+Peer::Peer(const Canary::PConfig pConfig, const Callbacks& callbacks, PFrameFanout pFanout, CloudwatchMonitoring* pMonitoring)
+    : pConfig(pConfig), callbacks(callbacks), pFanout(pFanout), pMonitoring(pMonitoring), signalingQueue(pMonitoring), terminated(FALSE),
+      iceServersAdded(FALSE), status(STATUS_SUCCESS), eventsTerminated(FALSE), createTime(GETTIME()), signalingStartTime(0),
+      lastReceiveStatsTime(createTime), signalingConnectTime(0), signalingClientCreateTime(0), signalingClientConnectTime(0), iceConnectTime(0),
+      setupTime(0), iceServerWaitTime(0), firstFrameTime(0), sentBytes(0), failedConnections(0)
 {
 }
 
 Peer::~Peer()
 {
+    // Only there in case shutdown wasn't called, events can't be handled while the connections go away
+    this->stopEvents();
+
+    {
+        // Connections have to go before the signaling client since they might still send messages through it. Freeing them
+        // joins SDK threads whose callbacks take connectionsMutex, so they're only freed once it's released.
+        std::map<std::string, PConnection> connections;
+        {
+            std::lock_guard<std::mutex> lock(this->connectionsMutex);
+            std::swap(connections, this->connections);
+        }
+    }
+    this->signalingQueue.stop();
+    this->pSignaling.reset();
+}
+
+Peer::Connection::Connection(PPeer pPeer, const std::string& peerId)
+    : pPeer(pPeer), peerId(peerId), pPeerConnection(nullptr), videoReceiveMetrics(MEDIA_STREAM_TRACK_KIND_VIDEO),
+      audioReceiveMetrics(MEDIA_STREAM_TRACK_KIND_AUDIO, pPeer->pConfig->stampAudio), negotiationState(NEGOTIATION_STATE_NEW),
+      pendingMessageType(SIGNALING_MESSAGE_TYPE_UNKNOWN), pendingReceiveTime(0), closed(FALSE), bandwidthEstimate(0), iceGatheringStartTime(0),
+      iceHolePunchingStartTime(0)
+{
+}
+
+Peer::Connection::~Connection()
+{
+    // Make sure that no frame is being written anymore before freeing the transceivers
+    for (auto& pConsumer : this->consumers) {
+        this->pPeer->pFanout->unsubscribe(pConsumer);
+    }
     CHK_LOG_ERR(freePeerConnection(&this->pPeerConnection));
-    CHK_LOG_ERR(freeSignalingClient(&this->pSignalingClientHandle));
-    CHK_LOG_ERR(freeStaticCredentialProvider(&this->pAwsCredentialProvider));
 }
 
 STATUS Peer::init()
 {
     STATUS retStatus = STATUS_SUCCESS;
 
-    CHK_STATUS(createStaticCredentialProvider((PCHAR) pConfig->pAccessKey, 0, (PCHAR) pConfig->pSecretKey, 0, (PCHAR) pConfig->pSessionToken, 0,
-                                              MAX_UINT64, &pAwsCredentialProvider));
+    CHK(!this->eventThread.joinable(), STATUS_INVALID_OPERATION);
+
+    // Up before signaling, messages may come in as soon as it's connected
+    this->eventThread = std::thread(&Peer::runEvents, this);
     CHK_STATUS(initSignaling());
     CHK_STATUS(initRtcConfiguration());
 
@@ -33,33 +87,11 @@ STATUS Peer::initSignaling()
 {
     STATUS retStatus = STATUS_SUCCESS;
 
-    SignalingClientInfo clientInfo;
-    ChannelInfo channelInfo;
     SignalingClientCallbacks clientCallbacks;
+    UINT64 startTime;
 
-    MEMSET(&clientInfo, 0, SIZEOF(clientInfo));
-    MEMSET(&channelInfo, 0, SIZEOF(channelInfo));
     MEMSET(&clientCallbacks, 0, SIZEOF(clientCallbacks));
 
-    clientInfo.version = SIGNALING_CLIENT_INFO_CURRENT_VERSION;
-    clientInfo.loggingLevel = pConfig->logLevel;
-    STRCPY(clientInfo.clientId, pConfig->pClientId);
-
-    channelInfo.version = CHANNEL_INFO_CURRENT_VERSION;
-    channelInfo.pChannelName = (PCHAR) pConfig->pChannelName;
-    channelInfo.pKmsKeyId = NULL;
-    channelInfo.tagCount = 0;
-    channelInfo.pTags = NULL;
-    channelInfo.channelType = SIGNALING_CHANNEL_TYPE_SINGLE_MASTER;
-    channelInfo.channelRoleType = pConfig->isMaster ? SIGNALING_CHANNEL_ROLE_TYPE_MASTER : SIGNALING_CHANNEL_ROLE_TYPE_VIEWER;
-    channelInfo.cachingPolicy = SIGNALING_API_CALL_CACHE_TYPE_FILE;
-    channelInfo.cachingPeriod = SIGNALING_API_CALL_CACHE_TTL_SENTINEL_VALUE;
-    channelInfo.asyncIceServerConfig = TRUE;
-    channelInfo.retry = TRUE;
-    channelInfo.reconnect = TRUE;
-    channelInfo.pCertPath = (PCHAR) DEFAULT_KVS_CACERT_PATH;
-    channelInfo.messageTtl = 0; // Default is 60 seconds
-
     clientCallbacks.customData = (UINT64) this;
     clientCallbacks.stateChangeFn = [](UINT64 customData, SIGNALING_CLIENT_STATE state) -> STATUS {
         STATUS retStatus = STATUS_SUCCESS;
@@ -68,6 +100,7 @@ STATUS Peer::initSignaling()
 
         signalingClientGetStateString(state, &pStateStr);
         DLOGD("Signaling client state changed to %d - '%s'", state, pStateStr);
+        TRACE_INSTANT("signaling", "signalingClientState", pStateStr);
 
         switch (state) {
             case SIGNALING_CLIENT_STATE_NEW:
@@ -76,7 +109,8 @@ STATUS Peer::initSignaling()
             case SIGNALING_CLIENT_STATE_CONNECTED: {
                 auto duration = (GETTIME() - pPeer->signalingStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
                 DLOGI("Signaling took %lu ms to connect", duration);
-                Canary::Cloudwatch::getInstance().monitoring.pushSignalingInitDelay(duration, StandardUnit::Milliseconds);
+                pPeer->pMonitoring->recordSignalingInitDelay(duration);
+                pPeer->signalingConnectTime = duration;
                 break;
             }
             default:
@@ -104,31 +138,28 @@ STATUS Peer::initSignaling()
         return STATUS_SUCCESS;
     };
     clientCallbacks.messageReceivedFn = [](UINT64 customData, PReceivedSignalingMessage pMsg) -> STATUS {
-        STATUS retStatus = STATUS_SUCCESS;
         PPeer pPeer = (PPeer) customData;
-        std::lock_guard<std::recursive_mutex> lock(pPeer->mutex);
 
-        if (!pPeer->foundPeerId.load()) {
-            pPeer->peerId = pMsg->signalingMessage.peerClientId;
-            DLOGI("Found peer id: %s", pPeer->peerId.c_str());
-            pPeer->foundPeerId = TRUE;
-            CHK_STATUS(pPeer->initPeerConnection());
-        }
+        // Even creating the connection for a new viewer takes a while, the callback thread only copies the message
+        pPeer->postEvent(PEER_EVENT_MESSAGE, pMsg->signalingMessage.peerClientId, std::make_shared<SignalingMessage>(pMsg->signalingMessage));
 
-        if (pPeer->pConfig->isMaster && STRCMP(pPeer->peerId.c_str(), pMsg->signalingMessage.peerClientId) != 0) {
-            DLOGW("Unexpected receiving message from extra peer: %s", pMsg->signalingMessage.peerClientId);
-            CHK(FALSE, retStatus);
-        }
-
-        DLOGD("Handling signaling message:\n%s", pMsg->signalingMessage.payload);
-        CHK_STATUS(pPeer->handleSignalingMsg(pMsg));
-
-    CleanUp:
-
-        return retStatus;
+        return STATUS_SUCCESS;
     };
 
-    CHK_STATUS(createSignalingClientSync(&clientInfo, &channelInfo, &clientCallbacks, pAwsCredentialProvider, &pSignalingClientHandle));
+    CHK_STATUS(createSignalingTransport(this->pConfig, this->pSignaling));
+    startTime = GETTIME();
+    CHK_STATUS(this->pSignaling->init(clientCallbacks));
+    this->signalingClientCreateTime = MAX((GETTIME() - startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, 1);
+    Tracer::getInstance().complete("signaling", "createSignalingClient", startTime);
+    CHK_STATUS(this->signalingQueue.start(this->pSignaling.get(), [this](const SignalingMessage& message, STATUS status) {
+        // A lost candidate may cost a candidate pair, a lost offer or answer costs the whole connection
+        if (message.messageType == SIGNALING_MESSAGE_TYPE_OFFER || message.messageType == SIGNALING_MESSAGE_TYPE_ANSWER) {
+            auto pConnection = this->findConnection(message.peerClientId);
+            if (pConnection != nullptr) {
+                this->onConnectionClosed(*pConnection, status);
+            }
+        }
+    }));
 
 CleanUp:
 
@@ -137,97 +168,208 @@ CleanUp:
 
 STATUS Peer::initRtcConfiguration()
 {
-    auto awaitGetIceConfigInfoCount = [](SIGNALING_CLIENT_HANDLE pSignalingClientHandle, PUINT32 pIceConfigInfoCount) -> STATUS {
-        STATUS retStatus = STATUS_SUCCESS;
-        UINT64 elapsed = 0;
+    STATUS retStatus = STATUS_SUCCESS;
+    auto pConfig = this->pConfig;
+    PRtcConfiguration pConfiguration = &this->rtcConfiguration;
 
-        CHK(IS_VALID_SIGNALING_CLIENT_HANDLE(pSignalingClientHandle) && pIceConfigInfoCount != NULL, STATUS_NULL_ARG);
+    MEMSET(pConfiguration, 0x00, SIZEOF(RtcConfiguration));
 
-        while (TRUE) {
-            // Get the configuration count
-            CHK_STATUS(signalingClientGetIceConfigInfoCount(pSignalingClientHandle, pIceConfigInfoCount));
+    // Set this to custom callback to enable filtering of interfaces
+    pConfiguration->kvsRtcConfiguration.iceSetInterfaceFilterFunc = NULL;
 
-            // Return OK if we have some ice configs
-            CHK(*pIceConfigInfoCount == 0, retStatus);
+    // Set the  STUN server, a host that only signals locally can't reach it and gets by with host candidates
+    if (pConfig->signaling != SIGNALING_TRANSPORT_LOCAL) {
+        SNPRINTF(pConfiguration->iceServers[0].urls, MAX_ICE_CONFIG_URI_LEN, KINESIS_VIDEO_STUN_URL, pConfig->pRegion);
+    }
 
-            // Check for timeout
-            CHK_ERR(elapsed <= ASYNC_ICE_CONFIG_INFO_WAIT_TIMEOUT, STATUS_OPERATION_TIMED_OUT,
-                    "Couldn't retrieve ICE configurations in alotted time.");
+    // The TURN servers are added by the first connection, signaling doesn't have to wait for them
 
-            THREAD_SLEEP(ICE_CONFIG_INFO_POLL_PERIOD);
-            elapsed += ICE_CONFIG_INFO_POLL_PERIOD;
-        }
+    return retStatus;
+}
 
-    CleanUp:
+STATUS Peer::addIceServers()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PRtcConfiguration pConfiguration = &this->rtcConfiguration;
+    IceServerConfig config;
+    UINT64 waitStartTime = GETTIME(), duration;
+    UINT32 uriCount = 0;
+
+    // A viewer creates its connection in connect() and a master on the event thread, never both at once
+    CHK(this->pConfig->useTurn && !this->iceServersAdded, retStatus);
+
+    CHK_STATUS(this->pSignaling->getIceServers(ASYNC_ICE_CONFIG_INFO_WAIT_TIMEOUT, config));
+    duration = (GETTIME() - waitStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    DLOGI("Waited %lu ms for %u TURN servers from %s", duration, (UINT32) config.servers.size(), config.cached ? "the cache" : "signaling");
+    this->pMonitoring->recordIceServerWait(duration, config.cached);
+    this->iceServerWaitTime = MAX(duration, 1);
+    Tracer::getInstance().complete("ice", "iceServers", waitStartTime, config.cached ? "cache" : "signaling");
+
+    // Only those that fit next to the STUN server
+    for (auto& server : config.servers) {
+        CHECK(uriCount < MAX_ICE_SERVERS_COUNT);
+        /*
+         * if configuration.iceServers[uriCount + 1].urls is "turn:ip:port?transport=udp" then ICE will try TURN over UDP
+         * if configuration.iceServers[uriCount + 1].urls is "turn:ip:port?transport=tcp" then ICE will try TURN over TCP/TLS
+         * if configuration.iceServers[uriCount + 1].urls is "turns:ip:port?transport=udp", it's currently ignored because sdk dont do
+         * TURN over DTLS yet. if configuration.iceServers[uriCount + 1].urls is "turns:ip:port?transport=tcp" then ICE will try TURN over
+         * TCP/TLS if configuration.iceServers[uriCount + 1].urls is "turn:ip:port" then ICE will try both TURN over UPD and TCP/TLS
+         *
+         * It's recommended to not pass too many TURN iceServers to configuration because it will slow down ice gathering in non-trickle
+         * mode.
+         */
+
+        STRNCPY(pConfiguration->iceServers[uriCount + 1].urls, server.uri.c_str(), MAX_ICE_CONFIG_URI_LEN);
+        STRNCPY(pConfiguration->iceServers[uriCount + 1].credential, server.credential.c_str(), MAX_ICE_CONFIG_CREDENTIAL_LEN);
+        STRNCPY(pConfiguration->iceServers[uriCount + 1].username, server.userName.c_str(), MAX_ICE_CONFIG_USER_NAME_LEN);
+
+        uriCount++;
+    }
+    this->iceServersAdded = TRUE;
 
-        return retStatus;
-    };
+CleanUp:
+
+    return retStatus;
+}
 
+STATUS Peer::findOrCreateConnection(const std::string& peerId, PConnection& pConnection)
+{
     STATUS retStatus = STATUS_SUCCESS;
-    auto pConfig = this->pConfig;
-    auto pSignalingClientHandle = this->pSignalingClientHandle;
-    UINT32 i, j, iceConfigCount, uriCount;
-    PIceConfigInfo pIceConfigInfo;
-    PRtcConfiguration pConfiguration = &this->rtcConfiguration;
+    UINT32 activeConnections = 0;
 
-    MEMSET(pConfiguration, 0x00, SIZEOF(RtcConfiguration));
+    pConnection = nullptr;
 
-    // Set this to custom callback to enable filtering of interfaces
-    pConfiguration->kvsRtcConfiguration.iceSetInterfaceFilterFunc = NULL;
+    if (!this->pConfig->isMaster) {
+        // A viewer only ever talks to the master, so every message belongs to the connection created in connect()
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        CHK_WARN(!this->connections.empty(), STATUS_INVALID_OPERATION, "Received a signaling message before connecting");
+        pConnection = this->connections.begin()->second;
+        CHK(FALSE, retStatus);
+    }
 
-    // Set the  STUN server
-    SNPRINTF(pConfiguration->iceServers[0].urls, MAX_ICE_CONFIG_URI_LEN, KINESIS_VIDEO_STUN_URL, pConfig->pRegion);
-
-    if (pConfig->useTurn) {
-        // Set the URIs from the configuration
-        CHK_STATUS(awaitGetIceConfigInfoCount(pSignalingClientHandle, &iceConfigCount));
-
-        /* signalingClientGetIceConfigInfoCount can return more than one turn server. Use only one to optimize
-         * candidate gathering latency. But user can also choose to use more than 1 turn server. */
-        for (uriCount = 0, i = 0; i < MAX_TURN_SERVERS; i++) {
-            CHK_STATUS(signalingClientGetIceConfigInfo(pSignalingClientHandle, i, &pIceConfigInfo));
-            for (j = 0; j < pIceConfigInfo->uriCount; j++) {
-                CHECK(uriCount < MAX_ICE_SERVERS_COUNT);
-                /*
-                 * if configuration.iceServers[uriCount + 1].urls is "turn:ip:port?transport=udp" then ICE will try TURN over UDP
-                 * if configuration.iceServers[uriCount + 1].urls is "turn:ip:port?transport=tcp" then ICE will try TURN over TCP/TLS
-                 * if configuration.iceServers[uriCount + 1].urls is "turns:ip:port?transport=udp", it's currently ignored because sdk dont do
-                 * TURN over DTLS yet. if configuration.iceServers[uriCount + 1].urls is "turns:ip:port?transport=tcp" then ICE will try TURN over
-                 * TCP/TLS if configuration.iceServers[uriCount + 1].urls is "turn:ip:port" then ICE will try both TURN over UPD and TCP/TLS
-                 *
-                 * It's recommended to not pass too many TURN iceServers to configuration because it will slow down ice gathering in non-trickle
-                 * mode.
-                 */
-
-                STRNCPY(pConfiguration->iceServers[uriCount + 1].urls, pIceConfigInfo->uris[j], MAX_ICE_CONFIG_URI_LEN);
-                STRNCPY(pConfiguration->iceServers[uriCount + 1].credential, pIceConfigInfo->password, MAX_ICE_CONFIG_CREDENTIAL_LEN);
-                STRNCPY(pConfiguration->iceServers[uriCount + 1].username, pIceConfigInfo->userName, MAX_ICE_CONFIG_USER_NAME_LEN);
-
-                uriCount++;
-            }
+    {
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        auto it = this->connections.find(peerId);
+        if (it != this->connections.end() && !it->second->closed.load()) {
+            pConnection = it->second;
+            CHK(FALSE, retStatus);
         }
     }
 
+    // Free up the slots of the viewers that went away before deciding whether there's room for a new one
+    this->reapConnections();
+
+    {
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        activeConnections = (UINT32) this->connections.size();
+    }
+
+    if (activeConnections >= this->pConfig->maxViewers) {
+        DLOGW("Unexpected receiving message from extra peer: %s", peerId.c_str());
+        CHK(FALSE, retStatus);
+    }
+
+    DLOGI("Found peer id: %s", peerId.c_str());
+    // Candidates of an earlier connection from the same peer id have to wait for the new answer again
+    this->signalingQueue.reset(peerId);
+    pConnection = std::make_shared<Connection>(this, peerId);
+    CHK_STATUS(pConnection->init());
+
+    {
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        this->connections[peerId] = pConnection;
+        activeConnections = (UINT32) this->connections.size();
+    }
+
+    DLOGI("Serving %u of %u viewers", activeConnections, this->pConfig->maxViewers);
+    this->pMonitoring->pushConcurrentConnections(activeConnections);
+
 CleanUp:
 
+    if (STATUS_FAILED(retStatus)) {
+        pConnection = nullptr;
+    }
+
     return retStatus;
 }
 
-STATUS Peer::initPeerConnection()
+VOID Peer::reapConnections()
+{
+    std::vector<PConnection> closedConnections;
+
+    {
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        for (auto it = this->connections.begin(); it != this->connections.end();) {
+            if (it->second->closed.load()) {
+                closedConnections.push_back(it->second);
+                it = this->connections.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    // Peer connections are freed outside of the lock since freeing waits for their threads to finish
+    closedConnections.clear();
+}
+
+VOID Peer::onConnectionClosed(Connection& connection, STATUS connectionStatus)
+{
+    BOOL singleConnection = !this->pConfig->isMaster || this->pConfig->maxViewers <= 1;
+    UINT32 activeConnections = 0;
+
+    if (singleConnection && STATUS_FAILED(connectionStatus)) {
+        this->status = connectionStatus;
+    }
+
+    if (connection.closed.exchange(TRUE)) {
+        return;
+    }
+
+    for (auto& pConsumer : connection.consumers) {
+        pConsumer->deactivate();
+    }
+
+    if (singleConnection) {
+        // Let the higher level to terminate
+        if (this->callbacks.onDisconnected != NULL) {
+            this->callbacks.onDisconnected();
+        }
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(this->connectionsMutex);
+            for (auto& it : this->connections) {
+                activeConnections += it.second->closed.load() ? 0 : 1;
+            }
+        }
+
+        if (STATUS_FAILED(connectionStatus)) {
+            DLOGW("Connection to %s failed with 0x%08x", connection.peerId.c_str(), connectionStatus);
+        }
+        DLOGI("Connection to %s closed, serving %u of %u viewers", connection.peerId.c_str(), activeConnections, this->pConfig->maxViewers);
+        this->pMonitoring->pushConcurrentConnections(activeConnections);
+    }
+}
+
+STATUS Peer::Connection::init()
 {
     auto handleOnIceCandidate = [](UINT64 customData, PCHAR candidateJson) -> VOID {
         STATUS retStatus = STATUS_SUCCESS;
-        auto pPeer = (PPeer) customData;
+        auto pConnection = (Connection*) customData;
+        auto pPeer = pConnection->pPeer;
         SignalingMessage message;
 
         if (candidateJson == NULL) {
             DLOGD("ice candidate gathering finished");
-            pPeer->iceGatheringDone = TRUE;
-            pPeer->cvar.notify_all();
-        } else if (pPeer->pConfig->trickleIce) {
-            message.messageType = SIGNALING_MESSAGE_TYPE_ICE_CANDIDATE;
-            STRCPY(message.payload, candidateJson);
-            CHK_STATUS(pPeer->send(&message));
+            Tracer::getInstance().complete("ice", "iceGathering", pConnection->iceGatheringStartTime, pConnection->peerId.c_str());
+            pPeer->postEvent(PEER_EVENT_GATHERING_DONE, pConnection->peerId, nullptr);
+        } else {
+            TRACE_INSTANT("ice", "localCandidate", pConnection->peerId.c_str());
+            if (pPeer->pConfig->trickleIce) {
+                message.messageType = SIGNALING_MESSAGE_TYPE_ICE_CANDIDATE;
+                STRCPY(message.payload, candidateJson);
+                CHK_STATUS(pPeer->send(*pConnection, &message));
+            }
         }
 
     CleanUp:
@@ -236,32 +378,42 @@ STATUS Peer::initPeerConnection()
     };
 
     auto onConnectionStateChange = [](UINT64 customData, RTC_PEER_CONNECTION_STATE newState) -> VOID {
-        auto pPeer = (PPeer) customData;
+        auto pConnection = (Connection*) customData;
+        auto pPeer = pConnection->pPeer;
+        UINT64 expected = 0;
 
-        DLOGI("New connection state %u", newState);
+        DLOGI("New connection state %u for %s", newState, pConnection->peerId.c_str());
+        // The DTLS handshake is part of CONNECTING, CONNECTED means that it's done
+        TRACE_INSTANT("connection", getConnectionStateName(newState), pConnection->peerId.c_str());
 
         switch (newState) {
             case RTC_PEER_CONNECTION_STATE_CONNECTING:
-                pPeer->iceHolePunchingStartTime = GETTIME();
+                pConnection->iceHolePunchingStartTime = GETTIME();
                 break;
             case RTC_PEER_CONNECTION_STATE_CONNECTED: {
-                auto duration = (GETTIME() - pPeer->iceHolePunchingStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+                auto duration = (GETTIME() - pConnection->iceHolePunchingStartTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
                 DLOGI("ICE hole punching took %lu ms", duration);
-                Canary::Cloudwatch::getInstance().monitoring.pushICEHolePunchingDelay(duration, StandardUnit::Milliseconds);
+                pPeer->pMonitoring->recordICEHolePunchingDelay(duration);
+                pPeer->iceConnectTime = duration;
+                Tracer::getInstance().complete("ice", "iceHolePunching", pConnection->iceHolePunchingStartTime, pConnection->peerId.c_str());
+
+                // A master waits for viewers to show up, so only a viewer's setup time says something about the SDK
+                duration = (GETTIME() - pPeer->createTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+                if (pPeer->setupTime.compare_exchange_strong(expected, MAX(duration, 1)) && !pPeer->pConfig->isMaster) {
+                    pPeer->pMonitoring->recordSessionSetupDelay(duration);
+                }
                 break;
             }
             case RTC_PEER_CONNECTION_STATE_FAILED:
+                pPeer->failedConnections++;
                 // TODO: Replace this with a proper error code. Since there's no way to get the actual error code
                 // at this moment, STATUS_PEERCONNECTION_BASE seems to be the best error code.
-                pPeer->status = STATUS_PEERCONNECTION_BASE;
-                // explicit fallthrough
+                pPeer->onConnectionClosed(*pConnection, STATUS_PEERCONNECTION_BASE);
+                break;
             case RTC_PEER_CONNECTION_STATE_CLOSED:
                 // explicit fallthrough
             case RTC_PEER_CONNECTION_STATE_DISCONNECTED:
-                // Let the higher level to terminate
-                if (pPeer->callbacks.onDisconnected != NULL) {
-                    pPeer->callbacks.onDisconnected();
-                }
+                pPeer->onConnectionClosed(*pConnection, STATUS_SUCCESS);
                 break;
             default:
                 break;
@@ -271,12 +423,13 @@ STATUS Peer::initPeerConnection()
     STATUS retStatus = STATUS_SUCCESS;
     CHK(this->pPeerConnection == NULL, STATUS_INVALID_OPERATION);
 
-    CHK_STATUS(createPeerConnection(&this->rtcConfiguration, &this->pPeerConnection));
+    CHK_STATUS(this->pPeer->addIceServers());
+    CHK_STATUS(createPeerConnection(&this->pPeer->rtcConfiguration, &this->pPeerConnection));
     CHK_STATUS(peerConnectionOnIceCandidate(this->pPeerConnection, (UINT64) this, handleOnIceCandidate));
     CHK_STATUS(peerConnectionOnConnectionStateChange(this->pPeerConnection, (UINT64) this, onConnectionStateChange));
 
-    if (this->callbacks.onNewConnection != NULL) {
-        this->callbacks.onNewConnection(this);
+    if (this->pPeer->callbacks.onNewConnection != NULL) {
+        CHK_STATUS(this->pPeer->callbacks.onNewConnection(*this));
     }
 
 CleanUp:
@@ -288,53 +441,104 @@ STATUS Peer::shutdown()
 {
     this->terminated = TRUE;
 
-    this->cvar.notify_all();
+    // Wait for the event being handled, whatever is still queued doesn't matter anymore
+    this->stopEvents();
+
+    std::vector<PConnection> activeConnections;
     {
-        // lock to wait until awoken thread finish.
-        std::lock_guard<std::recursive_mutex> lock(this->mutex);
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        for (auto& it : this->connections) {
+            activeConnections.push_back(it.second);
+        }
     }
 
-    if (this->pPeerConnection != NULL) {
-        CHK_LOG_ERR(closePeerConnection(this->pPeerConnection));
+    // Closing triggers connection state callbacks, so it must not happen while holding connectionsMutex
+    for (auto& pConnection : activeConnections) {
+        if (pConnection->pPeerConnection != NULL) {
+            CHK_LOG_ERR(closePeerConnection(pConnection->pPeerConnection));
+        }
     }
+    this->signalingQueue.stop();
 
     return this->status;
 }
 
-STATUS Peer::connect()
+VOID Peer::onBandwidthEstimation(Connection& connection, UINT64 bitrate)
 {
-    auto connectPeerConnection = [this]() -> STATUS {
-        STATUS retStatus = STATUS_SUCCESS;
-        RtcSessionDescriptionInit offerSDPInit;
-        UINT32 buffLen;
-        SignalingMessage msg;
+    UINT64 minimum = bitrate;
 
-        MEMSET(&offerSDPInit, 0, SIZEOF(offerSDPInit));
-        CHK_STATUS(createOffer(this->pPeerConnection, &offerSDPInit));
-        CHK_STATUS(setLocalDescription(this->pPeerConnection, &offerSDPInit));
+    connection.bandwidthEstimate = bitrate;
 
-        if (!this->pConfig->trickleIce) {
-            CHK_STATUS(this->awaitIceGathering(&offerSDPInit));
+    {
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        for (auto& it : this->connections) {
+            if (!it.second->closed.load() && it.second->bandwidthEstimate.load() != 0) {
+                minimum = MIN(minimum, it.second->bandwidthEstimate.load());
+            }
         }
+    }
 
-        msg.messageType = SIGNALING_MESSAGE_TYPE_OFFER;
-        CHK_STATUS(serializeSessionDescriptionInit(&offerSDPInit, NULL, &buffLen));
-        CHK_STATUS(serializeSessionDescriptionInit(&offerSDPInit, msg.payload, &buffLen));
-        CHK_STATUS(this->send(&msg));
+    if (this->callbacks.onBandwidthEstimation != NULL) {
+        this->callbacks.onBandwidthEstimation(minimum);
+    }
+}
 
-    CleanUp:
+VOID Peer::reportReceiveStats()
+{
+    ReceiveMetrics::Stats videoStats, audioStats;
+    UINT64 now = GETTIME(), period;
 
-        return retStatus;
-    };
+    {
+        std::lock_guard<std::mutex> lock(this->connectionsMutex);
+        for (auto& it : this->connections) {
+            videoStats.merge(it.second->videoReceiveMetrics.takeStats());
+            audioStats.merge(it.second->audioReceiveMetrics.takeStats());
+        }
+    }
+
+    period = now - this->lastReceiveStatsTime;
+    this->lastReceiveStatsTime = now;
+
+    auto& monitoring = *this->pMonitoring;
+    monitoring.pushReceiveStats(MEDIA_STREAM_TRACK_KIND_VIDEO, videoStats, period);
+    monitoring.pushReceiveStats(MEDIA_STREAM_TRACK_KIND_AUDIO, audioStats, period);
+}
+
+Peer::Stats Peer::getStats()
+{
+    Stats stats;
+
+    stats.signalingConnectTime = this->signalingConnectTime.load();
+    stats.signalingClientCreateTime = this->signalingClientCreateTime.load();
+    stats.signalingClientConnectTime = this->signalingClientConnectTime.load();
+    stats.iceServerWaitTime = this->iceServerWaitTime.load();
+    stats.iceConnectTime = this->iceConnectTime.load();
+    stats.setupTime = this->setupTime.load();
+    stats.firstFrameTime = this->firstFrameTime.load();
+    stats.sentBytes = this->sentBytes.load();
+    stats.failedConnections = this->failedConnections.load();
+
+    return stats;
+}
 
+STATUS Peer::connect()
+{
     STATUS retStatus = STATUS_SUCCESS;
-    CHK_STATUS(signalingClientConnectSync(pSignalingClientHandle));
+    PConnection pConnection;
+    UINT64 startTime = GETTIME();
+
+    CHK_STATUS(this->pSignaling->connect());
+    this->signalingClientConnectTime = MAX((GETTIME() - startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, 1);
+    Tracer::getInstance().complete("signaling", "signalingClientConnect", startTime);
 
     if (!this->pConfig->isMaster) {
-        this->foundPeerId = TRUE;
-        this->peerId = DEFAULT_VIEWER_PEER_ID;
-        CHK_STATUS(this->initPeerConnection());
-        CHK_STATUS(connectPeerConnection());
+        pConnection = std::make_shared<Connection>(this, DEFAULT_VIEWER_PEER_ID);
+        CHK_STATUS(pConnection->init());
+        {
+            std::lock_guard<std::mutex> lock(this->connectionsMutex);
+            this->connections[pConnection->peerId] = pConnection;
+        }
+        this->postEvent(PEER_EVENT_CONNECT, pConnection->peerId, nullptr);
     }
 
 CleanUp:
@@ -342,54 +546,207 @@ CleanUp:
     return retStatus;
 }
 
-STATUS Peer::send(PSignalingMessage pMsg)
+STATUS Peer::send(Connection& connection, PSignalingMessage pMsg)
 {
     STATUS retStatus = STATUS_SUCCESS;
 
-    if (this->foundPeerId.load()) {
-        pMsg->version = SIGNALING_MESSAGE_CURRENT_VERSION;
-        pMsg->correlationId[0] = '\0';
-        STRCPY(pMsg->peerClientId, peerId.c_str());
-        pMsg->payloadLen = (UINT32) STRLEN(pMsg->payload);
-        CHK_STATUS(signalingClientSendMessageSync(this->pSignalingClientHandle, pMsg));
+    pMsg->version = SIGNALING_MESSAGE_CURRENT_VERSION;
+    pMsg->correlationId[0] = '\0';
+    STRCPY(pMsg->peerClientId, connection.peerId.c_str());
+    pMsg->payloadLen = (UINT32) STRLEN(pMsg->payload);
+    // Sent from the queue's own thread, neither ICE gathering nor the event thread wait for the signaling connection
+    CHK_STATUS(this->signalingQueue.push(*pMsg));
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID Peer::postEvent(PEER_EVENT_TYPE type, const std::string& peerId, std::shared_ptr<SignalingMessage> pMessage)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->eventsMutex);
+        if (this->eventsTerminated) {
+            return;
+        }
+        this->events.push_back(Event{type, peerId, std::move(pMessage), GETTIME()});
+    }
+    this->eventsCvar.notify_all();
+}
+
+VOID Peer::runEvents()
+{
+    std::unique_lock<std::mutex> lock(this->eventsMutex);
+    Event event;
+
+    while (TRUE) {
+        this->eventsCvar.wait(lock, [this]() { return this->eventsTerminated || !this->events.empty(); });
+        if (this->eventsTerminated) {
+            break;
+        }
+
+        event = std::move(this->events.front());
+        this->events.pop_front();
+
+        lock.unlock();
+        CHK_LOG_ERR(this->handleEvent(event));
+        event.pMessage = nullptr;
+        lock.lock();
+    }
+}
+
+VOID Peer::stopEvents()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->eventsMutex);
+        this->eventsTerminated = TRUE;
+        this->events.clear();
+    }
+    this->eventsCvar.notify_all();
+
+    if (this->eventThread.joinable()) {
+        this->eventThread.join();
+    }
+}
+
+STATUS Peer::handleEvent(Event& event)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PConnection pConnection;
+
+    CHK(!this->terminated.load(), retStatus);
+
+    switch (event.type) {
+        case PEER_EVENT_MESSAGE:
+            CHK_STATUS(this->findOrCreateConnection(event.peerId, pConnection));
+            // Messages from peers that couldn't get a connection are dropped
+            CHK(pConnection != nullptr, retStatus);
+
+            DLOGD("Handling signaling message:\n%s", event.pMessage->payload);
+            CHK_STATUS(this->handleSignalingMsg(*pConnection, *event.pMessage, event.receiveTime));
+            break;
+        case PEER_EVENT_CONNECT:
+            pConnection = this->findConnection(event.peerId);
+            CHK(pConnection != nullptr, retStatus);
+
+            // Without the offer there's nothing else to wait for, so the viewer is done
+            retStatus = this->startNegotiation(*pConnection);
+            if (STATUS_FAILED(retStatus)) {
+                this->onConnectionClosed(*pConnection, retStatus);
+            }
+            break;
+        case PEER_EVENT_GATHERING_DONE:
+            pConnection = this->findConnection(event.peerId);
+            CHK(pConnection != nullptr, retStatus);
+            CHK_STATUS(this->onIceGatheringDone(*pConnection));
+            break;
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+Peer::PConnection Peer::findConnection(const std::string& peerId)
+{
+    std::lock_guard<std::mutex> lock(this->connectionsMutex);
+    auto it = this->connections.find(peerId);
+
+    return it == this->connections.end() || it->second->closed.load() ? nullptr : it->second;
+}
+
+STATUS Peer::startNegotiation(Connection& connection)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    RtcSessionDescriptionInit offerSDPInit;
+
+    CHK(connection.negotiationState == NEGOTIATION_STATE_NEW, STATUS_INVALID_OPERATION);
+
+    MEMSET(&offerSDPInit, 0, SIZEOF(offerSDPInit));
+    {
+        TRACE_SPAN("sdp", "createOffer", connection.peerId.c_str());
+        CHK_STATUS(createOffer(connection.pPeerConnection, &offerSDPInit));
+        CHK_STATUS(setLocalDescription(connection.pPeerConnection, &offerSDPInit));
+    }
+    connection.iceGatheringStartTime = GETTIME();
+
+    if (!this->pConfig->trickleIce) {
+        // The offer goes out with all of the candidates once gathering is done
+        connection.negotiationState = NEGOTIATION_STATE_GATHERING;
+        connection.pendingMessageType = SIGNALING_MESSAGE_TYPE_OFFER;
+        CHK(FALSE, retStatus);
+    }
+
+    CHK_STATUS(this->sendSessionDescription(connection, SIGNALING_MESSAGE_TYPE_OFFER, &offerSDPInit));
+    connection.negotiationState = NEGOTIATION_STATE_AWAITING_ANSWER;
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS Peer::onIceGatheringDone(Connection& connection)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    RtcSessionDescriptionInit sdpInit;
+
+    // With trickle ICE everything has been sent already
+    CHK(connection.negotiationState == NEGOTIATION_STATE_GATHERING, retStatus);
+
+    MEMSET(&sdpInit, 0, SIZEOF(sdpInit));
+    CHK_STATUS(peerConnectionGetCurrentLocalDescription(connection.pPeerConnection, &sdpInit));
+    CHK_STATUS(this->sendSessionDescription(connection, connection.pendingMessageType, &sdpInit));
+
+    if (connection.pendingMessageType == SIGNALING_MESSAGE_TYPE_OFFER) {
+        connection.negotiationState = NEGOTIATION_STATE_AWAITING_ANSWER;
     } else {
-        // TODO: maybe queue messages when there's no peer id
-        DLOGW("Peer id hasn't been found yet. Failed to send a signaling message");
+        connection.negotiationState = NEGOTIATION_STATE_NEGOTIATED;
+        // The offer is only handled once its answer is out
+        this->pMonitoring->recordSignalingMessageLatency(SIGNALING_MESSAGE_TYPE_OFFER,
+                                                         (GETTIME() - connection.pendingReceiveTime) / HUNDREDS_OF_NANOS_IN_A_MICROSECOND);
     }
 
 CleanUp:
 
+    if (STATUS_FAILED(retStatus)) {
+        this->onConnectionClosed(connection, retStatus);
+    }
+
     return retStatus;
 }
 
-STATUS Peer::awaitIceGathering(PRtcSessionDescriptionInit pSDPInit)
+STATUS Peer::sendSessionDescription(Connection& connection, SIGNALING_MESSAGE_TYPE type, PRtcSessionDescriptionInit pSDPInit)
 {
     STATUS retStatus = STATUS_SUCCESS;
-    std::unique_lock<std::recursive_mutex> lock(this->mutex);
-    this->cvar.wait(lock, [this]() { return this->terminated.load() || this->iceGatheringDone.load(); });
-    CHK_WARN(!this->terminated.load(), STATUS_OPERATION_TIMED_OUT, "application terminated and candidate gathering still not done");
+    SignalingMessage msg;
+    UINT32 buffLen;
 
-    CHK_STATUS(peerConnectionGetCurrentLocalDescription(this->pPeerConnection, pSDPInit));
+    msg.messageType = type;
+    {
+        TRACE_SPAN("sdp", "serializeSessionDescription", connection.peerId.c_str());
+        CHK_STATUS(serializeSessionDescriptionInit(pSDPInit, NULL, &buffLen));
+        CHK_STATUS(serializeSessionDescriptionInit(pSDPInit, msg.payload, &buffLen));
+    }
+    CHK_STATUS(this->send(connection, &msg));
 
 CleanUp:
 
     return retStatus;
-};
+}
 
-STATUS Peer::handleSignalingMsg(PReceivedSignalingMessage pMsg)
+STATUS Peer::handleSignalingMsg(Connection& connection, SignalingMessage& msg, UINT64 receiveTime)
 {
-    auto handleOffer = [this](SignalingMessage& msg) -> STATUS {
+    auto handleOffer = [this, &connection, receiveTime](SignalingMessage& msg) -> STATUS {
         STATUS retStatus = STATUS_SUCCESS;
         RtcSessionDescriptionInit offerSDPInit, answerSDPInit;
         NullableBool canTrickle;
-        UINT32 buffLen;
 
         if (!this->pConfig->isMaster) {
             DLOGW("Unexpected message SIGNALING_MESSAGE_TYPE_OFFER");
             CHK(FALSE, retStatus);
         }
 
-        if (receivedOffer.exchange(TRUE)) {
+        if (connection.negotiationState != NEGOTIATION_STATE_NEW) {
             DLOGW("Offer already received, ignore new offer from client id %s", msg.peerClientId);
             CHK(FALSE, retStatus);
         }
@@ -397,44 +754,54 @@ STATUS Peer::handleSignalingMsg(PReceivedSignalingMessage pMsg)
         MEMSET(&offerSDPInit, 0, SIZEOF(offerSDPInit));
         MEMSET(&answerSDPInit, 0, SIZEOF(answerSDPInit));
 
-        CHK_STATUS(deserializeSessionDescriptionInit(msg.payload, msg.payloadLen, &offerSDPInit));
-        CHK_STATUS(setRemoteDescription(this->pPeerConnection, &offerSDPInit));
+        {
+            TRACE_SPAN("sdp", "setRemoteDescription", connection.peerId.c_str());
+            CHK_STATUS(deserializeSessionDescriptionInit(msg.payload, msg.payloadLen, &offerSDPInit));
+            CHK_STATUS(setRemoteDescription(connection.pPeerConnection, &offerSDPInit));
+        }
 
-        canTrickle = canTrickleIceCandidates(this->pPeerConnection);
+        canTrickle = canTrickleIceCandidates(connection.pPeerConnection);
         /* cannot be null after setRemoteDescription */
         CHECK(!NULLABLE_CHECK_EMPTY(canTrickle));
 
-        CHK_STATUS(createAnswer(this->pPeerConnection, &answerSDPInit));
-        CHK_STATUS(setLocalDescription(this->pPeerConnection, &answerSDPInit));
+        {
+            TRACE_SPAN("sdp", "createAnswer", connection.peerId.c_str());
+            CHK_STATUS(createAnswer(connection.pPeerConnection, &answerSDPInit));
+            CHK_STATUS(setLocalDescription(connection.pPeerConnection, &answerSDPInit));
+        }
+        connection.iceGatheringStartTime = GETTIME();
 
         if (!canTrickle.value) {
-            CHK_STATUS(this->awaitIceGathering(&answerSDPInit));
+            // The answer goes out with all of the candidates once gathering is done
+            connection.negotiationState = NEGOTIATION_STATE_GATHERING;
+            connection.pendingMessageType = SIGNALING_MESSAGE_TYPE_ANSWER;
+            connection.pendingReceiveTime = receiveTime;
+            CHK(FALSE, retStatus);
         }
 
-        msg.messageType = SIGNALING_MESSAGE_TYPE_ANSWER;
-        CHK_STATUS(serializeSessionDescriptionInit(&answerSDPInit, NULL, &buffLen));
-        CHK_STATUS(serializeSessionDescriptionInit(&answerSDPInit, msg.payload, &buffLen));
-
-        CHK_STATUS(this->send(&msg));
+        CHK_STATUS(this->sendSessionDescription(connection, SIGNALING_MESSAGE_TYPE_ANSWER, &answerSDPInit));
+        connection.negotiationState = NEGOTIATION_STATE_NEGOTIATED;
 
     CleanUp:
 
         return retStatus;
     };
 
-    auto handleAnswer = [this](SignalingMessage& msg) -> STATUS {
+    auto handleAnswer = [this, &connection](SignalingMessage& msg) -> STATUS {
         STATUS retStatus = STATUS_SUCCESS;
         RtcSessionDescriptionInit answerSDPInit;
 
         if (this->pConfig->isMaster) {
             DLOGW("Unexpected message SIGNALING_MESSAGE_TYPE_ANSWER");
-        } else if (receivedAnswer.exchange(TRUE)) {
-            DLOGW("Offer already received, ignore new offer from client id %s", msg.peerClientId);
+        } else if (connection.negotiationState != NEGOTIATION_STATE_AWAITING_ANSWER) {
+            DLOGW("Unexpected answer in negotiation state %u from client id %s", connection.negotiationState, msg.peerClientId);
         } else {
+            TRACE_SPAN("sdp", "setRemoteDescription", connection.peerId.c_str());
             MEMSET(&answerSDPInit, 0x00, SIZEOF(RtcSessionDescriptionInit));
 
             CHK_STATUS(deserializeSessionDescriptionInit(msg.payload, msg.payloadLen, &answerSDPInit));
-            CHK_STATUS(setRemoteDescription(this->pPeerConnection, &answerSDPInit));
+            CHK_STATUS(setRemoteDescription(connection.pPeerConnection, &answerSDPInit));
+            connection.negotiationState = NEGOTIATION_STATE_NEGOTIATED;
         }
 
     CleanUp:
@@ -442,12 +809,12 @@ STATUS Peer::handleSignalingMsg(PReceivedSignalingMessage pMsg)
         return retStatus;
     };
 
-    auto handleICECandidate = [this](SignalingMessage& msg) -> STATUS {
+    auto handleICECandidate = [&connection](SignalingMessage& msg) -> STATUS {
         STATUS retStatus = STATUS_SUCCESS;
         RtcIceCandidateInit iceCandidate;
 
         CHK_STATUS(deserializeRtcIceCandidateInit(msg.payload, msg.payloadLen, &iceCandidate));
-        CHK_STATUS(addIceCandidate(this->pPeerConnection, iceCandidate.candidate));
+        CHK_STATUS(addIceCandidate(connection.pPeerConnection, iceCandidate.candidate));
 
     CleanUp:
 
@@ -456,12 +823,12 @@ STATUS Peer::handleSignalingMsg(PReceivedSignalingMessage pMsg)
     };
 
     STATUS retStatus = STATUS_SUCCESS;
-    auto& msg = pMsg->signalingMessage;
 
-    CHK(!this->terminated.load(), retStatus);
     switch (msg.messageType) {
         case SIGNALING_MESSAGE_TYPE_OFFER:
             CHK_STATUS(handleOffer(msg));
+            // While the answer is still being gathered, the latency is recorded once it went out
+            CHK(connection.negotiationState != NEGOTIATION_STATE_GATHERING, retStatus);
             break;
         case SIGNALING_MESSAGE_TYPE_ICE_CANDIDATE:
             CHK_STATUS(handleICECandidate(msg));
@@ -471,29 +838,32 @@ STATUS Peer::handleSignalingMsg(PReceivedSignalingMessage pMsg)
             break;
         default:
             DLOGW("Unknown message type %u", msg.messageType);
-            break;
+            CHK(FALSE, retStatus);
     }
 
+    this->pMonitoring->recordSignalingMessageLatency(msg.messageType, (GETTIME() - receiveTime) / HUNDREDS_OF_NANOS_IN_A_MICROSECOND);
+
 CleanUp:
 
     return retStatus;
 }
 
-STATUS Peer::addTransceiver(RtcMediaStreamTrack& track)
+STATUS Peer::Connection::addTransceiver(RtcMediaStreamTrack& track)
 {
     auto handleFrame = [](UINT64 customData, PFrame pFrame) -> VOID {
-        UNUSED_PARAM(customData);
-        // TODO: Probably reexpose or add metrics here directly
         DLOGV("Frame received. TrackId: %" PRIu64 ", Size: %u, Flags %u", pFrame->trackId, pFrame->size, pFrame->flags);
+        ((PReceiveMetrics) customData)->onFrame(pFrame, GETTIME());
     };
 
     auto handleBandwidthEstimation = [](UINT64 customData, DOUBLE maxiumBitrate) -> VOID {
-        UNUSED_PARAM(customData);
-        // TODO: Probably reexpose or add metrics here directly
+        auto pConnection = (Connection*) customData;
         DLOGV("received bitrate suggestion: %f", maxiumBitrate);
+        pConnection->pPeer->onBandwidthEstimation(*pConnection, (UINT64) maxiumBitrate);
     };
 
     PRtcRtpTransceiver pTransceiver;
+    PPeer pPeer = this->pPeer;
+    MEDIA_STREAM_TRACK_KIND kind = track.kind;
     STATUS retStatus = STATUS_SUCCESS;
 
     CHK_STATUS(::addTransceiver(pPeerConnection, &track, NULL, &pTransceiver));
@@ -503,34 +873,35 @@ STATUS Peer::addTransceiver(RtcMediaStreamTrack& track)
         this->audioTransceivers.push_back(pTransceiver);
     }
 
-    CHK_STATUS(transceiverOnFrame(pTransceiver, (UINT64) this, handleFrame));
+    CHK_STATUS(transceiverOnFrame(
+        pTransceiver, (UINT64) (track.kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? &this->videoReceiveMetrics : &this->audioReceiveMetrics), handleFrame));
     CHK_STATUS(transceiverOnBandwidthEstimation(pTransceiver, (UINT64) this, handleBandwidthEstimation));
 
-CleanUp:
-
-    return retStatus;
-}
-
-STATUS Peer::addSupportedCodec(RTC_CODEC codec)
-{
-    STATUS retStatus = STATUS_SUCCESS;
-
-    CHK_STATUS(::addSupportedCodec(pPeerConnection, codec));
+    this->consumers.push_back(
+        this->pPeer->pFanout->subscribe(this->peerId + "/" + track.trackId, track.kind, [pTransceiver, pPeer, kind](PFrame pFrame) -> STATUS {
+            TRACE_SPAN("media", kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? "writeVideoFrame" : "writeAudioFrame");
+            STATUS status = ::writeFrame(pTransceiver, pFrame);
+            UINT64 expected = 0;
+            if (STATUS_SUCCEEDED(status)) {
+                pPeer->sentBytes += pFrame->size;
+                if (pPeer->firstFrameTime.load() == 0) {
+                    auto duration = (GETTIME() - pPeer->createTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+                    pPeer->firstFrameTime.compare_exchange_strong(expected, MAX(duration, 1));
+                }
+            }
+            return status;
+        }));
 
 CleanUp:
 
     return retStatus;
 }
 
-STATUS Peer::writeFrame(PFrame pFrame, MEDIA_STREAM_TRACK_KIND kind)
+STATUS Peer::Connection::addSupportedCodec(RTC_CODEC codec)
 {
     STATUS retStatus = STATUS_SUCCESS;
 
-    auto& transceivers = kind == MEDIA_STREAM_TRACK_KIND_VIDEO ? this->videoTransceivers : this->audioTransceivers;
-
-    for (auto& transceiver : transceivers) {
-        CHK_LOG_ERR(::writeFrame(transceiver, pFrame));
-    }
+    CHK_STATUS(::addSupportedCodec(pPeerConnection, codec));
 
 CleanUp:
 
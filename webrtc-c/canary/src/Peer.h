@@ -4,51 +4,158 @@ namespace Canary {
 class Peer;
 typedef Peer* PPeer;
 
+typedef enum {
+    // nothing has been sent or received yet
+    NEGOTIATION_STATE_NEW,
+    // the local description is set and goes out once ICE gathering is done, since candidates can't be trickled
+    NEGOTIATION_STATE_GATHERING,
+    // a viewer sent its offer and waits for the answer
+    NEGOTIATION_STATE_AWAITING_ANSWER,
+    // both descriptions are set, only candidates are left to exchange
+    NEGOTIATION_STATE_NEGOTIATED,
+} NEGOTIATION_STATE;
+
+typedef enum {
+    // a signaling message came in
+    PEER_EVENT_MESSAGE,
+    // a viewer starts the negotiation with its offer
+    PEER_EVENT_CONNECT,
+    PEER_EVENT_GATHERING_DONE,
+} PEER_EVENT_TYPE;
+
 class Peer {
   public:
+    // Connection is the peer connection to a single remote client. A master can serve up to
+    // Config::maxViewers connections at once, all of them sharing the same signaling client.
+    class Connection {
+      public:
+        Connection(PPeer, const std::string&);
+        ~Connection();
+        STATUS addTransceiver(RtcMediaStreamTrack&);
+        STATUS addSupportedCodec(RTC_CODEC);
+
+      private:
+        friend class Peer;
+
+        const PPeer pPeer;
+        const std::string peerId;
+        PRtcPeerConnection pPeerConnection;
+        std::vector<PRtcRtpTransceiver> audioTransceivers;
+        std::vector<PRtcRtpTransceiver> videoTransceivers;
+        std::vector<FrameFanout::PConsumer> consumers;
+        ReceiveMetrics videoReceiveMetrics;
+        ReceiveMetrics audioReceiveMetrics;
+        // only touched by the event thread
+        NEGOTIATION_STATE negotiationState;
+        // what goes out once gathering is done, and when the offer it answers came in
+        SIGNALING_MESSAGE_TYPE pendingMessageType;
+        UINT64 pendingReceiveTime;
+        std::atomic<BOOL> closed;
+        std::atomic<UINT64> bandwidthEstimate;
+
+        // metrics
+        // set on the event thread when the local description starts gathering, read by the gathering done callback
+        UINT64 iceGatheringStartTime;
+        UINT64 iceHolePunchingStartTime;
+
+        STATUS init();
+    };
+    typedef std::shared_ptr<Connection> PConnection;
+
     struct Callbacks {
         std::function<VOID()> onDisconnected;
-        std::function<STATUS(PPeer)> onNewConnection;
+        std::function<STATUS(Connection&)> onNewConnection;
+        // Lowest bandwidth estimate in bits per second across all connections, since they share the same media
+        std::function<VOID(UINT64)> onBandwidthEstimation;
+    };
+
+    // Setup times in milliseconds, 0 until the step completed
+    struct Stats {
+        UINT64 signalingConnectTime;
+        // createSignalingClientSync and signalingClientConnectSync on their own
+        UINT64 signalingClientCreateTime;
+        UINT64 signalingClientConnectTime;
+        // how long the first connection was held up by the TURN servers
+        UINT64 iceServerWaitTime;
+        // ICE of the latest connection that got connected
+        UINT64 iceConnectTime;
+        // from the construction of the peer until its first connection got connected
+        UINT64 setupTime;
+        // from the construction of the peer until the first frame went out to any connection
+        UINT64 firstFrameTime;
+        UINT64 sentBytes;
+        UINT64 failedConnections;
     };
 
-    Peer(const Canary::PConfig, const Callbacks&);
+    Peer(const Canary::PConfig, const Callbacks&, PFrameFanout, CloudwatchMonitoring*);
     ~Peer();
     STATUS init();
     STATUS shutdown();
     STATUS connect();
-    STATUS addTransceiver(RtcMediaStreamTrack&);
-    STATUS addSupportedCodec(RTC_CODEC);
-    STATUS writeFrame(PFrame, MEDIA_STREAM_TRACK_KIND);
+    // Pushes the receive side frame stats of all connections, aggregated per track kind
+    VOID reportReceiveStats();
+    Stats getStats();
 
   private:
     const Canary::PConfig pConfig;
     const Callbacks callbacks;
-    PAwsCredentialProvider pAwsCredentialProvider;
-    SIGNALING_CLIENT_HANDLE pSignalingClientHandle;
-    std::recursive_mutex mutex;
-    std::condition_variable_any cvar;
+    const PFrameFanout pFanout;
+    CloudwatchMonitoring* const pMonitoring;
+    std::unique_ptr<SignalingTransport> pSignaling;
+    SignalingQueue signalingQueue;
     std::atomic<BOOL> terminated;
-    std::atomic<BOOL> iceGatheringDone;
-    std::atomic<BOOL> receivedOffer;
-    std::atomic<BOOL> receivedAnswer;
-    std::atomic<BOOL> foundPeerId;
-    std::string peerId;
     RtcConfiguration rtcConfiguration;
-    PRtcPeerConnection pPeerConnection;
-    std::vector<PRtcRtpTransceiver> audioTransceivers;
-    std::vector<PRtcRtpTransceiver> videoTransceivers;
+    BOOL iceServersAdded;
+    // connections is guarded by connectionsMutex so that connection callbacks never wait on the signaling lock
+    std::mutex connectionsMutex;
+    std::map<std::string, PConnection> connections;
     STATUS status;
 
+    // Signaling messages and gathering results are handled one at a time on the event thread, in the order they came
+    // in. The signaling callbacks only queue them, so they never wait for gathering or for another connection.
+    struct Event {
+        PEER_EVENT_TYPE type;
+        std::string peerId;
+        std::shared_ptr<SignalingMessage> pMessage;
+        UINT64 receiveTime;
+    };
+    std::mutex eventsMutex;
+    std::condition_variable eventsCvar;
+    std::deque<Event> events;
+    std::thread eventThread;
+    BOOL eventsTerminated;
+
     // metrics
+    UINT64 createTime;
     UINT64 signalingStartTime;
-    UINT64 iceHolePunchingStartTime;
+    UINT64 lastReceiveStatsTime;
+    std::atomic<UINT64> signalingConnectTime;
+    std::atomic<UINT64> signalingClientCreateTime;
+    std::atomic<UINT64> signalingClientConnectTime;
+    std::atomic<UINT64> iceConnectTime;
+    std::atomic<UINT64> setupTime;
+    std::atomic<UINT64> iceServerWaitTime;
+    std::atomic<UINT64> firstFrameTime;
+    std::atomic<UINT64> sentBytes;
+    std::atomic<UINT64> failedConnections;
 
     STATUS initSignaling();
     STATUS initRtcConfiguration();
-    STATUS initPeerConnection();
-    STATUS awaitIceGathering(PRtcSessionDescriptionInit);
-    STATUS handleSignalingMsg(PReceivedSignalingMessage);
-    STATUS send(PSignalingMessage);
+    STATUS addIceServers();
+    STATUS findOrCreateConnection(const std::string&, PConnection&);
+    VOID reapConnections();
+    VOID onConnectionClosed(Connection&, STATUS);
+    VOID onBandwidthEstimation(Connection&, UINT64);
+    VOID postEvent(PEER_EVENT_TYPE, const std::string&, std::shared_ptr<SignalingMessage>);
+    VOID runEvents();
+    VOID stopEvents();
+    STATUS handleEvent(Event&);
+    PConnection findConnection(const std::string&);
+    STATUS startNegotiation(Connection&);
+    STATUS onIceGatheringDone(Connection&);
+    STATUS handleSignalingMsg(Connection&, SignalingMessage&, UINT64);
+    STATUS sendSessionDescription(Connection&, SIGNALING_MESSAGE_TYPE, PRtcSessionDescriptionInit);
+    STATUS send(Connection&, PSignalingMessage);
 };
 
 } // namespace Canary
@@ -0,0 +1,94 @@
+#include "Include.h"
+
+namespace Canary {
+
+ReceiveMetrics::Stats::Stats()
+    : received(0), bytes(0), lost(0), outOfOrder(0), corrupted(0), jitter(0)
+{
+}
+
+VOID ReceiveMetrics::Stats::merge(const Stats& other)
+{
+    this->received += other.received;
+    this->bytes += other.bytes;
+    this->lost += other.lost;
+    this->outOfOrder += other.outOfOrder;
+    this->corrupted += other.corrupted;
+    this->latency.merge(other.latency);
+    this->jitter = MAX(this->jitter, other.jitter);
+}
+
+ReceiveMetrics::ReceiveMetrics(MEDIA_STREAM_TRACK_KIND kind, BOOL stamped)
+    : kind(kind), stamped(stamped), started(FALSE), expectedSequence(0), lastSendTime(0), lastReceiveTime(0), jitter(0), latency(MAX_TRACKED_LATENCY)
+{
+}
+
+MEDIA_STREAM_TRACK_KIND ReceiveMetrics::getKind() const
+{
+    return this->kind;
+}
+
+VOID ReceiveMetrics::onFrame(PFrame pFrame, UINT64 receiveTime)
+{
+    FrameMetadata metadata;
+    UINT32 payloadSize;
+    BOOL intact;
+    INT64 transit;
+
+    if (!this->stamped) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stats.received++;
+        this->stats.bytes += pFrame->size;
+        return;
+    }
+
+    intact = STATUS_SUCCEEDED(parseFrameMetadata(this->kind, pFrame->frameData, pFrame->size, &metadata, &payloadSize));
+    // The depacketizer may rewrite H264 start codes, so the video size can legitimately differ and the CRC covers it
+    intact = intact && (this->kind == MEDIA_STREAM_TRACK_KIND_VIDEO || payloadSize == metadata.size) &&
+        computeFrameCrc(this->kind, pFrame->frameData, payloadSize) == metadata.crc;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.received++;
+    this->stats.bytes += pFrame->size;
+
+    if (!intact) {
+        this->stats.corrupted++;
+        return;
+    }
+
+    if (this->started && metadata.sequence != this->expectedSequence) {
+        // Sequence numbers are unsigned, so a late frame shows up as a huge forward jump
+        if ((INT32) (metadata.sequence - this->expectedSequence) > 0) {
+            this->stats.lost += metadata.sequence - this->expectedSequence;
+        } else {
+            this->stats.outOfOrder++;
+            return;
+        }
+    }
+
+    this->latency.record(receiveTime > metadata.sendTime ? (receiveTime - metadata.sendTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND : 0);
+
+    if (this->started) {
+        transit = (INT64) (receiveTime - this->lastReceiveTime) - (INT64) (metadata.sendTime - this->lastSendTime);
+        this->jitter += (ABS((DOUBLE) transit) - this->jitter) / 16;
+        this->stats.jitter = MAX(this->stats.jitter, this->jitter / HUNDREDS_OF_NANOS_IN_A_MILLISECOND);
+    }
+
+    this->started = TRUE;
+    this->expectedSequence = metadata.sequence + 1;
+    this->lastSendTime = metadata.sendTime;
+    this->lastReceiveTime = receiveTime;
+}
+
+ReceiveMetrics::Stats ReceiveMetrics::takeStats()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Stats stats = this->stats;
+
+    this->stats = Stats();
+    stats.latency = this->latency.takeSnapshot();
+
+    return stats;
+}
+
+} // namespace Canary
@@ -0,0 +1,47 @@
+#pragma once
+
+namespace Canary {
+
+class ReceiveMetrics;
+typedef ReceiveMetrics* PReceiveMetrics;
+
+// ReceiveMetrics follows the frames of a single remote track using the trailer from FrameMetadata.h. Per frame work
+// is limited to updating counters, the aggregated stats are collected periodically with takeStats.
+class ReceiveMetrics {
+  public:
+    struct Stats {
+        UINT64 received;
+        // bytes of every received frame including the metadata, i.e. the achieved goodput
+        UINT64 bytes;
+        UINT64 lost;
+        UINT64 outOfOrder;
+        UINT64 corrupted;
+        // end to end latency in milliseconds, it's clamped to 0 when the clocks of both canaries aren't in sync
+        LatencyHistogram::Snapshot latency;
+        // highest inter-arrival jitter estimate (RFC 3550) in milliseconds
+        DOUBLE jitter;
+
+        Stats();
+        VOID merge(const Stats&);
+    };
+
+    // Frames of a track that isn't stamped are only counted
+    ReceiveMetrics(MEDIA_STREAM_TRACK_KIND, BOOL stamped = TRUE);
+    VOID onFrame(PFrame, UINT64 receiveTime);
+    Stats takeStats();
+    MEDIA_STREAM_TRACK_KIND getKind() const;
+
+  private:
+    const MEDIA_STREAM_TRACK_KIND kind;
+    const BOOL stamped;
+    std::mutex mutex;
+    BOOL started;
+    UINT32 expectedSequence;
+    UINT64 lastSendTime;
+    UINT64 lastReceiveTime;
+    DOUBLE jitter;
+    LatencyHistogram latency;
+    Stats stats;
+};
+
+} // namespace Canary
@@ -0,0 +1,125 @@
+#include "Include.h"
+
+namespace Canary {
+
+SignalingQueue::SignalingQueue(CloudwatchMonitoring* pMonitoring) : pMonitoring(pMonitoring), pSignaling(NULL), terminated(FALSE)
+{
+}
+
+SignalingQueue::~SignalingQueue()
+{
+    this->stop();
+}
+
+STATUS SignalingQueue::start(SignalingTransport* pSignaling, const FailureCallback& onFailure)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pSignaling != NULL, STATUS_NULL_ARG);
+    CHK(!this->senderThread.joinable(), STATUS_INVALID_OPERATION);
+
+    this->pSignaling = pSignaling;
+    this->onFailure = onFailure;
+    this->senderThread = std::thread(&SignalingQueue::runSender, this);
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID SignalingQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->queueMutex);
+        this->terminated = TRUE;
+        this->items.clear();
+        this->remotePeers.clear();
+    }
+    this->queueCvar.notify_all();
+
+    if (this->senderThread.joinable()) {
+        this->senderThread.join();
+    }
+}
+
+STATUS SignalingQueue::push(const SignalingMessage& message)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    Item item{std::make_shared<SignalingMessage>(message), GETTIME()};
+
+    {
+        std::lock_guard<std::mutex> lock(this->queueMutex);
+        CHK(!this->terminated, STATUS_INVALID_OPERATION);
+
+        auto& remotePeer = this->remotePeers[message.peerClientId];
+        CHK_ERR(this->items.size() + remotePeer.held.size() < MAX_QUEUED_SIGNALING_MESSAGES, STATUS_NOT_ENOUGH_MEMORY,
+                "Dropping message type %u to %s, %u messages are queued already", message.messageType, message.peerClientId,
+                MAX_QUEUED_SIGNALING_MESSAGES);
+
+        if (message.messageType == SIGNALING_MESSAGE_TYPE_ICE_CANDIDATE && !remotePeer.described) {
+            remotePeer.held.push_back(std::move(item));
+            CHK(FALSE, retStatus);
+        }
+
+        this->items.push_back(std::move(item));
+        if (message.messageType == SIGNALING_MESSAGE_TYPE_OFFER || message.messageType == SIGNALING_MESSAGE_TYPE_ANSWER) {
+            remotePeer.described = TRUE;
+            this->items.insert(this->items.end(), remotePeer.held.begin(), remotePeer.held.end());
+            remotePeer.held.clear();
+        }
+    }
+    this->queueCvar.notify_all();
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID SignalingQueue::reset(const std::string& peerId)
+{
+    std::lock_guard<std::mutex> lock(this->queueMutex);
+    this->remotePeers.erase(peerId);
+}
+
+VOID SignalingQueue::runSender()
+{
+    std::unique_lock<std::mutex> lock(this->queueMutex);
+    std::deque<Item> batch;
+
+    while (TRUE) {
+        this->queueCvar.wait(lock, [this]() { return this->terminated || !this->items.empty(); });
+        if (this->terminated) {
+            break;
+        }
+
+        // Whatever was queued while the previous batch was being sent goes out now, nothing is held back on purpose
+        batch.swap(this->items);
+        lock.unlock();
+        this->sendBatch(batch);
+        batch.clear();
+        lock.lock();
+    }
+}
+
+VOID SignalingQueue::sendBatch(std::deque<Item>& batch)
+{
+    STATUS status;
+    UINT64 sendTime;
+
+    for (auto& item : batch) {
+        sendTime = GETTIME();
+        this->pMonitoring->recordSignalingQueueWait((sendTime - item.queueTime) / HUNDREDS_OF_NANOS_IN_A_MICROSECOND);
+
+        status = this->pSignaling->send(item.pMessage.get());
+        this->pMonitoring->recordSignalingSendLatency((GETTIME() - sendTime) / HUNDREDS_OF_NANOS_IN_A_MICROSECOND);
+
+        if (STATUS_FAILED(status)) {
+            DLOGW("Failed to send message type %u to %s with 0x%08x", item.pMessage->messageType, item.pMessage->peerClientId, status);
+            if (this->onFailure != NULL) {
+                this->onFailure(*item.pMessage, status);
+            }
+        }
+    }
+}
+
+} // namespace Canary
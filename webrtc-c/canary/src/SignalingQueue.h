@@ -0,0 +1,55 @@
+#pragma once
+
+namespace Canary {
+
+class CloudwatchMonitoring;
+
+// SignalingQueue is what a peer sends its signaling messages through. Messages are sent from a sender thread of the
+// queue, so that neither the ICE gathering thread nor the event thread ever waits for the signaling connection.
+//
+// Candidates to a remote peer are held back until the offer or answer for it has been queued, the other side can't do
+// anything with them before. Every message goes out as soon as the sender thread gets to it, candidates stay one message
+// each since that's what other KVS clients on the channel expect.
+class SignalingQueue {
+  public:
+    // Called from the sender thread with every message that couldn't be sent
+    typedef std::function<VOID(const SignalingMessage&, STATUS)> FailureCallback;
+
+    SignalingQueue(CloudwatchMonitoring*);
+    ~SignalingQueue();
+    STATUS start(SignalingTransport*, const FailureCallback&);
+    // Messages still queued are dropped
+    VOID stop();
+    STATUS push(const SignalingMessage&);
+    // Whatever goes to this remote peer from now on belongs to a new connection
+    VOID reset(const std::string& peerId);
+
+  private:
+    struct Item {
+        std::shared_ptr<SignalingMessage> pMessage;
+        UINT64 queueTime;
+    };
+
+    struct RemotePeer {
+        // whether the offer or answer to the remote peer has been queued
+        BOOL described;
+        std::vector<Item> held;
+    };
+
+    CloudwatchMonitoring* const pMonitoring;
+    SignalingTransport* pSignaling;
+    FailureCallback onFailure;
+
+    // guards the members below
+    std::mutex queueMutex;
+    std::condition_variable queueCvar;
+    std::deque<Item> items;
+    std::map<std::string, RemotePeer> remotePeers;
+    BOOL terminated;
+    std::thread senderThread;
+
+    VOID runSender();
+    VOID sendBatch(std::deque<Item>&);
+};
+
+} // namespace Canary
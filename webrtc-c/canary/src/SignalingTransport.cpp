@@ -0,0 +1,299 @@
+#include "Include.h"
+
+namespace Canary {
+
+STATUS parseSignalingTransportType(const CHAR* pValue, SIGNALING_TRANSPORT_TYPE* pType)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pValue != NULL && pType != NULL, STATUS_NULL_ARG);
+
+    if (STRCMPI(pValue, "kvs") == 0) {
+        *pType = SIGNALING_TRANSPORT_KVS;
+    } else if (STRCMPI(pValue, "local") == 0) {
+        *pType = SIGNALING_TRANSPORT_LOCAL;
+    } else {
+        CHK(FALSE, STATUS_INVALID_ARG);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+const CHAR* getSignalingTransportTypeName(SIGNALING_TRANSPORT_TYPE type)
+{
+    switch (type) {
+        case SIGNALING_TRANSPORT_KVS:
+            return "kvs";
+        case SIGNALING_TRANSPORT_LOCAL:
+            return "local";
+    }
+
+    return "unknown";
+}
+
+static std::string getIceServerCacheKey(const Canary::PConfig pConfig)
+{
+    // TURN credentials are handed out per channel, whoever connects to it as master or viewer can use them
+    return std::string(pConfig->pRegion) + "/" + pConfig->pChannelName;
+}
+
+STATUS createSignalingTransport(const Canary::PConfig pConfig, std::unique_ptr<SignalingTransport>& transport)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK(pConfig != NULL, STATUS_NULL_ARG);
+
+    switch (pConfig->signaling) {
+        case SIGNALING_TRANSPORT_KVS:
+            transport.reset(new KvsSignalingTransport(pConfig));
+            break;
+        case SIGNALING_TRANSPORT_LOCAL:
+            transport.reset(new LocalSignalingTransport(pConfig));
+            break;
+        default:
+            CHK(FALSE, STATUS_INVALID_ARG);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+SignalingTransport::SignalingTransport() : iceServersFuture(iceServersPromise.get_future().share())
+{
+    this->iceServerConfig.cached = FALSE;
+}
+
+STATUS SignalingTransport::getIceServers(UINT64 timeout, IceServerConfig& config)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK_ERR(this->iceServersFuture.wait_for(std::chrono::milliseconds(timeout / HUNDREDS_OF_NANOS_IN_A_MILLISECOND)) == std::future_status::ready,
+            STATUS_OPERATION_TIMED_OUT, "Couldn't retrieve ICE configurations in alotted time.");
+    CHK_STATUS(this->iceServersFuture.get());
+    config = this->iceServerConfig;
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID SignalingTransport::resolveIceServers(STATUS status, const IceServerConfig& config)
+{
+    std::call_once(this->iceServersResolved, [&]() {
+        // The config is written before the future becomes ready and never again after
+        this->iceServerConfig = config;
+        this->iceServersPromise.set_value(status);
+    });
+}
+
+KvsSignalingTransport::KvsSignalingTransport(const Canary::PConfig pConfig)
+    : pConfig(pConfig), pAwsCredentialProvider(nullptr), pSignalingClientHandle(INVALID_SIGNALING_CLIENT_HANDLE_VALUE), stateChanges(0),
+      iceConfigStatus(STATUS_SUCCESS), terminated(FALSE)
+{
+    MEMSET(&this->callbacks, 0x00, SIZEOF(this->callbacks));
+}
+
+KvsSignalingTransport::~KvsSignalingTransport()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->stateMutex);
+        this->terminated = TRUE;
+    }
+    this->stateCvar.notify_all();
+
+    // It might be in the middle of a call into the signaling client
+    if (this->iceServersThread.joinable()) {
+        this->iceServersThread.join();
+    }
+
+    CHK_LOG_ERR(freeSignalingClient(&this->pSignalingClientHandle));
+    CHK_LOG_ERR(freeStaticCredentialProvider(&this->pAwsCredentialProvider));
+}
+
+STATUS KvsSignalingTransport::init(const SignalingClientCallbacks& callbacks)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    SignalingClientInfo clientInfo;
+    ChannelInfo channelInfo;
+    SignalingClientCallbacks clientCallbacks;
+    IceServerConfig config;
+    BOOL collectIceServers = FALSE;
+
+    CHK(!this->iceServersThread.joinable(), STATUS_INVALID_OPERATION);
+
+    // The transport sees the state changes and errors first, everything goes on to the peer's callbacks
+    this->callbacks = callbacks;
+    clientCallbacks = callbacks;
+    clientCallbacks.customData = (UINT64) this;
+    clientCallbacks.stateChangeFn = [](UINT64 customData, SIGNALING_CLIENT_STATE state) -> STATUS {
+        auto pTransport = (KvsSignalingTransport*) customData;
+        auto& callbacks = pTransport->callbacks;
+        pTransport->onStateChange(state);
+        return callbacks.stateChangeFn == NULL ? STATUS_SUCCESS : callbacks.stateChangeFn(callbacks.customData, state);
+    };
+    clientCallbacks.errorReportFn = [](UINT64 customData, STATUS status, PCHAR msg, UINT32 msgLen) -> STATUS {
+        auto pTransport = (KvsSignalingTransport*) customData;
+        auto& callbacks = pTransport->callbacks;
+        pTransport->onError(status);
+        return callbacks.errorReportFn == NULL ? STATUS_SUCCESS : callbacks.errorReportFn(callbacks.customData, status, msg, msgLen);
+    };
+    clientCallbacks.messageReceivedFn = [](UINT64 customData, PReceivedSignalingMessage pMsg) -> STATUS {
+        auto& callbacks = ((KvsSignalingTransport*) customData)->callbacks;
+        return callbacks.messageReceivedFn == NULL ? STATUS_SUCCESS : callbacks.messageReceivedFn(callbacks.customData, pMsg);
+    };
+
+    config.cached = FALSE;
+    if (pConfig->useTurn) {
+        IceServerCache cache(ICE_SERVER_CACHE_FILE_PATH);
+        CHK_LOG_ERR(cache.load(getIceServerCacheKey(pConfig), ICE_SERVER_CACHE_MIN_REMAINING_TTL, config.servers));
+        config.cached = !config.servers.empty();
+        collectIceServers = !config.cached;
+    }
+
+    if (config.cached) {
+        DLOGI("Using %u cached TURN servers for %s", (UINT32) config.servers.size(), pConfig->pChannelName);
+    }
+    if (!collectIceServers) {
+        this->resolveIceServers(STATUS_SUCCESS, config);
+    }
+
+    CHK_STATUS(createStaticCredentialProvider((PCHAR) pConfig->pAccessKey, 0, (PCHAR) pConfig->pSecretKey, 0, (PCHAR) pConfig->pSessionToken, 0,
+                                              MAX_UINT64, &pAwsCredentialProvider));
+
+    MEMSET(&clientInfo, 0, SIZEOF(clientInfo));
+    MEMSET(&channelInfo, 0, SIZEOF(channelInfo));
+
+    clientInfo.version = SIGNALING_CLIENT_INFO_CURRENT_VERSION;
+    clientInfo.loggingLevel = pConfig->logLevel;
+    STRCPY(clientInfo.clientId, pConfig->pClientId);
+
+    channelInfo.version = CHANNEL_INFO_CURRENT_VERSION;
+    channelInfo.pChannelName = (PCHAR) pConfig->pChannelName;
+    channelInfo.pKmsKeyId = NULL;
+    channelInfo.tagCount = 0;
+    channelInfo.pTags = NULL;
+    channelInfo.channelType = SIGNALING_CHANNEL_TYPE_SINGLE_MASTER;
+    channelInfo.channelRoleType = pConfig->isMaster ? SIGNALING_CHANNEL_ROLE_TYPE_MASTER : SIGNALING_CHANNEL_ROLE_TYPE_VIEWER;
+    channelInfo.cachingPolicy = SIGNALING_API_CALL_CACHE_TYPE_FILE;
+    channelInfo.cachingPeriod = SIGNALING_API_CALL_CACHE_TTL_SENTINEL_VALUE;
+    channelInfo.asyncIceServerConfig = TRUE;
+    channelInfo.retry = TRUE;
+    channelInfo.reconnect = TRUE;
+    channelInfo.pCertPath = (PCHAR) DEFAULT_KVS_CACERT_PATH;
+    channelInfo.messageTtl = 0; // Default is 60 seconds
+
+    CHK_STATUS(createSignalingClientSync(&clientInfo, &channelInfo, &clientCallbacks, pAwsCredentialProvider, &pSignalingClientHandle));
+
+    // Needs the client handle, the state changes that happened while creating the client have been counted already
+    if (collectIceServers) {
+        this->iceServersThread = std::thread(&KvsSignalingTransport::runIceServersCollection, this);
+    }
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        this->resolveIceServers(retStatus, config);
+    }
+
+    return retStatus;
+}
+
+STATUS KvsSignalingTransport::connect()
+{
+    return signalingClientConnectSync(this->pSignalingClientHandle);
+}
+
+STATUS KvsSignalingTransport::send(PSignalingMessage pMsg)
+{
+    return signalingClientSendMessageSync(this->pSignalingClientHandle, pMsg);
+}
+
+VOID KvsSignalingTransport::onStateChange(SIGNALING_CLIENT_STATE state)
+{
+    // The client only gets ready once it went through SIGNALING_CLIENT_STATE_GET_ICE_CONFIG
+    if (state != SIGNALING_CLIENT_STATE_READY && state != SIGNALING_CLIENT_STATE_CONNECTING && state != SIGNALING_CLIENT_STATE_CONNECTED) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->stateMutex);
+        this->stateChanges++;
+    }
+    this->stateCvar.notify_all();
+}
+
+VOID KvsSignalingTransport::onError(STATUS status)
+{
+    if (status != STATUS_SIGNALING_ICE_CONFIG_REFRESH_FAILED) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->stateMutex);
+        this->iceConfigStatus = status;
+    }
+    this->stateCvar.notify_all();
+}
+
+VOID KvsSignalingTransport::runIceServersCollection()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    IceServerConfig config;
+    UINT32 handledStateChanges = 0;
+    std::unique_lock<std::mutex> lock(this->stateMutex);
+
+    config.cached = FALSE;
+
+    while (config.servers.empty()) {
+        this->stateCvar.wait(lock, [&]() {
+            return this->terminated || STATUS_FAILED(this->iceConfigStatus) || this->stateChanges != handledStateChanges;
+        });
+        CHK(!this->terminated, STATUS_INVALID_OPERATION);
+        CHK_STATUS(this->iceConfigStatus);
+        handledStateChanges = this->stateChanges;
+
+        lock.unlock();
+        retStatus = this->collectIceServers(config);
+        lock.lock();
+        CHK_STATUS(retStatus);
+    }
+
+    CHK_LOG_ERR(IceServerCache(ICE_SERVER_CACHE_FILE_PATH).store(getIceServerCacheKey(this->pConfig), config.servers));
+
+CleanUp:
+
+    this->resolveIceServers(retStatus, config);
+}
+
+STATUS KvsSignalingTransport::collectIceServers(IceServerConfig& config)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT32 i, j, iceConfigCount;
+    PIceConfigInfo pIceConfigInfo;
+    IceServer server;
+
+    config.servers.clear();
+    CHK_STATUS(signalingClientGetIceConfigInfoCount(this->pSignalingClientHandle, &iceConfigCount));
+
+    /* signalingClientGetIceConfigInfoCount can return more than one turn server. Use only one to optimize
+     * candidate gathering latency. But user can also choose to use more than 1 turn server. */
+    for (i = 0; i < MIN(iceConfigCount, MAX_TURN_SERVERS); i++) {
+        CHK_STATUS(signalingClientGetIceConfigInfo(this->pSignalingClientHandle, i, &pIceConfigInfo));
+        for (j = 0; j < pIceConfigInfo->uriCount; j++) {
+            server.uri = pIceConfigInfo->uris[j];
+            server.userName = pIceConfigInfo->userName;
+            server.credential = pIceConfigInfo->password;
+            server.expiration = GETTIME() + pIceConfigInfo->ttl;
+            config.servers.push_back(server);
+        }
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+} // namespace Canary
@@ -0,0 +1,93 @@
+#pragma once
+
+namespace Canary {
+
+class Config;
+typedef Config* PConfig;
+
+typedef enum {
+    // The KVS signaling service, the channel has to exist or is created on the first connect
+    SIGNALING_TRANSPORT_KVS,
+    // LocalSignalingRelay in this process, masters and viewers meet there without any network or credentials
+    SIGNALING_TRANSPORT_LOCAL,
+} SIGNALING_TRANSPORT_TYPE;
+
+STATUS parseSignalingTransportType(const CHAR* pValue, SIGNALING_TRANSPORT_TYPE* pType);
+const CHAR* getSignalingTransportTypeName(SIGNALING_TRANSPORT_TYPE type);
+
+// One TURN server URI with the credentials that came with it
+struct IceServer {
+    std::string uri;
+    std::string userName;
+    std::string credential;
+    // Epoch time in hundreds of nanos after which the credentials are no good anymore
+    UINT64 expiration;
+};
+
+struct IceServerConfig {
+    std::vector<IceServer> servers;
+    // Whether the servers came from IceServerCache rather than the signaling service
+    BOOL cached;
+};
+
+// SignalingTransport is what Peer exchanges offers, answers and ICE candidates through. Transports report back through
+// the callbacks of the SDK signaling client, so that the peer handles messages and state changes the same way no
+// matter which transport is behind them.
+//
+// The TURN servers of the channel are handed out through a future that the transport resolves once it has them, so
+// that nobody has to poll for them and whoever doesn't need them yet doesn't wait for them.
+class SignalingTransport {
+  public:
+    SignalingTransport();
+    virtual ~SignalingTransport() = default;
+    virtual STATUS init(const SignalingClientCallbacks&) = 0;
+    virtual STATUS connect() = 0;
+    virtual STATUS send(PSignalingMessage) = 0;
+    // Waits up to timeout for the TURN servers of the channel, there are none without the KVS signaling service
+    STATUS getIceServers(UINT64 timeout, IceServerConfig&);
+
+  protected:
+    // Only the first call counts, later ones are ignored
+    VOID resolveIceServers(STATUS, const IceServerConfig&);
+
+  private:
+    std::once_flag iceServersResolved;
+    std::promise<STATUS> iceServersPromise;
+    std::shared_future<STATUS> iceServersFuture;
+    IceServerConfig iceServerConfig;
+};
+
+// KvsSignalingTransport takes the TURN servers from IceServerCache while they're still good for
+// ICE_SERVER_CACHE_MIN_REMAINING_TTL. Otherwise they're collected from the signaling client once its state machine
+// went past SIGNALING_CLIENT_STATE_GET_ICE_CONFIG and put into the cache for the next run.
+class KvsSignalingTransport : public SignalingTransport {
+  public:
+    KvsSignalingTransport(const Canary::PConfig);
+    ~KvsSignalingTransport();
+    STATUS init(const SignalingClientCallbacks&) override;
+    STATUS connect() override;
+    STATUS send(PSignalingMessage) override;
+
+  private:
+    const Canary::PConfig pConfig;
+    PAwsCredentialProvider pAwsCredentialProvider;
+    SIGNALING_CLIENT_HANDLE pSignalingClientHandle;
+    SignalingClientCallbacks callbacks;
+
+    // The SDK isn't called back from within its own callbacks, a state change only wakes up iceServersThread
+    std::mutex stateMutex;
+    std::condition_variable stateCvar;
+    UINT32 stateChanges;
+    STATUS iceConfigStatus;
+    BOOL terminated;
+    std::thread iceServersThread;
+
+    VOID onStateChange(SIGNALING_CLIENT_STATE);
+    VOID onError(STATUS);
+    VOID runIceServersCollection();
+    STATUS collectIceServers(IceServerConfig&);
+};
+
+STATUS createSignalingTransport(const Canary::PConfig, std::unique_ptr<SignalingTransport>&);
+
+} // namespace Canary
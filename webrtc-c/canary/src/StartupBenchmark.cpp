@@ -0,0 +1,175 @@
+#include "Include.h"
+
+namespace Canary {
+
+const CHAR* getStartupPhaseName(STARTUP_PHASE phase)
+{
+    switch (phase) {
+        case STARTUP_PHASE_AWS_INIT:
+            return "AwsInit";
+        case STARTUP_PHASE_CLOUDWATCH_INIT:
+            return "CloudwatchInit";
+        case STARTUP_PHASE_KVS_WEBRTC_INIT:
+            return "KvsWebRtcInit";
+        case STARTUP_PHASE_SIGNALING_CLIENT_CREATE:
+            return "SignalingClientCreate";
+        case STARTUP_PHASE_SIGNALING_CLIENT_CONNECT:
+            return "SignalingClientConnect";
+        case STARTUP_PHASE_ICE_SERVERS:
+            return "IceServers";
+        case STARTUP_PHASE_FIRST_CONNECTED:
+            return "FirstConnected";
+        case STARTUP_PHASE_FIRST_FRAME:
+            return "FirstFrame";
+        default:
+            break;
+    }
+
+    return "Unknown";
+}
+
+static VOID wipeStartupCaches()
+{
+    const CHAR* paths[] = {SIGNALING_CACHE_FILE_PATH, ICE_SERVER_CACHE_FILE_PATH};
+
+    for (auto pPath : paths) {
+        if (remove(pPath) != 0 && errno != ENOENT) {
+            DLOGW("Failed to wipe %s with errno %d", pPath, errno);
+        }
+    }
+}
+
+StartupBenchmark::StartupBenchmark(const Canary::PConfig pConfig, PFrameFanout pFanout, CloudwatchMonitoring* pMonitoring,
+                                   const Peer::Callbacks& callbacks, const StartupPhases& processPhases)
+    : pConfig(pConfig), pFanout(pFanout), pMonitoring(pMonitoring), callbacks(callbacks), processPhases(processPhases)
+{
+    UINT32 i;
+
+    for (i = 0; i < STARTUP_PHASE_COUNT; i++) {
+        this->coldPhases[i].reset(new LatencyHistogram(MAX_TRACKED_LATENCY));
+        this->warmPhases[i].reset(new LatencyHistogram(MAX_TRACKED_LATENCY));
+    }
+}
+
+STATUS StartupBenchmark::run(const std::atomic<bool>& terminated)
+{
+    STATUS retStatus = STATUS_SUCCESS, status, firstFailure = STATUS_SUCCESS;
+    StartupPhases phases;
+    UINT32 i, failed = 0;
+    BOOL cold;
+
+    for (i = 0; i < this->pConfig->startupRuns && !terminated.load(); i++) {
+        status = this->runOnce(i, terminated, phases, cold);
+        if (STATUS_FAILED(status)) {
+            DLOGW("Startup run %u failed with 0x%08x", i, status);
+            firstFailure = STATUS_FAILED(firstFailure) ? firstFailure : status;
+            failed++;
+            continue;
+        }
+
+        this->record(i, phases, cold);
+    }
+
+    this->report();
+
+    // Like with the load generator, a run that failed is a result too as long as some of them worked
+    CHK(failed == 0 || failed < i, firstFailure);
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS StartupBenchmark::runOnce(UINT32 index, const std::atomic<bool>& terminated, StartupPhases& phases, BOOL& cold)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    UINT64 startTime, deadline;
+    Peer::Stats stats;
+    BOOL cached = FALSE;
+    auto policy = this->pConfig->startupCaches;
+
+    MEMSET(&phases, 0x00, SIZEOF(phases));
+    MEMSET(&stats, 0x00, SIZEOF(stats));
+
+    if (policy == STARTUP_CACHES_WIPE || (policy == STARTUP_CACHES_ALTERNATE && index % 2 == 0)) {
+        wipeStartupCaches();
+    }
+    // Whatever the policy, the start is only warm when the signaling client finds the lookups of an earlier run
+    CHK_STATUS(fileExists((PCHAR) SIGNALING_CACHE_FILE_PATH, &cached));
+    cold = !cached;
+
+    if (index == 0) {
+        // The process has just been set up for the first run
+        phases = this->processPhases;
+    } else {
+        deinitKvsWebRtc();
+        startTime = GETTIME();
+        CHK_STATUS(initKvsWebRtc());
+        phases.durations[STARTUP_PHASE_KVS_WEBRTC_INIT] = MAX((GETTIME() - startTime) / HUNDREDS_OF_NANOS_IN_A_MILLISECOND, 1);
+        Tracer::getInstance().complete("startup", "initKvsWebRtc", startTime);
+    }
+
+    {
+        // Tearing the session down is part of every run, the next one starts from a process without any peer
+        LoadGenerator generator(this->pConfig, this->pFanout, this->pMonitoring, this->callbacks);
+        CHK_STATUS(generator.start());
+
+        deadline = GETTIME() + STARTUP_RUN_TIMEOUT;
+        while (!terminated.load() && !generator.isDone() && GETTIME() < deadline) {
+            if (generator.getSessionStats(0, stats) && stats.firstFrameTime != 0) {
+                break;
+            }
+            THREAD_SLEEP(TERMINATION_POLL_PERIOD);
+        }
+        generator.getSessionStats(0, stats);
+        CHK_STATUS(generator.stop());
+    }
+
+    CHK_ERR(stats.firstFrameTime != 0, STATUS_OPERATION_TIMED_OUT, "Startup run %u didn't get its first frame out", index);
+
+    phases.durations[STARTUP_PHASE_SIGNALING_CLIENT_CREATE] = stats.signalingClientCreateTime;
+    phases.durations[STARTUP_PHASE_SIGNALING_CLIENT_CONNECT] = stats.signalingClientConnectTime;
+    phases.durations[STARTUP_PHASE_ICE_SERVERS] = stats.iceServerWaitTime;
+    phases.durations[STARTUP_PHASE_FIRST_CONNECTED] = stats.setupTime;
+    phases.durations[STARTUP_PHASE_FIRST_FRAME] = stats.firstFrameTime;
+
+CleanUp:
+
+    return retStatus;
+}
+
+VOID StartupBenchmark::record(UINT32 index, const StartupPhases& phases, BOOL cold)
+{
+    std::string breakdown;
+    UINT32 i;
+
+    for (i = 0; i < STARTUP_PHASE_COUNT; i++) {
+        if (phases.durations[i] == 0) {
+            continue;
+        }
+
+        (cold ? this->coldPhases[i] : this->warmPhases[i])->record(phases.durations[i]);
+        this->pMonitoring->pushStartupPhase(getStartupPhaseName((STARTUP_PHASE) i), cold, phases.durations[i]);
+        breakdown += std::string(breakdown.empty() ? "" : ", ") + getStartupPhaseName((STARTUP_PHASE) i) + " " +
+            std::to_string(phases.durations[i]) + " ms";
+    }
+
+    DLOGI("Startup run %u, %s: %s", index, cold ? "cold" : "warm", breakdown.c_str());
+}
+
+VOID StartupBenchmark::report()
+{
+    LatencyHistogram::Snapshot snapshot;
+    UINT32 i;
+
+    for (auto cold : {TRUE, FALSE}) {
+        for (i = 0; i < STARTUP_PHASE_COUNT; i++) {
+            snapshot = (cold ? this->coldPhases[i] : this->warmPhases[i])->takeSnapshot();
+            if (snapshot.getCount() != 0) {
+                DLOGI("%s start %s in ms: %s", cold ? "Cold" : "Warm", getStartupPhaseName((STARTUP_PHASE) i), snapshot.toString().c_str());
+            }
+        }
+    }
+}
+
+} // namespace Canary
@@ -0,0 +1,58 @@
+#pragma once
+
+namespace Canary {
+
+typedef enum {
+    // Process wide, set up once per process
+    STARTUP_PHASE_AWS_INIT,
+    STARTUP_PHASE_CLOUDWATCH_INIT,
+    STARTUP_PHASE_KVS_WEBRTC_INIT,
+    // Per session
+    STARTUP_PHASE_SIGNALING_CLIENT_CREATE,
+    STARTUP_PHASE_SIGNALING_CLIENT_CONNECT,
+    STARTUP_PHASE_ICE_SERVERS,
+    STARTUP_PHASE_FIRST_CONNECTED,
+    STARTUP_PHASE_FIRST_FRAME,
+    STARTUP_PHASE_COUNT,
+} STARTUP_PHASE;
+
+const CHAR* getStartupPhaseName(STARTUP_PHASE);
+
+// Durations in milliseconds, 0 for the phases that haven't been measured. The calls of the SDKs are measured on their
+// own, the first connected state and the first frame from the construction of the peer, the same as Peer::Stats.
+struct StartupPhases {
+    UINT64 durations[STARTUP_PHASE_COUNT];
+};
+
+// StartupBenchmark runs Config::startupRuns cycles of setting up a single session, waiting for its first frame to go
+// out and tearing it down again, instead of keeping the session up for the duration. Config::startupCaches decides
+// whether the signaling and TURN server caches are wiped before a run. A run counts as cold when the signaling cache
+// wasn't there when it started and as warm otherwise.
+//
+// Aws::InitAPI and Cloudwatch::init can't be repeated within a process, so only the first run has them and their cold
+// and warm distributions build up over restarts of the canary. initKvsWebRtc is repeated for every run.
+//
+// Every run pushes its phases as StartupPhaseDuration with Phase and Start dimensions, the cold and warm distributions
+// of the whole benchmark are logged at the end.
+class StartupBenchmark {
+  public:
+    StartupBenchmark(const Canary::PConfig, PFrameFanout, CloudwatchMonitoring*, const Peer::Callbacks&, const StartupPhases& processPhases);
+    // Fails only when none of the runs got its first frame out
+    STATUS run(const std::atomic<bool>& terminated);
+
+  private:
+    const Canary::PConfig pConfig;
+    const PFrameFanout pFanout;
+    CloudwatchMonitoring* const pMonitoring;
+    const Peer::Callbacks callbacks;
+    const StartupPhases processPhases;
+
+    std::unique_ptr<LatencyHistogram> coldPhases[STARTUP_PHASE_COUNT];
+    std::unique_ptr<LatencyHistogram> warmPhases[STARTUP_PHASE_COUNT];
+
+    STATUS runOnce(UINT32 index, const std::atomic<bool>& terminated, StartupPhases&, BOOL& cold);
+    VOID record(UINT32 index, const StartupPhases&, BOOL cold);
+    VOID report();
+};
+
+} // namespace Canary
@@ -0,0 +1,203 @@
+#include "Include.h"
+
+namespace Canary {
+
+static VOID copyDetail(PCHAR pDst, const CHAR* pSrc)
+{
+    if (pSrc == NULL) {
+        pDst[0] = '\0';
+        return;
+    }
+
+    STRNCPY(pDst, pSrc, TRACE_DETAIL_LENGTH);
+    pDst[TRACE_DETAIL_LENGTH] = '\0';
+}
+
+static VOID appendEscaped(std::string& out, const CHAR* pStr)
+{
+    CHAR escaped[8];
+
+    for (; *pStr != '\0'; pStr++) {
+        if (*pStr == '"' || *pStr == '\\') {
+            out += '\\';
+            out += *pStr;
+        } else if ((UINT8) *pStr < 0x20) {
+            SNPRINTF(escaped, SIZEOF(escaped), "\\u%04x", (UINT32) (UINT8) *pStr);
+            out += escaped;
+        } else {
+            out += *pStr;
+        }
+    }
+}
+
+Tracer& Tracer::getInstance()
+{
+    static Tracer instance;
+    return instance;
+}
+
+Tracer::Tracer() : startTime(GETTIME()), enabled(TRUE)
+{
+}
+
+VOID Tracer::configure(const CHAR* pPath)
+{
+    this->path = pPath == NULL ? "" : pPath;
+    // What has been recorded so far stays with the buffers, they may still be in use by other threads
+    this->enabled = !this->path.empty();
+}
+
+BOOL Tracer::isEnabled()
+{
+    return this->enabled.load(std::memory_order_relaxed);
+}
+
+VOID Tracer::complete(const CHAR* category, const CHAR* name, UINT64 startTime, const CHAR* detail)
+{
+    UINT64 now;
+
+    if (!this->isEnabled()) {
+        return;
+    }
+
+    now = GETTIME();
+    startTime = MIN(startTime, now);
+    this->record('X', category, name, startTime, now - startTime, detail);
+}
+
+VOID Tracer::instant(const CHAR* category, const CHAR* name, const CHAR* detail)
+{
+    if (!this->isEnabled()) {
+        return;
+    }
+
+    this->record('i', category, name, GETTIME(), 0, detail);
+}
+
+Tracer::ThreadBuffer* Tracer::getThreadBuffer()
+{
+    // The tracer owns the buffers, so that the events of threads that are gone can still be written
+    thread_local ThreadBuffer* pBuffer = NULL;
+
+    if (pBuffer == NULL) {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+        buffer->threadId = (UINT64) GETTID();
+        buffer->count = 0;
+        buffer->dropped = 0;
+        pBuffer = buffer.get();
+
+        std::lock_guard<std::mutex> lock(this->buffersMutex);
+        this->buffers.push_back(std::move(buffer));
+    }
+
+    return pBuffer;
+}
+
+VOID Tracer::record(CHAR phase, const CHAR* category, const CHAR* name, UINT64 timestamp, UINT64 duration, const CHAR* detail)
+{
+    auto pBuffer = this->getThreadBuffer();
+    UINT32 index = pBuffer->count.load(std::memory_order_relaxed);
+    Event* pEvent;
+
+    if (index >= TRACE_BUFFER_CAPACITY) {
+        // Only this thread writes its counters, there's no need for a read-modify-write
+        pBuffer->dropped.store(pBuffer->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto& chunk = pBuffer->chunks[index / TRACE_BUFFER_CHUNK_SIZE];
+    if (chunk == nullptr) {
+        chunk.reset(new Event[TRACE_BUFFER_CHUNK_SIZE]);
+    }
+
+    pEvent = &chunk[index % TRACE_BUFFER_CHUNK_SIZE];
+    pEvent->category = category;
+    pEvent->name = name;
+    pEvent->phase = phase;
+    pEvent->timestamp = timestamp;
+    pEvent->duration = duration;
+    copyDetail(pEvent->detail, detail);
+
+    // Publishes the event and its chunk to write
+    pBuffer->count.store(index + 1, std::memory_order_release);
+}
+
+STATUS Tracer::write()
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string content;
+    CHAR line[256];
+    UINT64 dropped = 0, written = 0;
+    UINT32 count, i;
+    Event* pEvent;
+
+    CHK(!this->path.empty(), retStatus);
+
+    // Timestamps and durations are in microseconds
+    content = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"canary\"}}";
+
+    {
+        std::lock_guard<std::mutex> lock(this->buffersMutex);
+        for (auto& buffer : this->buffers) {
+            count = buffer->count.load(std::memory_order_acquire);
+            dropped += buffer->dropped.load(std::memory_order_relaxed);
+
+            for (i = 0; i < count; i++) {
+                pEvent = &buffer->chunks[i / TRACE_BUFFER_CHUNK_SIZE][i % TRACE_BUFFER_CHUNK_SIZE];
+                SNPRINTF(line, SIZEOF(line), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%" PRIu64 ",\"ts\":%.1f",
+                         pEvent->name, pEvent->category, pEvent->phase, buffer->threadId,
+                         (DOUBLE) (pEvent->timestamp > this->startTime ? pEvent->timestamp - this->startTime : 0) / 10);
+                content += line;
+
+                if (pEvent->phase == 'X') {
+                    SNPRINTF(line, SIZEOF(line), ",\"dur\":%.1f", (DOUBLE) pEvent->duration / 10);
+                    content += line;
+                } else {
+                    // An instant event of a thread, not of the whole process
+                    content += ",\"s\":\"t\"";
+                }
+
+                if (pEvent->detail[0] != '\0') {
+                    content += ",\"args\":{\"detail\":\"";
+                    appendEscaped(content, pEvent->detail);
+                    content += "\"}";
+                }
+                content += "}";
+                written++;
+            }
+        }
+    }
+
+    content += "\n]}\n";
+
+    CHK_STATUS(writeFile((PCHAR) this->path.c_str(), FALSE, FALSE, (PBYTE) content.c_str(), content.size()));
+    DLOGI("Wrote %" PRIu64 " trace events to %s", written, this->path.c_str());
+    if (dropped != 0) {
+        DLOGW("%" PRIu64 " trace events didn't fit into the buffers of their threads", dropped);
+    }
+
+CleanUp:
+
+    return retStatus;
+}
+
+TraceSpan::TraceSpan(const CHAR* category, const CHAR* name, const CHAR* detail) : category(category), name(name), startTime(0)
+{
+    if (!Tracer::getInstance().isEnabled()) {
+        return;
+    }
+
+    copyDetail(this->detail, detail);
+    this->startTime = GETTIME();
+}
+
+TraceSpan::~TraceSpan()
+{
+    // Recording might have been turned off in between, complete checks again
+    if (this->startTime != 0) {
+        Tracer::getInstance().complete(this->category, this->name, this->startTime, this->detail);
+    }
+}
+
+} // namespace Canary
@@ -0,0 +1,82 @@
+#pragma once
+
+namespace Canary {
+
+// Tracer records spans and instant events of the canary's timeline, e.g. how the setup of a session went from the
+// signaling client to the first frame, and writes them as a Chrome trace that chrome://tracing and Perfetto open.
+//
+// Every thread records into a buffer of its own, so recording takes neither a lock nor an atomic read-modify-write,
+// only publishing an event takes a release store. A buffer keeps the first TRACE_BUFFER_CAPACITY events of its
+// thread, which is what covers the startup, later ones are only counted. Names and categories have to be string
+// literals, anything else goes into the detail, which is copied.
+//
+// Recording is on from the start of the process, so that the setup before the config has been read is covered too.
+// configure turns it off when the config doesn't ask for a trace.
+class Tracer {
+  public:
+    static Tracer& getInstance();
+    // Where write puts the trace, NULL or empty turns recording off
+    VOID configure(const CHAR* pPath);
+    BOOL isEnabled();
+    // A span of the current thread that started at startTime and ends now, e.g. one that started on another thread
+    VOID complete(const CHAR* category, const CHAR* name, UINT64 startTime, const CHAR* detail = NULL);
+    VOID instant(const CHAR* category, const CHAR* name, const CHAR* detail = NULL);
+    // Writes everything recorded so far, does nothing without a path
+    STATUS write();
+
+  private:
+    struct Event {
+        const CHAR* category;
+        const CHAR* name;
+        // 'X' for a span, 'i' for an instant event
+        CHAR phase;
+        UINT64 timestamp;
+        UINT64 duration;
+        CHAR detail[TRACE_DETAIL_LENGTH + 1];
+    };
+
+    // Only the owning thread writes chunks and count, write reads the events below count. Chunks are allocated as the
+    // thread records, most threads only ever record a handful of events.
+    struct ThreadBuffer {
+        UINT64 threadId;
+        std::unique_ptr<Event[]> chunks[TRACE_BUFFER_CAPACITY / TRACE_BUFFER_CHUNK_SIZE];
+        std::atomic<UINT32> count;
+        std::atomic<UINT64> dropped;
+    };
+
+    Tracer();
+    Tracer(Tracer const&) = delete;
+    void operator=(Tracer const&) = delete;
+
+    const UINT64 startTime;
+    std::atomic<BOOL> enabled;
+    std::string path;
+    // guards buffers, threads only take it for registering their buffer
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    ThreadBuffer* getThreadBuffer();
+    VOID record(CHAR phase, const CHAR* category, const CHAR* name, UINT64 timestamp, UINT64 duration, const CHAR* detail);
+};
+
+// TraceSpan records a span from its construction until it goes out of scope
+class TraceSpan {
+  public:
+    TraceSpan(const CHAR* category, const CHAR* name, const CHAR* detail = NULL);
+    ~TraceSpan();
+
+  private:
+    const CHAR* category;
+    const CHAR* name;
+    UINT64 startTime;
+    CHAR detail[TRACE_DETAIL_LENGTH + 1];
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b)      TRACE_CONCAT_IMPL(a, b)
+// Spans until the end of the enclosing block. Declaring it after a CHK of the same block would make the CHK jump over
+// it, so put it first or wrap the traced calls in a block of their own.
+#define TRACE_SPAN(category, ...) Canary::TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(category, __VA_ARGS__)
+#define TRACE_INSTANT(category, ...) Canary::Tracer::getInstance().instant(category, __VA_ARGS__)
+
+} // namespace Canary
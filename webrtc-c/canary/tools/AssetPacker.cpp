@@ -0,0 +1,224 @@
+/**
+ * Packs the canary media samples into a single file, see src/AssetPack.h for the layout.
+ *
+ * Usage: kvsWebrtcCanaryAssetPacker <output> <kind>:<codec>:<frame duration ms>:<bitrate kbps>:<directory> ...
+ *
+ * kind is either "video" or "audio", codec is either "h264" or "opus". Every file with the codec extension in the
+ * directory becomes a frame of the track, in file name order.
+ */
+#include <dirent.h>
+#include <algorithm>
+#include <com/amazonaws/kinesis/video/webrtcclient/Include.h>
+#include "../src/AssetPack.h"
+
+struct TrackSpec {
+    AssetPackTrack track;
+    UINT64 frameDuration;
+    std::string directory;
+    std::vector<std::string> files;
+};
+
+STATUS parseTrackSpec(PCHAR pSpec, TrackSpec& spec)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::string value(pSpec);
+    std::vector<std::string> parts;
+    SIZE_T start = 0, end;
+    UINT32 frameDurationMs;
+
+    // The directory is the last part and is allowed to contain ':'
+    while (parts.size() < 4 && (end = value.find(':', start)) != std::string::npos) {
+        parts.push_back(value.substr(start, end - start));
+        start = end + 1;
+    }
+    parts.push_back(value.substr(start));
+    CHK_ERR(parts.size() == 5, STATUS_INVALID_ARG, "Invalid track spec %s", pSpec);
+
+    MEMSET(&spec.track, 0x00, SIZEOF(AssetPackTrack));
+    if (parts[0] == "video") {
+        spec.track.kind = ASSET_PACK_TRACK_KIND_VIDEO;
+    } else if (parts[0] == "audio") {
+        spec.track.kind = ASSET_PACK_TRACK_KIND_AUDIO;
+    } else {
+        CHK_ERR(FALSE, STATUS_INVALID_ARG, "Unknown track kind %s", parts[0].c_str());
+    }
+
+    if (parts[1] == "h264") {
+        spec.track.codec = ASSET_PACK_CODEC_H264;
+    } else if (parts[1] == "opus") {
+        spec.track.codec = ASSET_PACK_CODEC_OPUS;
+    } else {
+        CHK_ERR(FALSE, STATUS_INVALID_ARG, "Unknown codec %s", parts[1].c_str());
+    }
+
+    CHK_STATUS(STRTOUI32((PCHAR) parts[2].c_str(), NULL, 10, &frameDurationMs));
+    CHK_ERR(frameDurationMs > 0, STATUS_INVALID_ARG, "Frame duration must be positive");
+    spec.frameDuration = frameDurationMs * HUNDREDS_OF_NANOS_IN_A_MILLISECOND;
+    CHK_STATUS(STRTOUI32((PCHAR) parts[3].c_str(), NULL, 10, &spec.track.bitrate));
+    spec.directory = parts[4];
+
+CleanUp:
+
+    return retStatus;
+}
+
+STATUS listTrackFiles(TrackSpec& spec)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    DIR* pDir = NULL;
+    struct dirent* pEntry;
+    std::string extension = spec.track.codec == ASSET_PACK_CODEC_H264 ? ".h264" : ".opus";
+    std::string name;
+
+    CHK_ERR((pDir = opendir(spec.directory.c_str())) != NULL, STATUS_OPEN_FILE_FAILED, "Failed to open %s", spec.directory.c_str());
+
+    while ((pEntry = readdir(pDir)) != NULL) {
+        name = pEntry->d_name;
+        if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+            spec.files.push_back(spec.directory + "/" + name);
+        }
+    }
+
+    // Sample files are zero padded, so name order is the presentation order
+    std::sort(spec.files.begin(), spec.files.end());
+    CHK_ERR(!spec.files.empty(), STATUS_INVALID_ARG, "No %s files found in %s", extension.c_str(), spec.directory.c_str());
+
+CleanUp:
+
+    if (pDir != NULL) {
+        closedir(pDir);
+    }
+
+    return retStatus;
+}
+
+BOOL isKeyFrame(const AssetPackTrack& track, PBYTE pData, UINT32 size)
+{
+    UINT32 i;
+    BYTE nalType;
+
+    if (track.codec != ASSET_PACK_CODEC_H264) {
+        return TRUE;
+    }
+
+    // Look for an IDR slice or a sequence parameter set after any Annex-B start code
+    for (i = 0; i + 3 < size; i++) {
+        if (pData[i] == 0x00 && pData[i + 1] == 0x00 && pData[i + 2] == 0x01) {
+            nalType = pData[i + 3] & 0x1F;
+            if (nalType == 5 || nalType == 7) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+STATUS writePack(PCHAR pOutputPath, std::vector<TrackSpec>& specs)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    FILE* pFile = NULL;
+    AssetPackHeader header;
+    std::vector<AssetPackFrame> frames;
+    std::vector<BYTE> payload;
+    BYTE padding[ASSET_PACK_PAYLOAD_ALIGNMENT];
+    UINT64 offset, fileSize;
+    UINT32 i, j;
+
+    MEMSET(&header, 0x00, SIZEOF(AssetPackHeader));
+    MEMSET(padding, 0x00, SIZEOF(padding));
+    MEMCPY(header.magic, ASSET_PACK_MAGIC, SIZEOF(header.magic));
+    header.version = ASSET_PACK_CURRENT_VERSION;
+    header.trackCount = (UINT32) specs.size();
+    for (auto& spec : specs) {
+        spec.track.firstFrame = header.frameCount;
+        spec.track.frameCount = (UINT32) spec.files.size();
+        header.frameCount += spec.track.frameCount;
+    }
+    header.payloadOffset =
+        ROUND_UP(SIZEOF(AssetPackHeader) + header.trackCount * SIZEOF(AssetPackTrack) + header.frameCount * SIZEOF(AssetPackFrame),
+                 ASSET_PACK_PAYLOAD_ALIGNMENT);
+
+    // Build the index first so that every payload offset is known before anything gets written
+    frames.resize(header.frameCount);
+    offset = header.payloadOffset;
+    for (i = 0; i < specs.size(); i++) {
+        for (j = 0; j < specs[i].files.size(); j++) {
+            auto& frame = frames[specs[i].track.firstFrame + j];
+            CHK_STATUS(readFile((PCHAR) specs[i].files[j].c_str(), TRUE, NULL, &fileSize));
+            CHK_ERR(fileSize > 0 && fileSize <= MAX_UINT32, STATUS_INVALID_ARG, "Invalid frame size for %s", specs[i].files[j].c_str());
+            MEMSET(&frame, 0x00, SIZEOF(AssetPackFrame));
+            frame.offset = offset;
+            frame.duration = specs[i].frameDuration;
+            frame.size = (UINT32) fileSize;
+            frame.track = i;
+            offset = ROUND_UP(offset + fileSize, ASSET_PACK_PAYLOAD_ALIGNMENT);
+        }
+    }
+
+    CHK_ERR((pFile = FOPEN(pOutputPath, "wb")) != NULL, STATUS_OPEN_FILE_FAILED, "Failed to open %s", pOutputPath);
+    CHK(FWRITE(&header, SIZEOF(AssetPackHeader), 1, pFile) == 1, STATUS_WRITE_TO_FILE_FAILED);
+    for (auto& spec : specs) {
+        CHK(FWRITE(&spec.track, SIZEOF(AssetPackTrack), 1, pFile) == 1, STATUS_WRITE_TO_FILE_FAILED);
+    }
+    // Payloads go after the index, key frame flags are patched in once the payloads have been read
+    CHK(FSEEK(pFile, (long) header.payloadOffset, SEEK_SET) == 0, STATUS_WRITE_TO_FILE_FAILED);
+
+    for (i = 0; i < specs.size(); i++) {
+        for (j = 0; j < specs[i].files.size(); j++) {
+            auto& frame = frames[specs[i].track.firstFrame + j];
+            fileSize = frame.size;
+            payload.resize(fileSize);
+            CHK_STATUS(readFile((PCHAR) specs[i].files[j].c_str(), TRUE, payload.data(), &fileSize));
+            CHK_ERR(fileSize == frame.size, STATUS_READ_FILE_FAILED, "%s changed size while packing", specs[i].files[j].c_str());
+            if (isKeyFrame(specs[i].track, payload.data(), frame.size)) {
+                frame.flags |= ASSET_PACK_FRAME_FLAG_KEY_FRAME;
+            }
+
+            CHK(FWRITE(payload.data(), 1, frame.size, pFile) == frame.size, STATUS_WRITE_TO_FILE_FAILED);
+            fileSize = ROUND_UP(frame.size, ASSET_PACK_PAYLOAD_ALIGNMENT) - frame.size;
+            CHK(FWRITE(padding, 1, (SIZE_T) fileSize, pFile) == fileSize, STATUS_WRITE_TO_FILE_FAILED);
+        }
+    }
+
+    CHK(FSEEK(pFile, (long) (SIZEOF(AssetPackHeader) + header.trackCount * SIZEOF(AssetPackTrack)), SEEK_SET) == 0, STATUS_WRITE_TO_FILE_FAILED);
+    CHK(FWRITE(frames.data(), SIZEOF(AssetPackFrame), frames.size(), pFile) == frames.size(), STATUS_WRITE_TO_FILE_FAILED);
+
+    printf("Packed %u tracks and %u frames into %s (%" PRIu64 " bytes)\n", header.trackCount, header.frameCount, pOutputPath, offset);
+
+CleanUp:
+
+    if (pFile != NULL) {
+        FCLOSE(pFile);
+    }
+
+    return retStatus;
+}
+
+INT32 main(INT32 argc, CHAR* argv[])
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    std::vector<TrackSpec> specs;
+    INT32 i;
+
+    if (argc < 3) {
+        printf("Usage: %s <output> <kind>:<codec>:<frame duration ms>:<bitrate kbps>:<directory> ...\n", argv[0]);
+        CHK(FALSE, STATUS_INVALID_ARG);
+    }
+
+    specs.resize(argc - 2);
+    for (i = 2; i < argc; i++) {
+        CHK_STATUS(parseTrackSpec(argv[i], specs[i - 2]));
+        CHK_STATUS(listTrackFiles(specs[i - 2]));
+    }
+
+    CHK_STATUS(writePack(argv[1], specs));
+
+CleanUp:
+
+    if (STATUS_FAILED(retStatus)) {
+        printf("Failed to pack assets with 0x%08x\n", retStatus);
+    }
+
+    return STATUS_FAILED(retStatus) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
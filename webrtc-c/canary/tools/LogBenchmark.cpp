@@ -0,0 +1,108 @@
+/**
+ * Measures the cost of a log call on the calling thread, with verbose logging enabled.
+ *
+ * Usage: kvsWebrtcCanaryLogBenchmark [iterations]
+ *
+ * "immediate" is what a log call used to cost: addLogMetadata, one vsnprintf for CloudWatch and one for stdout (written
+ * to /dev/null here). "deferred" only captures the arguments with encodeLogRecord, "render" is the cost that moves to
+ * the log flush thread.
+ */
+#include <chrono>
+#include <functional>
+#include <com/amazonaws/kinesis/video/webrtcclient/Include.h>
+#include "LogRecord.h"
+
+#define DEFAULT_BENCHMARK_ITERATIONS 1000000
+#define BENCHMARK_RECORD_SIZE        512
+
+typedef VOID (*BenchmarkLogFunc)(PVOID, UINT32, PCHAR, ...);
+
+struct BenchmarkState {
+    FILE* pDevNull;
+    BYTE record[BENCHMARK_RECORD_SIZE];
+    UINT32 recordSize;
+};
+
+static VOID immediateLog(PVOID pState, UINT32 level, PCHAR fmt, ...)
+{
+    CHAR logFmtString[MAX_LOG_FORMAT_LENGTH + 1];
+    CHAR cwLogFmtString[MAX_LOG_FORMAT_LENGTH + 1];
+    va_list valist, valist_cw;
+
+    addLogMetadata(logFmtString, (UINT32) ARRAY_SIZE(logFmtString), fmt, level);
+    va_start(valist_cw, fmt);
+    vsnprintf(cwLogFmtString, (SIZE_T) SIZEOF(cwLogFmtString), logFmtString, valist_cw);
+    va_end(valist_cw);
+    va_start(valist, fmt);
+    vfprintf(((BenchmarkState*) pState)->pDevNull, logFmtString, valist);
+    va_end(valist);
+}
+
+static VOID deferredLog(PVOID pState, UINT32 level, PCHAR fmt, ...)
+{
+    auto pBenchmarkState = (BenchmarkState*) pState;
+    va_list valist;
+
+    va_start(valist, fmt);
+    pBenchmarkState->recordSize = Canary::encodeLogRecord(pBenchmarkState->record, SIZEOF(pBenchmarkState->record), level, fmt, valist);
+    va_end(valist);
+}
+
+// A mix of the per packet and per frame messages that dominate verbose logs
+static VOID logMessages(BenchmarkLogFunc logFn, PVOID pState, UINT32 i)
+{
+    logFn(pState, LOG_LEVEL_VERBOSE, (PCHAR) "Sending %u bytes to %s:%u, rtp timestamp %" PRIu64, 1200 + i % 100, "192.168.1.10", 50000,
+          (UINT64) i * 3000);
+    logFn(pState, LOG_LEVEL_VERBOSE, (PCHAR) "Frame %u of track %s took %.3f ms, jitter %" PRIu64 " us", i, "video", i * 0.001, (UINT64) i % 997);
+    logFn(pState, LOG_LEVEL_VERBOSE, (PCHAR) "ICE candidate pair state changed to %d", i % 5);
+}
+
+static DOUBLE measure(const CHAR* pName, UINT32 iterations, UINT32 callsPerIteration, std::function<VOID(UINT32)> body)
+{
+    UINT32 i;
+    DOUBLE nanosPerCall;
+
+    auto start = std::chrono::steady_clock::now();
+    for (i = 0; i < iterations; i++) {
+        body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    nanosPerCall = (DOUBLE) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / iterations / callsPerIteration;
+    printf("%-10s %8.1f ns per log call\n", pName, nanosPerCall);
+
+    return nanosPerCall;
+}
+
+INT32 main(INT32 argc, CHAR* argv[])
+{
+    BenchmarkState state;
+    CHAR rendered[MAX_LOG_FORMAT_LENGTH + 1];
+    UINT32 iterations = DEFAULT_BENCHMARK_ITERATIONS;
+    DOUBLE immediate, deferred;
+
+    if (argc > 1 && (STATUS_FAILED(STRTOUI32(argv[1], NULL, 10, &iterations)) || iterations == 0)) {
+        printf("Usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    state.pDevNull = FOPEN("/dev/null", "w");
+    if (state.pDevNull == NULL) {
+        printf("Failed to open /dev/null\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%u iterations of 3 verbose messages\n", iterations);
+    immediate = measure("immediate", iterations, 3, [&state](UINT32 i) { logMessages(immediateLog, &state, i); });
+    deferred = measure("deferred", iterations, 3, [&state](UINT32 i) { logMessages(deferredLog, &state, i); });
+    // Renders the last captured record over and over, which is what the flush thread does for every record
+    measure("render", iterations, 1, [&state, &rendered](UINT32 i) {
+        UNUSED_PARAM(i);
+        Canary::renderLogRecord(state.record, state.recordSize, rendered, SIZEOF(rendered), NULL);
+    });
+    printf("The logging thread spends %.1fx less time per call\n", immediate / deferred);
+
+    FCLOSE(state.pDevNull);
+
+    return EXIT_SUCCESS;
+}